@@ -0,0 +1,110 @@
+#!/usr/bin/python3
+
+# This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+#
+# Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+#
+# ----------------------------------------------------------------------------------------
+# Measure HTTP requests per second that the Linux build's http server can handle
+#
+#  python3 benchmark/linux_http_requests.py [path/to/espruino] [requests]
+#
+# JS runs an HTTP server that answers each request with a small JSON body. We
+# make requests on a new connection each time, then on a keep-alive connection,
+# then pipelined 10 at a time, then on a keep-alive connection with a response
+# that is streamed with several writes. If the server closes the connection we just open
+# a new one, so servers without keep-alive still complete every test.
+# ----------------------------------------------------------------------------------------
+
+import os
+import sys
+import time
+import socket
+import subprocess
+import tempfile
+
+ESPRUINO = sys.argv[1] if len(sys.argv)>1 else os.path.join(os.path.dirname(__file__), "..", "espruino")
+REQUESTS = int(sys.argv[2]) if len(sys.argv)>2 else 500
+PIPELINE = 10
+PORT = 19000 + os.getpid()%1000
+
+script = tempfile.NamedTemporaryFile("w", suffix=".js", delete=False)
+script.write("""
+require("http").createServer(function(req, res) {
+  res.writeHead(200, {"Content-Type":"application/json"});
+  if (req.url=="/stream") { // written in pieces, so the length isn't known up front
+    res.write('{"temp":');
+    res.write('21.5}');
+    res.end();
+  } else res.end('{"temp":21.5}');
+}).listen(%d);
+""" % PORT)
+script.close()
+
+proc = subprocess.Popen([ESPRUINO, script.name], stdin=subprocess.PIPE,
+                        stdout=subprocess.DEVNULL, stderr=subprocess.STDOUT)
+time.sleep(1) # let it start up
+
+def connect():
+  s = socket.create_connection(("127.0.0.1", PORT))
+  s.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+  s.settimeout(10)
+  return s
+
+def readResponses(s, count):
+  """ Read up to 'count' responses, returning how many arrived before the connection closed """
+  buf = b""
+  while buf.count(b"21.5}") < count:
+    try:
+      d = s.recv(65536)
+    except ConnectionResetError:
+      d = b""
+    if not d: break
+    buf += d
+  return buf.count(b"21.5}")
+
+def run(name, fn):
+  t = time.perf_counter()
+  try:
+    ok = fn()
+  except socket.timeout:
+    ok = False
+  t = time.perf_counter()-t
+  if ok: print("%-20s %8.0f requests/sec  (%d connections)" % (name, REQUESTS/t, ok))
+  else: print("%-20s failed" % name)
+
+def requests(perConnection, batch, header=b"", path=b"/"):
+  """ Make REQUESTS requests, 'batch' at a time, returning the number of connections used """
+  request = b"GET " + path + b" HTTP/1.1\r\nHost: localhost\r\n" + header + b"\r\n"
+  done = 0
+  connections = 0
+  while done < REQUESTS:
+    s = connect()
+    connections += 1
+    sent = 0
+    while done < REQUESTS and sent < perConnection:
+      s.sendall(request*batch)
+      sent += batch
+      got = readResponses(s, batch)
+      done += got
+      if got < batch: break # closed - open a new connection
+    s.close()
+  return connections
+
+def newConnections(): return requests(1, 1, b"Connection: close\r\n")
+def keepAlive(): return requests(REQUESTS, 1)
+def pipelined(): return requests(REQUESTS, PIPELINE)
+def streamed(): return requests(REQUESTS, 1, path=b"/stream")
+
+run("new connection", newConnections)
+run("keep-alive", keepAlive)
+run("pipelined x%d" % PIPELINE, pipelined)
+run("streamed keep-alive", streamed)
+
+proc.kill()
+proc.wait()
+os.unlink(script.name)
@@ -0,0 +1,90 @@
+#!/usr/bin/python3
+
+# This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+#
+# Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+#
+# ----------------------------------------------------------------------------------------
+# Measure input->callback latency and timer accuracy of the Linux build
+#
+#  python3 benchmark/linux_io_latency.py [path/to/espruino] [count]
+#
+# Serial1 is connected to a pty, and JS echoes everything it receives. We time
+# the round trip of single bytes, then ask JS how late its setTimeouts fire.
+# ----------------------------------------------------------------------------------------
+
+import os
+import re
+import sys
+import time
+import select
+import subprocess
+import tempfile
+
+ESPRUINO = sys.argv[1] if len(sys.argv)>1 else os.path.join(os.path.dirname(__file__), "..", "espruino")
+COUNT = int(sys.argv[2]) if len(sys.argv)>2 else 500
+
+def percentiles(name, samples):
+  samples = sorted(samples)
+  def p(x): return samples[min(len(samples)-1, int(len(samples)*x))]*1000000
+  print("%-14s median %8.1fus   p90 %8.1fus   p99 %8.1fus   max %8.1fus" %
+        (name, p(0.5), p(0.9), p(0.99), samples[-1]*1000000))
+
+master, slave = os.openpty()
+script = tempfile.NamedTemporaryFile("w", suffix=".js", delete=False)
+script.write("""
+Serial1.setup(9600, {path:%r});
+Serial1.on('data', function(d) {
+  if (d=="\\n") timer(); // start timer test
+  else Serial1.write(d);
+});
+var late = [];
+function timer() {
+  var want = getTime()+0.0025;
+  setTimeout(function() {
+    late.push(getTime()-want);
+    if (late.length < %d) timer();
+    else console.log("TIMERS "+late.join(","));
+  }, 2.5);
+}
+setTimeout(function() {}, 600000); // keep running until killed
+""" % (os.ttyname(slave), COUNT))
+script.close()
+
+proc = subprocess.Popen([ESPRUINO, script.name], stdin=subprocess.PIPE,
+                        stdout=subprocess.PIPE, stderr=subprocess.STDOUT)
+time.sleep(1) # let it start up
+while select.select([master],[],[],0)[0]: os.read(master, 1024)
+
+echo = []
+for i in range(COUNT):
+  ch = bytes([65 + i%26])
+  t = time.perf_counter()
+  os.write(master, ch)
+  if not select.select([master],[],[],1)[0]:
+    print("Timeout waiting for echo"); break
+  os.read(master, 1)
+  echo.append(time.perf_counter()-t)
+  time.sleep(0.002) # so we measure wake-from-idle, not back-to-back throughput
+
+os.write(master, b"\n") # start the timer test
+timers = []
+deadline = time.time()+10+COUNT*0.01
+output = b""
+while time.time()<deadline and not re.search(b"TIMERS [^\r\n]*[\r\n]", output):
+  if select.select([proc.stdout],[],[],0.1)[0]:
+    output += os.read(proc.stdout.fileno(), 65536)
+match = re.search(b"TIMERS ([^\r\n]*)", output)
+if match:
+  timers = [float(x) for x in match.group(1).split(b",")]
+
+proc.kill()
+proc.wait()
+os.unlink(script.name)
+
+if echo: percentiles("serial echo", echo)
+if timers: percentiles("timer lateness", timers)
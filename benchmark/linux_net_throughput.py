@@ -0,0 +1,96 @@
+#!/usr/bin/python3
+
+# This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+#
+# Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+#
+# ----------------------------------------------------------------------------------------
+# Measure socket receive and send throughput of the Linux build over loopback
+#
+#  python3 benchmark/linux_net_throughput.py [path/to/espruino] [kbytes]
+#
+# JS runs a net server that counts the bytes it receives and replies once it
+# has them all. We time how long it takes to send a big buffer and get the reply.
+# A second server writes a big string to each connection, and we time reading it.
+# ----------------------------------------------------------------------------------------
+
+import os
+import sys
+import time
+import socket
+import subprocess
+import tempfile
+
+ESPRUINO = sys.argv[1] if len(sys.argv)>1 else os.path.join(os.path.dirname(__file__), "..", "espruino")
+KBYTES = int(sys.argv[2]) if len(sys.argv)>2 else 1024
+RUNS = 5
+PORT = 18000 + os.getpid()%1000
+
+script = tempfile.NamedTemporaryFile("w", suffix=".js", delete=False)
+script.write("""
+require("net").createServer(function(c) {
+  var got = 0;
+  c.on('data', function(d) {
+    got += d.length;
+    if (got >= %d) c.write("OK");
+  });
+}).listen(%d);
+var big = "0123456789abcdef";
+while (big.length < %d) big += big;
+require("net").createServer(function(c) {
+  c.write(big);
+  c.end();
+}).listen(%d);
+""" % (KBYTES*1024, PORT, KBYTES*1024, PORT+1))
+script.close()
+
+proc = subprocess.Popen([ESPRUINO, script.name], stdin=subprocess.PIPE,
+                        stdout=subprocess.DEVNULL, stderr=subprocess.STDOUT)
+time.sleep(1) # let it start up
+
+payload = bytes(range(256)) * (KBYTES*4)
+rates = []
+for run in range(RUNS):
+  s = socket.create_connection(("127.0.0.1", PORT))
+  s.settimeout(30)
+  t = time.perf_counter()
+  s.sendall(payload)
+  try:
+    if s.recv(2) != b"OK": print("Bad reply")
+    rates.append(len(payload) / (time.perf_counter()-t))
+  except socket.timeout:
+    print("Timeout")
+  s.close()
+
+sendRates = []
+for run in range(RUNS):
+  s = socket.create_connection(("127.0.0.1", PORT+1))
+  s.settimeout(30)
+  t = time.perf_counter()
+  got = 0
+  try:
+    while True:
+      d = s.recv(65536)
+      if not d: break
+      got += len(d)
+    if got != KBYTES*1024: print("Got %d bytes" % got)
+    sendRates.append(got / (time.perf_counter()-t))
+  except socket.timeout:
+    print("Timeout")
+  s.close()
+
+proc.kill()
+proc.wait()
+os.unlink(script.name)
+
+def report(name, rates):
+  if not rates: return
+  rates.sort()
+  print("%-6s %dkB  median %8.0f kB/s   best %8.0f kB/s" %
+        (name, KBYTES, rates[len(rates)//2]/1024, rates[-1]/1024))
+report("recv", rates)
+report("send", sendRates)
@@ -0,0 +1,64 @@
+#!/usr/bin/python3
+
+# This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+#
+# Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+#
+# ----------------------------------------------------------------------------------------
+# Measure Serial1.write(bigString) throughput of the Linux build
+#
+#  python3 benchmark/linux_serial_throughput.py [path/to/espruino] [kbytes]
+#
+# Serial1 is connected to a pty. We ask JS to write a big string, and time how
+# long it takes for all of it to arrive.
+# ----------------------------------------------------------------------------------------
+
+import os
+import sys
+import time
+import select
+import subprocess
+import tempfile
+
+ESPRUINO = sys.argv[1] if len(sys.argv)>1 else os.path.join(os.path.dirname(__file__), "..", "espruino")
+KBYTES = int(sys.argv[2]) if len(sys.argv)>2 else 64
+RUNS = 5
+
+master, slave = os.openpty()
+script = tempfile.NamedTemporaryFile("w", suffix=".js", delete=False)
+script.write("""
+Serial1.setup(1000000, {path:%r});
+var big = "0123456789abcdef";
+while (big.length < %d) big += big;
+Serial1.on('data', function(d) { Serial1.write(big); });
+setTimeout(function() {}, 600000); // keep running until killed
+""" % (os.ttyname(slave), KBYTES*1024))
+script.close()
+
+proc = subprocess.Popen([ESPRUINO, script.name], stdin=subprocess.PIPE,
+                        stdout=subprocess.DEVNULL, stderr=subprocess.STDOUT)
+time.sleep(1) # let it start up
+while select.select([master],[],[],0)[0]: os.read(master, 65536)
+
+rates = []
+for run in range(RUNS):
+  t = time.perf_counter()
+  os.write(master, b"g")
+  got = 0
+  while got < KBYTES*1024:
+    if not select.select([master],[],[],5)[0]:
+      print("Timeout after %d bytes" % got); break
+    got += len(os.read(master, 65536))
+  rates.append(got / (time.perf_counter()-t))
+
+proc.kill()
+proc.wait()
+os.unlink(script.name)
+
+rates.sort()
+print("Serial1.write(%dkB)  median %8.0f kB/s   best %8.0f kB/s" %
+      (KBYTES, rates[len(rates)//2]/1024, rates[-1]/1024))
@@ -0,0 +1,137 @@
+#!/usr/bin/python3
+
+# This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+#
+# Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+#
+# This Source Code Form is subject to the terms of the Mozilla Public
+# License, v. 2.0. If a copy of the MPL was not distributed with this
+# file, You can obtain one at http://mozilla.org/MPL/2.0/.
+#
+# ----------------------------------------------------------------------------------------
+# Measure WebSocket echo performance of the Linux build over loopback
+#
+#  python3 benchmark/linux_websocket.py [path/to/espruino] [messages]
+#
+# JS runs two WebSocket echo servers - one using the HTTP server's native 'websocket'
+# event, and one doing the handshake and framing in JS on a net server (as WebSocket
+# modules written in JS have to). We time sending messages one at a time (waiting for
+# each echo), and a batch of bigger messages all at once.
+# ----------------------------------------------------------------------------------------
+
+import os
+import sys
+import time
+import struct
+import socket
+import subprocess
+import tempfile
+
+ESPRUINO = sys.argv[1] if len(sys.argv)>1 else os.path.join(os.path.dirname(__file__), "..", "espruino")
+MESSAGES = int(sys.argv[2]) if len(sys.argv)>2 else 1000
+PORT = 18000 + os.getpid()%1000
+
+script = tempfile.NamedTemporaryFile("w", suffix=".js", delete=False)
+script.write("""
+var server = require("http").createServer({maxMessageSize:65536}, function(req, res) { res.end(); });
+server.on('websocket', function(ws) {
+  ws.on('message', function(msg) { ws.send(msg); });
+});
+server.listen(%d);
+
+// The same thing, with the handshake and framing done in JS
+require("net").createServer(function(c) {
+  var data = "", open = false;
+  c.on('data', function(d) {
+    data += d;
+    if (!open) {
+      var i = data.indexOf("\\r\\n\\r\\n");
+      if (i<0) return;
+      var key = /Sec-WebSocket-Key: (.*)\\r\\n/.exec(data)[1];
+      data = data.substr(i+4);
+      open = true;
+      c.write("HTTP/1.1 101 Switching Protocols\\r\\nUpgrade: websocket\\r\\nConnection: Upgrade\\r\\n"+
+              "Sec-WebSocket-Accept: "+btoa(require("crypto").SHA1(key+"258EAFA5-E914-47DA-95CA-C5AB0DC85B11"))+"\\r\\n\\r\\n");
+    }
+    while (data.length>=6) {
+      var len = data.charCodeAt(1)&127, h = 2;
+      if (len==126) { len = (data.charCodeAt(2)<<8)|data.charCodeAt(3); h = 4; }
+      if (data.length < h+4+len) return;
+      var mask = E.toUint8Array(data.substr(h,4));
+      var msg = E.toUint8Array(data.substr(h+4,len));
+      for (var i=0;i<len;i++) msg[i] ^= mask[i&3];
+      data = data.substr(h+4+len);
+      c.write(String.fromCharCode(0x81) +
+              (len<126 ? String.fromCharCode(len) : String.fromCharCode(126,len>>8,len&255)) +
+              E.toString(msg));
+    }
+  });
+}).listen(%d);
+""" % (PORT, PORT+1))
+script.close()
+
+proc = subprocess.Popen([ESPRUINO, script.name], stdin=subprocess.PIPE,
+                        stdout=subprocess.DEVNULL, stderr=subprocess.STDOUT)
+time.sleep(1) # let it start up
+
+def frame(payload):
+  mask = b"\x12\x34\x56\x78"
+  if len(payload)<126: header = struct.pack("!BB", 0x81, 0x80|len(payload))
+  else: header = struct.pack("!BBH", 0x81, 0x80|126, len(payload))
+  return header + mask + bytes(b ^ mask[i&3] for i,b in enumerate(payload))
+
+class Client:
+  def __init__(self, port):
+    self.s = socket.create_connection(("127.0.0.1", port))
+    self.s.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    self.s.settimeout(10)
+    self.s.sendall(b"GET / HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                   b"Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n")
+    self.buf = b""
+    while b"\r\n\r\n" not in self.buf: self.buf += self.s.recv(4096)
+    self.buf = self.buf.split(b"\r\n\r\n",1)[1]
+  def read(self):
+    """ Read one (unmasked) frame and return its payload """
+    while True:
+      if len(self.buf)>=2:
+        n, h = self.buf[1]&127, 2
+        if n==126 and len(self.buf)>=4: n, h = struct.unpack("!H", self.buf[2:4])[0], 4
+        if n!=126 and len(self.buf)>=h+n:
+          payload, self.buf = self.buf[h:h+n], self.buf[h+n:]
+          return payload
+      d = self.s.recv(65536)
+      if not d: raise EOFError()
+      self.buf += d
+
+def run(port):
+  c = Client(port)
+  msg = b"Hello World!"
+  t = time.perf_counter()
+  for i in range(MESSAGES):
+    c.s.sendall(frame(msg))
+    if c.read()!=msg: print("Bad echo")
+  roundTrips = MESSAGES / (time.perf_counter()-t)
+  big = bytes(range(256))*16 # 4kB
+  batch = MESSAGES//10
+  t = time.perf_counter()
+  c.s.sendall(frame(big)*batch)
+  for i in range(batch):
+    if c.read()!=big: print("Bad echo")
+  throughput = batch*len(big) / (time.perf_counter()-t)
+  c.s.close()
+  return roundTrips, throughput
+
+results = {}
+for name, port in (("native", PORT), ("JS", PORT+1)):
+  try:
+    results[name] = run(port)
+  except (socket.timeout, EOFError, ConnectionError) as e:
+    print("%s: %r" % (name, e))
+
+proc.kill()
+proc.wait()
+os.unlink(script.name)
+
+for name in results:
+  roundTrips, throughput = results[name]
+  print("%-7s %6.0f round trips/s (12 bytes)   %6.0f kB/s (4kB messages)" % (name, roundTrips, throughput/1024))
@@ -0,0 +1,2675 @@
+// Automatically generated wrapper file 
+// Generated by scripts/build_jswrapper.py
+
+#include "jswrapper.h"
+#include "jsnative.h"
+#include "src/jswrap_array.h"
+#include "src/jswrap_arraybuffer.h"
+#include "src/jswrap_dataview.h"
+#include "src/jswrap_date.h"
+#include "src/jswrap_error.h"
+#include "src/jswrap_espruino.h"
+#include "src/jswrap_filter.h"
+#include "src/jswrap_flash.h"
+#include "src/jswrap_functions.h"
+#include "src/jswrap_interactive.h"
+#include "src/jswrap_io.h"
+#include "src/jswrap_json.h"
+#include "src/jswrap_modules.h"
+#include "src/jswrap_pin.h"
+#include "src/jswrap_number.h"
+#include "src/jswrap_object.h"
+#include "src/jswrap_onewire.h"
+#include "src/jswrap_pipe.h"
+#include "src/jswrap_process.h"
+#include "src/jswrap_promise.h"
+#include "src/jswrap_regexp.h"
+#include "src/jswrap_serial.h"
+#include "src/jswrap_storage.h"
+#include "src/jswrap_spi_i2c.h"
+#include "src/jswrap_stream.h"
+#include "src/jswrap_string.h"
+#include "src/jswrap_waveform.h"
+#include "libs/compression/jswrap_heatshrink.h"
+#include "libs/filesystem/jswrap_fs.h"
+#include "libs/filesystem/jswrap_file.h"
+#include "libs/math/jswrap_math.h"
+#include "libs/graphics/jswrap_graphics.h"
+#include "libs/network/jswrap_net.h"
+#include "libs/network/http/jswrap_http.h"
+#include "libs/network/http/jswrap_websocket.h"
+#include "libs/network/js/jswrap_jsnetwork.h"
+#include "libs/network/telnet/jswrap_telnet.h"
+#include "libs/crypto/jswrap_crypto.h"
+#include "/root/repo/libs/tensorflow/jswrap_tensorflow.h"
+
+
+// -----------------------------------------------------------------------------------------
+// ----------------------------------------------------------------- AUTO-GENERATED WRAPPERS
+// -----------------------------------------------------------------------------------------
+
+static JsVar* gen_jswrap_Array_pop(JsVar *parent) {
+  return jsvSkipNameAndUnLock(jsvArrayPop(parent));
+}
+
+static bool gen_jswrap_Array_isArray(JsVar* var) {
+  return jsvIsArray(var);
+}
+
+static JsVarInt gen_jswrap_ArrayBuffer_byteLength(JsVar *parent) {
+  return (JsVarInt)(parent->varData.arraybuffer.length);
+}
+
+static JsVar* gen_jswrap_Uint8Array_Uint8Array(JsVar* arr, JsVarInt byteOffset, JsVarInt length) {
+  return jswrap_typedarray_constructor(ARRAYBUFFERVIEW_UINT8, arr, byteOffset, length);
+}
+
+static JsVar* gen_jswrap_Uint8ClampedArray_Uint8ClampedArray(JsVar* arr, JsVarInt byteOffset, JsVarInt length) {
+  return jswrap_typedarray_constructor(ARRAYBUFFERVIEW_UINT8|ARRAYBUFFERVIEW_CLAMPED, arr, byteOffset, length);
+}
+
+static JsVar* gen_jswrap_Int8Array_Int8Array(JsVar* arr, JsVarInt byteOffset, JsVarInt length) {
+  return jswrap_typedarray_constructor(ARRAYBUFFERVIEW_INT8, arr, byteOffset, length);
+}
+
+static JsVar* gen_jswrap_Uint16Array_Uint16Array(JsVar* arr, JsVarInt byteOffset, JsVarInt length) {
+  return jswrap_typedarray_constructor(ARRAYBUFFERVIEW_UINT16, arr, byteOffset, length);
+}
+
+static JsVar* gen_jswrap_Int16Array_Int16Array(JsVar* arr, JsVarInt byteOffset, JsVarInt length) {
+  return jswrap_typedarray_constructor(ARRAYBUFFERVIEW_INT16, arr, byteOffset, length);
+}
+
+static JsVar* gen_jswrap_Uint24Array_Uint24Array(JsVar* arr, JsVarInt byteOffset, JsVarInt length) {
+  return jswrap_typedarray_constructor(ARRAYBUFFERVIEW_UINT24, arr, byteOffset, length);
+}
+
+static JsVar* gen_jswrap_Uint32Array_Uint32Array(JsVar* arr, JsVarInt byteOffset, JsVarInt length) {
+  return jswrap_typedarray_constructor(ARRAYBUFFERVIEW_UINT32, arr, byteOffset, length);
+}
+
+static JsVar* gen_jswrap_Int32Array_Int32Array(JsVar* arr, JsVarInt byteOffset, JsVarInt length) {
+  return jswrap_typedarray_constructor(ARRAYBUFFERVIEW_INT32, arr, byteOffset, length);
+}
+
+static JsVar* gen_jswrap_Float32Array_Float32Array(JsVar* arr, JsVarInt byteOffset, JsVarInt length) {
+  return jswrap_typedarray_constructor(ARRAYBUFFERVIEW_FLOAT32, arr, byteOffset, length);
+}
+
+static JsVar* gen_jswrap_Float64Array_Float64Array(JsVar* arr, JsVarInt byteOffset, JsVarInt length) {
+  return jswrap_typedarray_constructor(ARRAYBUFFERVIEW_FLOAT64, arr, byteOffset, length);
+}
+
+static JsVar* gen_jswrap_ArrayBufferView_buffer(JsVar *parent) {
+  return jsvLock(jsvGetFirstChild(parent));
+}
+
+static JsVarInt gen_jswrap_ArrayBufferView_byteLength(JsVar *parent) {
+  return (JsVarInt)(parent->varData.arraybuffer.length * JSV_ARRAYBUFFER_GET_SIZE(parent->varData.arraybuffer.type));
+}
+
+static JsVarInt gen_jswrap_ArrayBufferView_byteOffset(JsVar *parent) {
+  return parent->varData.arraybuffer.byteOffset;
+}
+
+static JsVar* gen_jswrap_DataView_getFloat32(JsVar *parent, JsVarInt byteOffset, bool littleEndian) {
+  return jswrap_dataview_get(parent, ARRAYBUFFERVIEW_FLOAT32, byteOffset, littleEndian);
+}
+
+static JsVar* gen_jswrap_DataView_getFloat64(JsVar *parent, JsVarInt byteOffset, bool littleEndian) {
+  return jswrap_dataview_get(parent, ARRAYBUFFERVIEW_FLOAT64, byteOffset, littleEndian);
+}
+
+static JsVar* gen_jswrap_DataView_getInt8(JsVar *parent, JsVarInt byteOffset, bool littleEndian) {
+  return jswrap_dataview_get(parent, ARRAYBUFFERVIEW_INT8, byteOffset, littleEndian);
+}
+
+static JsVar* gen_jswrap_DataView_getInt16(JsVar *parent, JsVarInt byteOffset, bool littleEndian) {
+  return jswrap_dataview_get(parent, ARRAYBUFFERVIEW_INT16, byteOffset, littleEndian);
+}
+
+static JsVar* gen_jswrap_DataView_getInt32(JsVar *parent, JsVarInt byteOffset, bool littleEndian) {
+  return jswrap_dataview_get(parent, ARRAYBUFFERVIEW_INT32, byteOffset, littleEndian);
+}
+
+static JsVar* gen_jswrap_DataView_getUint8(JsVar *parent, JsVarInt byteOffset, bool littleEndian) {
+  return jswrap_dataview_get(parent, ARRAYBUFFERVIEW_UINT8, byteOffset, littleEndian);
+}
+
+static JsVar* gen_jswrap_DataView_getUint16(JsVar *parent, JsVarInt byteOffset, bool littleEndian) {
+  return jswrap_dataview_get(parent, ARRAYBUFFERVIEW_UINT16, byteOffset, littleEndian);
+}
+
+static JsVar* gen_jswrap_DataView_getUint32(JsVar *parent, JsVarInt byteOffset, bool littleEndian) {
+  return jswrap_dataview_get(parent, ARRAYBUFFERVIEW_UINT32, byteOffset, littleEndian);
+}
+
+static void gen_jswrap_DataView_setFloat32(JsVar *parent, JsVarInt byteOffset, JsVar* value, bool littleEndian) {
+  jswrap_dataview_set(parent, ARRAYBUFFERVIEW_FLOAT32, byteOffset, value, littleEndian);
+}
+
+static void gen_jswrap_DataView_setFloat64(JsVar *parent, JsVarInt byteOffset, JsVar* value, bool littleEndian) {
+  jswrap_dataview_set(parent, ARRAYBUFFERVIEW_FLOAT64, byteOffset, value, littleEndian);
+}
+
+static void gen_jswrap_DataView_setInt8(JsVar *parent, JsVarInt byteOffset, JsVar* value, bool littleEndian) {
+  jswrap_dataview_set(parent, ARRAYBUFFERVIEW_INT8, byteOffset, value, littleEndian);
+}
+
+static void gen_jswrap_DataView_setInt16(JsVar *parent, JsVarInt byteOffset, JsVar* value, bool littleEndian) {
+  jswrap_dataview_set(parent, ARRAYBUFFERVIEW_INT16, byteOffset, value, littleEndian);
+}
+
+static void gen_jswrap_DataView_setInt32(JsVar *parent, JsVarInt byteOffset, JsVar* value, bool littleEndian) {
+  jswrap_dataview_set(parent, ARRAYBUFFERVIEW_INT32, byteOffset, value, littleEndian);
+}
+
+static void gen_jswrap_DataView_setUint8(JsVar *parent, JsVarInt byteOffset, JsVar* value, bool littleEndian) {
+  jswrap_dataview_set(parent, ARRAYBUFFERVIEW_UINT8, byteOffset, value, littleEndian);
+}
+
+static void gen_jswrap_DataView_setUint16(JsVar *parent, JsVarInt byteOffset, JsVar* value, bool littleEndian) {
+  jswrap_dataview_set(parent, ARRAYBUFFERVIEW_UINT16, byteOffset, value, littleEndian);
+}
+
+static void gen_jswrap_DataView_setUint32(JsVar *parent, JsVarInt byteOffset, JsVar* value, bool littleEndian) {
+  jswrap_dataview_set(parent, ARRAYBUFFERVIEW_UINT32, byteOffset, value, littleEndian);
+}
+
+static JsVarFloat gen_jswrap_E_getTemperature() {
+  return jshReadTemperature();
+}
+
+static JsVarFloat gen_jswrap_E_getAnalogVRef() {
+  return jshReadVRef();
+}
+
+static JsVar* gen_jswrap_global() {
+  return jsvLockAgain(execInfo.root);
+}
+
+static void gen_jswrap_dump() {
+  jsiDumpState((vcbprintf_callback)jsiConsolePrintString, 0);
+}
+
+static JsVarFloat gen_jswrap_getTime() {
+  return (JsVarFloat)jshGetSystemTime() / (JsVarFloat)jshGetTimeFromMilliseconds(1000);
+}
+
+static JsVar* gen_jswrap_peek8(JsVarInt addr, JsVarInt count) {
+  return jswrap_io_peek(addr,count,1);
+}
+
+static void gen_jswrap_poke8(JsVarInt addr, JsVar* value) {
+  jswrap_io_poke(addr,value,1);
+}
+
+static JsVar* gen_jswrap_peek16(JsVarInt addr, JsVarInt count) {
+  return jswrap_io_peek(addr,count,2);
+}
+
+static void gen_jswrap_poke16(JsVarInt addr, JsVar* value) {
+  jswrap_io_poke(addr,value,2);
+}
+
+static JsVar* gen_jswrap_peek32(JsVarInt addr, JsVarInt count) {
+  return jswrap_io_peek(addr,count,4);
+}
+
+static void gen_jswrap_poke32(JsVarInt addr, JsVar* value) {
+  jswrap_io_poke(addr,value,4);
+}
+
+static JsVarFloat gen_jswrap_NaN() {
+  return NAN;
+}
+
+static JsVarFloat gen_jswrap_Infinity() {
+  return INFINITY;
+}
+
+static JsVarFloat gen_jswrap_Number_NaN() {
+  return NAN;
+}
+
+static JsVarFloat gen_jswrap_Number_MAX_VALUE() {
+  return DBL_MAX;
+}
+
+static JsVarFloat gen_jswrap_Number_MIN_VALUE() {
+  return DBL_MIN;
+}
+
+static JsVarFloat gen_jswrap_Number_NEGATIVE_INFINITY() {
+  return -INFINITY;
+}
+
+static JsVarFloat gen_jswrap_Number_POSITIVE_INFINITY() {
+  return INFINITY;
+}
+
+static int gen_jswrap_HIGH() {
+  return 1;
+}
+
+static int gen_jswrap_LOW() {
+  return 0;
+}
+
+static JsVar* gen_jswrap_Object_keys(JsVar* object) {
+  return jswrap_object_keys_or_property_names(object, false, false);
+}
+
+static JsVar* gen_jswrap_Object_getOwnPropertyNames(JsVar* object) {
+  return jswrap_object_keys_or_property_names(object, true, false);
+}
+
+static JsVar* gen_jswrap_process_version() {
+  return jsvNewFromString(JS_VERSION);
+}
+
+static JsVar* gen_jswrap_Serial_find(Pin pin) {
+  return jshGetDeviceObjectFor(JSH_USART1, JSH_USARTMAX, pin);
+}
+
+static JsVar* gen_jswrap_USB() {
+  return jspNewObject("USB", "Serial") /* needs JSWAT_EXECUTE_IMMEDIATELY */;
+}
+
+static JsVar* gen_jswrap_Serial1() {
+  return jspNewObject("Serial1", "Serial") /* needs JSWAT_EXECUTE_IMMEDIATELY */;
+}
+
+static JsVar* gen_jswrap_Serial2() {
+  return jspNewObject("Serial2", "Serial") /* needs JSWAT_EXECUTE_IMMEDIATELY */;
+}
+
+static JsVar* gen_jswrap_Serial3() {
+  return jspNewObject("Serial3", "Serial") /* needs JSWAT_EXECUTE_IMMEDIATELY */;
+}
+
+static JsVar* gen_jswrap_Serial4() {
+  return jspNewObject("Serial4", "Serial") /* needs JSWAT_EXECUTE_IMMEDIATELY */;
+}
+
+static JsVar* gen_jswrap_Serial5() {
+  return jspNewObject("Serial5", "Serial") /* needs JSWAT_EXECUTE_IMMEDIATELY */;
+}
+
+static JsVar* gen_jswrap_Serial6() {
+  return jspNewObject("Serial6", "Serial") /* needs JSWAT_EXECUTE_IMMEDIATELY */;
+}
+
+static JsVar* gen_jswrap_LoopbackA() {
+  return jspNewObject("LoopbackA", "Serial") /* needs JSWAT_EXECUTE_IMMEDIATELY */;
+}
+
+static JsVar* gen_jswrap_LoopbackB() {
+  return jspNewObject("LoopbackB", "Serial") /* needs JSWAT_EXECUTE_IMMEDIATELY */;
+}
+
+static JsVar* gen_jswrap_Telnet() {
+  return jspNewObject("Telnet", "Serial") /* needs JSWAT_EXECUTE_IMMEDIATELY */;
+}
+
+static JsVar* gen_jswrap_SPI1() {
+  return jspNewObject("SPI1", "SPI") /* needs JSWAT_EXECUTE_IMMEDIATELY */;
+}
+
+static JsVar* gen_jswrap_SPI2() {
+  return jspNewObject("SPI2", "SPI") /* needs JSWAT_EXECUTE_IMMEDIATELY */;
+}
+
+static JsVar* gen_jswrap_SPI3() {
+  return jspNewObject("SPI3", "SPI") /* needs JSWAT_EXECUTE_IMMEDIATELY */;
+}
+
+static JsVar* gen_jswrap_SPI_find(Pin pin) {
+  return jshGetDeviceObjectFor(JSH_SPI1, JSH_SPIMAX, pin);
+}
+
+static JsVar* gen_jswrap_I2C_find(Pin pin) {
+  return jshGetDeviceObjectFor(JSH_I2C1, JSH_I2CMAX, pin);
+}
+
+static JsVar* gen_jswrap_I2C1() {
+  return jspNewObject("I2C1", "I2C") /* needs JSWAT_EXECUTE_IMMEDIATELY */;
+}
+
+static JsVar* gen_jswrap_I2C2() {
+  return jspNewObject("I2C2", "I2C") /* needs JSWAT_EXECUTE_IMMEDIATELY */;
+}
+
+static JsVar* gen_jswrap_I2C3() {
+  return jspNewObject("I2C3", "I2C") /* needs JSWAT_EXECUTE_IMMEDIATELY */;
+}
+
+static int gen_jswrap_String_indexOf(JsVar *parent, JsVar* substring, JsVar* fromIndex) {
+  return jswrap_string_indexOf(parent, substring, fromIndex, false);
+}
+
+static int gen_jswrap_String_lastIndexOf(JsVar *parent, JsVar* substring, JsVar* fromIndex) {
+  return jswrap_string_indexOf(parent, substring, fromIndex, true);
+}
+
+static JsVar* gen_jswrap_String_toLowerCase(JsVar *parent) {
+  return jswrap_string_toUpperLowerCase(parent, false);
+}
+
+static JsVar* gen_jswrap_String_toUpperCase(JsVar *parent) {
+  return jswrap_string_toUpperLowerCase(parent, true);
+}
+
+static bool gen_jswrap_String_includes(JsVar *parent, JsVar* substring, JsVar* fromIndex) {
+  return jswrap_string_indexOf(parent, substring, fromIndex, false)>=0;
+}
+
+static bool gen_jswrap_fs_writeFile(JsVar* path, JsVar* data) {
+  return  jswrap_fs_writeOrAppendFile(path, data, false);
+}
+
+static bool gen_jswrap_fs_writeFileSync(JsVar* path, JsVar* data) {
+  return  jswrap_fs_writeOrAppendFile(path, data, false);
+}
+
+static bool gen_jswrap_fs_appendFile(JsVar* path, JsVar* data) {
+  return  jswrap_fs_writeOrAppendFile(path, data, true);
+}
+
+static bool gen_jswrap_fs_appendFileSync(JsVar* path, JsVar* data) {
+  return jswrap_fs_writeOrAppendFile(path, data, true);
+}
+
+static void gen_jswrap_File_close(JsVar *parent) {
+  jswrap_file_close(parent);
+}
+
+static void gen_jswrap_File_skip(JsVar *parent, int nBytes) {
+  jswrap_file_skip_or_seek(parent,nBytes,true);
+}
+
+static void gen_jswrap_File_seek(JsVar *parent, int nBytes) {
+  jswrap_file_skip_or_seek(parent,nBytes,false);
+}
+
+static JsVarFloat gen_jswrap_Math_E() {
+  return 2.718281828459045;
+}
+
+static JsVarFloat gen_jswrap_Math_PI() {
+  return PI;
+}
+
+static JsVarFloat gen_jswrap_Math_LN2() {
+  return 0.6931471805599453;
+}
+
+static JsVarFloat gen_jswrap_Math_LN10() {
+  return 2.302585092994046;
+}
+
+static JsVarFloat gen_jswrap_Math_LOG2E() {
+  return 1.4426950408889634;
+}
+
+static JsVarFloat gen_jswrap_Math_LOG10E() {
+  return 0.4342944819032518;
+}
+
+static JsVarFloat gen_jswrap_Math_SQRT2() {
+  return 1.4142135623730951;
+}
+
+static JsVarFloat gen_jswrap_Math_SQRT1_2() {
+  return 0.7071067811865476;
+}
+
+static JsVarFloat gen_jswrap_Math_acos(JsVarFloat x) {
+  return jswrap_math_atan(jswrap_math_sqrt(1-x*x) / x);
+}
+
+static JsVarFloat gen_jswrap_Math_asin(JsVarFloat x) {
+  return jswrap_math_atan(x / jswrap_math_sqrt(1-x*x));
+}
+
+static JsVarFloat gen_jswrap_Math_cos(JsVarFloat theta) {
+  return jswrap_math_sin(theta + (PI/2));
+}
+
+static JsVarFloat gen_jswrap_Math_random() {
+  return (JsVarFloat)rand() / (JsVarFloat)RAND_MAX;
+}
+
+static JsVarFloat gen_jswrap_Math_tan(JsVarFloat theta) {
+  return jswrap_math_sin(theta) / jswrap_math_sin(theta+(PI/2));
+}
+
+static JsVarFloat gen_jswrap_Math_min(JsVar* args) {
+  return jswrap_math_minmax(args, false);
+}
+
+static JsVarFloat gen_jswrap_Math_max(JsVar* args) {
+  return jswrap_math_minmax(args, true);
+}
+
+static JsVarInt gen_jswrap_Graphics_getWidth(JsVar *parent) {
+  return jswrap_graphics_getWidthOrHeight(parent, false);
+}
+
+static JsVarInt gen_jswrap_Graphics_getHeight(JsVar *parent) {
+  return jswrap_graphics_getWidthOrHeight(parent, true);
+}
+
+static JsVar* gen_jswrap_Graphics_setColor(JsVar *parent, JsVar* r, JsVar* g, JsVar* b) {
+  return jswrap_graphics_setColorX(parent, r,g,b, true);
+}
+
+static JsVar* gen_jswrap_Graphics_setBgColor(JsVar *parent, JsVar* r, JsVar* g, JsVar* b) {
+  return jswrap_graphics_setColorX(parent, r,g,b, false);
+}
+
+static JsVarInt gen_jswrap_Graphics_getColor(JsVar *parent) {
+  return jswrap_graphics_getColorX(parent, true);
+}
+
+static JsVarInt gen_jswrap_Graphics_getBgColor(JsVar *parent) {
+  return jswrap_graphics_getColorX(parent, false);
+}
+
+static JsVar* gen_jswrap_Graphics_setFontBitmap(JsVar *parent) {
+  return jswrap_graphics_setFontSizeX(parent, 1+JSGRAPHICS_FONTSIZE_4X6, false);
+}
+
+static JsVar* gen_jswrap_Graphics_setFontVector(JsVar *parent, int size) {
+  return jswrap_graphics_setFontSizeX(parent, size, true);
+}
+
+static JsVar* gen_jswrap_net_connect(JsVar* options, JsVar* callback) {
+  return jswrap_net_connect(options, callback, ST_NORMAL);
+}
+
+static JsVar* gen_jswrap_dgram_createSocket(JsVar* type, JsVar* callback) {
+  return jswrap_dgram_createSocket(type, callback);
+}
+
+static JsVar* gen_jswrap_tls_connect(JsVar* options, JsVar* callback) {
+  return jswrap_net_connect(options, callback, ST_NORMAL | ST_TLS);
+}
+
+static JsVar* gen_jswrap_Server_listen(JsVar *parent, int port) {
+  return jswrap_net_server_listen(parent, port, ST_NORMAL);
+}
+
+static JsVar* gen_jswrap_http_request(JsVar* options, JsVar* callback) {
+  return jswrap_net_connect(options, callback, ST_HTTP);
+}
+
+static JsVar* gen_jswrap_httpSrv_listen(JsVar *parent, int port) {
+  return jswrap_net_server_listen(parent, port, ST_HTTP);
+}
+
+static JsVar* gen_jswrap_crypto_AES() {
+  return jspNewBuiltin("AES");;
+}
+
+static JsVar* gen_jswrap_crypto_SHA1(JsVar* message) {
+  return jswrap_crypto_SHAx(message, 1);
+}
+
+static JsVar* gen_jswrap_crypto_SHA224(JsVar* message) {
+  return jswrap_crypto_SHAx(message, 224);
+}
+
+static JsVar* gen_jswrap_crypto_SHA256(JsVar* message) {
+  return jswrap_crypto_SHAx(message, 256);
+}
+
+static JsVar* gen_jswrap_crypto_SHA384(JsVar* message) {
+  return jswrap_crypto_SHAx(message, 384);
+}
+
+static JsVar* gen_jswrap_crypto_SHA512(JsVar* message) {
+  return jswrap_crypto_SHAx(message, 512);
+}
+
+static JsVar* gen_jswrap_ArrayBufferView_ArrayBufferView() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_DataViewCodec_DataViewCodec() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_E_E() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_Flash_Flash() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_console_console() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_JSON_JSON() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_Modules_Modules() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_fs_fs() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_process_process() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_Storage_Storage() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_StorageFile_StorageFile() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_StorageLog_StorageLog() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_heatshrink_heatshrink() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_File_File() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_Math_Math() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_Graphics_Graphics() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_url_url() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_net_net() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_Server_Server() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_Socket_Socket() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_dgram_dgram() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_dgramSocket_dgramSocket() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_tls_tls() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_http_http() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_httpSrv_httpSrv() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_httpSRq_httpSRq() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_httpSRs_httpSRs() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_httpCRq_httpCRq() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_httpCRs_httpCRs() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_httpWS_httpWS() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_NetworkJS_NetworkJS() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_TelnetServer_TelnetServer() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_crypto_crypto() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_AES_AES() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_tensorflow_tensorflow() {
+  return NULL;
+}
+
+static JsVar* gen_jswrap_TFMicroInterpreter_TFMicroInterpreter() {
+  return NULL;
+}
+
+// -----------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------
+
+
+// Binary search coded to allow for JswSyms to be in flash on the esp8266 where they require
+// word accesses
+JsVar *jswBinarySearch(const JswSymList *symbolsPtr, JsVar *parent, const char *name) {
+  uint8_t symbolCount = READ_FLASH_UINT8(&symbolsPtr->symbolCount);
+  int searchMin = 0;
+  int searchMax = symbolCount - 1;
+  while (searchMin <= searchMax) {
+    int idx = (searchMin+searchMax) >> 1;
+    const JswSymPtr *sym = &symbolsPtr->symbols[idx];
+    unsigned short strOffset = READ_FLASH_UINT16(&sym->strOffset);
+    int cmp = FLASH_STRCMP(name, &symbolsPtr->symbolChars[strOffset]);
+    if (cmp==0) {
+      unsigned short functionSpec = READ_FLASH_UINT16(&sym->functionSpec);
+      if ((functionSpec & JSWAT_EXECUTE_IMMEDIATELY_MASK) == JSWAT_EXECUTE_IMMEDIATELY)
+        return jsnCallFunction(sym->functionPtr, functionSpec, parent, 0, 0);
+      return jsvNewNativeFunction(sym->functionPtr, functionSpec);
+    } else {
+      if (cmp<0) {
+        // searchMin is the same
+        searchMax = idx-1;
+      } else {
+        searchMin = idx+1;
+        // searchMax is the same
+      }
+    }
+  }
+  return 0;
+}
+
+
+// -----------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------
+// -----------------------------------------------------------------------------------------
+
+
+#ifdef ESP8266
+#define FLASH_SECT __attribute__((section(".irom.literal2"))) __attribute__((aligned(4)))
+#else
+#define FLASH_SECT
+#endif
+
+static const JswSymPtr jswSymbols_global[] FLASH_SECT = {
+  {0, JSWAT_JSVAR, (void (*)(void))gen_jswrap_AES_AES},
+  {4, JSWAT_JSVAR | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)), (void (*)(void))jswrap_array_constructor},
+  {10, JSWAT_JSVAR | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))jswrap_arraybuffer_constructor},
+  {22, JSWAT_JSVAR, (void (*)(void))gen_jswrap_ArrayBufferView_ArrayBufferView},
+  {38, JSWAT_BOOL | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_boolean_constructor},
+  {46, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)), (void (*)(void))jswrap_dataview_constructor},
+  {55, JSWAT_JSVAR, (void (*)(void))gen_jswrap_DataViewCodec_DataViewCodec},
+  {69, JSWAT_JSVAR | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)), (void (*)(void))jswrap_date_constructor},
+  {74, JSWAT_JSVAR, (void (*)(void))gen_jswrap_E_E},
+  {76, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_error_constructor},
+  {82, JSWAT_JSVAR, (void (*)(void))gen_jswrap_File_File},
+  {87, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_filter_constructor},
+  {94, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)), (void (*)(void))gen_jswrap_Float32Array_Float32Array},
+  {107, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)), (void (*)(void))gen_jswrap_Float64Array_Float64Array},
+  {120, JSWAT_JSVAR | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)), (void (*)(void))jswrap_function_constructor},
+  {129, JSWAT_JSVAR, (void (*)(void))gen_jswrap_Graphics_Graphics},
+  {138, JSWAT_INT32 | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_HIGH},
+  {143, JSWAT_VOID, (void (*)(void))jswrap_i2c_constructor},
+  {147, JSWAT_JSVAR | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_I2C1},
+  {152, JSWAT_JSVAR | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_I2C2},
+  {157, JSWAT_JSVAR | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_I2C3},
+  {162, JSWAT_JSVARFLOAT | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_Infinity},
+  {171, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)), (void (*)(void))gen_jswrap_Int16Array_Int16Array},
+  {182, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)), (void (*)(void))gen_jswrap_Int32Array_Int32Array},
+  {193, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)), (void (*)(void))gen_jswrap_Int8Array_Int8Array},
+  {203, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_internalerror_constructor},
+  {217, JSWAT_JSVAR, (void (*)(void))gen_jswrap_JSON_JSON},
+  {222, JSWAT_INT32 | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_LOW},
+  {226, JSWAT_JSVAR | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_LoopbackA},
+  {236, JSWAT_JSVAR | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_LoopbackB},
+  {246, JSWAT_JSVAR, (void (*)(void))gen_jswrap_Math_Math},
+  {251, JSWAT_JSVAR, (void (*)(void))gen_jswrap_Modules_Modules},
+  {259, JSWAT_JSVARFLOAT | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_NaN},
+  {263, JSWAT_JSVAR | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)), (void (*)(void))jswrap_number_constructor},
+  {270, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_object_constructor},
+  {277, JSWAT_JSVAR | (JSWAT_PIN << (JSWAT_BITS*1)), (void (*)(void))jswrap_onewire_constructor},
+  {285, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_pin_constructor},
+  {289, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_promise_constructor},
+  {297, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_referenceerror_constructor},
+  {312, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_regexp_constructor},
+  {319, JSWAT_VOID, (void (*)(void))jswrap_spi_constructor},
+  {323, JSWAT_JSVAR | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_SPI1},
+  {328, JSWAT_JSVAR | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_SPI2},
+  {333, JSWAT_JSVAR | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_SPI3},
+  {338, JSWAT_VOID, (void (*)(void))jswrap_serial_constructor},
+  {345, JSWAT_JSVAR | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_Serial1},
+  {353, JSWAT_JSVAR | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_Serial2},
+  {361, JSWAT_JSVAR | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_Serial3},
+  {369, JSWAT_JSVAR | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_Serial4},
+  {377, JSWAT_JSVAR | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_Serial5},
+  {385, JSWAT_JSVAR | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_Serial6},
+  {393, JSWAT_JSVAR, (void (*)(void))gen_jswrap_Server_Server},
+  {400, JSWAT_JSVAR, (void (*)(void))gen_jswrap_Socket_Socket},
+  {407, JSWAT_JSVAR, (void (*)(void))gen_jswrap_StorageFile_StorageFile},
+  {419, JSWAT_JSVAR, (void (*)(void))gen_jswrap_StorageLog_StorageLog},
+  {430, JSWAT_JSVAR | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)), (void (*)(void))jswrap_string_constructor},
+  {437, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_syntaxerror_constructor},
+  {449, JSWAT_JSVAR, (void (*)(void))gen_jswrap_TFMicroInterpreter_TFMicroInterpreter},
+  {468, JSWAT_JSVAR | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_Telnet},
+  {475, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_typeerror_constructor},
+  {485, JSWAT_JSVAR | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_USB},
+  {489, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)), (void (*)(void))gen_jswrap_Uint16Array_Uint16Array},
+  {501, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)), (void (*)(void))gen_jswrap_Uint24Array_Uint24Array},
+  {513, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)), (void (*)(void))gen_jswrap_Uint32Array_Uint32Array},
+  {525, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)), (void (*)(void))gen_jswrap_Uint8Array_Uint8Array},
+  {536, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)), (void (*)(void))gen_jswrap_Uint8ClampedArray_Uint8ClampedArray},
+  {554, JSWAT_JSVAR | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_waveform_constructor},
+  {563, JSWAT_JSVARFLOAT | (JSWAT_PIN << (JSWAT_BITS*1)), (void (*)(void))jshPinAnalog},
+  {574, JSWAT_VOID | (JSWAT_PIN << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)), (void (*)(void))jswrap_io_analogWrite},
+  {586, JSWAT_JSVAR | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))jswrap_arguments},
+  {596, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_atob},
+  {601, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_btoa},
+  {606, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)), (void (*)(void))jswrap_interface_changeInterval},
+  {621, JSWAT_VOID | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)), (void (*)(void))jswrap_interface_clearInterval},
+  {635, JSWAT_VOID | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)), (void (*)(void))jswrap_interface_clearTimeout},
+  {648, JSWAT_VOID | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)), (void (*)(void))jswrap_interface_clearWatch},
+  {659, JSWAT_JSVAR, (void (*)(void))gen_jswrap_console_console},
+  {667, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_decodeURIComponent},
+  {686, JSWAT_JSVAR, (void (*)(void))gen_jswrap_dgramSocket_dgramSocket},
+  {698, JSWAT_VOID | (JSWAT_PIN << (JSWAT_BITS*1)) | (JSWAT_BOOL << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)), (void (*)(void))jswrap_io_digitalPulse},
+  {711, JSWAT_INT32 | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_io_digitalRead},
+  {723, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)), (void (*)(void))jswrap_io_digitalWrite},
+  {736, JSWAT_VOID, (void (*)(void))gen_jswrap_dump},
+  {741, JSWAT_VOID | (JSWAT_BOOL << (JSWAT_BITS*1)), (void (*)(void))jswrap_interface_echo},
+  {746, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_interface_edit},
+  {751, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_encodeURIComponent},
+  {770, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_eval},
+  {775, JSWAT_JSVAR | (JSWAT_PIN << (JSWAT_BITS*1)), (void (*)(void))jswrap_io_getPinMode},
+  {786, JSWAT_JSVAR, (void (*)(void))jswrap_interface_getSerial},
+  {796, JSWAT_JSVARFLOAT, (void (*)(void))gen_jswrap_getTime},
+  {804, JSWAT_JSVAR | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_global},
+  {811, JSWAT_JSVAR, (void (*)(void))gen_jswrap_httpCRq_httpCRq},
+  {819, JSWAT_JSVAR, (void (*)(void))gen_jswrap_httpCRs_httpCRs},
+  {827, JSWAT_JSVAR, (void (*)(void))gen_jswrap_httpSRq_httpSRq},
+  {835, JSWAT_JSVAR, (void (*)(void))gen_jswrap_httpSRs_httpSRs},
+  {843, JSWAT_JSVAR, (void (*)(void))gen_jswrap_httpSrv_httpSrv},
+  {851, JSWAT_JSVAR, (void (*)(void))gen_jswrap_httpWS_httpWS},
+  {858, JSWAT_BOOL | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_isFinite},
+  {867, JSWAT_BOOL | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_isNaN},
+  {873, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_interface_load},
+  {878, JSWAT_JSVARFLOAT | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_parseFloat},
+  {889, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_parseInt},
+  {898, JSWAT_JSVAR | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_peek16},
+  {905, JSWAT_JSVAR | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_peek32},
+  {912, JSWAT_JSVAR | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_peek8},
+  {918, JSWAT_VOID | (JSWAT_PIN << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_BOOL << (JSWAT_BITS*3)), (void (*)(void))jswrap_io_pinMode},
+  {926, JSWAT_VOID | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_poke16},
+  {933, JSWAT_VOID | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_poke32},
+  {940, JSWAT_VOID | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_poke8},
+  {946, JSWAT_VOID | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)), (void (*)(void))jswrap_interface_print},
+  {952, JSWAT_JSVAR, (void (*)(void))gen_jswrap_process_process},
+  {960, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_require},
+  {968, JSWAT_VOID | (JSWAT_BOOL << (JSWAT_BITS*1)), (void (*)(void))jswrap_interface_reset},
+  {974, JSWAT_VOID | (JSWAT_BOOL << (JSWAT_BITS*1)), (void (*)(void))jswrap_interface_save},
+  {979, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_interface_setBusyIndicator},
+  {996, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)) | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*3)), (void (*)(void))jswrap_interface_setInterval},
+  {1008, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_interface_setSleepIndicator},
+  {1026, JSWAT_VOID | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)), (void (*)(void))jswrap_interactive_setTime},
+  {1034, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)) | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*3)), (void (*)(void))jswrap_interface_setTimeout},
+  {1045, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_PIN << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)), (void (*)(void))jswrap_interface_setWatch},
+  {1054, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)), (void (*)(void))jswrap_io_shiftOut},
+  {1063, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_interface_trace},
+  {1069, JSWAT_JSVAR, (void (*)(void))gen_jswrap_url_url}
+};
+static const unsigned char jswSymbolIndex_global = 0;
+static const JswSymPtr jswSymbols_Array_proto[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)), (void (*)(void))jswrap_array_concat},
+  {7, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_array_every},
+  {13, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)), (void (*)(void))jswrap_array_fill},
+  {18, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_array_filter},
+  {25, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_array_find},
+  {30, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_array_findIndex},
+  {40, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_array_forEach},
+  {48, JSWAT_BOOL | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)), (void (*)(void))jswrap_array_includes},
+  {57, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)), (void (*)(void))jswrap_array_indexOf},
+  {65, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_array_join},
+  {70, JSWAT_JSVAR | JSWAT_THIS_ARG | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))jswrap_object_length},
+  {77, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_array_map},
+  {81, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))gen_jswrap_Array_pop},
+  {85, JSWAT_INT32 | JSWAT_THIS_ARG | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)), (void (*)(void))jswrap_array_push},
+  {90, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_array_reduce},
+  {97, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_array_reverse},
+  {105, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_array_shift},
+  {111, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_array_slice},
+  {117, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_array_some},
+  {122, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_array_sort},
+  {127, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*3)), (void (*)(void))jswrap_array_splice},
+  {134, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_object_toString},
+  {143, JSWAT_INT32 | JSWAT_THIS_ARG | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)), (void (*)(void))jswrap_array_unshift}
+};
+static const unsigned char jswSymbolIndex_Array_proto = 1;
+static const JswSymPtr jswSymbols_Array[] FLASH_SECT = {
+  {0, JSWAT_BOOL | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))gen_jswrap_Array_isArray}
+};
+static const unsigned char jswSymbolIndex_Array = 2;
+static const JswSymPtr jswSymbols_ArrayBuffer_proto[] FLASH_SECT = {
+  {0, JSWAT_INT32 | JSWAT_THIS_ARG | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_ArrayBuffer_byteLength}
+};
+static const unsigned char jswSymbolIndex_ArrayBuffer_proto = 3;
+static const JswSymPtr jswSymbols_ArrayBufferView_proto[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_THIS_ARG | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_ArrayBufferView_buffer},
+  {7, JSWAT_INT32 | JSWAT_THIS_ARG | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_ArrayBufferView_byteLength},
+  {18, JSWAT_INT32 | JSWAT_THIS_ARG | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_ArrayBufferView_byteOffset},
+  {29, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)), (void (*)(void))jswrap_array_fill},
+  {34, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_array_filter},
+  {41, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_array_find},
+  {46, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_array_findIndex},
+  {56, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_array_forEach},
+  {64, JSWAT_BOOL | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)), (void (*)(void))jswrap_array_includes},
+  {73, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)), (void (*)(void))jswrap_array_indexOf},
+  {81, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_array_join},
+  {86, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_arraybufferview_map},
+  {90, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_array_reduce},
+  {97, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_array_reverse},
+  {105, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)), (void (*)(void))jswrap_arraybufferview_set},
+  {109, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_array_slice},
+  {115, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_arraybufferview_sort}
+};
+static const unsigned char jswSymbolIndex_ArrayBufferView_proto = 4;
+static const JswSymPtr jswSymbols_DataView_proto[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_BOOL << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_DataView_getFloat32},
+  {11, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_BOOL << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_DataView_getFloat64},
+  {22, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_BOOL << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_DataView_getInt16},
+  {31, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_BOOL << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_DataView_getInt32},
+  {40, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_BOOL << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_DataView_getInt8},
+  {48, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_BOOL << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_DataView_getUint16},
+  {58, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_BOOL << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_DataView_getUint32},
+  {68, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_BOOL << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_DataView_getUint8},
+  {77, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_BOOL << (JSWAT_BITS*3)), (void (*)(void))gen_jswrap_DataView_setFloat32},
+  {88, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_BOOL << (JSWAT_BITS*3)), (void (*)(void))gen_jswrap_DataView_setFloat64},
+  {99, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_BOOL << (JSWAT_BITS*3)), (void (*)(void))gen_jswrap_DataView_setInt16},
+  {108, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_BOOL << (JSWAT_BITS*3)), (void (*)(void))gen_jswrap_DataView_setInt32},
+  {117, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_BOOL << (JSWAT_BITS*3)), (void (*)(void))gen_jswrap_DataView_setInt8},
+  {125, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_BOOL << (JSWAT_BITS*3)), (void (*)(void))gen_jswrap_DataView_setUint16},
+  {135, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_BOOL << (JSWAT_BITS*3)), (void (*)(void))gen_jswrap_DataView_setUint32},
+  {145, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_BOOL << (JSWAT_BITS*3)), (void (*)(void))gen_jswrap_DataView_setUint8}
+};
+static const unsigned char jswSymbolIndex_DataView_proto = 5;
+static const JswSymPtr jswSymbols_DataView[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_dataview_compile}
+};
+static const unsigned char jswSymbolIndex_DataView = 6;
+static const JswSymPtr jswSymbols_DataViewCodec_proto[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)), (void (*)(void))jswrap_dataview_codec_pack},
+  {5, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)), (void (*)(void))jswrap_dataview_codec_unpack}
+};
+static const unsigned char jswSymbolIndex_DataViewCodec_proto = 7;
+static const JswSymPtr jswSymbols_Date[] FLASH_SECT = {
+  {0, JSWAT_JSVARFLOAT, (void (*)(void))jswrap_date_now},
+  {4, JSWAT_JSVARFLOAT | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_date_parse}
+};
+static const unsigned char jswSymbolIndex_Date = 8;
+static const JswSymPtr jswSymbols_Date_proto[] FLASH_SECT = {
+  {0, JSWAT_INT32 | JSWAT_THIS_ARG, (void (*)(void))jswrap_date_getDate},
+  {8, JSWAT_INT32 | JSWAT_THIS_ARG, (void (*)(void))jswrap_date_getDay},
+  {15, JSWAT_INT32 | JSWAT_THIS_ARG, (void (*)(void))jswrap_date_getFullYear},
+  {27, JSWAT_INT32 | JSWAT_THIS_ARG, (void (*)(void))jswrap_date_getHours},
+  {36, JSWAT_INT32 | JSWAT_THIS_ARG, (void (*)(void))jswrap_date_getMilliseconds},
+  {52, JSWAT_INT32 | JSWAT_THIS_ARG, (void (*)(void))jswrap_date_getMinutes},
+  {63, JSWAT_INT32 | JSWAT_THIS_ARG, (void (*)(void))jswrap_date_getMonth},
+  {72, JSWAT_INT32 | JSWAT_THIS_ARG, (void (*)(void))jswrap_date_getSeconds},
+  {83, JSWAT_JSVARFLOAT | JSWAT_THIS_ARG, (void (*)(void))jswrap_date_getTime},
+  {91, JSWAT_INT32 | JSWAT_THIS_ARG, (void (*)(void))jswrap_date_getTimezoneOffset},
+  {109, JSWAT_JSVARFLOAT | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))jswrap_date_setDate},
+  {117, JSWAT_JSVARFLOAT | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)), (void (*)(void))jswrap_date_setFullYear},
+  {129, JSWAT_JSVARFLOAT | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)) | (JSWAT_JSVAR << (JSWAT_BITS*4)), (void (*)(void))jswrap_date_setHours},
+  {138, JSWAT_JSVARFLOAT | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))jswrap_date_setMilliseconds},
+  {154, JSWAT_JSVARFLOAT | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)), (void (*)(void))jswrap_date_setMinutes},
+  {165, JSWAT_JSVARFLOAT | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_date_setMonth},
+  {174, JSWAT_JSVARFLOAT | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_date_setSeconds},
+  {185, JSWAT_JSVARFLOAT | JSWAT_THIS_ARG | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)), (void (*)(void))jswrap_date_setTime},
+  {193, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_date_toISOString},
+  {205, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_date_toString},
+  {214, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_date_toUTCString},
+  {226, JSWAT_JSVARFLOAT | JSWAT_THIS_ARG, (void (*)(void))jswrap_date_getTime}
+};
+static const unsigned char jswSymbolIndex_Date_proto = 9;
+static const JswSymPtr jswSymbols_Error_proto[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_error_toString}
+};
+static const unsigned char jswSymbolIndex_Error_proto = 10;
+static const JswSymPtr jswSymbols_SyntaxError_proto[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_error_toString}
+};
+static const unsigned char jswSymbolIndex_SyntaxError_proto = 11;
+static const JswSymPtr jswSymbols_TypeError_proto[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_error_toString}
+};
+static const unsigned char jswSymbolIndex_TypeError_proto = 12;
+static const JswSymPtr jswSymbols_InternalError_proto[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_error_toString}
+};
+static const unsigned char jswSymbolIndex_InternalError_proto = 13;
+static const JswSymPtr jswSymbols_ReferenceError_proto[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_error_toString}
+};
+static const unsigned char jswSymbolIndex_ReferenceError_proto = 14;
+static const JswSymPtr jswSymbols_E[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_espruino_CRC32},
+  {6, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_BOOL << (JSWAT_BITS*3)), (void (*)(void))jswrap_espruino_FFT},
+  {10, JSWAT_JSVAR | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*3)) | (JSWAT_BOOL << (JSWAT_BITS*4)), (void (*)(void))jswrap_espruino_HSBtoRGB},
+  {19, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*2)), (void (*)(void))jswrap_espruino_asm},
+  {23, JSWAT_JSVARFLOAT | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*3)), (void (*)(void))jswrap_espruino_clip},
+  {28, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_espruino_compiledC},
+  {38, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_PIN << (JSWAT_BITS*2)), (void (*)(void))jswrap_E_connectSDCard},
+  {52, JSWAT_JSVARFLOAT | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)), (void (*)(void))jswrap_espruino_convolve},
+  {61, JSWAT_VOID, (void (*)(void))jsvDefragment},
+  {68, JSWAT_VOID, (void (*)(void))jswrap_e_dumpFragmentation},
+  {86, JSWAT_VOID, (void (*)(void))jswrap_espruino_dumpFreeList},
+  {99, JSWAT_VOID, (void (*)(void))jswrap_espruino_dumpLockedVars},
+  {114, JSWAT_JSVAR, (void (*)(void))jswrap_e_dumpStr},
+  {122, JSWAT_VOID, (void (*)(void))jswrap_espruino_dumpTimers},
+  {133, JSWAT_VOID, (void (*)(void))jswrap_e_dumpVariables},
+  {147, JSWAT_VOID | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_espruino_enableWatchdog},
+  {162, JSWAT_INT32 | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_BOOL << (JSWAT_BITS*2)), (void (*)(void))jswrap_espruino_getAddressOf},
+  {175, JSWAT_JSVARFLOAT, (void (*)(void))gen_jswrap_E_getAnalogVRef},
+  {189, JSWAT_JSVAR, (void (*)(void))jswrap_espruino_getErrorFlags},
+  {203, JSWAT_JSVAR, (void (*)(void))jsfGetFlags},
+  {212, JSWAT_JSVAR, (void (*)(void))jswrap_espruino_getIOStats},
+  {223, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)), (void (*)(void))jswrap_espruino_getSizeOf},
+  {233, JSWAT_JSVARFLOAT, (void (*)(void))gen_jswrap_E_getTemperature},
+  {248, JSWAT_INT32, (void (*)(void))jshGetRandomNumber},
+  {255, JSWAT_JSVARFLOAT | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)), (void (*)(void))jswrap_espruino_interpolate},
+  {267, JSWAT_JSVARFLOAT | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*3)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*4)), (void (*)(void))jswrap_espruino_interpolate2d},
+  {281, JSWAT_VOID, (void (*)(void))jswrap_espruino_kickWatchdog},
+  {294, JSWAT_VOID, (void (*)(void))jswrap_espruino_lockConsole},
+  {306, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_BOOL << (JSWAT_BITS*3)), (void (*)(void))jswrap_espruino_lookupNoCase},
+  {319, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)) | (JSWAT_INT32 << (JSWAT_BITS*4)), (void (*)(void))jswrap_espruino_mapInPlace},
+  {330, JSWAT_JSVAR | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)), (void (*)(void))jswrap_espruino_memoryArea},
+  {341, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_espruino_memoryMap},
+  {351, JSWAT_JSVAR | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)), (void (*)(void))jswrap_espruino_nativeCall},
+  {362, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_E_openFile},
+  {371, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)), (void (*)(void))jswrap_pipe},
+  {376, JSWAT_VOID, (void (*)(void))jswrap_espruino_reboot},
+  {383, JSWAT_INT32 | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))jswrap_espruino_reverseByte},
+  {395, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_BOOL << (JSWAT_BITS*2)), (void (*)(void))jswrap_espruino_setBootCode},
+  {407, JSWAT_INT32 | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_espruino_setClock},
+  {416, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jsfSetFlags},
+  {425, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)), (void (*)(void))jswrap_espruino_setIOLimit},
+  {436, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_espruino_setPassword},
+  {448, JSWAT_VOID | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)), (void (*)(void))jswrap_espruino_setTimeZone},
+  {460, JSWAT_VOID | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))srand},
+  {466, JSWAT_JSVARFLOAT | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_espruino_sum},
+  {470, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_espruino_toArrayBuffer},
+  {484, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_espruino_toJS},
+  {489, JSWAT_JSVAR | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)), (void (*)(void))jswrap_espruino_toString},
+  {498, JSWAT_JSVAR | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)), (void (*)(void))jswrap_espruino_toUint8Array},
+  {511, JSWAT_VOID, (void (*)(void))jswrap_E_unmountSD},
+  {521, JSWAT_JSVARFLOAT | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)), (void (*)(void))jswrap_espruino_variance}
+};
+static const unsigned char jswSymbolIndex_E = 15;
+static const JswSymPtr jswSymbols_Filter_proto[] FLASH_SECT = {
+  {0, JSWAT_INT32 | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_filter_process},
+  {8, JSWAT_VOID | JSWAT_THIS_ARG, (void (*)(void))jswrap_filter_reset}
+};
+static const unsigned char jswSymbolIndex_Filter_proto = 16;
+static const JswSymPtr jswSymbols_Flash[] FLASH_SECT = {
+  {0, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_flash_erasePage},
+  {10, JSWAT_JSVAR, (void (*)(void))jswrap_flash_getFree},
+  {18, JSWAT_JSVAR | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))jswrap_flash_getPage},
+  {26, JSWAT_JSVAR | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)), (void (*)(void))jswrap_flash_read},
+  {31, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)), (void (*)(void))jswrap_flash_write}
+};
+static const unsigned char jswSymbolIndex_Flash = 17;
+static const JswSymPtr jswSymbols_console[] FLASH_SECT = {
+  {0, JSWAT_VOID | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)), (void (*)(void))jswrap_interface_print}
+};
+static const unsigned char jswSymbolIndex_console = 18;
+static const JswSymPtr jswSymbols_JSON[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_json_parse},
+  {6, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)), (void (*)(void))jswrap_json_stringify}
+};
+static const unsigned char jswSymbolIndex_JSON = 19;
+static const JswSymPtr jswSymbols_Modules[] FLASH_SECT = {
+  {0, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_modules_addCached},
+  {10, JSWAT_JSVAR, (void (*)(void))jswrap_modules_getCached},
+  {20, JSWAT_VOID, (void (*)(void))jswrap_modules_removeAllCached},
+  {36, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_modules_removeCached}
+};
+static const unsigned char jswSymbolIndex_Modules = 20;
+static const JswSymPtr jswSymbols_Pin_proto[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_pin_getInfo},
+  {8, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_pin_getMode},
+  {16, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_pin_mode},
+  {21, JSWAT_BOOL | JSWAT_THIS_ARG, (void (*)(void))jswrap_pin_read},
+  {26, JSWAT_VOID | JSWAT_THIS_ARG, (void (*)(void))jswrap_pin_reset},
+  {32, JSWAT_VOID | JSWAT_THIS_ARG, (void (*)(void))jswrap_pin_set},
+  {36, JSWAT_BOOL | JSWAT_THIS_ARG, (void (*)(void))jswrap_pin_toggle},
+  {43, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_BOOL << (JSWAT_BITS*1)), (void (*)(void))jswrap_pin_write},
+  {49, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_BOOL << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)), (void (*)(void))jswrap_pin_writeAtTime}
+};
+static const unsigned char jswSymbolIndex_Pin_proto = 21;
+static const JswSymPtr jswSymbols_Number[] FLASH_SECT = {
+  {0, JSWAT_JSVARFLOAT | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_Number_MAX_VALUE},
+  {10, JSWAT_JSVARFLOAT | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_Number_MIN_VALUE},
+  {20, JSWAT_JSVARFLOAT | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_Number_NEGATIVE_INFINITY},
+  {38, JSWAT_JSVARFLOAT | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_Number_NaN},
+  {42, JSWAT_JSVARFLOAT | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_Number_POSITIVE_INFINITY}
+};
+static const unsigned char jswSymbolIndex_Number = 22;
+static const JswSymPtr jswSymbols_Number_proto[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))jswrap_number_toFixed}
+};
+static const unsigned char jswSymbolIndex_Number_proto = 23;
+static const JswSymPtr jswSymbols_Object_proto[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_object_clone},
+  {6, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*2)), (void (*)(void))jswrap_object_emit},
+  {11, JSWAT_BOOL | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_object_hasOwnProperty},
+  {26, JSWAT_JSVAR | JSWAT_THIS_ARG | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))jswrap_object_length},
+  {33, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_object_on},
+  {36, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_object_removeAllListeners},
+  {55, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_object_removeListener},
+  {70, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_object_toString},
+  {79, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_object_valueOf}
+};
+static const unsigned char jswSymbolIndex_Object_proto = 24;
+static const JswSymPtr jswSymbols_Object[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)), (void (*)(void))jswrap_object_assign},
+  {7, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_object_create},
+  {14, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_object_defineProperties},
+  {31, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)), (void (*)(void))jswrap_object_defineProperty},
+  {46, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_object_getOwnPropertyDescriptor},
+  {71, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))gen_jswrap_Object_getOwnPropertyNames},
+  {91, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_object_getPrototypeOf},
+  {106, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))gen_jswrap_Object_keys},
+  {111, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_object_setPrototypeOf}
+};
+static const unsigned char jswSymbolIndex_Object = 25;
+static const JswSymPtr jswSymbols_Function_proto[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_function_apply_or_call},
+  {6, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*2)), (void (*)(void))jswrap_function_bind},
+  {11, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*2)), (void (*)(void))jswrap_function_apply_or_call},
+  {16, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_function_replaceWith}
+};
+static const unsigned char jswSymbolIndex_Function_proto = 26;
+static const JswSymPtr jswSymbols_OneWire_proto[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_onewire_read},
+  {5, JSWAT_BOOL | JSWAT_THIS_ARG, (void (*)(void))jswrap_onewire_reset},
+  {11, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_onewire_search},
+  {18, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))jswrap_onewire_search},
+  {25, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_onewire_select},
+  {32, JSWAT_VOID | JSWAT_THIS_ARG, (void (*)(void))jswrap_onewire_skip},
+  {37, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_BOOL << (JSWAT_BITS*2)), (void (*)(void))jswrap_onewire_write}
+};
+static const unsigned char jswSymbolIndex_OneWire_proto = 27;
+static const JswSymPtr jswSymbols_fs[] FLASH_SECT = {
+  {0, JSWAT_BOOL | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_fs_appendFile},
+  {11, JSWAT_BOOL | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_fs_appendFileSync},
+  {26, JSWAT_BOOL | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_fs_mkdir},
+  {32, JSWAT_BOOL | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_fs_mkdir},
+  {42, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)), (void (*)(void))jswrap_pipe},
+  {47, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_fs_readFile},
+  {56, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_fs_readFile},
+  {69, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_fs_readdir},
+  {77, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_fs_readdir},
+  {89, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_fs_stat},
+  {98, JSWAT_BOOL | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_fs_unlink},
+  {105, JSWAT_BOOL | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_fs_unlink},
+  {116, JSWAT_BOOL | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_fs_writeFile},
+  {126, JSWAT_BOOL | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_fs_writeFileSync}
+};
+static const unsigned char jswSymbolIndex_fs = 28;
+static const JswSymPtr jswSymbols_process[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))jswrap_process_env},
+  {4, JSWAT_JSVAR, (void (*)(void))jswrap_process_memory},
+  {11, JSWAT_JSVAR | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_process_version}
+};
+static const unsigned char jswSymbolIndex_process = 29;
+static const JswSymPtr jswSymbols_Promise[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_promise_all},
+  {4, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_promise_reject},
+  {11, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_promise_resolve}
+};
+static const unsigned char jswSymbolIndex_Promise = 30;
+static const JswSymPtr jswSymbols_Promise_proto[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_promise_catch},
+  {6, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_promise_then}
+};
+static const unsigned char jswSymbolIndex_Promise_proto = 31;
+static const JswSymPtr jswSymbols_RegExp_proto[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_regexp_exec},
+  {5, JSWAT_BOOL | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_regexp_test}
+};
+static const unsigned char jswSymbolIndex_RegExp_proto = 32;
+static const JswSymPtr jswSymbols_Serial[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | (JSWAT_PIN << (JSWAT_BITS*1)), (void (*)(void))gen_jswrap_Serial_find}
+};
+static const unsigned char jswSymbolIndex_Serial = 33;
+static const JswSymPtr jswSymbols_Serial_proto[] FLASH_SECT = {
+  {0, JSWAT_INT32 | JSWAT_THIS_ARG, (void (*)(void))jswrap_stream_available},
+  {10, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)), (void (*)(void))jswrap_serial_inject},
+  {17, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_pipe},
+  {22, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_serial_print},
+  {28, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_serial_println},
+  {36, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))jswrap_stream_read},
+  {41, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_BOOL << (JSWAT_BITS*1)), (void (*)(void))jswrap_serial_setConsole},
+  {52, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_serial_setup},
+  {58, JSWAT_VOID | JSWAT_THIS_ARG, (void (*)(void))jswrap_serial_unsetup},
+  {66, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)), (void (*)(void))jswrap_serial_write}
+};
+static const unsigned char jswSymbolIndex_Serial_proto = 34;
+static const JswSymPtr jswSymbols_Storage[] FLASH_SECT = {
+  {0, JSWAT_VOID | (JSWAT_BOOL << (JSWAT_BITS*1)), (void (*)(void))jswrap_storage_compact},
+  {8, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_storage_erase},
+  {14, JSWAT_VOID, (void (*)(void))jswrap_storage_eraseAll},
+  {23, JSWAT_INT32, (void (*)(void))jswrap_storage_getFree},
+  {31, JSWAT_JSVAR, (void (*)(void))jswrap_storage_getStats},
+  {40, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_storage_hash},
+  {45, JSWAT_JSVAR, (void (*)(void))jswrap_storage_list},
+  {50, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_storage_open},
+  {55, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_storage_openLog},
+  {63, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)), (void (*)(void))jswrap_storage_read},
+  {68, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_storage_readArrayBuffer},
+  {84, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_storage_readJSON},
+  {93, JSWAT_BOOL | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)) | (JSWAT_INT32 << (JSWAT_BITS*4)), (void (*)(void))jswrap_storage_write}
+};
+static const unsigned char jswSymbolIndex_Storage = 35;
+static const JswSymPtr jswSymbols_StorageFile_proto[] FLASH_SECT = {
+  {0, JSWAT_VOID | JSWAT_THIS_ARG, (void (*)(void))jswrap_storagefile_erase},
+  {6, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))jswrap_storagefile_read},
+  {11, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_storagefile_readLine},
+  {20, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_storagefile_write}
+};
+static const unsigned char jswSymbolIndex_StorageFile_proto = 36;
+static const JswSymPtr jswSymbols_StorageLog_proto[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_storagelog_append},
+  {7, JSWAT_VOID | JSWAT_THIS_ARG, (void (*)(void))jswrap_storagelog_erase},
+  {13, JSWAT_INT32 | JSWAT_THIS_ARG | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)), (void (*)(void))jswrap_storagelog_find},
+  {18, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_storagelog_getInfo},
+  {26, JSWAT_JSVARFLOAT | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))jswrap_storagelog_getTime},
+  {34, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))jswrap_storagelog_read}
+};
+static const unsigned char jswSymbolIndex_StorageLog_proto = 37;
+static const JswSymPtr jswSymbols_SPI[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | (JSWAT_PIN << (JSWAT_BITS*1)), (void (*)(void))gen_jswrap_SPI_find}
+};
+static const unsigned char jswSymbolIndex_SPI = 38;
+static const JswSymPtr jswSymbols_SPI_proto[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_PIN << (JSWAT_BITS*2)), (void (*)(void))jswrap_spi_send},
+  {5, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)) | (JSWAT_PIN << (JSWAT_BITS*4)), (void (*)(void))jswrap_spi_send4bit},
+  {14, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)) | (JSWAT_PIN << (JSWAT_BITS*4)), (void (*)(void))jswrap_spi_send8bit},
+  {23, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_spi_setup},
+  {29, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)), (void (*)(void))jswrap_spi_write}
+};
+static const unsigned char jswSymbolIndex_SPI_proto = 39;
+static const JswSymPtr jswSymbols_I2C[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | (JSWAT_PIN << (JSWAT_BITS*1)), (void (*)(void))gen_jswrap_I2C_find}
+};
+static const unsigned char jswSymbolIndex_I2C = 40;
+static const JswSymPtr jswSymbols_I2C_proto[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)), (void (*)(void))jswrap_i2c_readFrom},
+  {9, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_i2c_setup},
+  {15, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*2)), (void (*)(void))jswrap_i2c_writeTo}
+};
+static const unsigned char jswSymbolIndex_I2C_proto = 41;
+static const JswSymPtr jswSymbols_String_proto[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))jswrap_string_charAt},
+  {7, JSWAT_INT32 | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))jswrap_string_charCodeAt},
+  {18, JSWAT_BOOL | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_string_endsWith},
+  {27, JSWAT_BOOL | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_String_includes},
+  {36, JSWAT_INT32 | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_String_indexOf},
+  {44, JSWAT_INT32 | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_String_lastIndexOf},
+  {56, JSWAT_JSVAR | JSWAT_THIS_ARG | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))jswrap_object_length},
+  {63, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_string_match},
+  {69, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))jswrap_string_repeat},
+  {76, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_string_replace},
+  {84, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_string_slice},
+  {90, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_string_split},
+  {96, JSWAT_BOOL | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)), (void (*)(void))jswrap_string_startsWith},
+  {107, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_string_substr},
+  {114, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_string_substring},
+  {124, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))gen_jswrap_String_toLowerCase},
+  {136, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))gen_jswrap_String_toUpperCase},
+  {148, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_string_trim}
+};
+static const unsigned char jswSymbolIndex_String_proto = 42;
+static const JswSymPtr jswSymbols_String[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)), (void (*)(void))jswrap_string_fromCharCode}
+};
+static const unsigned char jswSymbolIndex_String = 43;
+static const JswSymPtr jswSymbols_Waveform_proto[] FLASH_SECT = {
+  {0, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_PIN << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)), (void (*)(void))jswrap_waveform_startInput},
+  {11, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_PIN << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)), (void (*)(void))jswrap_waveform_startOutput},
+  {23, JSWAT_VOID | JSWAT_THIS_ARG, (void (*)(void))jswrap_waveform_stop}
+};
+static const unsigned char jswSymbolIndex_Waveform_proto = 44;
+static const JswSymPtr jswSymbols_heatshrink[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_heatshrink_compress},
+  {9, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_heatshrink_decompress}
+};
+static const unsigned char jswSymbolIndex_heatshrink = 45;
+static const JswSymPtr jswSymbols_File_proto[] FLASH_SECT = {
+  {0, JSWAT_VOID | JSWAT_THIS_ARG, (void (*)(void))gen_jswrap_File_close},
+  {6, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_pipe},
+  {11, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))jswrap_file_read},
+  {16, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))gen_jswrap_File_seek},
+  {21, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))gen_jswrap_File_skip},
+  {26, JSWAT_INT32 | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_file_write}
+};
+static const unsigned char jswSymbolIndex_File_proto = 46;
+static const JswSymPtr jswSymbols_Math[] FLASH_SECT = {
+  {0, JSWAT_JSVARFLOAT | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_Math_E},
+  {2, JSWAT_JSVARFLOAT | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_Math_LN10},
+  {7, JSWAT_JSVARFLOAT | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_Math_LN2},
+  {11, JSWAT_JSVARFLOAT | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_Math_LOG10E},
+  {18, JSWAT_JSVARFLOAT | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_Math_LOG2E},
+  {24, JSWAT_JSVARFLOAT | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_Math_PI},
+  {27, JSWAT_JSVARFLOAT | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_Math_SQRT1_2},
+  {35, JSWAT_JSVARFLOAT | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_Math_SQRT2},
+  {41, JSWAT_JSVARFLOAT | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)), (void (*)(void))jswrap_math_abs},
+  {45, JSWAT_JSVARFLOAT | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)), (void (*)(void))gen_jswrap_Math_acos},
+  {50, JSWAT_JSVARFLOAT | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)), (void (*)(void))gen_jswrap_Math_asin},
+  {55, JSWAT_JSVARFLOAT | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)), (void (*)(void))jswrap_math_atan},
+  {60, JSWAT_JSVARFLOAT | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)), (void (*)(void))jswrap_math_atan2},
+  {66, JSWAT_JSVARFLOAT | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)), (void (*)(void))ceil},
+  {71, JSWAT_JSVARFLOAT | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*3)), (void (*)(void))jswrap_math_clip},
+  {76, JSWAT_JSVARFLOAT | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)), (void (*)(void))gen_jswrap_Math_cos},
+  {80, JSWAT_JSVARFLOAT | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)), (void (*)(void))exp},
+  {84, JSWAT_JSVARFLOAT | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)), (void (*)(void))floor},
+  {90, JSWAT_JSVARFLOAT | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)), (void (*)(void))log},
+  {94, JSWAT_JSVARFLOAT | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)), (void (*)(void))gen_jswrap_Math_max},
+  {98, JSWAT_JSVARFLOAT | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)), (void (*)(void))gen_jswrap_Math_min},
+  {102, JSWAT_JSVARFLOAT | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)), (void (*)(void))jswrap_math_pow},
+  {106, JSWAT_JSVARFLOAT, (void (*)(void))gen_jswrap_Math_random},
+  {113, JSWAT_JSVAR | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)), (void (*)(void))jswrap_math_round},
+  {119, JSWAT_JSVARFLOAT | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)), (void (*)(void))jswrap_math_sin},
+  {123, JSWAT_JSVARFLOAT | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)), (void (*)(void))jswrap_math_sqrt},
+  {128, JSWAT_JSVARFLOAT | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)), (void (*)(void))gen_jswrap_Math_tan},
+  {132, JSWAT_JSVARFLOAT | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)), (void (*)(void))wrapAround}
+};
+static const unsigned char jswSymbolIndex_Math = 47;
+static const JswSymPtr jswSymbols_Graphics[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)) | (JSWAT_JSVAR << (JSWAT_BITS*4)), (void (*)(void))jswrap_graphics_createArrayBuffer},
+  {18, JSWAT_JSVAR | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)) | (JSWAT_JSVAR << (JSWAT_BITS*4)), (void (*)(void))jswrap_graphics_createCallback},
+  {33, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_graphics_createImage},
+  {45, JSWAT_JSVAR, (void (*)(void))jswrap_graphics_getInstance}
+};
+static const unsigned char jswSymbolIndex_Graphics = 48;
+static const JswSymPtr jswSymbols_Graphics_proto[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_graphics_asBMP},
+  {6, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_graphics_asImage},
+  {14, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_graphics_asURL},
+  {20, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_BOOL << (JSWAT_BITS*1)), (void (*)(void))jswrap_graphics_clear},
+  {26, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)) | (JSWAT_INT32 << (JSWAT_BITS*4)), (void (*)(void))jswrap_graphics_clearRect},
+  {36, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)), (void (*)(void))jswrap_graphics_drawCircle},
+  {47, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)) | (JSWAT_INT32 << (JSWAT_BITS*4)), (void (*)(void))jswrap_graphics_drawEllipse},
+  {59, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)) | (JSWAT_JSVAR << (JSWAT_BITS*4)), (void (*)(void))jswrap_graphics_drawImage},
+  {69, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)) | (JSWAT_INT32 << (JSWAT_BITS*4)), (void (*)(void))jswrap_graphics_drawLine},
+  {78, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_BOOL << (JSWAT_BITS*2)), (void (*)(void))jswrap_graphics_drawPoly},
+  {87, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)) | (JSWAT_INT32 << (JSWAT_BITS*4)), (void (*)(void))jswrap_graphics_drawRect},
+  {96, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)) | (JSWAT_BOOL << (JSWAT_BITS*4)), (void (*)(void))jswrap_graphics_drawString},
+  {107, JSWAT_VOID | JSWAT_THIS_ARG, (void (*)(void))jswrap_graphics_dump},
+  {112, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)), (void (*)(void))jswrap_graphics_fillCircle},
+  {123, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)) | (JSWAT_INT32 << (JSWAT_BITS*4)), (void (*)(void))jswrap_graphics_fillEllipse},
+  {135, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_graphics_fillPoly},
+  {144, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)) | (JSWAT_INT32 << (JSWAT_BITS*4)), (void (*)(void))jswrap_graphics_fillRect},
+  {153, JSWAT_INT32 | JSWAT_THIS_ARG, (void (*)(void))gen_jswrap_Graphics_getBgColor},
+  {164, JSWAT_INT32 | JSWAT_THIS_ARG, (void (*)(void))gen_jswrap_Graphics_getColor},
+  {173, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_graphics_getFont},
+  {181, JSWAT_INT32 | JSWAT_THIS_ARG, (void (*)(void))jswrap_graphics_getFontHeight},
+  {195, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_graphics_getFonts},
+  {204, JSWAT_INT32 | JSWAT_THIS_ARG, (void (*)(void))gen_jswrap_Graphics_getHeight},
+  {214, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_BOOL << (JSWAT_BITS*1)), (void (*)(void))jswrap_graphics_getModified},
+  {226, JSWAT_INT32 | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)), (void (*)(void))jswrap_graphics_getPixel},
+  {235, JSWAT_INT32 | JSWAT_THIS_ARG, (void (*)(void))gen_jswrap_Graphics_getWidth},
+  {244, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)), (void (*)(void))jswrap_graphics_lineTo},
+  {251, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)), (void (*)(void))jswrap_graphics_moveTo},
+  {258, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_graphics_reset},
+  {264, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)), (void (*)(void))jswrap_graphics_scroll},
+  {271, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)), (void (*)(void))gen_jswrap_Graphics_setBgColor},
+  {282, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)) | (JSWAT_INT32 << (JSWAT_BITS*4)), (void (*)(void))jswrap_graphics_setClipRect},
+  {294, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)), (void (*)(void))gen_jswrap_Graphics_setColor},
+  {303, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)), (void (*)(void))jswrap_graphics_setFont},
+  {311, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)), (void (*)(void))jswrap_graphics_setFontAlign},
+  {324, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))gen_jswrap_Graphics_setFontBitmap},
+  {338, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)) | (JSWAT_INT32 << (JSWAT_BITS*4)), (void (*)(void))jswrap_graphics_setFontCustom},
+  {352, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))gen_jswrap_Graphics_setFontVector},
+  {366, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)), (void (*)(void))jswrap_graphics_setPixel},
+  {375, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_BOOL << (JSWAT_BITS*2)), (void (*)(void))jswrap_graphics_setRotation},
+  {387, JSWAT_INT32 | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_graphics_stringWidth},
+  {399, JSWAT_INT32 | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)), (void (*)(void))jswrap_graphics_toColor}
+};
+static const unsigned char jswSymbolIndex_Graphics_proto = 49;
+static const JswSymPtr jswSymbols_url[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_BOOL << (JSWAT_BITS*2)), (void (*)(void))jswrap_url_parse}
+};
+static const unsigned char jswSymbolIndex_url = 50;
+static const JswSymPtr jswSymbols_Socket[] FLASH_SECT = {
+  
+};
+static const unsigned char jswSymbolIndex_Socket = 51;
+static const JswSymPtr jswSymbols_Socket_proto[] FLASH_SECT = {
+  {0, JSWAT_INT32 | JSWAT_THIS_ARG, (void (*)(void))jswrap_stream_available},
+  {10, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_net_socket_end},
+  {14, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_pipe},
+  {19, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))jswrap_stream_read},
+  {24, JSWAT_BOOL | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_net_socket_write}
+};
+static const unsigned char jswSymbolIndex_Socket_proto = 52;
+static const JswSymPtr jswSymbols_net[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_net_connect},
+  {8, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_net_createServer}
+};
+static const unsigned char jswSymbolIndex_net = 53;
+static const JswSymPtr jswSymbols_dgram[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_dgram_createSocket}
+};
+static const unsigned char jswSymbolIndex_dgram = 54;
+static const JswSymPtr jswSymbols_dgramSocket_proto[] FLASH_SECT = {
+  {0, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_dgram_addMembership},
+  {14, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_dgramSocket_bind},
+  {19, JSWAT_VOID | JSWAT_THIS_ARG, (void (*)(void))jswrap_dgram_close},
+  {25, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)) | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*4)), (void (*)(void))jswrap_dgram_socket_send}
+};
+static const unsigned char jswSymbolIndex_dgramSocket_proto = 55;
+static const JswSymPtr jswSymbols_dgramSocket[] FLASH_SECT = {
+  
+};
+static const unsigned char jswSymbolIndex_dgramSocket = 56;
+static const JswSymPtr jswSymbols_tls[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_tls_connect}
+};
+static const unsigned char jswSymbolIndex_tls = 57;
+static const JswSymPtr jswSymbols_Server_proto[] FLASH_SECT = {
+  {0, JSWAT_VOID | JSWAT_THIS_ARG, (void (*)(void))jswrap_net_server_close},
+  {6, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))gen_jswrap_Server_listen}
+};
+static const unsigned char jswSymbolIndex_Server_proto = 58;
+static const JswSymPtr jswSymbols_httpSRq[] FLASH_SECT = {
+  
+};
+static const unsigned char jswSymbolIndex_httpSRq = 59;
+static const JswSymPtr jswSymbols_httpSRq_proto[] FLASH_SECT = {
+  {0, JSWAT_INT32 | JSWAT_THIS_ARG, (void (*)(void))jswrap_stream_available},
+  {10, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_pipe},
+  {15, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))jswrap_stream_read}
+};
+static const unsigned char jswSymbolIndex_httpSRq_proto = 60;
+static const JswSymPtr jswSymbols_httpSRs[] FLASH_SECT = {
+  
+};
+static const unsigned char jswSymbolIndex_httpSRs = 61;
+static const JswSymPtr jswSymbols_httpCRq[] FLASH_SECT = {
+  
+};
+static const unsigned char jswSymbolIndex_httpCRq = 62;
+static const JswSymPtr jswSymbols_httpCRs[] FLASH_SECT = {
+  
+};
+static const unsigned char jswSymbolIndex_httpCRs = 63;
+static const JswSymPtr jswSymbols_httpCRs_proto[] FLASH_SECT = {
+  {0, JSWAT_INT32 | JSWAT_THIS_ARG, (void (*)(void))jswrap_stream_available},
+  {10, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_pipe},
+  {15, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))jswrap_stream_read}
+};
+static const unsigned char jswSymbolIndex_httpCRs_proto = 64;
+static const JswSymPtr jswSymbols_http[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_http_createServer},
+  {13, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_http_get},
+  {17, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))gen_jswrap_http_request}
+};
+static const unsigned char jswSymbolIndex_http = 65;
+static const JswSymPtr jswSymbols_httpSrv_proto[] FLASH_SECT = {
+  {0, JSWAT_VOID | JSWAT_THIS_ARG, (void (*)(void))jswrap_net_server_close},
+  {6, JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)), (void (*)(void))gen_jswrap_httpSrv_listen}
+};
+static const unsigned char jswSymbolIndex_httpSrv_proto = 66;
+static const JswSymPtr jswSymbols_httpSRs_proto[] FLASH_SECT = {
+  {0, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_httpSRs_end},
+  {4, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_httpSRs_setHeader},
+  {14, JSWAT_BOOL | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_httpSRs_write},
+  {20, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_httpSRs_writeHead}
+};
+static const unsigned char jswSymbolIndex_httpSRs_proto = 67;
+static const JswSymPtr jswSymbols_httpCRq_proto[] FLASH_SECT = {
+  {0, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_net_socket_end},
+  {4, JSWAT_BOOL | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_net_socket_write}
+};
+static const unsigned char jswSymbolIndex_httpCRq_proto = 68;
+static const JswSymPtr jswSymbols_httpSrv[] FLASH_SECT = {
+  
+};
+static const unsigned char jswSymbolIndex_httpSrv = 69;
+static const JswSymPtr jswSymbols_httpWS[] FLASH_SECT = {
+  
+};
+static const unsigned char jswSymbolIndex_httpWS = 70;
+static const JswSymPtr jswSymbols_httpWS_proto[] FLASH_SECT = {
+  {0, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_httpWS_close},
+  {6, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_httpWS_ping},
+  {11, JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_httpWS_send}
+};
+static const unsigned char jswSymbolIndex_httpWS_proto = 71;
+static const JswSymPtr jswSymbols_NetworkJS[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_networkjs_create}
+};
+static const unsigned char jswSymbolIndex_NetworkJS = 72;
+static const JswSymPtr jswSymbols_TelnetServer[] FLASH_SECT = {
+  {0, JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))jswrap_telnet_setOptions}
+};
+static const unsigned char jswSymbolIndex_TelnetServer = 73;
+static const JswSymPtr jswSymbols_crypto[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_EXECUTE_IMMEDIATELY, (void (*)(void))gen_jswrap_crypto_AES},
+  {4, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)), (void (*)(void))jswrap_crypto_PBKDF2},
+  {11, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))gen_jswrap_crypto_SHA1},
+  {16, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))gen_jswrap_crypto_SHA224},
+  {23, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))gen_jswrap_crypto_SHA256},
+  {30, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))gen_jswrap_crypto_SHA384},
+  {37, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)), (void (*)(void))gen_jswrap_crypto_SHA512}
+};
+static const unsigned char jswSymbolIndex_crypto = 74;
+static const JswSymPtr jswSymbols_AES[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)), (void (*)(void))jswrap_crypto_AES_decrypt},
+  {8, JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)), (void (*)(void))jswrap_crypto_AES_encrypt}
+};
+static const unsigned char jswSymbolIndex_AES = 75;
+static const JswSymPtr jswSymbols_tensorflow[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)), (void (*)(void))jswrap_tensorflow_create}
+};
+static const unsigned char jswSymbolIndex_tensorflow = 76;
+static const JswSymPtr jswSymbols_TFMicroInterpreter_proto[] FLASH_SECT = {
+  {0, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_tfmicrointerpreter_getInput},
+  {9, JSWAT_JSVAR | JSWAT_THIS_ARG, (void (*)(void))jswrap_tfmicrointerpreter_getOutput},
+  {19, JSWAT_VOID | JSWAT_THIS_ARG, (void (*)(void))jswrap_tfmicrointerpreter_invoke}
+};
+static const unsigned char jswSymbolIndex_TFMicroInterpreter_proto = 77;
+
+
+FLASH_STR(jswSymbols_global_str, "AES\0Array\0ArrayBuffer\0ArrayBufferView\0Boolean\0DataView\0DataViewCodec\0Date\0E\0Error\0File\0Filter\0Float32Array\0Float64Array\0Function\0Graphics\0HIGH\0I2C\0I2C1\0I2C2\0I2C3\0Infinity\0Int16Array\0Int32Array\0Int8Array\0InternalError\0JSON\0LOW\0LoopbackA\0LoopbackB\0Math\0Modules\0NaN\0Number\0Object\0OneWire\0Pin\0Promise\0ReferenceError\0RegExp\0SPI\0SPI1\0SPI2\0SPI3\0Serial\0Serial1\0Serial2\0Serial3\0Serial4\0Serial5\0Serial6\0Server\0Socket\0StorageFile\0StorageLog\0String\0SyntaxError\0TFMicroInterpreter\0Telnet\0TypeError\0USB\0Uint16Array\0Uint24Array\0Uint32Array\0Uint8Array\0Uint8ClampedArray\0Waveform\0analogRead\0analogWrite\0arguments\0atob\0btoa\0changeInterval\0clearInterval\0clearTimeout\0clearWatch\0console\0decodeURIComponent\0dgramSocket\0digitalPulse\0digitalRead\0digitalWrite\0dump\0echo\0edit\0encodeURIComponent\0eval\0getPinMode\0getSerial\0getTime\0global\0httpCRq\0httpCRs\0httpSRq\0httpSRs\0httpSrv\0httpWS\0isFinite\0isNaN\0load\0parseFloat\0parseInt\0peek16\0peek32\0peek8\0pinMode\0poke16\0poke32\0poke8\0print\0process\0require\0reset\0save\0setBusyIndicator\0setInterval\0setSleepIndicator\0setTime\0setTimeout\0setWatch\0shiftOut\0trace\0url\0");
+FLASH_STR(jswSymbols_Array_proto_str, "concat\0every\0fill\0filter\0find\0findIndex\0forEach\0includes\0indexOf\0join\0length\0map\0pop\0push\0reduce\0reverse\0shift\0slice\0some\0sort\0splice\0toString\0unshift\0");
+FLASH_STR(jswSymbols_Array_str, "isArray\0");
+FLASH_STR(jswSymbols_ArrayBuffer_proto_str, "byteLength\0");
+FLASH_STR(jswSymbols_ArrayBufferView_proto_str, "buffer\0byteLength\0byteOffset\0fill\0filter\0find\0findIndex\0forEach\0includes\0indexOf\0join\0map\0reduce\0reverse\0set\0slice\0sort\0");
+FLASH_STR(jswSymbols_DataView_proto_str, "getFloat32\0getFloat64\0getInt16\0getInt32\0getInt8\0getUint16\0getUint32\0getUint8\0setFloat32\0setFloat64\0setInt16\0setInt32\0setInt8\0setUint16\0setUint32\0setUint8\0");
+FLASH_STR(jswSymbols_DataView_str, "compile\0");
+FLASH_STR(jswSymbols_DataViewCodec_proto_str, "pack\0unpack\0");
+FLASH_STR(jswSymbols_Date_str, "now\0parse\0");
+FLASH_STR(jswSymbols_Date_proto_str, "getDate\0getDay\0getFullYear\0getHours\0getMilliseconds\0getMinutes\0getMonth\0getSeconds\0getTime\0getTimezoneOffset\0setDate\0setFullYear\0setHours\0setMilliseconds\0setMinutes\0setMonth\0setSeconds\0setTime\0toISOString\0toString\0toUTCString\0valueOf\0");
+FLASH_STR(jswSymbols_Error_proto_str, "toString\0");
+FLASH_STR(jswSymbols_SyntaxError_proto_str, "toString\0");
+FLASH_STR(jswSymbols_TypeError_proto_str, "toString\0");
+FLASH_STR(jswSymbols_InternalError_proto_str, "toString\0");
+FLASH_STR(jswSymbols_ReferenceError_proto_str, "toString\0");
+FLASH_STR(jswSymbols_E_str, "CRC32\0FFT\0HSBtoRGB\0asm\0clip\0compiledC\0connectSDCard\0convolve\0defrag\0dumpFragmentation\0dumpFreeList\0dumpLockedVars\0dumpStr\0dumpTimers\0dumpVariables\0enableWatchdog\0getAddressOf\0getAnalogVRef\0getErrorFlags\0getFlags\0getIOStats\0getSizeOf\0getTemperature\0hwRand\0interpolate\0interpolate2d\0kickWatchdog\0lockConsole\0lookupNoCase\0mapInPlace\0memoryArea\0memoryMap\0nativeCall\0openFile\0pipe\0reboot\0reverseByte\0setBootCode\0setClock\0setFlags\0setIOLimit\0setPassword\0setTimeZone\0srand\0sum\0toArrayBuffer\0toJS\0toString\0toUint8Array\0unmountSD\0variance\0");
+FLASH_STR(jswSymbols_Filter_proto_str, "process\0reset\0");
+FLASH_STR(jswSymbols_Flash_str, "erasePage\0getFree\0getPage\0read\0write\0");
+FLASH_STR(jswSymbols_console_str, "log\0");
+FLASH_STR(jswSymbols_JSON_str, "parse\0stringify\0");
+FLASH_STR(jswSymbols_Modules_str, "addCached\0getCached\0removeAllCached\0removeCached\0");
+FLASH_STR(jswSymbols_Pin_proto_str, "getInfo\0getMode\0mode\0read\0reset\0set\0toggle\0write\0writeAtTime\0");
+FLASH_STR(jswSymbols_Number_str, "MAX_VALUE\0MIN_VALUE\0NEGATIVE_INFINITY\0NaN\0POSITIVE_INFINITY\0");
+FLASH_STR(jswSymbols_Number_proto_str, "toFixed\0");
+FLASH_STR(jswSymbols_Object_proto_str, "clone\0emit\0hasOwnProperty\0length\0on\0removeAllListeners\0removeListener\0toString\0valueOf\0");
+FLASH_STR(jswSymbols_Object_str, "assign\0create\0defineProperties\0defineProperty\0getOwnPropertyDescriptor\0getOwnPropertyNames\0getPrototypeOf\0keys\0setPrototypeOf\0");
+FLASH_STR(jswSymbols_Function_proto_str, "apply\0bind\0call\0replaceWith\0");
+FLASH_STR(jswSymbols_OneWire_proto_str, "read\0reset\0search\0search\0select\0skip\0write\0");
+FLASH_STR(jswSymbols_fs_str, "appendFile\0appendFileSync\0mkdir\0mkdirSync\0pipe\0readFile\0readFileSync\0readdir\0readdirSync\0statSync\0unlink\0unlinkSync\0writeFile\0writeFileSync\0");
+FLASH_STR(jswSymbols_process_str, "env\0memory\0version\0");
+FLASH_STR(jswSymbols_Promise_str, "all\0reject\0resolve\0");
+FLASH_STR(jswSymbols_Promise_proto_str, "catch\0then\0");
+FLASH_STR(jswSymbols_RegExp_proto_str, "exec\0test\0");
+FLASH_STR(jswSymbols_Serial_str, "find\0");
+FLASH_STR(jswSymbols_Serial_proto_str, "available\0inject\0pipe\0print\0println\0read\0setConsole\0setup\0unsetup\0write\0");
+FLASH_STR(jswSymbols_Storage_str, "compact\0erase\0eraseAll\0getFree\0getStats\0hash\0list\0open\0openLog\0read\0readArrayBuffer\0readJSON\0write\0");
+FLASH_STR(jswSymbols_StorageFile_proto_str, "erase\0read\0readLine\0write\0");
+FLASH_STR(jswSymbols_StorageLog_proto_str, "append\0erase\0find\0getInfo\0getTime\0read\0");
+FLASH_STR(jswSymbols_SPI_str, "find\0");
+FLASH_STR(jswSymbols_SPI_proto_str, "send\0send4bit\0send8bit\0setup\0write\0");
+FLASH_STR(jswSymbols_I2C_str, "find\0");
+FLASH_STR(jswSymbols_I2C_proto_str, "readFrom\0setup\0writeTo\0");
+FLASH_STR(jswSymbols_String_proto_str, "charAt\0charCodeAt\0endsWith\0includes\0indexOf\0lastIndexOf\0length\0match\0repeat\0replace\0slice\0split\0startsWith\0substr\0substring\0toLowerCase\0toUpperCase\0trim\0");
+FLASH_STR(jswSymbols_String_str, "fromCharCode\0");
+FLASH_STR(jswSymbols_Waveform_proto_str, "startInput\0startOutput\0stop\0");
+FLASH_STR(jswSymbols_heatshrink_str, "compress\0decompress\0");
+FLASH_STR(jswSymbols_File_proto_str, "close\0pipe\0read\0seek\0skip\0write\0");
+FLASH_STR(jswSymbols_Math_str, "E\0LN10\0LN2\0LOG10E\0LOG2E\0PI\0SQRT1_2\0SQRT2\0abs\0acos\0asin\0atan\0atan2\0ceil\0clip\0cos\0exp\0floor\0log\0max\0min\0pow\0random\0round\0sin\0sqrt\0tan\0wrap\0");
+FLASH_STR(jswSymbols_Graphics_str, "createArrayBuffer\0createCallback\0createImage\0getInstance\0");
+FLASH_STR(jswSymbols_Graphics_proto_str, "asBMP\0asImage\0asURL\0clear\0clearRect\0drawCircle\0drawEllipse\0drawImage\0drawLine\0drawPoly\0drawRect\0drawString\0dump\0fillCircle\0fillEllipse\0fillPoly\0fillRect\0getBgColor\0getColor\0getFont\0getFontHeight\0getFonts\0getHeight\0getModified\0getPixel\0getWidth\0lineTo\0moveTo\0reset\0scroll\0setBgColor\0setClipRect\0setColor\0setFont\0setFontAlign\0setFontBitmap\0setFontCustom\0setFontVector\0setPixel\0setRotation\0stringWidth\0toColor\0");
+FLASH_STR(jswSymbols_url_str, "parse\0");
+FLASH_STR(jswSymbols_Socket_str, "");
+FLASH_STR(jswSymbols_Socket_proto_str, "available\0end\0pipe\0read\0write\0");
+FLASH_STR(jswSymbols_net_str, "connect\0createServer\0");
+FLASH_STR(jswSymbols_dgram_str, "createSocket\0");
+FLASH_STR(jswSymbols_dgramSocket_proto_str, "addMembership\0bind\0close\0send\0");
+FLASH_STR(jswSymbols_dgramSocket_str, "");
+FLASH_STR(jswSymbols_tls_str, "connect\0");
+FLASH_STR(jswSymbols_Server_proto_str, "close\0listen\0");
+FLASH_STR(jswSymbols_httpSRq_str, "");
+FLASH_STR(jswSymbols_httpSRq_proto_str, "available\0pipe\0read\0");
+FLASH_STR(jswSymbols_httpSRs_str, "");
+FLASH_STR(jswSymbols_httpCRq_str, "");
+FLASH_STR(jswSymbols_httpCRs_str, "");
+FLASH_STR(jswSymbols_httpCRs_proto_str, "available\0pipe\0read\0");
+FLASH_STR(jswSymbols_http_str, "createServer\0get\0request\0");
+FLASH_STR(jswSymbols_httpSrv_proto_str, "close\0listen\0");
+FLASH_STR(jswSymbols_httpSRs_proto_str, "end\0setHeader\0write\0writeHead\0");
+FLASH_STR(jswSymbols_httpCRq_proto_str, "end\0write\0");
+FLASH_STR(jswSymbols_httpSrv_str, "");
+FLASH_STR(jswSymbols_httpWS_str, "");
+FLASH_STR(jswSymbols_httpWS_proto_str, "close\0ping\0send\0");
+FLASH_STR(jswSymbols_NetworkJS_str, "create\0");
+FLASH_STR(jswSymbols_TelnetServer_str, "setOptions\0");
+FLASH_STR(jswSymbols_crypto_str, "AES\0PBKDF2\0SHA1\0SHA224\0SHA256\0SHA384\0SHA512\0");
+FLASH_STR(jswSymbols_AES_str, "decrypt\0encrypt\0");
+FLASH_STR(jswSymbols_tensorflow_str, "create\0");
+FLASH_STR(jswSymbols_TFMicroInterpreter_proto_str, "getInput\0getOutput\0invoke\0");
+
+const JswSymList jswSymbolTables[] FLASH_SECT = {
+  {jswSymbols_global, jswSymbols_global_str, 123},
+  {jswSymbols_Array_proto, jswSymbols_Array_proto_str, 23},
+  {jswSymbols_Array, jswSymbols_Array_str, 1},
+  {jswSymbols_ArrayBuffer_proto, jswSymbols_ArrayBuffer_proto_str, 1},
+  {jswSymbols_ArrayBufferView_proto, jswSymbols_ArrayBufferView_proto_str, 17},
+  {jswSymbols_DataView_proto, jswSymbols_DataView_proto_str, 16},
+  {jswSymbols_DataView, jswSymbols_DataView_str, 1},
+  {jswSymbols_DataViewCodec_proto, jswSymbols_DataViewCodec_proto_str, 2},
+  {jswSymbols_Date, jswSymbols_Date_str, 2},
+  {jswSymbols_Date_proto, jswSymbols_Date_proto_str, 22},
+  {jswSymbols_Error_proto, jswSymbols_Error_proto_str, 1},
+  {jswSymbols_SyntaxError_proto, jswSymbols_SyntaxError_proto_str, 1},
+  {jswSymbols_TypeError_proto, jswSymbols_TypeError_proto_str, 1},
+  {jswSymbols_InternalError_proto, jswSymbols_InternalError_proto_str, 1},
+  {jswSymbols_ReferenceError_proto, jswSymbols_ReferenceError_proto_str, 1},
+  {jswSymbols_E, jswSymbols_E_str, 51},
+  {jswSymbols_Filter_proto, jswSymbols_Filter_proto_str, 2},
+  {jswSymbols_Flash, jswSymbols_Flash_str, 5},
+  {jswSymbols_console, jswSymbols_console_str, 1},
+  {jswSymbols_JSON, jswSymbols_JSON_str, 2},
+  {jswSymbols_Modules, jswSymbols_Modules_str, 4},
+  {jswSymbols_Pin_proto, jswSymbols_Pin_proto_str, 9},
+  {jswSymbols_Number, jswSymbols_Number_str, 5},
+  {jswSymbols_Number_proto, jswSymbols_Number_proto_str, 1},
+  {jswSymbols_Object_proto, jswSymbols_Object_proto_str, 9},
+  {jswSymbols_Object, jswSymbols_Object_str, 9},
+  {jswSymbols_Function_proto, jswSymbols_Function_proto_str, 4},
+  {jswSymbols_OneWire_proto, jswSymbols_OneWire_proto_str, 7},
+  {jswSymbols_fs, jswSymbols_fs_str, 14},
+  {jswSymbols_process, jswSymbols_process_str, 3},
+  {jswSymbols_Promise, jswSymbols_Promise_str, 3},
+  {jswSymbols_Promise_proto, jswSymbols_Promise_proto_str, 2},
+  {jswSymbols_RegExp_proto, jswSymbols_RegExp_proto_str, 2},
+  {jswSymbols_Serial, jswSymbols_Serial_str, 1},
+  {jswSymbols_Serial_proto, jswSymbols_Serial_proto_str, 10},
+  {jswSymbols_Storage, jswSymbols_Storage_str, 13},
+  {jswSymbols_StorageFile_proto, jswSymbols_StorageFile_proto_str, 4},
+  {jswSymbols_StorageLog_proto, jswSymbols_StorageLog_proto_str, 6},
+  {jswSymbols_SPI, jswSymbols_SPI_str, 1},
+  {jswSymbols_SPI_proto, jswSymbols_SPI_proto_str, 5},
+  {jswSymbols_I2C, jswSymbols_I2C_str, 1},
+  {jswSymbols_I2C_proto, jswSymbols_I2C_proto_str, 3},
+  {jswSymbols_String_proto, jswSymbols_String_proto_str, 18},
+  {jswSymbols_String, jswSymbols_String_str, 1},
+  {jswSymbols_Waveform_proto, jswSymbols_Waveform_proto_str, 3},
+  {jswSymbols_heatshrink, jswSymbols_heatshrink_str, 2},
+  {jswSymbols_File_proto, jswSymbols_File_proto_str, 6},
+  {jswSymbols_Math, jswSymbols_Math_str, 28},
+  {jswSymbols_Graphics, jswSymbols_Graphics_str, 4},
+  {jswSymbols_Graphics_proto, jswSymbols_Graphics_proto_str, 42},
+  {jswSymbols_url, jswSymbols_url_str, 1},
+  {jswSymbols_Socket, jswSymbols_Socket_str, 0},
+  {jswSymbols_Socket_proto, jswSymbols_Socket_proto_str, 5},
+  {jswSymbols_net, jswSymbols_net_str, 2},
+  {jswSymbols_dgram, jswSymbols_dgram_str, 1},
+  {jswSymbols_dgramSocket_proto, jswSymbols_dgramSocket_proto_str, 4},
+  {jswSymbols_dgramSocket, jswSymbols_dgramSocket_str, 0},
+  {jswSymbols_tls, jswSymbols_tls_str, 1},
+  {jswSymbols_Server_proto, jswSymbols_Server_proto_str, 2},
+  {jswSymbols_httpSRq, jswSymbols_httpSRq_str, 0},
+  {jswSymbols_httpSRq_proto, jswSymbols_httpSRq_proto_str, 3},
+  {jswSymbols_httpSRs, jswSymbols_httpSRs_str, 0},
+  {jswSymbols_httpCRq, jswSymbols_httpCRq_str, 0},
+  {jswSymbols_httpCRs, jswSymbols_httpCRs_str, 0},
+  {jswSymbols_httpCRs_proto, jswSymbols_httpCRs_proto_str, 3},
+  {jswSymbols_http, jswSymbols_http_str, 3},
+  {jswSymbols_httpSrv_proto, jswSymbols_httpSrv_proto_str, 2},
+  {jswSymbols_httpSRs_proto, jswSymbols_httpSRs_proto_str, 4},
+  {jswSymbols_httpCRq_proto, jswSymbols_httpCRq_proto_str, 2},
+  {jswSymbols_httpSrv, jswSymbols_httpSrv_str, 0},
+  {jswSymbols_httpWS, jswSymbols_httpWS_str, 0},
+  {jswSymbols_httpWS_proto, jswSymbols_httpWS_proto_str, 3},
+  {jswSymbols_NetworkJS, jswSymbols_NetworkJS_str, 1},
+  {jswSymbols_TelnetServer, jswSymbols_TelnetServer_str, 1},
+  {jswSymbols_crypto, jswSymbols_crypto_str, 7},
+  {jswSymbols_AES, jswSymbols_AES_str, 2},
+  {jswSymbols_tensorflow, jswSymbols_tensorflow_str, 1},
+  {jswSymbols_TFMicroInterpreter_proto, jswSymbols_TFMicroInterpreter_proto_str, 3},
+};
+
+
+const JswSymList *jswGetSymbolListForConstructorProto(JsVar *constructor) {
+  void *constructorPtr = constructor->varData.native.ptr;
+  if (constructorPtr==(void*)jswrap_dataview_constructor) return &jswSymbolTables[jswSymbolIndex_DataView_proto];
+  if (constructorPtr==(void*)gen_jswrap_DataViewCodec_DataViewCodec) return &jswSymbolTables[jswSymbolIndex_DataViewCodec_proto];
+  if (constructorPtr==(void*)jswrap_date_constructor) return &jswSymbolTables[jswSymbolIndex_Date_proto];
+  if (constructorPtr==(void*)jswrap_error_constructor) return &jswSymbolTables[jswSymbolIndex_Error_proto];
+  if (constructorPtr==(void*)jswrap_syntaxerror_constructor) return &jswSymbolTables[jswSymbolIndex_SyntaxError_proto];
+  if (constructorPtr==(void*)jswrap_typeerror_constructor) return &jswSymbolTables[jswSymbolIndex_TypeError_proto];
+  if (constructorPtr==(void*)jswrap_internalerror_constructor) return &jswSymbolTables[jswSymbolIndex_InternalError_proto];
+  if (constructorPtr==(void*)jswrap_referenceerror_constructor) return &jswSymbolTables[jswSymbolIndex_ReferenceError_proto];
+  if (constructorPtr==(void*)jswrap_filter_constructor) return &jswSymbolTables[jswSymbolIndex_Filter_proto];
+  if (constructorPtr==(void*)jswrap_onewire_constructor) return &jswSymbolTables[jswSymbolIndex_OneWire_proto];
+  if (constructorPtr==(void*)jswrap_promise_constructor) return &jswSymbolTables[jswSymbolIndex_Promise_proto];
+  if (constructorPtr==(void*)jswrap_regexp_constructor) return &jswSymbolTables[jswSymbolIndex_RegExp_proto];
+  if (constructorPtr==(void*)jswrap_serial_constructor) return &jswSymbolTables[jswSymbolIndex_Serial_proto];
+  if (constructorPtr==(void*)gen_jswrap_StorageFile_StorageFile) return &jswSymbolTables[jswSymbolIndex_StorageFile_proto];
+  if (constructorPtr==(void*)gen_jswrap_StorageLog_StorageLog) return &jswSymbolTables[jswSymbolIndex_StorageLog_proto];
+  if (constructorPtr==(void*)jswrap_spi_constructor) return &jswSymbolTables[jswSymbolIndex_SPI_proto];
+  if (constructorPtr==(void*)jswrap_i2c_constructor) return &jswSymbolTables[jswSymbolIndex_I2C_proto];
+  if (constructorPtr==(void*)jswrap_waveform_constructor) return &jswSymbolTables[jswSymbolIndex_Waveform_proto];
+  if (constructorPtr==(void*)gen_jswrap_File_File) return &jswSymbolTables[jswSymbolIndex_File_proto];
+  if (constructorPtr==(void*)gen_jswrap_Graphics_Graphics) return &jswSymbolTables[jswSymbolIndex_Graphics_proto];
+  if (constructorPtr==(void*)gen_jswrap_Socket_Socket) return &jswSymbolTables[jswSymbolIndex_Socket_proto];
+  if (constructorPtr==(void*)gen_jswrap_dgramSocket_dgramSocket) return &jswSymbolTables[jswSymbolIndex_dgramSocket_proto];
+  if (constructorPtr==(void*)gen_jswrap_Server_Server) return &jswSymbolTables[jswSymbolIndex_Server_proto];
+  if (constructorPtr==(void*)gen_jswrap_httpSRq_httpSRq) return &jswSymbolTables[jswSymbolIndex_httpSRq_proto];
+  if (constructorPtr==(void*)gen_jswrap_httpCRs_httpCRs) return &jswSymbolTables[jswSymbolIndex_httpCRs_proto];
+  if (constructorPtr==(void*)gen_jswrap_httpSrv_httpSrv) return &jswSymbolTables[jswSymbolIndex_httpSrv_proto];
+  if (constructorPtr==(void*)gen_jswrap_httpSRs_httpSRs) return &jswSymbolTables[jswSymbolIndex_httpSRs_proto];
+  if (constructorPtr==(void*)gen_jswrap_httpCRq_httpCRq) return &jswSymbolTables[jswSymbolIndex_httpCRq_proto];
+  if (constructorPtr==(void*)gen_jswrap_httpWS_httpWS) return &jswSymbolTables[jswSymbolIndex_httpWS_proto];
+  if (constructorPtr==(void*)gen_jswrap_TFMicroInterpreter_TFMicroInterpreter) return &jswSymbolTables[jswSymbolIndex_TFMicroInterpreter_proto];
+  return 0;
+}
+
+
+JsVar *jswFindBuiltInFunction(JsVar *parent, const char *name) {
+  JsVar *v;
+  if (parent && !jsvIsRoot(parent)) {
+    // ------------------------------------------ INSTANCE + STATIC METHODS
+    if (jsvIsNativeFunction(parent)) {
+      const JswSymList *l = jswGetSymbolListForObject(parent);
+      if (l) {
+        v = jswBinarySearch(l, parent, name);
+        if (v) return v;
+      }
+    }
+    if (jsvIsArray(parent)) {
+      v = jswBinarySearch(&jswSymbolTables[jswSymbolIndex_Array_proto], parent, name);
+      if (v) return v;
+    }
+    if (jsvIsArrayBuffer(parent) && parent->varData.arraybuffer.type==ARRAYBUFFERVIEW_ARRAYBUFFER) {
+      v = jswBinarySearch(&jswSymbolTables[jswSymbolIndex_ArrayBuffer_proto], parent, name);
+      if (v) return v;
+    }
+    if (jsvIsArrayBuffer(parent) && parent->varData.arraybuffer.type!=ARRAYBUFFERVIEW_ARRAYBUFFER) {
+      v = jswBinarySearch(&jswSymbolTables[jswSymbolIndex_ArrayBufferView_proto], parent, name);
+      if (v) return v;
+    }
+    if (jsvIsPin(parent)) {
+      v = jswBinarySearch(&jswSymbolTables[jswSymbolIndex_Pin_proto], parent, name);
+      if (v) return v;
+    }
+    if (jsvIsNumeric(parent)) {
+      v = jswBinarySearch(&jswSymbolTables[jswSymbolIndex_Number_proto], parent, name);
+      if (v) return v;
+    }
+    if (jsvIsFunction(parent)) {
+      v = jswBinarySearch(&jswSymbolTables[jswSymbolIndex_Function_proto], parent, name);
+      if (v) return v;
+    }
+    if (jsvIsString(parent)) {
+      v = jswBinarySearch(&jswSymbolTables[jswSymbolIndex_String_proto], parent, name);
+      if (v) return v;
+    }
+    // ------------------------------------------ INSTANCE METHODS WE MUST CHECK CONSTRUCTOR FOR
+    JsVar *proto = jsvIsObject(parent)?jsvSkipNameAndUnLock(jsvFindChildFromString(parent, JSPARSE_INHERITS_VAR, false)):0;
+    JsVar *constructor = jsvIsObject(proto)?jsvSkipNameAndUnLock(jsvFindChildFromString(proto, JSPARSE_CONSTRUCTOR_VAR, false)):0;
+    jsvUnLock(proto);
+    if (constructor && jsvIsNativeFunction(constructor)) {
+      const JswSymList *l = jswGetSymbolListForConstructorProto(constructor);
+      jsvUnLock(constructor);
+      if (l) {
+        v = jswBinarySearch(l, parent, name);
+        if (v) return v;
+      }
+    } else {
+      jsvUnLock(constructor);
+    }
+    // ------------------------------------------ METHODS ON OBJECT
+    v = jswBinarySearch(&jswSymbolTables[jswSymbolIndex_Object_proto], parent, name);
+    if (v) return v;
+  } else { /* if (!parent) */
+    // ------------------------------------------ FUNCTIONS
+    // Handle pin names - eg LED1 or D5 (this is hardcoded in build_jsfunctions.py)
+    Pin pin = jshGetPinFromString(name);
+    if (pin != PIN_UNDEFINED) {
+      return jsvNewFromPin(pin);
+    }
+    return jswBinarySearch(&jswSymbolTables[jswSymbolIndex_global], parent, name);
+  }
+  return 0;
+}
+
+
+const JswSymList *jswGetSymbolListForObject(JsVar *parent) {
+  if (jsvIsNativeFunction(parent)) {
+    if ((void*)parent->varData.native.ptr==(void*)jswrap_array_constructor) return &jswSymbolTables[jswSymbolIndex_Array];
+    if ((void*)parent->varData.native.ptr==(void*)jswrap_dataview_constructor) return &jswSymbolTables[jswSymbolIndex_DataView];
+    if ((void*)parent->varData.native.ptr==(void*)jswrap_date_constructor) return &jswSymbolTables[jswSymbolIndex_Date];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_E_E) return &jswSymbolTables[jswSymbolIndex_E];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_Flash_Flash) return &jswSymbolTables[jswSymbolIndex_Flash];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_console_console) return &jswSymbolTables[jswSymbolIndex_console];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_JSON_JSON) return &jswSymbolTables[jswSymbolIndex_JSON];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_Modules_Modules) return &jswSymbolTables[jswSymbolIndex_Modules];
+    if ((void*)parent->varData.native.ptr==(void*)jswrap_number_constructor) return &jswSymbolTables[jswSymbolIndex_Number];
+    if ((void*)parent->varData.native.ptr==(void*)jswrap_object_constructor) return &jswSymbolTables[jswSymbolIndex_Object];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_fs_fs) return &jswSymbolTables[jswSymbolIndex_fs];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_process_process) return &jswSymbolTables[jswSymbolIndex_process];
+    if ((void*)parent->varData.native.ptr==(void*)jswrap_promise_constructor) return &jswSymbolTables[jswSymbolIndex_Promise];
+    if ((void*)parent->varData.native.ptr==(void*)jswrap_serial_constructor) return &jswSymbolTables[jswSymbolIndex_Serial];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_Storage_Storage) return &jswSymbolTables[jswSymbolIndex_Storage];
+    if ((void*)parent->varData.native.ptr==(void*)jswrap_spi_constructor) return &jswSymbolTables[jswSymbolIndex_SPI];
+    if ((void*)parent->varData.native.ptr==(void*)jswrap_i2c_constructor) return &jswSymbolTables[jswSymbolIndex_I2C];
+    if ((void*)parent->varData.native.ptr==(void*)jswrap_string_constructor) return &jswSymbolTables[jswSymbolIndex_String];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_heatshrink_heatshrink) return &jswSymbolTables[jswSymbolIndex_heatshrink];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_Math_Math) return &jswSymbolTables[jswSymbolIndex_Math];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_Graphics_Graphics) return &jswSymbolTables[jswSymbolIndex_Graphics];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_url_url) return &jswSymbolTables[jswSymbolIndex_url];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_Socket_Socket) return &jswSymbolTables[jswSymbolIndex_Socket];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_net_net) return &jswSymbolTables[jswSymbolIndex_net];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_dgram_dgram) return &jswSymbolTables[jswSymbolIndex_dgram];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_dgramSocket_dgramSocket) return &jswSymbolTables[jswSymbolIndex_dgramSocket];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_tls_tls) return &jswSymbolTables[jswSymbolIndex_tls];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_httpSRq_httpSRq) return &jswSymbolTables[jswSymbolIndex_httpSRq];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_httpSRs_httpSRs) return &jswSymbolTables[jswSymbolIndex_httpSRs];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_httpCRq_httpCRq) return &jswSymbolTables[jswSymbolIndex_httpCRq];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_httpCRs_httpCRs) return &jswSymbolTables[jswSymbolIndex_httpCRs];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_http_http) return &jswSymbolTables[jswSymbolIndex_http];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_httpSrv_httpSrv) return &jswSymbolTables[jswSymbolIndex_httpSrv];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_httpWS_httpWS) return &jswSymbolTables[jswSymbolIndex_httpWS];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_NetworkJS_NetworkJS) return &jswSymbolTables[jswSymbolIndex_NetworkJS];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_TelnetServer_TelnetServer) return &jswSymbolTables[jswSymbolIndex_TelnetServer];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_crypto_crypto) return &jswSymbolTables[jswSymbolIndex_crypto];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_AES_AES) return &jswSymbolTables[jswSymbolIndex_AES];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_tensorflow_tensorflow) return &jswSymbolTables[jswSymbolIndex_tensorflow];
+  }
+  if (parent==execInfo.root) return &jswSymbolTables[jswSymbolIndex_global];
+  return 0;
+}
+
+
+const JswSymList *jswGetSymbolListForObjectProto(JsVar *parent) {
+  if (jsvIsNativeFunction(parent)) {
+    if ((void*)parent->varData.native.ptr==(void*)jswrap_array_constructor) return &jswSymbolTables[jswSymbolIndex_Array_proto];
+    if ((void*)parent->varData.native.ptr==(void*)jswrap_arraybuffer_constructor) return &jswSymbolTables[jswSymbolIndex_ArrayBuffer_proto];
+    if ((void*)parent->varData.native.ptr==(void*)gen_jswrap_ArrayBufferView_ArrayBufferView) return &jswSymbolTables[jswSymbolIndex_ArrayBufferView_proto];
+    if ((void*)parent->varData.native.ptr==(void*)jswrap_pin_constructor) return &jswSymbolTables[jswSymbolIndex_Pin_proto];
+    if ((void*)parent->varData.native.ptr==(void*)jswrap_number_constructor) return &jswSymbolTables[jswSymbolIndex_Number_proto];
+    if ((void*)parent->varData.native.ptr==(void*)jswrap_function_constructor) return &jswSymbolTables[jswSymbolIndex_Function_proto];
+    if ((void*)parent->varData.native.ptr==(void*)jswrap_string_constructor) return &jswSymbolTables[jswSymbolIndex_String_proto];
+  }
+  JsVar *constructor = jsvIsObject(parent)?jsvSkipNameAndUnLock(jsvFindChildFromString(parent, JSPARSE_CONSTRUCTOR_VAR, false)):0;
+  if (constructor && jsvIsNativeFunction(constructor)) {
+    const JswSymList *l = jswGetSymbolListForConstructorProto(constructor);
+    jsvUnLock(constructor);
+    if (l) return l;
+  }
+  if (jsvIsArray(parent)) return &jswSymbolTables[jswSymbolIndex_Array_proto];
+  if (jsvIsArrayBuffer(parent) && parent->varData.arraybuffer.type==ARRAYBUFFERVIEW_ARRAYBUFFER) return &jswSymbolTables[jswSymbolIndex_ArrayBuffer_proto];
+  if (jsvIsArrayBuffer(parent) && parent->varData.arraybuffer.type!=ARRAYBUFFERVIEW_ARRAYBUFFER) return &jswSymbolTables[jswSymbolIndex_ArrayBufferView_proto];
+  if (jsvIsPin(parent)) return &jswSymbolTables[jswSymbolIndex_Pin_proto];
+  if (jsvIsNumeric(parent)) return &jswSymbolTables[jswSymbolIndex_Number_proto];
+  if (jsvIsFunction(parent)) return &jswSymbolTables[jswSymbolIndex_Function_proto];
+  if (jsvIsString(parent)) return &jswSymbolTables[jswSymbolIndex_String_proto];
+  return &jswSymbolTables[jswSymbolIndex_Object_proto];
+}
+
+
+bool jswIsBuiltInObject(const char *name) {
+  return
+strcmp(name, "Array")==0 ||
+    strcmp(name, "ArrayBuffer")==0 ||
+    strcmp(name, "ArrayBufferView")==0 ||
+    strcmp(name, "Uint8Array")==0 ||
+    strcmp(name, "Uint8ClampedArray")==0 ||
+    strcmp(name, "Int8Array")==0 ||
+    strcmp(name, "Uint16Array")==0 ||
+    strcmp(name, "Int16Array")==0 ||
+    strcmp(name, "Uint24Array")==0 ||
+    strcmp(name, "Uint32Array")==0 ||
+    strcmp(name, "Int32Array")==0 ||
+    strcmp(name, "Float32Array")==0 ||
+    strcmp(name, "Float64Array")==0 ||
+    strcmp(name, "DataView")==0 ||
+    strcmp(name, "DataViewCodec")==0 ||
+    strcmp(name, "Date")==0 ||
+    strcmp(name, "Error")==0 ||
+    strcmp(name, "SyntaxError")==0 ||
+    strcmp(name, "TypeError")==0 ||
+    strcmp(name, "InternalError")==0 ||
+    strcmp(name, "ReferenceError")==0 ||
+    strcmp(name, "E")==0 ||
+    strcmp(name, "Filter")==0 ||
+    strcmp(name, "Function")==0 ||
+    strcmp(name, "console")==0 ||
+    strcmp(name, "JSON")==0 ||
+    strcmp(name, "Modules")==0 ||
+    strcmp(name, "Pin")==0 ||
+    strcmp(name, "Number")==0 ||
+    strcmp(name, "Object")==0 ||
+    strcmp(name, "Boolean")==0 ||
+    strcmp(name, "OneWire")==0 ||
+    strcmp(name, "process")==0 ||
+    strcmp(name, "Promise")==0 ||
+    strcmp(name, "RegExp")==0 ||
+    strcmp(name, "Serial")==0 ||
+    strcmp(name, "StorageFile")==0 ||
+    strcmp(name, "StorageLog")==0 ||
+    strcmp(name, "SPI")==0 ||
+    strcmp(name, "I2C")==0 ||
+    strcmp(name, "String")==0 ||
+    strcmp(name, "Waveform")==0 ||
+    strcmp(name, "File")==0 ||
+    strcmp(name, "Math")==0 ||
+    strcmp(name, "Graphics")==0 ||
+    strcmp(name, "url")==0 ||
+    strcmp(name, "Server")==0 ||
+    strcmp(name, "Socket")==0 ||
+    strcmp(name, "dgramSocket")==0 ||
+    strcmp(name, "httpSrv")==0 ||
+    strcmp(name, "httpSRq")==0 ||
+    strcmp(name, "httpSRs")==0 ||
+    strcmp(name, "httpCRq")==0 ||
+    strcmp(name, "httpCRs")==0 ||
+    strcmp(name, "httpWS")==0 ||
+    strcmp(name, "AES")==0 ||
+    strcmp(name, "TFMicroInterpreter")==0;
+}
+
+
+void *jswGetBuiltInLibrary(const char *name) {
+  if (strcmp(name, "Flash")==0) return (void*)gen_jswrap_Flash_Flash;
+  if (strcmp(name, "Storage")==0) return (void*)gen_jswrap_Storage_Storage;
+  if (strcmp(name, "heatshrink")==0) return (void*)gen_jswrap_heatshrink_heatshrink;
+  if (strcmp(name, "fs")==0) return (void*)gen_jswrap_fs_fs;
+  if (strcmp(name, "net")==0) return (void*)gen_jswrap_net_net;
+  if (strcmp(name, "dgram")==0) return (void*)gen_jswrap_dgram_dgram;
+  if (strcmp(name, "tls")==0) return (void*)gen_jswrap_tls_tls;
+  if (strcmp(name, "http")==0) return (void*)gen_jswrap_http_http;
+  if (strcmp(name, "NetworkJS")==0) return (void*)gen_jswrap_NetworkJS_NetworkJS;
+  if (strcmp(name, "TelnetServer")==0) return (void*)gen_jswrap_TelnetServer_TelnetServer;
+  if (strcmp(name, "crypto")==0) return (void*)gen_jswrap_crypto_crypto;
+  if (strcmp(name, "tensorflow")==0) return (void*)gen_jswrap_tensorflow_tensorflow;
+  return 0;
+}
+
+
+/** Given a variable, return the basic object name of it */
+const char *jswGetBasicObjectName(JsVar *var) {
+  if (jsvIsArray(var)) return "Array";
+  if (jsvIsArrayBuffer(var) && var->varData.arraybuffer.type==ARRAYBUFFERVIEW_ARRAYBUFFER) return "ArrayBuffer";
+  if (jsvIsArrayBuffer(var) && var->varData.arraybuffer.type==ARRAYBUFFERVIEW_UINT8) return "Uint8Array";
+  if (jsvIsArrayBuffer(var) && var->varData.arraybuffer.type==(ARRAYBUFFERVIEW_UINT8|ARRAYBUFFERVIEW_CLAMPED)) return "Uint8ClampedArray";
+  if (jsvIsArrayBuffer(var) && var->varData.arraybuffer.type==ARRAYBUFFERVIEW_INT8) return "Int8Array";
+  if (jsvIsArrayBuffer(var) && var->varData.arraybuffer.type==ARRAYBUFFERVIEW_UINT16) return "Uint16Array";
+  if (jsvIsArrayBuffer(var) && var->varData.arraybuffer.type==ARRAYBUFFERVIEW_INT16) return "Int16Array";
+  if (jsvIsArrayBuffer(var) && var->varData.arraybuffer.type==ARRAYBUFFERVIEW_UINT24) return "Uint24Array";
+  if (jsvIsArrayBuffer(var) && var->varData.arraybuffer.type==ARRAYBUFFERVIEW_UINT32) return "Uint32Array";
+  if (jsvIsArrayBuffer(var) && var->varData.arraybuffer.type==ARRAYBUFFERVIEW_INT32) return "Int32Array";
+  if (jsvIsArrayBuffer(var) && var->varData.arraybuffer.type==ARRAYBUFFERVIEW_FLOAT32) return "Float32Array";
+  if (jsvIsArrayBuffer(var) && var->varData.arraybuffer.type==ARRAYBUFFERVIEW_FLOAT64) return "Float64Array";
+  if (jsvIsPin(var)) return "Pin";
+  if (jsvIsNumeric(var)) return "Number";
+  if (jsvIsObject(var)) return "Object";
+  if (jsvIsFunction(var)) return "Function";
+  if (jsvIsString(var)) return "String";
+  return 0;
+}
+
+
+/** Given the name of a Basic Object, eg, Uint8Array, String, etc. Return the prototype object's name - or 0. */
+const char *jswGetBasicObjectPrototypeName(const char *objectName) {
+  if (!strcmp(objectName, "Uint8Array")) return "ArrayBufferView";
+  if (!strcmp(objectName, "Uint8ClampedArray")) return "ArrayBufferView";
+  if (!strcmp(objectName, "Int8Array")) return "ArrayBufferView";
+  if (!strcmp(objectName, "Uint16Array")) return "ArrayBufferView";
+  if (!strcmp(objectName, "Int16Array")) return "ArrayBufferView";
+  if (!strcmp(objectName, "Uint24Array")) return "ArrayBufferView";
+  if (!strcmp(objectName, "Uint32Array")) return "ArrayBufferView";
+  if (!strcmp(objectName, "Int32Array")) return "ArrayBufferView";
+  if (!strcmp(objectName, "Float32Array")) return "ArrayBufferView";
+  if (!strcmp(objectName, "Float64Array")) return "ArrayBufferView";
+  return strcmp(objectName,"Object") ? "Object" : 0;
+}
+
+
+/** Tasks to run on Idle. Returns true if either one of the tasks returned true (eg. they're doing something and want to avoid sleeping) */
+bool jswIdle() {
+  bool wasBusy = false;
+  if (jswrap_pipe_idle()) wasBusy = true;
+  if (jswrap_serial_idle()) wasBusy = true;
+  if (jswrap_storage_idle()) wasBusy = true;
+  if (jswrap_waveform_idle()) wasBusy = true;
+  if (jswrap_graphics_idle()) wasBusy = true;
+  if (jswrap_net_idle()) wasBusy = true;
+  if (jswrap_telnet_idle()) wasBusy = true;
+  return wasBusy;
+}
+
+
+/** Tasks to run on Initialisation */
+void jswInit() {
+  jswrap_graphics_init();
+  jswrap_net_init();
+  jswrap_telnet_init();
+}
+
+
+/** Tasks to run on Deinitialisation */
+void jswKill() {
+  jswrap_pipe_kill();
+  jswrap_waveform_kill();
+  jswrap_file_kill();
+  jswrap_net_kill();
+  jswrap_telnet_kill();
+}
+/** Tasks to run on Deinitialisation */
+bool jswOnCharEvent(IOEventFlags channel, char charData) {
+  return false;
+}
+/** If we have a built-in module with the given name, return the module's contents - or 0 */
+const char *jswGetBuiltInJSLibrary(const char *name) {
+  return 0;
+}
+
+
+const char *jswGetBuiltInLibraryNames() {
+  return "Flash,Storage,heatshrink,fs,net,dgram,tls,http,NetworkJS,TelnetServer,crypto,tensorflow";
+}
+#ifdef EMSCRIPTEN
+// on Emscripten we cant easily hack around function calls with floats/etc so we must just do this brute-force by handling every call pattern we use
+JsVar *jswCallFunctionHack(void *function, JsnArgumentType argumentSpecifier, JsVar *thisParam, JsVar **paramData, int paramCount) {
+  switch(argumentSpecifier) {
+    case JSWAT_JSVAR | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      JsVar *argArray = (paramCount>0)?jsvNewArray(&paramData[0],paramCount-0):jsvNewEmptyArray();
+
+      result = (((JsVar*(*)(JsVar*))function)(argArray));
+      jsvUnLock(argArray);
+
+
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,JsVar*))function)(thisParam,((paramCount>0)?paramData[0]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | JSWAT_EXECUTE_IMMEDIATELY: {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*))function)(thisParam));
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,JsVar*,JsVarInt))function)(thisParam,((paramCount>0)?paramData[0]:0),jsvGetInteger((paramCount>1)?paramData[1]:0)));
+      return result;
+    }
+    case JSWAT_BOOL | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      result = jsvNewFromBool(((bool(*)(JsVar*,JsVar*,JsVarInt))function)(thisParam,((paramCount>0)?paramData[0]:0),jsvGetInteger((paramCount>1)?paramData[1]:0)));
+      return result;
+    }
+    case JSWAT_INT32 | JSWAT_THIS_ARG | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      JsVar *argArray = (paramCount>0)?jsvNewArray(&paramData[0],paramCount-0):jsvNewEmptyArray();
+
+      result = jsvNewFromInteger(((JsVarInt(*)(JsVar*,JsVar*))function)(thisParam,argArray));
+      jsvUnLock(argArray);
+
+
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG: {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*))function)(thisParam));
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,JsVar*,JsVar*))function)(thisParam,((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0)));
+      return result;
+    }
+    case JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      ((void(*)(JsVar*,JsVar*,JsVar*))function)(thisParam,((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0));
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      JsVar *argArray = (paramCount>2)?jsvNewArray(&paramData[2],paramCount-2):jsvNewEmptyArray();
+
+      result = (((JsVar*(*)(JsVar*,JsVarInt,JsVar*,JsVar*))function)(thisParam,jsvGetInteger((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0),argArray));
+      jsvUnLock(argArray);
+
+
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,JsVarInt,JsVar*))function)(thisParam,jsvGetInteger((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0)));
+      return result;
+    }
+    case JSWAT_BOOL | (JSWAT_JSVAR << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      result = jsvNewFromBool(((bool(*)(JsVar*))function)(((paramCount>0)?paramData[0]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      JsVar *argArray = (paramCount>0)?jsvNewArray(&paramData[0],paramCount-0):jsvNewEmptyArray();
+
+      result = (((JsVar*(*)(JsVar*,JsVar*))function)(thisParam,argArray));
+      jsvUnLock(argArray);
+
+
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,JsVar*,JsVarInt,JsVar*))function)(thisParam,((paramCount>0)?paramData[0]:0),jsvGetInteger((paramCount>1)?paramData[1]:0),((paramCount>2)?paramData[2]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | (JSWAT_INT32 << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVarInt))function)(jsvGetInteger((paramCount>0)?paramData[0]:0)));
+      return result;
+    }
+    case JSWAT_INT32 | JSWAT_THIS_ARG | JSWAT_EXECUTE_IMMEDIATELY: {
+      JsVar *result = 0;
+      result = jsvNewFromInteger(((JsVarInt(*)(JsVar*))function)(thisParam));
+      return result;
+    }
+    case JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,JsVarInt,JsVarInt))function)(((paramCount>0)?paramData[0]:0),jsvGetInteger((paramCount>1)?paramData[1]:0),jsvGetInteger((paramCount>2)?paramData[2]:0)));
+      return result;
+    }
+    case JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      ((void(*)(JsVar*,JsVar*,int))function)(thisParam,((paramCount>0)?paramData[0]:0),jsvGetInteger((paramCount>1)?paramData[1]:0));
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_BOOL << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,JsVarInt,bool))function)(thisParam,jsvGetInteger((paramCount>0)?paramData[0]:0),jsvGetBool((paramCount>1)?paramData[1]:0)));
+      return result;
+    }
+    case JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_BOOL << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      ((void(*)(JsVar*,JsVarInt,JsVar*,bool))function)(thisParam,jsvGetInteger((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0),jsvGetBool((paramCount>2)?paramData[2]:0));
+      return result;
+    }
+    case JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,JsVar*))function)(((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,JsVar*,JsVarInt,JsVarInt))function)(thisParam,((paramCount>0)?paramData[0]:0),jsvGetInteger((paramCount>1)?paramData[1]:0),jsvGetInteger((paramCount>2)?paramData[2]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,JsVar*,JsVar*,JsVarInt))function)(thisParam,((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0),jsvGetInteger((paramCount>2)?paramData[2]:0)));
+      return result;
+    }
+    case JSWAT_JSVARFLOAT: {
+      JsVar *result = 0;
+      result = jsvNewFromFloat(((JsVarFloat(*)())function)());
+      return result;
+    }
+    case JSWAT_INT32 | JSWAT_THIS_ARG: {
+      JsVar *result = 0;
+      result = jsvNewFromInteger(((int(*)(JsVar*))function)(thisParam));
+      return result;
+    }
+    case JSWAT_JSVARFLOAT | JSWAT_THIS_ARG: {
+      JsVar *result = 0;
+      result = jsvNewFromFloat(((JsVarFloat(*)(JsVar*))function)(thisParam));
+      return result;
+    }
+    case JSWAT_JSVARFLOAT | JSWAT_THIS_ARG | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      result = jsvNewFromFloat(((JsVarFloat(*)(JsVar*,JsVarFloat))function)(thisParam,jsvGetFloat((paramCount>0)?paramData[0]:0)));
+      return result;
+    }
+    case JSWAT_JSVARFLOAT | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)) | (JSWAT_JSVAR << (JSWAT_BITS*4)): {
+      JsVar *result = 0;
+      result = jsvNewFromFloat(((JsVarFloat(*)(JsVar*,JsVarInt,JsVar*,JsVar*,JsVar*))function)(thisParam,jsvGetInteger((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0),((paramCount>2)?paramData[2]:0),((paramCount>3)?paramData[3]:0)));
+      return result;
+    }
+    case JSWAT_JSVARFLOAT | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      result = jsvNewFromFloat(((JsVarFloat(*)(JsVar*,JsVarInt,JsVar*,JsVar*))function)(thisParam,jsvGetInteger((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0),((paramCount>2)?paramData[2]:0)));
+      return result;
+    }
+    case JSWAT_JSVARFLOAT | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      result = jsvNewFromFloat(((JsVarFloat(*)(JsVar*,JsVarInt,JsVar*))function)(thisParam,jsvGetInteger((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0)));
+      return result;
+    }
+    case JSWAT_JSVARFLOAT | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      result = jsvNewFromFloat(((JsVarFloat(*)(JsVar*,JsVarInt))function)(thisParam,jsvGetInteger((paramCount>0)?paramData[0]:0)));
+      return result;
+    }
+    case JSWAT_JSVARFLOAT | (JSWAT_JSVAR << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      result = jsvNewFromFloat(((JsVarFloat(*)(JsVar*))function)(((paramCount>0)?paramData[0]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*))function)(((paramCount>0)?paramData[0]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVarInt,JsVar*,JsVar*))function)(jsvGetInteger((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0),((paramCount>2)?paramData[2]:0)));
+      return result;
+    }
+    case JSWAT_JSVARFLOAT | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      result = jsvNewFromFloat(((JsVarFloat(*)(JsVarFloat,JsVarFloat,JsVarFloat))function)(jsvGetFloat((paramCount>0)?paramData[0]:0),jsvGetFloat((paramCount>1)?paramData[1]:0),jsvGetFloat((paramCount>2)?paramData[2]:0)));
+      return result;
+    }
+    case JSWAT_JSVARFLOAT | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      result = jsvNewFromFloat(((JsVarFloat(*)(JsVar*,JsVarFloat))function)(((paramCount>0)?paramData[0]:0),jsvGetFloat((paramCount>1)?paramData[1]:0)));
+      return result;
+    }
+    case JSWAT_JSVARFLOAT | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      result = jsvNewFromFloat(((JsVarFloat(*)(JsVar*,JsVar*,int))function)(((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0),jsvGetInteger((paramCount>2)?paramData[2]:0)));
+      return result;
+    }
+    case JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_BOOL << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      ((void(*)(JsVar*,JsVar*,bool))function)(((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0),jsvGetBool((paramCount>2)?paramData[2]:0));
+      return result;
+    }
+    case JSWAT_JSVARFLOAT | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*3)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*4)): {
+      JsVar *result = 0;
+      result = jsvNewFromFloat(((JsVarFloat(*)(JsVar*,int,JsVarFloat,JsVarFloat))function)(((paramCount>0)?paramData[0]:0),jsvGetInteger((paramCount>1)?paramData[1]:0),jsvGetFloat((paramCount>2)?paramData[2]:0),jsvGetFloat((paramCount>3)?paramData[3]:0)));
+      return result;
+    }
+    case JSWAT_VOID | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      ((void(*)(JsVarFloat,JsVar*))function)(jsvGetFloat((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0));
+      return result;
+    }
+    case JSWAT_VOID: {
+      JsVar *result = 0;
+      ((void(*)())function)();
+      return result;
+    }
+    case JSWAT_JSVAR: {
+      JsVar *result = 0;
+      result = (((JsVar*(*)())function)());
+      return result;
+    }
+    case JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      ((void(*)(JsVar*,JsVarInt))function)(((paramCount>0)?paramData[0]:0),jsvGetInteger((paramCount>1)?paramData[1]:0));
+      return result;
+    }
+    case JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      ((void(*)(JsVar*))function)(((paramCount>0)?paramData[0]:0));
+      return result;
+    }
+    case JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      ((void(*)(JsVar*,JsVar*,JsVar*))function)(((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0),((paramCount>2)?paramData[2]:0));
+      return result;
+    }
+    case JSWAT_JSVAR | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVarInt,JsVarInt))function)(jsvGetInteger((paramCount>0)?paramData[0]:0),jsvGetInteger((paramCount>1)?paramData[1]:0)));
+      return result;
+    }
+    case JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_BOOL << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      ((void(*)(JsVar*,bool))function)(((paramCount>0)?paramData[0]:0),jsvGetBool((paramCount>1)?paramData[1]:0));
+      return result;
+    }
+    case JSWAT_INT32 | (JSWAT_JSVAR << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      result = jsvNewFromInteger(((JsVarInt(*)(JsVar*))function)(((paramCount>0)?paramData[0]:0)));
+      return result;
+    }
+    case JSWAT_INT32 | (JSWAT_INT32 << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      result = jsvNewFromInteger(((int(*)(int))function)(jsvGetInteger((paramCount>0)?paramData[0]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,JsVarInt))function)(((paramCount>0)?paramData[0]:0),jsvGetInteger((paramCount>1)?paramData[1]:0)));
+      return result;
+    }
+    case JSWAT_INT32 | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_BOOL << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      result = jsvNewFromInteger(((JsVarInt(*)(JsVar*,bool))function)(((paramCount>0)?paramData[0]:0),jsvGetBool((paramCount>1)?paramData[1]:0)));
+      return result;
+    }
+    case JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)) | (JSWAT_INT32 << (JSWAT_BITS*4)): {
+      JsVar *result = 0;
+      ((void(*)(JsVar*,JsVar*,JsVar*,JsVarInt))function)(((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0),((paramCount>2)?paramData[2]:0),jsvGetInteger((paramCount>3)?paramData[3]:0));
+      return result;
+    }
+    case JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_BOOL << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,JsVar*,bool))function)(((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0),jsvGetBool((paramCount>2)?paramData[2]:0)));
+      return result;
+    }
+    case JSWAT_VOID | (JSWAT_INT32 << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      ((void(*)(JsVarInt))function)(jsvGetInteger((paramCount>0)?paramData[0]:0));
+      return result;
+    }
+    case JSWAT_INT32: {
+      JsVar *result = 0;
+      result = jsvNewFromInteger(((int(*)())function)());
+      return result;
+    }
+    case JSWAT_JSVAR | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*3)) | (JSWAT_BOOL << (JSWAT_BITS*4)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVarFloat,JsVarFloat,JsVarFloat,bool))function)(jsvGetFloat((paramCount>0)?paramData[0]:0),jsvGetFloat((paramCount>1)?paramData[1]:0),jsvGetFloat((paramCount>2)?paramData[2]:0),jsvGetBool((paramCount>3)?paramData[3]:0)));
+      return result;
+    }
+    case JSWAT_VOID | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      ((void(*)(JsVarFloat))function)(jsvGetFloat((paramCount>0)?paramData[0]:0));
+      return result;
+    }
+    case JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      JsVar *argArray = (paramCount>1)?jsvNewArray(&paramData[1],paramCount-1):jsvNewEmptyArray();
+
+      ((void(*)(JsVar*,JsVar*))function)(((paramCount>0)?paramData[0]:0),argArray);
+      jsvUnLock(argArray);
+
+
+      return result;
+    }
+    case JSWAT_VOID | JSWAT_THIS_ARG: {
+      JsVar *result = 0;
+      ((void(*)(JsVar*))function)(thisParam);
+      return result;
+    }
+    case JSWAT_INT32 | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      result = jsvNewFromInteger(((JsVarInt(*)(JsVar*,JsVar*,JsVar*))function)(thisParam,((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_EXECUTE_IMMEDIATELY: {
+      JsVar *result = 0;
+      result = (((JsVar*(*)())function)());
+      return result;
+    }
+    case JSWAT_VOID | (JSWAT_BOOL << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      ((void(*)(bool))function)(jsvGetBool((paramCount>0)?paramData[0]:0));
+      return result;
+    }
+    case JSWAT_VOID | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      JsVar *argArray = (paramCount>0)?jsvNewArray(&paramData[0],paramCount-0):jsvNewEmptyArray();
+
+      ((void(*)(JsVar*))function)(argArray);
+      jsvUnLock(argArray);
+
+
+      return result;
+    }
+    case JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)) | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      JsVar *argArray = (paramCount>2)?jsvNewArray(&paramData[2],paramCount-2):jsvNewEmptyArray();
+
+      result = (((JsVar*(*)(JsVar*,JsVarFloat,JsVar*))function)(((paramCount>0)?paramData[0]:0),jsvGetFloat((paramCount>1)?paramData[1]:0),argArray));
+      jsvUnLock(argArray);
+
+
+      return result;
+    }
+    case JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      ((void(*)(JsVar*,JsVarFloat))function)(((paramCount>0)?paramData[0]:0),jsvGetFloat((paramCount>1)?paramData[1]:0));
+      return result;
+    }
+    case JSWAT_VOID | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      ((void(*)(JsVarInt,JsVar*))function)(jsvGetInteger((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0));
+      return result;
+    }
+    case JSWAT_JSVARFLOAT | (JSWAT_PIN << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      result = jsvNewFromFloat(((JsVarFloat(*)(Pin))function)(jshGetPinFromVar((paramCount>0)?paramData[0]:0)));
+      return result;
+    }
+    case JSWAT_VOID | (JSWAT_PIN << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      ((void(*)(Pin,JsVarFloat,JsVar*))function)(jshGetPinFromVar((paramCount>0)?paramData[0]:0),jsvGetFloat((paramCount>1)?paramData[1]:0),((paramCount>2)?paramData[2]:0));
+      return result;
+    }
+    case JSWAT_VOID | (JSWAT_PIN << (JSWAT_BITS*1)) | (JSWAT_BOOL << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      ((void(*)(Pin,bool,JsVar*))function)(jshGetPinFromVar((paramCount>0)?paramData[0]:0),jsvGetBool((paramCount>1)?paramData[1]:0),((paramCount>2)?paramData[2]:0));
+      return result;
+    }
+    case JSWAT_VOID | (JSWAT_PIN << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_BOOL << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      ((void(*)(Pin,JsVar*,bool))function)(jshGetPinFromVar((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0),jsvGetBool((paramCount>2)?paramData[2]:0));
+      return result;
+    }
+    case JSWAT_JSVAR | (JSWAT_PIN << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(Pin))function)(jshGetPinFromVar((paramCount>0)?paramData[0]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_PIN << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,Pin,JsVar*))function)(((paramCount>0)?paramData[0]:0),jshGetPinFromVar((paramCount>1)?paramData[1]:0),((paramCount>2)?paramData[2]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,JsVar*,JsVar*))function)(((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0),((paramCount>2)?paramData[2]:0)));
+      return result;
+    }
+    case JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      ((void(*)(JsVar*,JsVar*))function)(((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0));
+      return result;
+    }
+    case JSWAT_BOOL | JSWAT_THIS_ARG: {
+      JsVar *result = 0;
+      result = jsvNewFromBool(((bool(*)(JsVar*))function)(thisParam));
+      return result;
+    }
+    case JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_BOOL << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      ((void(*)(JsVar*,bool))function)(thisParam,jsvGetBool((paramCount>0)?paramData[0]:0));
+      return result;
+    }
+    case JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_BOOL << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      ((void(*)(JsVar*,bool,JsVarFloat))function)(thisParam,jsvGetBool((paramCount>0)?paramData[0]:0),jsvGetFloat((paramCount>1)?paramData[1]:0));
+      return result;
+    }
+    case JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      ((void(*)(JsVar*,JsVar*))function)(thisParam,((paramCount>0)?paramData[0]:0));
+      return result;
+    }
+    case JSWAT_JSVARFLOAT | JSWAT_EXECUTE_IMMEDIATELY: {
+      JsVar *result = 0;
+      result = jsvNewFromFloat(((JsVarFloat(*)())function)());
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,int))function)(thisParam,jsvGetInteger((paramCount>0)?paramData[0]:0)));
+      return result;
+    }
+    case JSWAT_INT32 | JSWAT_EXECUTE_IMMEDIATELY: {
+      JsVar *result = 0;
+      result = jsvNewFromInteger(((int(*)())function)());
+      return result;
+    }
+    case JSWAT_BOOL | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      result = jsvNewFromBool(((bool(*)(JsVar*,JsVar*))function)(thisParam,((paramCount>0)?paramData[0]:0)));
+      return result;
+    }
+    case JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      JsVar *argArray = (paramCount>1)?jsvNewArray(&paramData[1],paramCount-1):jsvNewEmptyArray();
+
+      ((void(*)(JsVar*,JsVar*,JsVar*))function)(thisParam,((paramCount>0)?paramData[0]:0),argArray);
+      jsvUnLock(argArray);
+
+
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      JsVar *argArray = (paramCount>1)?jsvNewArray(&paramData[1],paramCount-1):jsvNewEmptyArray();
+
+      result = (((JsVar*(*)(JsVar*,JsVar*,JsVar*))function)(thisParam,((paramCount>0)?paramData[0]:0),argArray));
+      jsvUnLock(argArray);
+
+
+      return result;
+    }
+    case JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_BOOL << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      ((void(*)(JsVar*,JsVar*,bool))function)(thisParam,((paramCount>0)?paramData[0]:0),jsvGetBool((paramCount>1)?paramData[1]:0));
+      return result;
+    }
+    case JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      JsVar *argArray = (paramCount>0)?jsvNewArray(&paramData[0],paramCount-0):jsvNewEmptyArray();
+
+      ((void(*)(JsVar*,JsVar*))function)(thisParam,argArray);
+      jsvUnLock(argArray);
+
+
+      return result;
+    }
+    case JSWAT_BOOL | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)) | (JSWAT_INT32 << (JSWAT_BITS*4)): {
+      JsVar *result = 0;
+      result = jsvNewFromBool(((bool(*)(JsVar*,JsVar*,JsVar*,JsVarInt))function)(((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0),((paramCount>2)?paramData[2]:0),jsvGetInteger((paramCount>3)?paramData[3]:0)));
+      return result;
+    }
+    case JSWAT_INT32 | JSWAT_THIS_ARG | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      result = jsvNewFromInteger(((JsVarInt(*)(JsVar*,JsVarFloat))function)(thisParam,jsvGetFloat((paramCount>0)?paramData[0]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_PIN << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,JsVar*,Pin))function)(thisParam,((paramCount>0)?paramData[0]:0),jshGetPinFromVar((paramCount>1)?paramData[1]:0)));
+      return result;
+    }
+    case JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)) | (JSWAT_PIN << (JSWAT_BITS*4)): {
+      JsVar *result = 0;
+      ((void(*)(JsVar*,JsVar*,int,int,Pin))function)(thisParam,((paramCount>0)?paramData[0]:0),jsvGetInteger((paramCount>1)?paramData[1]:0),jsvGetInteger((paramCount>2)?paramData[2]:0),jshGetPinFromVar((paramCount>3)?paramData[3]:0));
+      return result;
+    }
+    case JSWAT_INT32 | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      result = jsvNewFromInteger(((int(*)(JsVar*,JsVarInt))function)(thisParam,jsvGetInteger((paramCount>0)?paramData[0]:0)));
+      return result;
+    }
+    case JSWAT_BOOL | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      result = jsvNewFromBool(((bool(*)(JsVar*,JsVar*,JsVar*))function)(thisParam,((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(int,JsVar*))function)(jsvGetInteger((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0)));
+      return result;
+    }
+    case JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_PIN << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      ((void(*)(JsVar*,Pin,JsVarFloat,JsVar*))function)(thisParam,jshGetPinFromVar((paramCount>0)?paramData[0]:0),jsvGetFloat((paramCount>1)?paramData[1]:0),((paramCount>2)?paramData[2]:0));
+      return result;
+    }
+    case JSWAT_BOOL | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      result = jsvNewFromBool(((bool(*)(JsVar*,JsVar*))function)(((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0)));
+      return result;
+    }
+    case JSWAT_VOID | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_PIN << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      ((void(*)(JsVar*,Pin))function)(((paramCount>0)?paramData[0]:0),jshGetPinFromVar((paramCount>1)?paramData[1]:0));
+      return result;
+    }
+    case JSWAT_INT32 | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      result = jsvNewFromInteger(((int(*)(JsVar*,JsVar*))function)(thisParam,((paramCount>0)?paramData[0]:0)));
+      return result;
+    }
+    case JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      ((void(*)(JsVar*,int))function)(thisParam,jsvGetInteger((paramCount>0)?paramData[0]:0));
+      return result;
+    }
+    case JSWAT_JSVARFLOAT | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      result = jsvNewFromFloat(((JsVarFloat(*)(JsVarFloat))function)(jsvGetFloat((paramCount>0)?paramData[0]:0)));
+      return result;
+    }
+    case JSWAT_JSVARFLOAT | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)) | (JSWAT_JSVARFLOAT << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      result = jsvNewFromFloat(((JsVarFloat(*)(JsVarFloat,JsVarFloat))function)(jsvGetFloat((paramCount>0)?paramData[0]:0),jsvGetFloat((paramCount>1)?paramData[1]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | (JSWAT_JSVARFLOAT << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVarFloat))function)(jsvGetFloat((paramCount>0)?paramData[0]:0)));
+      return result;
+    }
+    case JSWAT_JSVARFLOAT | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      JsVar *argArray = (paramCount>0)?jsvNewArray(&paramData[0],paramCount-0):jsvNewEmptyArray();
+
+      result = jsvNewFromFloat(((JsVarFloat(*)(JsVar*))function)(argArray));
+      jsvUnLock(argArray);
+
+
+      return result;
+    }
+    case JSWAT_JSVAR | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)) | (JSWAT_JSVAR << (JSWAT_BITS*4)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(int,int,int,JsVar*))function)(jsvGetInteger((paramCount>0)?paramData[0]:0),jsvGetInteger((paramCount>1)?paramData[1]:0),jsvGetInteger((paramCount>2)?paramData[2]:0),((paramCount>3)?paramData[3]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_BOOL << (JSWAT_BITS*1)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,bool))function)(thisParam,jsvGetBool((paramCount>0)?paramData[0]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)) | (JSWAT_INT32 << (JSWAT_BITS*4)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,int,int,int,int))function)(thisParam,jsvGetInteger((paramCount>0)?paramData[0]:0),jsvGetInteger((paramCount>1)?paramData[1]:0),jsvGetInteger((paramCount>2)?paramData[2]:0),jsvGetInteger((paramCount>3)?paramData[3]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,int,int,int))function)(thisParam,jsvGetInteger((paramCount>0)?paramData[0]:0),jsvGetInteger((paramCount>1)?paramData[1]:0),jsvGetInteger((paramCount>2)?paramData[2]:0)));
+      return result;
+    }
+    case JSWAT_INT32 | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      result = jsvNewFromInteger(((int(*)(JsVar*,int,int))function)(thisParam,jsvGetInteger((paramCount>0)?paramData[0]:0),jsvGetInteger((paramCount>1)?paramData[1]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,int,int,JsVar*))function)(thisParam,jsvGetInteger((paramCount>0)?paramData[0]:0),jsvGetInteger((paramCount>1)?paramData[1]:0),((paramCount>2)?paramData[2]:0)));
+      return result;
+    }
+    case JSWAT_INT32 | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      result = jsvNewFromInteger(((JsVarInt(*)(JsVar*,JsVar*,JsVar*,JsVar*))function)(thisParam,((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0),((paramCount>2)?paramData[2]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,JsVar*,JsVar*,JsVar*))function)(thisParam,((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0),((paramCount>2)?paramData[2]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)) | (JSWAT_INT32 << (JSWAT_BITS*4)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,JsVar*,int,JsVar*,int))function)(thisParam,((paramCount>0)?paramData[0]:0),jsvGetInteger((paramCount>1)?paramData[1]:0),((paramCount>2)?paramData[2]:0),jsvGetInteger((paramCount>3)?paramData[3]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)) | (JSWAT_BOOL << (JSWAT_BITS*4)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,JsVar*,int,int,bool))function)(thisParam,((paramCount>0)?paramData[0]:0),jsvGetInteger((paramCount>1)?paramData[1]:0),jsvGetInteger((paramCount>2)?paramData[2]:0),jsvGetBool((paramCount>3)?paramData[3]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,int,int))function)(thisParam,jsvGetInteger((paramCount>0)?paramData[0]:0),jsvGetInteger((paramCount>1)?paramData[1]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_BOOL << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,JsVar*,bool))function)(thisParam,((paramCount>0)?paramData[0]:0),jsvGetBool((paramCount>1)?paramData[1]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_INT32 << (JSWAT_BITS*2)) | (JSWAT_INT32 << (JSWAT_BITS*3)) | (JSWAT_JSVAR << (JSWAT_BITS*4)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,JsVar*,int,int,JsVar*))function)(thisParam,((paramCount>0)?paramData[0]:0),jsvGetInteger((paramCount>1)?paramData[1]:0),jsvGetInteger((paramCount>2)?paramData[2]:0),((paramCount>3)?paramData[3]:0)));
+      return result;
+    }
+    case JSWAT_JSVAR | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_BOOL << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      result = (((JsVar*(*)(JsVar*,bool))function)(((paramCount>0)?paramData[0]:0),jsvGetBool((paramCount>1)?paramData[1]:0)));
+      return result;
+    }
+    case JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_JSVAR << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)) | (JSWAT_JSVAR << (JSWAT_BITS*3)) | (JSWAT_ARGUMENT_ARRAY << (JSWAT_BITS*4)): {
+      JsVar *result = 0;
+      JsVar *argArray = (paramCount>3)?jsvNewArray(&paramData[3],paramCount-3):jsvNewEmptyArray();
+
+      ((void(*)(JsVar*,JsVar*,JsVar*,JsVar*,JsVar*))function)(thisParam,((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0),((paramCount>2)?paramData[2]:0),argArray);
+      jsvUnLock(argArray);
+
+
+      return result;
+    }
+    case JSWAT_VOID | JSWAT_THIS_ARG | (JSWAT_INT32 << (JSWAT_BITS*1)) | (JSWAT_JSVAR << (JSWAT_BITS*2)): {
+      JsVar *result = 0;
+      ((void(*)(JsVar*,int,JsVar*))function)(thisParam,jsvGetInteger((paramCount>0)?paramData[0]:0),((paramCount>1)?paramData[1]:0));
+      return result;
+    }
+  default: jsExceptionHere(JSET_ERROR,"Unknown argspec %d",argumentSpecifier);
+  }
+  return 0;
+}
+#endif
+
+
@@ -32,6 +32,14 @@ Espruino uses heatshrink internally to compress RAM down to fit in Flash memory
 Functions here take and return buffers of data. There is no support for streaming, so both the compressed and decompressed data must be able to fit in memory at the same time.
 */
 
+/* Get a pointer to the data if it's in a flat area of memory (flat/native string
+ * or an ArrayBuffer of one). Only for 8 bit data - for other views iterating
+ * gives each element's value &0xFF, which isn't the same as the raw bytes */
+static unsigned char *jswrap_heatshrink_getDataPointer(JsVar *data, size_t *len) {
+  if (jsvIsArrayBuffer(data) && JSV_ARRAYBUFFER_GET_SIZE(data->varData.arraybuffer.type)!=1)
+    return 0;
+  return (unsigned char *)jsvGetDataPointer(data, len);
+}
 
 /*JSON{
   "type" : "staticmethod",
@@ -53,10 +61,18 @@ JsVar *jswrap_heatshrink_compress(JsVar *data) {
   }
   JsvIterator in_it;
   JsvStringIterator out_it;
-
-  jsvIteratorNew(&in_it, data, JSIF_EVERY_ARRAY_ELEMENT);
-  uint32_t compressedSize = heatshrink_encode_cb(heatshrink_var_input_cb, (uint32_t*)&in_it, NULL, NULL);
-  jsvIteratorFree(&in_it);
+  // If the data is in a flat area of memory read it directly
+  HeatShrinkPtrInputCallbackInfo in_ptr;
+  in_ptr.ptr = jswrap_heatshrink_getDataPointer(data, &in_ptr.len);
+
+  uint32_t compressedSize;
+  if (in_ptr.ptr) {
+    compressedSize = heatshrink_encode(in_ptr.ptr, in_ptr.len, NULL, NULL);
+  } else {
+    jsvIteratorNew(&in_it, data, JSIF_EVERY_ARRAY_ELEMENT);
+    compressedSize = heatshrink_encode_cb(heatshrink_var_input_cb, (uint32_t*)&in_it, NULL, NULL);
+    jsvIteratorFree(&in_it);
+  }
 
   JsVar *outVar = jsvNewStringOfLength((unsigned int)compressedSize, NULL);
   if (!outVar) {
@@ -64,11 +80,15 @@ JsVar *jswrap_heatshrink_compress(JsVar *data) {
     return 0;
   }
 
-  jsvIteratorNew(&in_it, data, JSIF_EVERY_ARRAY_ELEMENT);
   jsvStringIteratorNew(&out_it,outVar,0);
-  heatshrink_encode_cb(heatshrink_var_input_cb, (uint32_t*)&in_it, heatshrink_var_output_cb, (uint32_t*)&out_it);
+  if (in_ptr.ptr) {
+    heatshrink_encode(in_ptr.ptr, in_ptr.len, heatshrink_var_output_cb, (uint32_t*)&out_it);
+  } else {
+    jsvIteratorNew(&in_it, data, JSIF_EVERY_ARRAY_ELEMENT);
+    heatshrink_encode_cb(heatshrink_var_input_cb, (uint32_t*)&in_it, heatshrink_var_output_cb, (uint32_t*)&out_it);
+    jsvIteratorFree(&in_it);
+  }
   jsvStringIteratorFree(&out_it);
-  jsvIteratorFree(&in_it);
 
   JsVar *ab = jsvNewArrayBufferFromString(outVar, 0);
   jsvUnLock(outVar);
@@ -96,22 +116,41 @@ JsVar *jswrap_heatshrink_decompress(JsVar *data) {
   }
   JsvIterator in_it;
   JsvStringIterator out_it;
+  // If the data is in a flat area of memory read it directly
+  HeatShrinkPtrInputCallbackInfo in_ptr;
+  in_ptr.ptr = jswrap_heatshrink_getDataPointer(data, &in_ptr.len);
+  HeatShrinkPtrInputCallbackInfo in_info = in_ptr;
+
+  uint32_t decompressedSize;
+  if (in_ptr.ptr) {
+    decompressedSize = heatshrink_decode(heatshrink_ptr_input_cb, (uint32_t*)&in_info, NULL);
+  } else {
+    jsvIteratorNew(&in_it, data, JSIF_EVERY_ARRAY_ELEMENT);
+    decompressedSize = heatshrink_decode(heatshrink_var_input_cb, (uint32_t*)&in_it, NULL);
+    jsvIteratorFree(&in_it);
+  }
 
-  jsvIteratorNew(&in_it, data, JSIF_EVERY_ARRAY_ELEMENT);
-  uint32_t decompressedSize = heatshrink_decode(heatshrink_var_input_cb, (uint32_t*)&in_it, NULL);
-  jsvIteratorFree(&in_it);
-
-  JsVar *outVar = jsvNewStringOfLength((unsigned int)decompressedSize, NULL);
+  // Try and decompress straight into a flat string, or fall back to a normal one
+  JsVar *outVar = jsvNewFlatStringOfLength((unsigned int)decompressedSize);
+  unsigned char *out_ptr = outVar ? (unsigned char*)jsvGetFlatStringPointer(outVar) : 0;
+  if (!outVar) outVar = jsvNewStringOfLength((unsigned int)decompressedSize, NULL);
   if (!outVar) {
     jsError("Not enough memory for result");
     return 0;
   }
 
-  jsvIteratorNew(&in_it, data, JSIF_EVERY_ARRAY_ELEMENT);
-  jsvStringIteratorNew(&out_it,outVar,0);
-  heatshrink_decode_cb(heatshrink_var_input_cb, (uint32_t*)&in_it, heatshrink_var_output_cb, (uint32_t*)&out_it);
-  jsvStringIteratorFree(&out_it);
-  jsvIteratorFree(&in_it);
+  if (!out_ptr) jsvStringIteratorNew(&out_it,outVar,0);
+  if (in_ptr.ptr) {
+    in_info = in_ptr;
+    if (out_ptr) heatshrink_decode(heatshrink_ptr_input_cb, (uint32_t*)&in_info, out_ptr);
+    else heatshrink_decode_cb(heatshrink_ptr_input_cb, (uint32_t*)&in_info, heatshrink_var_output_cb, (uint32_t*)&out_it);
+  } else {
+    jsvIteratorNew(&in_it, data, JSIF_EVERY_ARRAY_ELEMENT);
+    if (out_ptr) heatshrink_decode(heatshrink_var_input_cb, (uint32_t*)&in_it, out_ptr);
+    else heatshrink_decode_cb(heatshrink_var_input_cb, (uint32_t*)&in_it, heatshrink_var_output_cb, (uint32_t*)&out_it);
+    jsvIteratorFree(&in_it);
+  }
+  if (!out_ptr) jsvStringIteratorFree(&out_it);
 
   JsVar *ab = jsvNewArrayBufferFromString(outVar, 0);
   jsvUnLock(outVar);
@@ -1651,6 +1651,45 @@ JsVar *jswrap_graphics_setRotation(JsVar *parent, int rotation, bool reflect) {
   return jsvLockAgain(parent);
 }
 
+/** Reads image data for drawImage. If it's all in one place (a flat or
+ * native string) it's read directly, otherwise with a JsvStringIterator */
+typedef struct {
+  const unsigned char *ptr; ///< the image data, or 0 if we must use the iterator
+  size_t len;               ///< length of the data at ptr
+  size_t idx;               ///< index of the next char when using ptr
+  JsvStringIterator it;
+} GfxImageReader;
+
+static void _jswrap_graphics_imageReaderNew(GfxImageReader *r, JsVar *str, size_t idx) {
+  r->ptr = (const unsigned char*)jsvGetDataPointer(str, &r->len);
+  r->idx = idx;
+  if (!r->ptr) jsvStringIteratorNew(&r->it, str, idx);
+}
+
+/// Get the char at the current position (0 if past the end) and move on to the next
+static unsigned char _jswrap_graphics_imageReaderGetCharAndNext(GfxImageReader *r) {
+  if (r->ptr) {
+    size_t i = r->idx++;
+    return (i < r->len) ? r->ptr[i] : 0;
+  }
+  unsigned char ch = (unsigned char)jsvStringIteratorGetChar(&r->it);
+  jsvStringIteratorNext(&r->it);
+  return ch;
+}
+
+static size_t _jswrap_graphics_imageReaderGetIndex(GfxImageReader *r) {
+  return r->ptr ? r->idx : jsvStringIteratorGetIndex(&r->it);
+}
+
+static void _jswrap_graphics_imageReaderGoto(GfxImageReader *r, JsVar *str, size_t idx) {
+  if (r->ptr) r->idx = idx;
+  else jsvStringIteratorGoto(&r->it, str, idx);
+}
+
+static void _jswrap_graphics_imageReaderFree(GfxImageReader *r) {
+  if (!r->ptr) jsvStringIteratorFree(&r->it);
+}
+
 /*JSON{
   "type" : "method",
   "class" : "Graphics",
@@ -1718,6 +1757,7 @@ JsVar *jswrap_graphics_drawImage(JsVar *parent, JsVar *image, int xPos, int yPos
         size_t l = 0;
         palettePtr = (uint16_t *)jsvGetDataPointer(v, &l);
         jsvUnLock(v);
+        l /= 2; // bytes -> palette entries
         if (l==2 || l==4 || l==16)
           paletteMask = l-1;
         else {
@@ -1820,8 +1860,8 @@ JsVar *jswrap_graphics_drawImage(JsVar *parent, JsVar *image, int xPos, int yPos
   int x=0, y=0;
   int bits=0;
   unsigned int colData = 0;
-  JsvStringIterator it;
-  jsvStringIteratorNew(&it, imageBufferString, imageBufferOffset);
+  GfxImageReader it;
+  _jswrap_graphics_imageReaderNew(&it, imageBufferString, imageBufferOffset);
 
   if (jsvIsUndefined(options)) {
     // Standard 1:1 blitting
@@ -1835,8 +1875,7 @@ JsVar *jswrap_graphics_drawImage(JsVar *parent, JsVar *image, int xPos, int yPos
         for (x=0;x<imageWidth;x++) {
           // Get the data we need...
           while (bits < imageBpp) {
-            colData = (colData<<8) | ((unsigned char)jsvStringIteratorGetChar(&it));
-            jsvStringIteratorNext(&it);
+            colData = (colData<<8) | _jswrap_graphics_imageReaderGetCharAndNext(&it);
             bits += 8;
           }
           // extract just the bits we want
@@ -1871,8 +1910,7 @@ JsVar *jswrap_graphics_drawImage(JsVar *parent, JsVar *image, int xPos, int yPos
         for (x=0;x<imageWidth;x++) {
           // Get the data we need...
           while (bits < imageBpp) {
-            colData = (colData<<8) | ((unsigned char)jsvStringIteratorGetChar(&it));
-            jsvStringIteratorNext(&it);
+            colData = (colData<<8) | _jswrap_graphics_imageReaderGetCharAndNext(&it);
             bits += 8;
           }
           // extract just the bits we want
@@ -1914,13 +1952,13 @@ JsVar *jswrap_graphics_drawImage(JsVar *parent, JsVar *image, int xPos, int yPos
       int yp = yPos;
       for (y=0;y<imageHeight;y++) {
         // Store current pos as we need to rewind
-        size_t lastIt = jsvStringIteratorGetIndex(&it);
+        size_t lastIt = _jswrap_graphics_imageReaderGetIndex(&it);
         int lastBits = bits;
         unsigned int lastColData = colData;
         // do a new iteration for each line we're scaling
         for (int iy=0;iy<s;iy++) {
           if (iy) { // rewind for all but the first line of scaling
-            jsvStringIteratorGoto(&it, imageBufferString, lastIt);
+            _jswrap_graphics_imageReaderGoto(&it, imageBufferString, lastIt);
             bits = lastBits;
             colData = lastColData;
           }
@@ -1929,8 +1967,7 @@ JsVar *jswrap_graphics_drawImage(JsVar *parent, JsVar *image, int xPos, int yPos
           for (x=0;x<imageWidth;x++) {
             // Get the data we need...
             while (bits < imageBpp) {
-              colData = (colData<<8) | ((unsigned char)jsvStringIteratorGetChar(&it));
-              jsvStringIteratorNext(&it);
+              colData = (colData<<8) | _jswrap_graphics_imageReaderGetCharAndNext(&it);
               bits += 8;
             }
             // extract just the bits we want
@@ -1995,16 +2032,14 @@ JsVar *jswrap_graphics_drawImage(JsVar *parent, JsVar *image, int xPos, int yPos
           int imagey = (qy+127)>>8;
           if (imagex>=0 && imagey>=0 && imagex<imageWidth && imagey<imageHeight) {
             if (imageBpp==8) { // fast path for 8 bits
-              jsvStringIteratorGoto(&it, imageBufferString, imageBufferOffset+imagex+(imagey*imageStride));
-              colData = (unsigned char)jsvStringIteratorGetChar(&it);
+              _jswrap_graphics_imageReaderGoto(&it, imageBufferString, imageBufferOffset+imagex+(imagey*imageStride));
+              colData = _jswrap_graphics_imageReaderGetCharAndNext(&it);
             } else {
               int bitOffset = (imagex+(imagey*imageWidth))*imageBpp;
-              jsvStringIteratorGoto(&it, imageBufferString, imageBufferOffset+(bitOffset>>3));
-              colData = (unsigned char)jsvStringIteratorGetChar(&it);
-              for (int b=8;b<imageBpp;b+=8) {
-                jsvStringIteratorNext(&it);
-                colData = (colData<<8) | (unsigned char)jsvStringIteratorGetChar(&it);
-              }
+              _jswrap_graphics_imageReaderGoto(&it, imageBufferString, imageBufferOffset+(bitOffset>>3));
+              colData = _jswrap_graphics_imageReaderGetCharAndNext(&it);
+              for (int b=8;b<imageBpp;b+=8)
+                colData = (colData<<8) | _jswrap_graphics_imageReaderGetCharAndNext(&it);
               //jsiConsolePrintf("%d %d %d\n", bitOffset, imagePixelsPerByteMask, (imagePixelsPerByteMask-(bitOffset&imagePixelsPerByteMask))*imageBpp);
               colData = (colData>>((imagePixelsPerByteMask-(bitOffset&imagePixelsPerByteMask))*imageBpp)) & imageBitMask;
             }
@@ -2022,7 +2057,7 @@ JsVar *jswrap_graphics_drawImage(JsVar *parent, JsVar *image, int xPos, int yPos
     }
 #endif
   }
-  jsvStringIteratorFree(&it);
+  _jswrap_graphics_imageReaderFree(&it);
   jsvUnLock(imageBufferString);
   graphicsSetVar(&gfx); // gfx data changed because modified area
   return jsvLockAgain(parent);
@@ -293,6 +293,7 @@ Pipe this to a stream (an object with a 'write' method)
   "name" : "createServer",
   "generate" : "jswrap_http_createServer",
   "params" : [
+    ["options","JsVar","(optional) An object of options: `{ maxHeaderSize : int=4096, keepAliveTimeout : int=5000, maxMessageSize : int=16384 }`, or the callback function"],
     ["callback","JsVar","A function(request,response) that will be called when a connection is made"]
   ],
   "return" : ["JsVar","Returns a new httpSrv object"],
@@ -301,17 +302,35 @@ Pipe this to a stream (an object with a 'write' method)
 Create an HTTP Server
 
 When a request to the server is made, the callback is called. In the callback you can use the methods on the response (`httpSRs`) to send data. You can also add `request.on('data',function() { ... })` to listen for POSTed data
+
+`options` is optional. `maxHeaderSize` is the biggest (in bytes) the headers of a request may be. If
+a client sends more, it is sent a `431` error and the connection is closed.
+
+HTTP/1.1 connections are kept open after a response if the response has a known length (so
+`Content-Length` is added automatically when you call `res.end(data)` without writing data first).
+Requests that are pipelined on the same connection are handled one after the other. `keepAliveTimeout`
+is how long (in milliseconds) an idle connection is kept open for - set it to `0` to close every
+connection after its response.
+
+On builds with the `crypto` library, the server can handle WebSockets itself - see the `websocket`
+event. `maxMessageSize` (default 16384) is then the biggest (in bytes) a received message may be.
 */
 
-JsVar *jswrap_http_createServer(JsVar *callback) {
+JsVar *jswrap_http_createServer(JsVar *options, JsVar *callback) {
   JsVar *skippedCallback = jsvSkipName(callback);
+  if (jsvIsUndefined(skippedCallback)) { // createServer(callback)
+    jsvUnLock(skippedCallback);
+    callback = options;
+    options = 0;
+    skippedCallback = jsvSkipName(callback);
+  }
   if (!jsvIsFunction(skippedCallback)) {
     jsError("Expecting Callback Function but got %t", skippedCallback);
     jsvUnLock(skippedCallback);
     return 0;
   }
   jsvUnLock(skippedCallback);
-  return serverNew(ST_HTTP, callback);
+  return serverNew(ST_HTTP, jsvIsObject(options) ? options : 0, callback);
 }
 
 /*JSON{
@@ -356,6 +375,13 @@ There's an example of using [`http.request` for HTTP POST here](/Internet#http-p
 **Note:** if TLS/HTTPS is enabled, options can have `ca`, `key` and `cert` fields. See `tls.connect` for
 more information about these and how to use them.
 
+`options` can also contain `maxHeaderSize` (default 4096), the biggest (in bytes) the headers of the response
+may be. If the server sends more, an `error` event is emitted on the request and the connection is closed.
+
+If `options.keepAlive` is `true`, the connection is kept open after the response has been received, and is
+reused by the next request to the same host and port. `keepAliveTimeout` (default 5000) is how long (in
+milliseconds) an idle connection is kept for.
+
 */
 
 /*JSON{
@@ -402,7 +428,7 @@ JsVar *jswrap_http_get(JsVar *options, JsVar *callback) {
   }
   jsvUnLock(skippedCallback);
   JsVar *cliReq = jswrap_net_connect(options, callback, ST_HTTP);
-  if (cliReq) clientRequestEnd(&net, cliReq);
+  if (cliReq) clientRequestEnd(&net, cliReq, 0);
   networkFree(&net);
   return cliReq;
 }
@@ -471,6 +497,10 @@ The default contents are:
 This function writes the `data` argument as a string. Data that is passed in
 (including arrays) will be converted to a string with the normal JavaScript 
 `toString` method. For more information about sending binary data see `Socket.write`
+
+If `write` is called before `end` and no `Content-Length` header was set, the response
+is sent with `Transfer-Encoding: chunked` (unless the request was HTTP/1.0). Each write
+is sent straight away and the connection can still be kept alive afterwards.
 */
 bool jswrap_httpSRs_write(JsVar *parent, JsVar *data) {
   serverResponseWrite(parent, data);
@@ -489,8 +519,7 @@ bool jswrap_httpSRs_write(JsVar *parent, JsVar *data) {
 See `Socket.write` for more information about the data argument
 */
 void jswrap_httpSRs_end(JsVar *parent, JsVar *data) {
-  if (!jsvIsUndefined(data)) jswrap_httpSRs_write(parent, data);
-  serverResponseEnd(parent);
+  serverResponseEnd(parent, data);
 }
 
 
@@ -550,6 +579,10 @@ void jswrap_httpSRs_setHeader(JsVar *parent, JsVar *name, JsVar *value) {
 This function writes the `data` argument as a string. Data that is passed in
 (including arrays) will be converted to a string with the normal JavaScript 
 `toString` method. For more information about sending binary data see `Socket.write`
+
+If `write` is called before `end` and no `Content-Length` header was set, the request
+is sent with `Transfer-Encoding: chunked`. If only `end(data)` is called, a
+`Content-Length` header is added instead.
 */
 // Re-use existing
 
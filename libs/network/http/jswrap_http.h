@@ -13,7 +13,7 @@
  */
 #include "jsvar.h"
 
-JsVar *jswrap_http_createServer(JsVar *callback);
+JsVar *jswrap_http_createServer(JsVar *options, JsVar *callback);
 
 JsVar *jswrap_http_request(JsVar *options, JsVar *callback);
 JsVar *jswrap_http_get(JsVar *options, JsVar *callback);
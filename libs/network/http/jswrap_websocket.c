@@ -0,0 +1,146 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * This file is designed to be parsed during the build process
+ *
+ * Contains JavaScript WebSocket Functions
+ * ----------------------------------------------------------------------------
+ */
+#include "jswrap_websocket.h"
+#include "socketserver.h"
+
+/*JSON{
+  "type" : "event",
+  "class" : "httpSrv",
+  "name" : "websocket",
+  "params" : [
+    ["ws","JsVar","The new WebSocket (`httpWS`)"],
+    ["request","JsVar","The HTTP request (`httpSRq`) that asked for the WebSocket, so you can check its `url` and `headers`"]
+  ]
+}
+If there is a handler for this event, HTTP requests that ask to be upgraded to a WebSocket
+are accepted and passed to it, rather than to the server's request callback. The WebSocket
+framing is handled natively, so you just get whole messages:
+
+```
+var server = require('http').createServer(function (req, res) {
+  res.writeHead(200);
+  res.end("Hello");
+});
+server.on('websocket', function(ws, req) {
+  ws.on('message', function(msg) { ws.send("You said "+msg); });
+});
+server.listen(8080);
+```
+
+Without a handler, upgrade requests go to the request callback as normal, so JS WebSocket
+modules still work.
+*/
+
+/*JSON{
+  "type" : "class",
+  "library" : "http",
+  "class" : "httpWS"
+}
+A WebSocket connection to an HTTP server, passed to the server's `websocket` event
+*/
+/*JSON{
+  "type" : "event",
+  "class" : "httpWS",
+  "name" : "message",
+  "params" : [
+    ["data","JsVar","A String containing the whole message (text or binary)"]
+  ]
+}
+Called when a complete message has been received. Messages that were sent in fragments are
+joined together first. Messages bigger than the server's `maxMessageSize` option (default
+16384 bytes) make the connection close with status code 1009.
+*/
+/*JSON{
+  "type" : "event",
+  "class" : "httpWS",
+  "name" : "pong",
+  "params" : [
+    ["data","JsVar","A String containing the data sent with the pong"]
+  ]
+}
+Called when a pong is received (usually in reply to `ping`). Pings from the other end
+are replied to automatically.
+*/
+/*JSON{
+  "type" : "event",
+  "class" : "httpWS",
+  "name" : "close"
+}
+Called when the connection closes.
+*/
+/*JSON{
+  "type" : "event",
+  "class" : "httpWS",
+  "name" : "drain"
+}
+An event that is fired when the buffer is empty and it can accept more data to send.
+*/
+/*JSON{
+  "type" : "event",
+  "class" : "httpWS",
+  "name" : "error",
+  "params" : [
+    ["details","JsVar","An error object with an error code (a negative integer) and a message."]
+  ]
+}
+An event that is fired if there is an error on this connection.
+*/
+
+/*JSON{
+  "type" : "method",
+  "class" : "httpWS",
+  "name" : "send",
+  "generate" : "jswrap_httpWS_send",
+  "params" : [
+    ["data","JsVar","The message to send"]
+  ]
+}
+Send a message. ArrayBuffers (and typed arrays) are sent as binary messages, and anything
+else is converted to a String and sent as text.
+*/
+void jswrap_httpWS_send(JsVar *parent, JsVar *data) {
+  webSocketSend(parent, data, WS_OPCODE_TEXT);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "httpWS",
+  "name" : "ping",
+  "generate" : "jswrap_httpWS_ping",
+  "params" : [
+    ["data","JsVar","(optional) Data to send with the ping, which will come back in the `pong` event"]
+  ]
+}
+Send a ping. The other end should reply with a pong.
+*/
+void jswrap_httpWS_ping(JsVar *parent, JsVar *data) {
+  webSocketSend(parent, data, WS_OPCODE_PING);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "httpWS",
+  "name" : "close",
+  "generate" : "jswrap_httpWS_close",
+  "params" : [
+    ["code","JsVar","(optional) The status code to close with, default 1000"]
+  ]
+}
+Close the WebSocket. A close frame is sent, then the connection is closed.
+*/
+void jswrap_httpWS_close(JsVar *parent, JsVar *code) {
+  webSocketClose(parent, jsvIsUndefined(code) ? WS_CLOSE_NORMAL : jsvGetInteger(code));
+}
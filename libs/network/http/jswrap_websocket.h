@@ -0,0 +1,18 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * Contains JavaScript WebSocket Functions
+ * ----------------------------------------------------------------------------
+ */
+#include "jsvar.h"
+
+void jswrap_httpWS_send(JsVar *parent, JsVar *data);
+void jswrap_httpWS_ping(JsVar *parent, JsVar *data);
+void jswrap_httpWS_close(JsVar *parent, JsVar *code);
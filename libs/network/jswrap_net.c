@@ -27,8 +27,11 @@
 bool jswrap_net_idle() {
   JsNetwork net;
   if (!networkGetFromVar(&net)) return false;
+  netWasBusy = false;
   net.idle(&net);
   bool b = socketIdle(&net);
+  // if we'll be woken when a socket is ready, only stay awake if something happened
+  if (net.wakesWhenReady) b = netWasBusy;
   networkFree(&net);
   return b;
 }
@@ -360,7 +363,7 @@ JsVar *jswrap_net_createServer(JsVar *callback) {
     return 0;
   }
   jsvUnLock(skippedCallback);
-  return serverNew(ST_NORMAL, callback);
+  return serverNew(ST_NORMAL, 0, callback);
 }
 
 
@@ -566,7 +569,7 @@ void jswrap_dgram_close(JsVar *parent) {
   JsNetwork net;
   if (!networkGetFromVarIfOnline(&net)) return;
 
-  clientRequestEnd(&net, parent);
+  clientRequestEnd(&net, parent, 0);
   networkFree(&net);
 }
 
@@ -762,7 +765,6 @@ void jswrap_net_socket_end(JsVar *parent, JsVar *data) {
   JsNetwork net;
   if (!networkGetFromVarIfOnline(&net)) return;
 
-  if (!jsvIsUndefined(data)) jswrap_net_socket_write(parent, data);
-  clientRequestEnd(&net, parent);
+  clientRequestEnd(&net, parent, data);
   networkFree(&net);
 }
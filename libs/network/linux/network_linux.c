@@ -28,6 +28,7 @@
   #include <sys/select.h>
   #include <arpa/inet.h>
   #include <netinet/in.h>
+  #include <netinet/tcp.h>
   #include <resolv.h>
  #endif
  #include <sys/socket.h>
@@ -40,6 +41,23 @@
  typedef int SOCKET;
 #endif
 
+#if defined(LINUX) && defined(__linux__)
+ #include <sys/epoll.h>
+ #include "jshardware.h"
+ /* Rather than calling select() on every socket each time around the idle
+  * loop, keep all sockets in one epoll set. net_linux_idle collects what's
+  * ready with a single epoll_wait, and recv/send/accept only make a syscall
+  * for sockets that are ready. jshSleep also waits on the epoll set. */
+ #define NET_LINUX_EPOLL
+ #define NET_LINUX_MAX_FDS 4096 // sockets with bigger fds fall back to select()
+ #define NET_READY_READ  1 ///< socket can be read (or accepted from)
+ #define NET_READY_WRITE 2 ///< socket can be written to
+ #define NET_WATCHED     4 ///< socket is in the epoll set
+ static int netEpoll = -1;
+ static int netWatched = 0; ///< number of sockets in netEpoll
+ static unsigned char netReady[NET_LINUX_MAX_FDS];
+#endif
+
 #define closesocket(SOCK) close(SOCK)
 
 #if NET_DBG > 0
@@ -58,9 +76,60 @@ void net_linux_gethostbyname(JsNetwork *net, char * hostName, uint32_t* out_ip_a
     *out_ip_addr = *(uint32_t*)*host_addr_p->h_addr_list;
 }
 
+#ifdef NET_LINUX_EPOLL
+/// Add a socket to the epoll set (and make it non-blocking, as we only find out when it becomes ready)
+static void net_linux_watch(int sckt) {
+  if (sckt<0 || sckt>=NET_LINUX_MAX_FDS) return;
+  if (netEpoll<0) {
+    netEpoll = epoll_create1(EPOLL_CLOEXEC);
+    if (netEpoll<0) return;
+  }
+  fcntl(sckt, F_SETFL, fcntl(sckt, F_GETFL, 0) | O_NONBLOCK);
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  // edge triggered - a flag is only cleared when the socket returns EAGAIN
+  ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+  ev.data.fd = sckt;
+  netReady[sckt] = 0;
+  if (epoll_ctl(netEpoll, EPOLL_CTL_ADD, sckt, &ev)==0) {
+    netReady[sckt] = NET_WATCHED;
+    // jshSleep only needs to wake for us (and keep running) while there are sockets
+    if (!netWatched++) jshSleepWatchFd(netEpoll, true);
+  }
+}
+
+/// Is this socket watched by epoll? If so we don't need select()
+static bool net_linux_watched(int sckt) {
+  return sckt>=0 && sckt<NET_LINUX_MAX_FDS && (netReady[sckt]&NET_WATCHED);
+}
+
+/// Clear a ready flag because the socket returned EAGAIN. Returns true if it did
+static bool net_linux_wouldBlock(int sckt, unsigned char flag) {
+  if (errno!=EAGAIN && errno!=EWOULDBLOCK) return false;
+  netReady[sckt] &= (unsigned char)~flag;
+  return true;
+}
+#endif
+
 /// Called on idle. Do any checks required for this device
 void net_linux_idle(JsNetwork *net) {
   NOT_USED(net);
+#ifdef NET_LINUX_EPOLL
+  if (netEpoll<0) return;
+  struct epoll_event events[64];
+  int n;
+  do {
+    n = epoll_wait(netEpoll, events, 64, 0);
+    for (int i=0;i<n;i++) {
+      int sckt = events[i].data.fd;
+      uint32_t e = events[i].events;
+      if (sckt<0 || sckt>=NET_LINUX_MAX_FDS) continue;
+      // on errors or hangup let recv/send find out what happened
+      if (e & (EPOLLIN|EPOLLRDHUP|EPOLLHUP|EPOLLERR)) netReady[sckt] |= NET_READY_READ;
+      if (e & (EPOLLOUT|EPOLLHUP|EPOLLERR)) netReady[sckt] |= NET_READY_WRITE;
+    }
+  } while (n==64);
+#endif
 }
 
 /// Call just before returning to idle loop. This checks for errors and tries to recover. Returns true if no errors.
@@ -70,6 +139,8 @@ bool net_linux_checkError(JsNetwork *net) {
   return hadErrors;
 }
 
+void net_linux_closesocket(JsNetwork *net, int sckt);
+
 /// if host=0, creates a server otherwise creates a client (and automatically connects). Returns >=0 on success
 int net_linux_createsocket(JsNetwork *net, SocketType socketType, uint32_t host, unsigned short port, JsVar *options) {
   int ippProto = socketType & ST_UDP ? IPPROTO_UDP : IPPROTO_TCP;
@@ -89,6 +160,9 @@ int net_linux_createsocket(JsNetwork *net, SocketType socketType, uint32_t host,
     u_long n = 1;
     ioctlsocket(sckt,FIONBIO,&n);
     #endif
+    #ifdef NET_LINUX_EPOLL
+    net_linux_watch(sckt);
+    #endif
 
     if (scktType == SOCK_DGRAM) { // only for UDP
       // set broadcast
@@ -112,7 +186,7 @@ int net_linux_createsocket(JsNetwork *net, SocketType socketType, uint32_t host,
        if (err != EINPROGRESS &&
            err != EWOULDBLOCK) {
          jsError("Connect failed (err %d)", err);
-         closesocket(sckt);
+         net_linux_closesocket(net, sckt); // also stops watching it
          return -1;
        }
       }
@@ -198,6 +272,9 @@ int net_linux_createsocket(JsNetwork *net, SocketType socketType, uint32_t host,
   if (setsockopt(sckt,SOL_SOCKET,SO_NOSIGPIPE,(const char *)&optval,sizeof(optval))<0)
     jsWarn("setsockopt(SO_NOSIGPIPE) failed\n");
 #endif
+#ifdef NET_LINUX_EPOLL
+  if (host==0) net_linux_watch(sckt); // clients were added before connecting
+#endif
 
   return sckt;
 }
@@ -205,12 +282,39 @@ int net_linux_createsocket(JsNetwork *net, SocketType socketType, uint32_t host,
 /// destroys the given socket
 void net_linux_closesocket(JsNetwork *net, int sckt) {
   NOT_USED(net);
+#ifdef NET_LINUX_EPOLL
+  if (net_linux_watched(sckt)) {
+    epoll_ctl(netEpoll, EPOLL_CTL_DEL, sckt, NULL);
+    netReady[sckt] = 0;
+    if (!--netWatched) jshSleepWatchFd(netEpoll, false);
+  }
+#endif
   closesocket(sckt);
 }
 
+/// Send small writes straight away - we answer requests, so Nagle just adds a delayed-ACK wait
+static void net_linux_nodelay(int sckt) {
+#ifdef TCP_NODELAY
+  int optval = 1;
+  setsockopt(sckt,IPPROTO_TCP,TCP_NODELAY,(const char *)&optval,sizeof(optval));
+#endif
+}
+
 /// If the given server socket can accept a connection, return it (or return < 0)
 int net_linux_accept(JsNetwork *net, int sckt) {
   NOT_USED(net);
+#ifdef NET_LINUX_EPOLL
+  if (net_linux_watched(sckt)) {
+    if (!(netReady[sckt]&NET_READY_READ)) return -1;
+    int theClient = accept(sckt,0,0);
+    if (theClient<0) net_linux_wouldBlock(sckt, NET_READY_READ);
+    else {
+      net_linux_watch(theClient);
+      net_linux_nodelay(theClient);
+    }
+    return theClient;
+  }
+#endif
   // TODO: look for unreffed servers?
   fd_set s;
   FD_ZERO(&s);
@@ -223,6 +327,7 @@ int net_linux_accept(JsNetwork *net, int sckt) {
   if (n>0) {
     // we have a client waiting to connect... try to connect and see what happens
     int theClient = accept(sckt,0,0);
+    if (theClient>=0) net_linux_nodelay(theClient);
     return theClient;
   }
   return -1;
@@ -234,14 +339,23 @@ int net_linux_recv(JsNetwork *net, SocketType socketType, int sckt, void *buf, s
   struct sockaddr_in fromAddr;
   int fromAddrLen = sizeof(fromAddr);
   int num = 0;
-  fd_set s;
-  FD_ZERO(&s);
-  FD_SET(sckt,&s);
-  // check for waiting clients
-  struct timeval timeout;
-  timeout.tv_sec = 0;
-  timeout.tv_usec = 0;
-  int n = select(sckt+1,&s,NULL,NULL,&timeout);
+  int n;
+#ifdef NET_LINUX_EPOLL
+  if (net_linux_watched(sckt)) {
+    if (!(netReady[sckt]&NET_READY_READ)) return 0;
+    n = 1;
+  } else
+#endif
+  {
+    fd_set s;
+    FD_ZERO(&s);
+    FD_SET(sckt,&s);
+    // check for waiting clients
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 0;
+    n = select(sckt+1,&s,NULL,NULL,&timeout);
+  }
   if (n==SOCKET_ERROR) {
     // we probably disconnected
     return -1;
@@ -250,6 +364,9 @@ int net_linux_recv(JsNetwork *net, SocketType socketType, int sckt, void *buf, s
     if (socketType & ST_UDP) {
       JsNetUDPPacketHeader *header = (JsNetUDPPacketHeader*)buf;
       num = (int)recvfrom(sckt,buf+sizeof(JsNetUDPPacketHeader),len-sizeof(JsNetUDPPacketHeader),0,(struct sockaddr *)&fromAddr,(socklen_t*)&fromAddrLen);
+#ifdef NET_LINUX_EPOLL
+      if (num<0 && net_linux_watched(sckt) && net_linux_wouldBlock(sckt, NET_READY_READ)) return 0;
+#endif
       *(in_addr_t*)&header->host = fromAddr.sin_addr.s_addr;
       header->port = ntohs(fromAddr.sin_port);
       header->length = (uint16_t)num;
@@ -259,6 +376,9 @@ int net_linux_recv(JsNetwork *net, SocketType socketType, int sckt, void *buf, s
       num += sizeof(JsNetUDPPacketHeader);
     } else {
       num = (int)recvfrom(sckt,buf,len,0,(struct sockaddr *)&fromAddr,(socklen_t*)&fromAddrLen);
+#ifdef NET_LINUX_EPOLL
+      if (num<0 && net_linux_watched(sckt) && net_linux_wouldBlock(sckt, NET_READY_READ)) return 0;
+#endif
       if (num==0) return -1; // select says data, but recv says 0 means connection is closed
     }
   }
@@ -266,20 +386,39 @@ int net_linux_recv(JsNetwork *net, SocketType socketType, int sckt, void *buf, s
   return num;
 }
 
+#ifdef NET_LINUX_EPOLL
+/// Return true if recv on this socket has something to report (sockets not in the epoll set just use the stack)
+bool net_linux_recvReady(JsNetwork *net, int sckt) {
+  NOT_USED(net);
+  return net_linux_watched(sckt) && (netReady[sckt]&NET_READY_READ);
+}
+#endif
+
 /// Send data if possible. returns nBytes on success, 0 on no data, or -1 on failure
 int net_linux_send(JsNetwork *net, SocketType socketType, int sckt, const void *buf, size_t len) {
   NOT_USED(net);
-  fd_set writefds;
-  FD_ZERO(&writefds);
-  FD_SET(sckt, &writefds);
-  struct timeval time;
-  time.tv_sec = 0;
-  time.tv_usec = 0;
-  int n = select(sckt+1, 0, &writefds, 0, &time);
+  int n;
+  bool ready;
+#ifdef NET_LINUX_EPOLL
+  if (net_linux_watched(sckt)) {
+    n = 1;
+    ready = netReady[sckt]&NET_READY_WRITE;
+  } else
+#endif
+  {
+    fd_set writefds;
+    FD_ZERO(&writefds);
+    FD_SET(sckt, &writefds);
+    struct timeval time;
+    time.tv_sec = 0;
+    time.tv_usec = 0;
+    n = select(sckt+1, 0, &writefds, 0, &time);
+    ready = n>0 && FD_ISSET(sckt, &writefds);
+  }
   if (n==SOCKET_ERROR ) {
      // we probably disconnected so just get rid of this
     return -1;
-  } else if (FD_ISSET(sckt, &writefds)) {
+  } else if (ready) {
     int flags = 0;
 #if !defined(SO_NOSIGPIPE) && defined(MSG_NOSIGNAL)
     flags |= MSG_NOSIGNAL;
@@ -293,9 +432,15 @@ int net_linux_send(JsNetwork *net, SocketType socketType, int sckt, const void *
 
       DBG("Send %d %x:%d", len - sizeof(JsNetUDPPacketHeader), header->host, header->port);
       n = (int)sendto(sckt, buf + sizeof(JsNetUDPPacketHeader), header->length, flags, (struct sockaddr *)&sin, sizeof(sockaddr_in));
+#ifdef NET_LINUX_EPOLL
+      if (n<0 && net_linux_watched(sckt) && net_linux_wouldBlock(sckt, NET_READY_WRITE)) return 0;
+#endif
       n += sizeof(JsNetUDPPacketHeader);
     } else {
       n = (int)send(sckt, buf, len, flags);
+#ifdef NET_LINUX_EPOLL
+      if (n<0 && net_linux_watched(sckt) && net_linux_wouldBlock(sckt, NET_READY_WRITE)) return 0;
+#endif
     }
     return n;
   } else
@@ -311,5 +456,9 @@ void netSetCallbacks_linux(JsNetwork *net) {
   net->gethostbyname = net_linux_gethostbyname;
   net->recv = net_linux_recv;
   net->send = net_linux_send;
-  net->chunkSize = 536;
+  net->chunkSize = 8192;
+#ifdef NET_LINUX_EPOLL
+  net->wakesWhenReady = true;
+  net->recvReady = net_linux_recvReady;
+#endif
 }
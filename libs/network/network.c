@@ -50,6 +50,7 @@ JsNetworkState networkState =
     ;
 
 JsNetwork *networkCurrentStruct = 0;
+bool netWasBusy = false;
 
 uint32_t networkParseIPAddress(const char *ip) {
   if (!strcmp(ip,"localhost"))
@@ -232,6 +233,8 @@ bool networkGetFromVar(JsNetwork *net) {
 
   // Now we know which kind of network we are working with, invoke the corresponding initialization
   // function to set the callbacks for this network tyoe.
+  net->wakesWhenReady = false;
+  net->recvReady = 0;
   switch (net->data.type) {
 #if defined(USE_CC3000)
   case JSNETWORKTYPE_CC3000 : netSetCallbacks_cc3000(net); break;
@@ -697,7 +700,9 @@ void netCloseSocket(JsNetwork *net, SocketType socketType, int sckt) {
 }
 
 int netAccept(JsNetwork *net, int sckt) {
-  return net->accept(net, sckt);
+  int r = net->accept(net, sckt);
+  if (r>=0) netWasBusy = true;
+  return r;
 }
 
 void netGetHostByName(JsNetwork *net, char * hostName, uint32_t* out_ip_addr) {
@@ -707,6 +712,7 @@ void netGetHostByName(JsNetwork *net, char * hostName, uint32_t* out_ip_addr) {
 int netRecv(JsNetwork *net, SocketType socketType, int sckt, void *buf, size_t len) {
 #ifdef USE_TLS
   if (socketType & ST_TLS) {
+    netWasBusy = true; // mbedtls may have data buffered, or be handshaking
     SSLSocketData *sd = ssl_getSocketData(sckt);
     if (!sd) return -1;
     if (sd->connecting) return 0; // busy
@@ -718,13 +724,16 @@ int netRecv(JsNetwork *net, SocketType socketType, int sckt, void *buf, size_t l
   } else
 #endif
   {
-    return net->recv(net, socketType, sckt, buf, len);
+    int r = net->recv(net, socketType, sckt, buf, len);
+    if (r) netWasBusy = true;
+    return r;
   }
 }
 
 int netSend(JsNetwork *net, SocketType socketType, int sckt, const void *buf, size_t len) {
 #ifdef USE_TLS
   if (socketType & ST_TLS) {
+    netWasBusy = true; // mbedtls may be handshaking
     SSLSocketData *sd = ssl_getSocketData(sckt);
     if (!sd) return -1;
     if (sd->connecting) return 0; // busy
@@ -736,6 +745,8 @@ int netSend(JsNetwork *net, SocketType socketType, int sckt, const void *buf, si
   } else
 #endif
   {
-    return net->send(net, socketType, sckt, buf, len);
+    int r = net->send(net, socketType, sckt, buf, len);
+    if (r) netWasBusy = true;
+    return r;
   }
 }
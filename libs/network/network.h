@@ -39,6 +39,8 @@ typedef enum {
 } PACKED_FLAGS JsNetworkState;
 
 extern JsNetworkState networkState; // FIXME put this in JsNetwork
+/// Set when a socket accepts, sends, receives or fails - see JsNetwork.wakesWhenReady
+extern bool netWasBusy;
 
 // This is all code for handling multiple types of network access with one binary
 typedef enum {
@@ -66,6 +68,9 @@ typedef struct JsNetwork {
   unsigned char _blank; ///< this is needed as jsvGetString for 'data' wants to add a trailing zero  
 
   int chunkSize; ///< Amount of memory to allocate for chunks of data when using send/recv
+  /** If set, jshSleep is woken when a socket becomes ready, so the idle loop
+   * only needs to stay awake if a socket did something (see netWasBusy) */
+  bool wakesWhenReady;
 
   /// Called on idle. Do any checks required for this device
   void (*idle)(struct JsNetwork *net);
@@ -82,6 +87,9 @@ typedef struct JsNetwork {
   void (*gethostbyname)(struct JsNetwork *net, char * hostName, uint32_t* out_ip_addr);
   /// Receive data if possible. returns nBytes on success, 0 on no data, or -1 on failure
   int (*recv)(struct JsNetwork *net, SocketType socketType, int sckt, void *buf, size_t len);
+  /** Optional: return true if recv on this socket has something to report (data or an error).
+   * If set, received data is read straight into a newly allocated string rather than via the stack */
+  bool (*recvReady)(struct JsNetwork *net, int sckt);
   /// Send data if possible. returns nBytes on success, 0 on no data, or -1 on failure
   int (*send)(struct JsNetwork *net, SocketType socketType, int sckt, const void *buf, size_t len);
 } PACKED_FLAGS JsNetwork;
@@ -29,6 +29,7 @@ static char *socketErrors[] = {
   "SSL handshake failed",
   "invalid SSL data",
   "no response",
+  "headers too big",
 };
 
 char *socketErrorString(int error) {
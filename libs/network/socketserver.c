@@ -20,6 +20,9 @@
 #include "jswrap_stream.h"
 #include "jswrap_string.h"
 #include "jswrap_functions.h"
+#ifdef USE_WEBSOCKET
+#include "mbedtls/include/mbedtls/sha1.h"
+#endif
 
 #define HTTP_NAME_SOCKETTYPE "type" // normal socket or HTTP
 #define HTTP_NAME_PORT "port"
@@ -28,12 +31,19 @@
 #define HTTP_NAME_ENDED "endd"
 #define HTTP_NAME_RECEIVE_DATA "dRcv"
 #define HTTP_NAME_RECEIVE_COUNT "cRcv"
-#define HTTP_NAME_SEND_DATA "dSnd"
+#define HTTP_NAME_SEND_DATA "dSnd"   // array of strings waiting to be sent
+#define HTTP_NAME_SEND_OFFSET "dSnO" // how much of the first string in HTTP_NAME_SEND_DATA was already sent
 #define HTTP_NAME_RESPONSE_VAR "res"
 #define HTTP_NAME_OPTIONS_VAR "opt"
 #define HTTP_NAME_SERVER_VAR "svr"
 #define HTTP_NAME_CHUNKED "chunked"
 #define HTTP_NAME_HEADERS "headers"
+#define HTTP_NAME_HEADER_PARSER "hPrs" // state of httpParseHeaders while headers are still arriving
+#define HTTP_NAME_KEEP_ALIVE "kAlv"  // boolean: the connection can be used for another request after this one
+#define HTTP_NAME_KEEP_ALIVE_TIMEOUT "kaTo" // JsSysTime at which an idle keep-alive connection is closed
+#define HTTP_NAME_STATUS_CODE "code" // status code from writeHead, for when we send the headers
+#define HTTP_NAME_HTTP10 "h10"       // boolean: the request was HTTP/1.0, so we can't send a 'chunked' response
+#define HTTP_NAME_UPGRADE "upgr"     // boolean: the request asked to be switched to a WebSocket
 #define HTTP_NAME_CLOSENOW "clsNow"  // boolean: gotta close
 #define HTTP_NAME_CONNECTED "conn"     // boolean: we are connected
 #define HTTP_NAME_CLOSE "cls"        // close after sending
@@ -45,9 +55,35 @@
 
 #define DGRAM_NAME_ON_MESSAGE JS_EVENT_PREFIX"message"
 
+#define HTTP_NAME_WEBSOCKET "ws"      // boolean: this connection is a WebSocket
+#define WS_NAME_MESSAGE "wsMsg"      // the fragments of a WebSocket message we have received so far
+#define WS_NAME_OPCODE "wsOp"        // the WebSocketOpcode of WS_NAME_MESSAGE
+#define WS_NAME_CLOSING "wsCls"      // boolean: we have sent a close frame
+#define WS_NAME_PENDING "wsPnd"      // boolean: frames came with the handshake and haven't been handled yet
+#define HTTP_NAME_ON_WEBSOCKET JS_EVENT_PREFIX"websocket"
+#define WS_NAME_ON_MESSAGE JS_EVENT_PREFIX"message"
+#define WS_NAME_ON_PONG JS_EVENT_PREFIX"pong"
+
 #define HTTP_ARRAY_HTTP_CLIENT_CONNECTIONS "HttpCC"
 #define HTTP_ARRAY_HTTP_SERVERS "HttpS"
 #define HTTP_ARRAY_HTTP_SERVER_CONNECTIONS "HttpSC"
+#define HTTP_ARRAY_HTTP_CLIENT_POOL "HttpCP" // idle keep-alive client connections
+#define HTTP_NAME_POOL_KEY "key" // "host:port" of a connection in HTTP_ARRAY_HTTP_CLIENT_POOL
+
+#ifndef HTTP_MAX_HEADER_SIZE
+#define HTTP_MAX_HEADER_SIZE 4096 // default for 'maxHeaderSize'
+#endif
+#ifndef HTTP_KEEP_ALIVE_TIMEOUT
+#define HTTP_KEEP_ALIVE_TIMEOUT 5000 // default for 'keepAliveTimeout' (milliseconds)
+#endif
+#ifndef HTTP_CLIENT_POOL_SIZE
+#define HTTP_CLIENT_POOL_SIZE 4 // the most idle keep-alive client connections we keep open
+#endif
+#define HTTP_HEADERS_TOO_BIG_RESPONSE "HTTP/1.1 431 Request Header Fields Too Large\r\nConnection: close\r\n\r\n"
+#ifndef WEBSOCKET_MAX_MESSAGE_SIZE
+#define WEBSOCKET_MAX_MESSAGE_SIZE 16384 // default for 'maxMessageSize'
+#endif
+#define WEBSOCKET_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11" // for Sec-WebSocket-Accept
 
 #ifdef ESP8266
 // esp8266 debugging, need to remove this eventually
@@ -90,109 +126,236 @@ static void httpAppendHeaders(JsVar *string, JsVar *headerObject) {
   // free headers
 }
 
-// httpParseHeaders(&receiveData, reqVar, true) // server
-// httpParseHeaders(&receiveData, resVar, false) // client
-bool httpParseHeaders(JsVar **receiveData, JsVar *objectForData, bool isServer) {
-  // find /r/n/r/n
-  int newlineIdx = 0;
-  int strIdx = 0;
+/// Well-known headers that httpParseHeaders acts on as it parses them
+typedef enum {
+  HTTP_HEADER_OTHER,
+  HTTP_HEADER_CONTENT_LENGTH,
+  HTTP_HEADER_TRANSFER_ENCODING,
+  HTTP_HEADER_CONNECTION,
+} HttpHeaderId;
+
+static const char *httpHeaderNames[] = {
+  0, // HTTP_HEADER_OTHER
+  "Content-Length",
+  "Transfer-Encoding",
+  "Connection",
+};
+
+/// Flags for the tokens we care about in a 'Connection' header
+typedef enum {
+  HTTP_CONNECTION_CLOSE = 1,
+  HTTP_CONNECTION_KEEP_ALIVE = 2,
+  HTTP_CONNECTION_UPGRADE = 4,
+} HttpConnectionFlags;
+
+/// Return HttpConnectionFlags for the value of a 'Connection' header (which may be a list like "keep-alive, Upgrade")
+static HttpConnectionFlags httpGetConnectionFlags(JsVar *value) {
+  char buf[32];
+  size_t i, len = jsvGetStringChars(value, 0, buf, sizeof(buf)-1);
+  for (i=0;i<len;i++) buf[i] = jsvStringCharToLower(buf[i]);
+  HttpConnectionFlags flags = 0;
+  if (strstr(buf, "close")) flags |= HTTP_CONNECTION_CLOSE;
+  if (strstr(buf, "keep-alive")) flags |= HTTP_CONNECTION_KEEP_ALIVE;
+  if (strstr(buf, "upgrade")) flags |= HTTP_CONNECTION_UPGRADE;
+  return flags;
+}
+
+/// Look up a header name (case insensitive) in httpHeaderNames
+static HttpHeaderId httpGetHeaderId(JsVar *name, size_t nameLen) {
+  unsigned int i;
+  for (i=1;i<sizeof(httpHeaderNames)/sizeof(httpHeaderNames[0]);i++)
+    if (strlen(httpHeaderNames[i])==nameLen && jsvIsStringIEqualAndUnLock(jsvLockAgain(name), httpHeaderNames[i]))
+      return (HttpHeaderId)i;
+  return HTTP_HEADER_OTHER;
+}
+
+/// State of httpParseHeaders, kept in HTTP_NAME_HEADER_PARSER while we wait for the rest of the headers
+typedef struct {
+  int pos;          ///< index in receiveData of the next character to parse
+  int lineStart;    ///< index of the start of the current line
+  int colon;        ///< index of the first ':' in the current line, or -1
+  int valueStart;   ///< index of the first non-whitespace character after the colon, or -1
+  int space1;       ///< index of the first space in the first line, or -1
+  int space2;       ///< index of the second space in the first line, or -1
+  int contentLength;
+  unsigned short lines; ///< how many lines we have parsed
+  bool chunked;
+  bool hasLength;   ///< we had a Content-Length header
+  bool http10;      ///< this is HTTP/1.0 (where connections aren't persistent by default)
+  unsigned char connection; ///< HttpConnectionFlags from the 'Connection' header
+  char lastChar;
+} HttpHeaderParser;
+
+/// Get a numeric option for this connection (from http.createServer's options for a server, or http.request's for a client)
+static JsVarFloat httpGetOption(JsVar *connection, bool isServer, const char *name, JsVarFloat defaultValue) {
+  JsVar *server = isServer ? jsvObjectGetChild(connection, HTTP_NAME_SERVER_VAR, 0) : jsvLockAgain(connection);
+  JsVar *options = server ? jsvObjectGetChild(server, HTTP_NAME_OPTIONS_VAR, 0) : 0;
+  jsvUnLock(server);
+  JsVar *value = jsvIsObject(options) ? jsvObjectGetChild(options, name, 0) : 0;
+  jsvUnLock(options);
+  JsVarFloat v = jsvIsNumeric(value) ? jsvGetFloat(value) : defaultValue;
+  jsvUnLock(value);
+  return v;
+}
+
+/// Create a new string from the characters [start,end) of str
+static JsVar *httpNewFromStringRange(JsVar *str, int start, int end) {
+  return jsvNewFromStringVar(str, (size_t)start, (end>start) ? (size_t)(end-start) : 0);
+}
+
+/// Called by httpParseHeaders for each complete line, lineEnd is the index of the CR (or LF)
+static void httpParseHeaderLine(HttpHeaderParser *p, JsVar *receiveData, int lineEnd, JsVar *objectForData, bool isServer) {
+  if (p->lines==0) {
+    // the request or status line
+    int space1 = (p->space1>=0) ? p->space1 : lineEnd;
+    int space2 = (p->space2>=0) ? p->space2 : lineEnd;
+    int afterSpace1 = (space1<lineEnd) ? space1+1 : lineEnd;
+    int afterSpace2 = (space2<lineEnd) ? space2+1 : lineEnd;
+    JsVar *version;
+    if (isServer) {
+      jsvObjectSetChildAndUnLock(objectForData, "method", httpNewFromStringRange(receiveData, p->lineStart, space1));
+      jsvObjectSetChildAndUnLock(objectForData, "url", httpNewFromStringRange(receiveData, afterSpace1, space2));
+      version = httpNewFromStringRange(receiveData, afterSpace2+5/*HTTP/*/, lineEnd);
+    } else {
+      version = httpNewFromStringRange(receiveData, p->lineStart+5/*HTTP/*/, space1);
+      jsvObjectSetChildAndUnLock(objectForData, "statusCode", httpNewFromStringRange(receiveData, afterSpace1, space2));
+      jsvObjectSetChildAndUnLock(objectForData, "statusMessage", httpNewFromStringRange(receiveData, afterSpace2, lineEnd));
+    }
+    p->http10 = jsvIsStringEqual(version, "1.0");
+    jsvObjectSetChildAndUnLock(objectForData, "httpVersion", version);
+    return;
+  }
+  if (p->colon <= p->lineStart) return; // not a header
+  JsVar *vHeaders = jsvObjectGetChild(objectForData, HTTP_NAME_HEADERS, JSV_OBJECT);
+  if (!vHeaders) return;
+  JsVar *hVal = httpNewFromStringRange(receiveData, (p->valueStart>=0) ? p->valueStart : lineEnd, lineEnd);
+  JsVar *hKey = jsvNewFromEmptyString();
+  if (hKey) {
+    size_t keyLen = (size_t)(p->colon - p->lineStart);
+    jsvMakeIntoVariableName(hKey, hVal);
+    jsvAppendStringVar(hKey, receiveData, (size_t)p->lineStart, keyLen);
+    jsvAddName(vHeaders, hKey);
+    switch (httpGetHeaderId(hKey, keyLen)) {
+      case HTTP_HEADER_CONTENT_LENGTH:
+        p->contentLength = jsvGetInteger(hVal);
+        p->hasLength = true;
+        break;
+      case HTTP_HEADER_TRANSFER_ENCODING:
+        p->chunked = compareTransferEncodingAndUnlock(jsvLockAgain(hVal), "chunked");
+        break;
+      case HTTP_HEADER_CONNECTION:
+        p->connection = (unsigned char)(p->connection | httpGetConnectionFlags(hVal));
+        break;
+      default: break;
+    }
+    jsvUnLock(hKey);
+  }
+  jsvUnLock2(hVal, vHeaders);
+}
+
+/** Parse HTTP headers from the start of receiveData into objectForData. We
+ * parse each line as it arrives and keep our position in HTTP_NAME_HEADER_PARSER,
+ * so headers that arrive a few bytes at a time don't get rescanned each time.
+ * Returns 1 (and removes the headers from receiveData) when all headers have been
+ * parsed, 0 if we need more data, or SOCKET_ERR_HEADERS_TOO_BIG if the headers
+ * were bigger than maxHeaderSize.
+ *
+ * httpParseHeaders(&receiveData, reqVar, true, maxHeaderSize) // server
+ * httpParseHeaders(&receiveData, resVar, false, maxHeaderSize) // client */
+static int httpParseHeaders(JsVar **receiveData, JsVar *objectForData, bool isServer, int maxHeaderSize) {
+  HttpHeaderParser p;
+  JsVar *state = jsvObjectGetChild(objectForData, HTTP_NAME_HEADER_PARSER, 0);
+  if (state) {
+    char buf[sizeof(HttpHeaderParser)+1]; // trailing 0 from jsvGetStringChars
+    jsvGetStringChars(state, 0, buf, sizeof(HttpHeaderParser)+1);
+    memcpy(&p, buf, sizeof(HttpHeaderParser));
+    jsvUnLock(state);
+  } else {
+    memset(&p, 0, sizeof(p));
+    p.colon = -1;
+    p.valueStart = -1;
+    p.space1 = -1;
+    p.space2 = -1;
+    jsvObjectSetChildAndUnLock(objectForData, HTTP_NAME_HEADERS, jsvNewObject());
+  }
+
   int headerEnd = -1;
   JsvStringIterator it;
-  jsvStringIteratorNew(&it, *receiveData, 0);
-  while (jsvStringIteratorHasChar(&it)) {
-    char ch = jsvStringIteratorGetChar(&it);
-    if (ch == '\r') {
-      if (newlineIdx==0) newlineIdx=1;
-      else if (newlineIdx==2) newlineIdx=3;
-    } else if (ch == '\n') {
-      if (newlineIdx==1) newlineIdx=2;
-      else if (newlineIdx==3) {
-        headerEnd = strIdx+1;
-        break;
-      }
-    } else newlineIdx=0;
-    jsvStringIteratorNext(&it);
-    strIdx++;
+  jsvStringIteratorNew(&it, *receiveData, (size_t)p.pos);
+  while (headerEnd<0 && jsvStringIteratorHasChar(&it)) {
+    unsigned char *data;
+    unsigned int i, len;
+    jsvStringIteratorGetPtrAndNext(&it, &data, &len);
+    for (i=0;i<len;i++) {
+      char ch = (char)data[i];
+      int idx = p.pos++;
+      if (ch=='\n') {
+        int lineEnd = (p.lastChar=='\r') ? idx-1 : idx;
+        if (lineEnd <= p.lineStart) {
+          if (p.lines) { // empty line - end of headers
+            headerEnd = idx+1;
+            break;
+          } // else ignore empty lines before the request/status line
+        } else {
+          httpParseHeaderLine(&p, *receiveData, lineEnd, objectForData, isServer);
+          p.lines++;
+        }
+        p.lineStart = idx+1;
+        p.colon = -1;
+        p.valueStart = -1;
+      } else if (ch==':') {
+        if (p.colon<0) p.colon = idx;
+        else if (p.valueStart<0) p.valueStart = idx;
+      } else if (ch==' ' || ch=='\t') {
+        if (!p.lines) {
+          if (p.space1<0) p.space1 = idx;
+          else if (p.space2<0) p.space2 = idx;
+        }
+      } else if (ch!='\r' && p.colon>=0 && p.valueStart<0)
+        p.valueStart = idx;
+      p.lastChar = ch;
+    }
   }
   jsvStringIteratorFree(&it);
-  // skip if we have no header
-  if (headerEnd<0) return false;
-  // Now parse the header
-  JsVar *vHeaders = jsvNewObject();
-  if (!vHeaders) return true;
-  jsvUnLock(jsvAddNamedChild(objectForData, vHeaders, HTTP_NAME_HEADERS));
-  strIdx = 0;
-  int firstSpace = -1;
-  int secondSpace = -1;
-  int firstEOL = -1;
-  int lineNumber = 0;
-  int lastLineStart = 0;
-  int colonPos = 0;
-  //jsiConsolePrintStringVar(receiveData);
-  jsvStringIteratorNew(&it, *receiveData, 0);
-    while (jsvStringIteratorHasChar(&it)) {
-      char ch = jsvStringIteratorGetChar(&it);
-      if (ch==' ' || ch=='\r') {
-        if (firstSpace<0) firstSpace = strIdx;
-        else if (secondSpace<0) secondSpace = strIdx;
-      }
-      if (ch == ':' && colonPos<0) colonPos = strIdx;
-      if (ch == '\r') {
-        if (firstEOL<0) firstEOL=strIdx;
-        if (lineNumber>0 && colonPos>lastLineStart && lastLineStart<strIdx) {
-          JsVar *hVal = jsvNewFromEmptyString();
-          if (hVal)
-            jsvAppendStringVar(hVal, *receiveData, (size_t)colonPos+2, (size_t)(strIdx-(colonPos+2)));
-          JsVar *hKey = jsvNewFromEmptyString();
-          if (hKey) {
-            jsvMakeIntoVariableName(hKey, hVal);
-            jsvAppendStringVar(hKey, *receiveData, (size_t)lastLineStart, (size_t)(colonPos-lastLineStart));
-            jsvAddName(vHeaders, hKey);
-            jsvUnLock(hKey);
-          }
-          jsvUnLock(hVal);
-        }
-        lineNumber++;
-        colonPos=-1;
-      }
-      if (ch == '\r' || ch == '\n') {
-        lastLineStart = strIdx+1;
-      }
 
-      jsvStringIteratorNext(&it);
-      strIdx++;
+  if (p.pos > maxHeaderSize) {
+    jsvObjectRemoveChild(objectForData, HTTP_NAME_HEADER_PARSER);
+    return SOCKET_ERR_HEADERS_TOO_BIG;
+  }
+  if (headerEnd<0) {
+    // not finished - save our state for when more data arrives
+    JsVar *stateName = jsvFindChildFromString(objectForData, HTTP_NAME_HEADER_PARSER, true);
+    state = jsvSkipName(stateName);
+    if (!state) {
+      state = jsvNewStringOfLength(sizeof(HttpHeaderParser), NULL);
+      jsvSetValueOfName(stateName, state);
     }
-    jsvStringIteratorFree(&it);
+    if (state) jsvSetString(state, (char*)&p, sizeof(HttpHeaderParser));
+    jsvUnLock2(stateName, state);
+    return 0;
+  }
+  jsvObjectRemoveChild(objectForData, HTTP_NAME_HEADER_PARSER);
   // flag the req/response if Transfer-Encoding:chunked was set
-  JsVarInt contentToReceive;
-  if (compareTransferEncodingAndUnlock(jsvObjectGetChildI(vHeaders, "Transfer-Encoding"), "chunked")) {
+  if (p.chunked)
     jsvObjectSetChildAndUnLock(objectForData, HTTP_NAME_CHUNKED, jsvNewFromBool(true));
-    contentToReceive = 1;
-  } else {
-    contentToReceive = jsvGetIntegerAndUnLock(jsvObjectGetChildI(vHeaders,"Content-Length"));
-  }
-  jsvObjectSetChildAndUnLock(objectForData, HTTP_NAME_RECEIVE_COUNT, jsvNewFromInteger(contentToReceive));
-  jsvUnLock(vHeaders);
-  // try and pull out methods/etc
-  if (isServer) {
-    jsvObjectSetChildAndUnLock(objectForData, "method", jsvNewFromStringVar(*receiveData, 0, (size_t)firstSpace));
-    jsvObjectSetChildAndUnLock(objectForData, "url", jsvNewFromStringVar(*receiveData, (size_t)(firstSpace+1), (size_t)(secondSpace-(firstSpace+1))));
-  } else {
-    jsvObjectSetChildAndUnLock(objectForData, "httpVersion", jsvNewFromStringVar(*receiveData, 5, (size_t)firstSpace-5));
-    jsvObjectSetChildAndUnLock(objectForData, "statusCode", jsvNewFromStringVar(*receiveData, (size_t)(firstSpace+1), (size_t)(secondSpace-(firstSpace+1))));
-    jsvObjectSetChildAndUnLock(objectForData, "statusMessage", jsvNewFromStringVar(*receiveData, (size_t)(secondSpace+1), (size_t)(firstEOL-(secondSpace+1))));
-  }
+  jsvObjectSetChildAndUnLock(objectForData, HTTP_NAME_RECEIVE_COUNT, jsvNewFromInteger(p.chunked ? 1 : p.contentLength));
+  /* Can the connection be used for another request after this one? Requests
+   * always say how long their body is, but a response without a length
+   * runs until the connection closes. */
+  bool persistent = p.http10 ? (p.connection & HTTP_CONNECTION_KEEP_ALIVE) : !(p.connection & HTTP_CONNECTION_CLOSE);
+  if (persistent && (isServer || p.hasLength || p.chunked))
+    jsvObjectSetChildAndUnLock(objectForData, HTTP_NAME_KEEP_ALIVE, jsvNewFromBool(true));
   // strip out the header
   JsVar *afterHeaders = jsvNewFromStringVar(*receiveData, (size_t)headerEnd, JSVAPPENDSTRINGVAR_MAXLENGTH);
   jsvUnLock(*receiveData);
   *receiveData = afterHeaders;
-  return true;
+  return 1;
 }
 
-size_t httpStringGet(JsVar *v, char *str, size_t len) {
+size_t httpStringGet(JsVar *v, size_t startChar, char *str, size_t len) {
   size_t l = len;
   JsvStringIterator it;
-  jsvStringIteratorNew(&it, v, 0);
+  jsvStringIteratorNew(&it, v, startChar);
   while (jsvStringIteratorHasChar(&it)) {
     if (l--==0) {
       jsvStringIteratorFree(&it);
@@ -258,48 +421,147 @@ NO_INLINE static void _socketCloseAllConnections(JsNetwork *net) {
   // shut down connections
   _socketCloseAllConnectionsFor(net, HTTP_ARRAY_HTTP_SERVER_CONNECTIONS);
   _socketCloseAllConnectionsFor(net, HTTP_ARRAY_HTTP_CLIENT_CONNECTIONS);
+  _socketCloseAllConnectionsFor(net, HTTP_ARRAY_HTTP_CLIENT_POOL);
   _socketCloseAllConnectionsFor(net, HTTP_ARRAY_HTTP_SERVERS);
 }
 
+/// Writes smaller than this are copied and merged together, rather than each being queued separately
+#define SOCKET_SEND_MERGE_SIZE 256
+/// The most strings from the send queue that we'll gather into a single send
+#define SOCKET_SEND_MAX_STRINGS 8
+
+/// Return true if there's anything in this send queue (HTTP_NAME_SEND_DATA)
+static bool socketHasSendData(JsVar *sendData) {
+  return jsvIsArray(sendData) && jsvGetFirstChild(sendData);
+}
+
+/// Add a string to the end of a send queue
+static void socketQueueSendData(JsVar *sendData, JsVar *str) {
+  size_t len = jsvGetStringLength(str);
+  if (!len) return;
+  if (len >= SOCKET_SEND_MERGE_SIZE) {
+    if (jsvIsNativeString(str) || jsvIsFlashString(str)) {
+      /* These point at memory we don't own (eg. a file in Storage) that could
+       * change (or be compacted away) before we've sent it - so copy them */
+      JsVar *copy = jsvNewFromStringVar(str, 0, JSVAPPENDSTRINGVAR_MAXLENGTH);
+      if (copy) jsvArrayPush(sendData, copy); // else out of memory
+      jsvUnLock(copy);
+      return;
+    }
+    // other big strings can't change, so are queued as-is rather than copied
+    jsvArrayPush(sendData, str);
+    return;
+  }
+  /* Small strings get copied, and merged with the last string if that was
+   * small too - which means it must also have been one of our copies */
+  JsVar *last = jsvGetLastArrayItem(sendData);
+  if (!jsvIsBasicString(last) || jsvGetStringLength(last)+len > SOCKET_SEND_MERGE_SIZE) {
+    jsvUnLock(last);
+    last = jsvNewFromEmptyString();
+    if (!last) return; // out of memory
+    jsvArrayPush(sendData, last);
+  }
+  jsvAppendStringVarComplete(last, str);
+  jsvUnLock(last);
+}
+
+/// Add a string to the end of a send queue, as a chunk for 'Transfer-Encoding: chunked'
+static void socketQueueSendDataChunked(JsVar *sendData, JsVar *str) {
+  JsVar *v = jsvVarPrintf("%x\r\n", jsvGetStringLength(str));
+  if (v) socketQueueSendData(sendData, v);
+  jsvUnLock(v);
+  socketQueueSendData(sendData, str);
+  v = jsvNewFromString("\r\n");
+  if (v) socketQueueSendData(sendData, v);
+  jsvUnLock(v);
+}
+
 // returns 0 on success and a (negative) error number on failure
-int socketSendData(JsNetwork *net, JsVar *connection, int sckt, JsVar **sendData) {
+int socketSendData(JsNetwork *net, JsVar *connection, int sckt, JsVar *sendData) {
   SocketType socketType = socketGetType(connection);
 
-  assert(!jsvIsEmptyString(*sendData));
-
-  size_t sndBufLen;
+  assert(socketHasSendData(sendData));
+  size_t offset = (size_t)jsvGetIntegerAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_SEND_OFFSET, 0));
+  JsVar *first = jsvSkipNameAndUnLock(jsvLock(jsvGetFirstChild(sendData)));
+  char *buf;
+  size_t bufLen = 0;
+  // lengths of the strings we're sending from, or 0 if we didn't get to the end of that string
+  size_t strLen[SOCKET_SEND_MAX_STRINGS];
+  int strCount = 0;
+
+  size_t dataLen;
+  char *dataPtr = jsvGetDataPointer(first, &dataLen);
   if ((socketType&ST_TYPE_MASK)==ST_UDP) {
-      sndBufLen = (size_t)jsvGetStringLength(*sendData);
-      if (sndBufLen+1024 > jsuGetFreeStack()) {
-          jsExceptionHere(JSET_ERROR, "Not enough free stack to send this amount of data");
-          return -1;
-      }
+    // one packet per string - send all of it
+    size_t sndBufLen = (size_t)jsvGetStringLength(first);
+    if (sndBufLen+1024 > jsuGetFreeStack()) {
+      jsExceptionHere(JSET_ERROR, "Not enough free stack to send this amount of data");
+      jsvUnLock(first);
+      return -1;
+    }
+    buf = alloca(sndBufLen); // allocate on stack
+    bufLen = httpStringGet(first, 0, buf, sndBufLen);
+    strLen[strCount++] = bufLen;
+  } else if (dataPtr && offset<dataLen) {
+    // we can send straight out of the string without copying
+    buf = dataPtr + offset;
+    bufLen = dataLen - offset;
+    if (bufLen > (size_t)net->chunkSize) bufLen = (size_t)net->chunkSize;
+    strLen[strCount++] = (offset+bufLen == dataLen) ? dataLen : 0;
   } else {
-      sndBufLen = (size_t)net->chunkSize;
+    // copy from as many queued strings as we can into one buffer
+    size_t sndBufLen = (size_t)net->chunkSize;
+    buf = alloca(sndBufLen+1); // allocate on stack
+    size_t strOffset = offset;
+    JsvObjectIterator it;
+    jsvObjectIteratorNew(&it, sendData);
+    while (jsvObjectIteratorHasValue(&it) && bufLen<sndBufLen && strCount<SOCKET_SEND_MAX_STRINGS) {
+      JsVar *str = jsvObjectIteratorGetValue(&it);
+      // ask for one more char than we have space for, so we know if we got to the end of the string
+      size_t l = httpStringGet(str, strOffset, &buf[bufLen], sndBufLen+1-bufLen);
+      if (bufLen+l > sndBufLen) {
+        bufLen = sndBufLen;
+        strLen[strCount++] = 0;
+      } else {
+        bufLen += l;
+        strLen[strCount++] = strOffset+l;
+      }
+      strOffset = 0;
+      jsvUnLock(str);
+      jsvObjectIteratorNext(&it);
+    }
+    jsvObjectIteratorFree(&it);
   }
-  char *buf = alloca(sndBufLen); // allocate on stack
+  jsvUnLock(first);
 
-  size_t bufLen = httpStringGet(*sendData, buf, sndBufLen);
-  int num = netSend(net, socketType, sckt, buf, bufLen);
+  int num = bufLen ? netSend(net, socketType, sckt, buf, bufLen) : 0;
   DBG("socketSendData %x:%d (%d -> %d)\n", *(uint32_t*)buf, *(unsigned short*)(buf+sizeof(uint32_t)), bufLen, num);
   if (num < 0) return num; // an error occurred
-  // Now cut what we managed to send off the beginning of sendData
-  if (num > 0) {
-    JsVar *newSendData = 0;
-    if (num < (int)jsvGetStringLength(*sendData)) {
-      // we didn't send all of it... cut out what we did send
-      newSendData = jsvNewFromStringVar(*sendData, (size_t)num, JSVAPPENDSTRINGVAR_MAXLENGTH);
-    } else {
-      // we sent all of it! Issue a drain event, unless we want to close, then we shouldn't
-      // callback for more data
-      bool wantClose = jsvGetBoolAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_CLOSE,0));
-      if (!wantClose) {
-        jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_DRAIN, &connection, 1);
-      }
-      newSendData = jsvNewFromEmptyString();
+  // Now remove whatever we have completely sent from the front of the queue
+  size_t sent = (size_t)num;
+  bool removed = false;
+  int i;
+  for (i=0;i<strCount;i++) {
+    if (!strLen[i] || sent < strLen[i]-offset) break;
+    sent -= strLen[i]-offset;
+    offset = 0;
+    jsvUnLock(jsvArrayPopFirst(sendData));
+    removed = true;
+  }
+  if (sent || removed) {
+    offset += sent;
+    if (offset)
+      jsvObjectSetChildAndUnLock(connection, HTTP_NAME_SEND_OFFSET, jsvNewFromInteger((JsVarInt)offset));
+    else
+      jsvObjectRemoveChild(connection, HTTP_NAME_SEND_OFFSET);
+  }
+  if (removed && !socketHasSendData(sendData)) {
+    // we sent all of it! Issue a drain event, unless we want to close, then we shouldn't
+    // callback for more data
+    bool wantClose = jsvGetBoolAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_CLOSE,0));
+    if (!wantClose) {
+      jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_DRAIN, &connection, 1);
     }
-    jsvUnLock(*sendData);
-    *sendData = newSendData;
   }
 
   return 0;
@@ -313,10 +575,13 @@ void socketPushReceiveData(JsVar *reader, JsVar **receiveData, bool isHttp, bool
 
   JsVar *nextChunk = 0;
   JsVar *partialChunk = 0;
+  JsVar *nextMessage = 0;
 
   // Keep track of how much we received (so we can close once we have it)
   if (isHttp) {
     size_t len = (size_t)jsvGetStringLength(*receiveData);
+    // on a keep-alive connection, anything after this message is the next request/response
+    bool keepAlive = jsvGetBoolAndUnLock(jsvObjectGetChild(reader, HTTP_NAME_KEEP_ALIVE, 0));
     if (jsvGetBoolAndUnLock(jsvObjectGetChild(reader, HTTP_NAME_CHUNKED, 0))) {
       // check for incomplete chunk, at least "0\r\n\r\n"
       if (len < 5) return; // incomplete, wait for more data
@@ -335,8 +600,11 @@ void socketPushReceiveData(JsVar *reader, JsVar **receiveData, bool isHttp, bool
       jsvObjectSetChildAndUnLock(reader, HTTP_NAME_RECEIVE_COUNT, jsvNewFromInteger(chunkLen ? 1 : 0));
       if (!chunkLen) { // no 'data' callback
         // clear received data
+        JsVar *afterChunks = 0;
+        if (keepAlive && startIdx+4 < len) // skip "0\r\n\r\n"
+          afterChunks = jsvNewFromStringVar(*receiveData, startIdx+4, JSVAPPENDSTRINGVAR_MAXLENGTH);
         jsvUnLock(*receiveData);
-        *receiveData = 0;
+        *receiveData = afterChunks;
         return;
       }
 
@@ -362,22 +630,29 @@ void socketPushReceiveData(JsVar *reader, JsVar **receiveData, bool isHttp, bool
       jsvUnLock(*receiveData);
       *receiveData = chunkData;
     } else {
-      jsvObjectSetChildAndUnLock(reader, HTTP_NAME_RECEIVE_COUNT,
-        jsvNewFromInteger(
-          jsvGetIntegerAndUnLock(jsvObjectGetChild(reader, HTTP_NAME_RECEIVE_COUNT, JSV_INTEGER)) - (JsVarInt)len)
-        );
+      JsVarInt contentToReceive = jsvGetIntegerAndUnLock(jsvObjectGetChild(reader, HTTP_NAME_RECEIVE_COUNT, JSV_INTEGER));
+      if (keepAlive && (JsVarInt)len > contentToReceive) {
+        if (contentToReceive <= 0) return; // it's all for the next message
+        nextMessage = jsvNewFromStringVar(*receiveData, (size_t)contentToReceive, JSVAPPENDSTRINGVAR_MAXLENGTH);
+        JsVar *body = jsvNewFromStringVar(*receiveData, 0, (size_t)contentToReceive);
+        jsvUnLock(*receiveData);
+        *receiveData = body;
+        len = (size_t)contentToReceive;
+      }
+      jsvObjectSetChildAndUnLock(reader, HTTP_NAME_RECEIVE_COUNT, jsvNewFromInteger(contentToReceive - (JsVarInt)len));
     }
   }
 
   // execute 'data' callback or save data
   if (!jswrap_stream_pushData(reader, *receiveData, force)) {
-    jsvUnLock2(nextChunk, partialChunk);
+    if (nextMessage) jsvAppendStringVarComplete(*receiveData, nextMessage);
+    jsvUnLock3(nextChunk, partialChunk, nextMessage);
     return;
   }
 
   // clear received data
   jsvUnLock(*receiveData);
-  *receiveData = nextChunk ? nextChunk : partialChunk;
+  *receiveData = nextChunk ? nextChunk : (partialChunk ? partialChunk : nextMessage);
 
   if (nextChunk) { // process following chunks if any
     socketPushReceiveData(reader, receiveData, isHttp, force);
@@ -412,23 +687,259 @@ void socketReceivedUDP(JsVar *connection, JsVar **receiveData) {
   }
 }
 
-void socketReceived(JsVar *connection, JsVar *socket, SocketType socketType, JsVar **receiveData, bool isServer) {
+#ifdef USE_WEBSOCKET
+/// Did this request (that we have just had the headers for) ask to be a WebSocket, and can we handle it?
+static bool webSocketWanted(JsVar *req, JsVar *server) {
+  // without a 'websocket' handler, the request is passed to JS as normal
+  JsVar *handler = jsvObjectGetChild(server, HTTP_NAME_ON_WEBSOCKET, 0);
+  if (!handler) return false;
+  jsvUnLock(handler);
+  JsVar *headers = jsvObjectGetChild(req, HTTP_NAME_HEADERS, 0);
+  JsVar *connectionHeader = jsvObjectGetChildI(headers, "Connection");
+  JsVar *key = jsvObjectGetChildI(headers, "Sec-WebSocket-Key");
+  bool wanted = key && connectionHeader &&
+                (httpGetConnectionFlags(connectionHeader) & HTTP_CONNECTION_UPGRADE) &&
+                jsvIsStringIEqualAndUnLock(jsvObjectGetChildI(headers, "Upgrade"), "websocket");
+  jsvUnLock3(headers, connectionHeader, key);
+  return wanted;
+}
+
+/// Work out the value of Sec-WebSocket-Accept for the client's Sec-WebSocket-Key
+static JsVar *webSocketAcceptKey(JsVar *key) {
+  char buf[64+sizeof(WEBSOCKET_GUID)];
+  size_t len = jsvGetStringChars(key, 0, buf, 64);
+  strcpy(&buf[len], WEBSOCKET_GUID);
+  unsigned char hash[20];
+  mbedtls_sha1((unsigned char *)buf, len+strlen(WEBSOCKET_GUID), hash);
+  JsVar *hashStr = jsvNewStringOfLength(sizeof(hash), (char *)hash);
+  JsVar *accept = hashStr ? jswrap_btoa(hashStr) : 0;
+  jsvUnLock(hashStr);
+  return accept;
+}
+
+/// Queue a WebSocket frame (the whole of 'data') to send
+void webSocketSend(JsVar *ws, JsVar *data, WebSocketOpcode opcode) {
+  if (!_socketConnectionOpen(ws) || jsvGetBoolAndUnLock(jsvObjectGetChild(ws, WS_NAME_CLOSING, 0))) {
+    jsExceptionHere(JSET_ERROR, "This socket is closed.");
+    return;
+  }
+  JsVar *payload;
+  if (jsvIsArrayBuffer(data)) {
+    // send the bytes of ArrayBuffers/typed arrays as a binary message
+    JSV_GET_AS_CHAR_ARRAY(dataPtr, dataLen, data);
+    if (!dataPtr) return;
+    payload = jsvNewStringOfLength((unsigned int)dataLen, dataPtr);
+    if (opcode==WS_OPCODE_TEXT) opcode = WS_OPCODE_BINARY;
+  } else {
+    payload = jsvIsUndefined(data) ? jsvNewFromEmptyString() : jsvAsString(data);
+  }
+  if (!payload) return; // out of memory
+  size_t len = jsvGetStringLength(payload);
+  // server frames aren't masked, so all we need is a header
+  char header[10];
+  size_t headerLen = 2;
+  header[0] = (char)(0x80 | opcode); // FIN - we always send whole messages
+  if (len < 126) {
+    header[1] = (char)len;
+  } else if (len < 65536) {
+    header[1] = 126;
+    header[2] = (char)(len>>8);
+    header[3] = (char)len;
+    headerLen = 4;
+  } else {
+    header[1] = 127;
+    int i;
+    for (i=0;i<8;i++)
+      header[2+i] = (char)((uint64_t)len >> (8*(7-i)));
+    headerLen = 10;
+  }
+  JsVar *sendData = jsvObjectGetChild(ws, HTTP_NAME_SEND_DATA, 0);
+  if (!sendData) {
+    sendData = jsvNewEmptyArray();
+    jsvObjectSetChild(ws, HTTP_NAME_SEND_DATA, sendData);
+  }
+  JsVar *headerStr = jsvNewStringOfLength((unsigned int)headerLen, header);
+  if (sendData && headerStr) {
+    socketQueueSendData(sendData, headerStr);
+    if (len) socketQueueSendData(sendData, payload);
+  }
+  jsvUnLock3(headerStr, payload, sendData);
+}
+
+/// Send a close frame with the given status code, and close the connection once it has gone
+void webSocketClose(JsVar *ws, int code) {
+  if (!_socketConnectionOpen(ws) || jsvGetBoolAndUnLock(jsvObjectGetChild(ws, WS_NAME_CLOSING, 0)))
+    return; // already closing
+  JsVar *payload = 0;
+  if (code) {
+    char codeStr[2] = { (char)(code>>8), (char)code };
+    payload = jsvNewStringOfLength(2, codeStr);
+  }
+  webSocketSend(ws, payload, WS_OPCODE_CLOSE);
+  jsvUnLock(payload);
+  jsvObjectSetChildAndUnLock(ws, WS_NAME_CLOSING, jsvNewFromBool(true));
+  jsvObjectSetChildAndUnLock(ws, HTTP_NAME_CLOSE, jsvNewFromBool(true));
+}
+
+/** Handle the WebSocket frames at the start of receiveData. Whole messages are passed
+ * to 'message' listeners, and anything after the last complete frame is left in receiveData */
+static void webSocketReceived(JsVar *ws, JsVar **receiveData) {
+  size_t len = jsvGetStringLength(*receiveData);
+  size_t offset = 0; // start of the frame we're looking at
+  while (offset < len && !jsvGetBoolAndUnLock(jsvObjectGetChild(ws, WS_NAME_CLOSING, 0))) {
+    unsigned char header[14];
+    size_t available = httpStringGet(*receiveData, offset, (char *)header, sizeof(header));
+    if (available < 2) break;
+    bool fin = (header[0]&0x80)!=0;
+    WebSocketOpcode opcode = (WebSocketOpcode)(header[0]&0x0F);
+    bool isControl = opcode >= WS_OPCODE_CLOSE;
+    uint64_t payloadLen = header[1]&0x7F;
+    size_t headerLen = 2;
+    if (payloadLen==126) headerLen += 2;
+    else if (payloadLen==127) headerLen += 8;
+    // clients must always mask what they send
+    if (!(header[1]&0x80)) {
+      webSocketClose(ws, WS_CLOSE_PROTOCOL_ERROR);
+      break;
+    }
+    const unsigned char *mask = &header[headerLen];
+    headerLen += 4;
+    if (available < headerLen) break; // wait for the rest of the header
+    int i;
+    if (payloadLen==126) {
+      payloadLen = ((uint64_t)header[2]<<8) | header[3];
+    } else if (payloadLen==127) {
+      payloadLen = 0;
+      for (i=0;i<8;i++) payloadLen = (payloadLen<<8) | header[2+i];
+    }
+    // control frames can't be fragmented, and are small
+    if (isControl && (!fin || payloadLen>125)) {
+      webSocketClose(ws, WS_CLOSE_PROTOCOL_ERROR);
+      break;
+    }
+    JsVar *message = jsvObjectGetChild(ws, WS_NAME_MESSAGE, 0);
+    if (!isControl && payloadLen + (message ? jsvGetStringLength(message) : 0) >
+        (uint64_t)httpGetOption(ws, true, "maxMessageSize", WEBSOCKET_MAX_MESSAGE_SIZE)) {
+      jsvUnLock(message);
+      webSocketClose(ws, WS_CLOSE_TOO_BIG);
+      break;
+    }
+    if (len-offset < headerLen+payloadLen) {
+      jsvUnLock(message);
+      break; // wait for the rest of the frame
+    }
+    // copy out the payload and unmask it
+    JsVar *payload = jsvNewFromStringVar(*receiveData, offset+headerLen, (size_t)payloadLen);
+    offset += headerLen+(size_t)payloadLen;
+    if (!payload) { // out of memory
+      jsvUnLock(message);
+      break;
+    }
+    JsvStringIterator it;
+    jsvStringIteratorNew(&it, payload, 0);
+    size_t n = 0;
+    while (jsvStringIteratorHasChar(&it)) {
+      unsigned char *ptr;
+      unsigned int ptrLen;
+      jsvStringIteratorGetPtrAndNext(&it, &ptr, &ptrLen);
+      while (ptrLen--) *(ptr++) ^= mask[(n++)&3];
+    }
+    jsvStringIteratorFree(&it);
+
+    if (opcode==WS_OPCODE_TEXT || opcode==WS_OPCODE_BINARY) {
+      if (message) { // we hadn't finished the last one
+        webSocketClose(ws, WS_CLOSE_PROTOCOL_ERROR);
+      } else if (fin) {
+        jsiQueueObjectCallbacks(ws, WS_NAME_ON_MESSAGE, &payload, 1);
+      } else { // the first fragment
+        jsvObjectSetChild(ws, WS_NAME_MESSAGE, payload);
+        jsvObjectSetChildAndUnLock(ws, WS_NAME_OPCODE, jsvNewFromInteger(opcode));
+      }
+    } else if (opcode==WS_OPCODE_CONTINUATION) {
+      if (!message) {
+        webSocketClose(ws, WS_CLOSE_PROTOCOL_ERROR);
+      } else {
+        jsvAppendStringVarComplete(message, payload);
+        if (fin) {
+          jsiQueueObjectCallbacks(ws, WS_NAME_ON_MESSAGE, &message, 1);
+          jsvObjectRemoveChild(ws, WS_NAME_MESSAGE);
+          jsvObjectRemoveChild(ws, WS_NAME_OPCODE);
+        }
+      }
+    } else if (opcode==WS_OPCODE_PING) {
+      webSocketSend(ws, payload, WS_OPCODE_PONG);
+    } else if (opcode==WS_OPCODE_PONG) {
+      jsiQueueObjectCallbacks(ws, WS_NAME_ON_PONG, &payload, 1);
+    } else if (opcode==WS_OPCODE_CLOSE) {
+      // reply with the same status code, then close
+      int code = 0;
+      if (payloadLen>=2) {
+        char codeStr[2];
+        jsvGetStringChars(payload, 0, codeStr, 2);
+        code = ((unsigned char)codeStr[0]<<8) | (unsigned char)codeStr[1];
+      }
+      webSocketClose(ws, code);
+    } else { // unknown opcode
+      webSocketClose(ws, WS_CLOSE_PROTOCOL_ERROR);
+    }
+    jsvUnLock2(payload, message);
+  }
+  // keep whatever we haven't handled yet
+  if (offset) {
+    JsVar *rest = (offset<len) ? jsvNewFromStringVar(*receiveData, offset, JSVAPPENDSTRINGVAR_MAXLENGTH) : 0;
+    jsvUnLock(*receiveData);
+    *receiveData = rest;
+  }
+}
+#endif
+
+/// Handle newly received data. Returns 0, or a (negative) socket error if the connection should be closed
+int socketReceived(JsVar *connection, JsVar *socket, SocketType socketType, JsVar **receiveData, bool isServer) {
   if ((socketType&ST_TYPE_MASK)==ST_UDP) {
     socketReceivedUDP(connection, receiveData);
-    return;
+    return 0;
   }
+#ifdef USE_WEBSOCKET
+  if (isServer && jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_WEBSOCKET, 0))) {
+    webSocketReceived(connection, receiveData);
+    return 0;
+  }
+#endif
   JsVar *reader = isServer ? connection : socket;
   bool isHttp = (socketType&ST_TYPE_MASK)==ST_HTTP;
   bool hadHeaders = jsvGetBoolAndUnLock(jsvObjectGetChild(reader,HTTP_NAME_HAD_HEADERS,0));
   if (!hadHeaders) {
-    if (!isHttp) {
-      hadHeaders = true;
-    } else if (httpParseHeaders(receiveData, reader, isServer)) {
-      hadHeaders = true;
-
+    int parsed = 1;
+    if (isHttp)
+      parsed = httpParseHeaders(receiveData, reader, isServer, (int)httpGetOption(connection, isServer, "maxHeaderSize", HTTP_MAX_HEADER_SIZE));
+    if (parsed < 0) {
+      // headers were too big - throw away what we have
+      jsvUnLock(*receiveData);
+      *receiveData = 0;
+      return parsed;
+    }
+    if (parsed && isHttp) {
       // on connect only when just parsed the HTTP headers
       if (isServer) {
+        // no longer idle. If the client wants to keep the connection open, let the response know
+        jsvObjectRemoveChild(connection, HTTP_NAME_KEEP_ALIVE_TIMEOUT);
+        if (jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_KEEP_ALIVE, 0)) &&
+            httpGetOption(connection, true, "keepAliveTimeout", HTTP_KEEP_ALIVE_TIMEOUT) > 0)
+          jsvObjectSetChildAndUnLock(socket, HTTP_NAME_KEEP_ALIVE, jsvNewFromBool(true));
+        JsVar *version = jsvObjectGetChild(connection, "httpVersion", 0);
+        if (version && jsvIsStringEqual(version, "1.0"))
+          jsvObjectSetChildAndUnLock(socket, HTTP_NAME_HTTP10, jsvNewFromBool(true));
+        jsvUnLock(version);
         JsVar *server = jsvObjectGetChild(connection,HTTP_NAME_SERVER_VAR,0);
+#ifdef USE_WEBSOCKET
+        if (webSocketWanted(connection, server)) {
+          // socketServerConnectionsIdle swaps the request for a WebSocket
+          jsvObjectSetChildAndUnLock(connection, HTTP_NAME_UPGRADE, jsvNewFromBool(true));
+          jsvObjectSetChildAndUnLock(connection, HTTP_NAME_HAD_HEADERS, jsvNewFromBool(true));
+          jsvUnLock(server);
+          return 0;
+        }
+#endif
         JsVar *args[2] = { connection, socket };
         jsiQueueObjectCallbacks(server, HTTP_NAME_ON_CONNECT, args, isHttp ? 2 : 1);
         jsvUnLock(server);
@@ -436,13 +947,15 @@ void socketReceived(JsVar *connection, JsVar *socket, SocketType socketType, JsV
         jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_CONNECT, &socket, 1);
       }
     }
+    hadHeaders = parsed!=0;
     jsvObjectSetChildAndUnLock(reader, HTTP_NAME_HAD_HEADERS, jsvNewFromBool(hadHeaders));
   }
   if (!hadHeaders) {
     // no headers yet, no 'data' callback
-    return;
+    return 0;
   }
   socketPushReceiveData(reader, receiveData, isHttp, false);
+  return 0;
 }
 
 
@@ -487,6 +1000,186 @@ static bool fireErrorEvent(int error, JsVar *obj1, JsVar *obj2) {
 
 // -----------------------------
 
+/** Receive from a socket into a new string, returning 0 if nothing was received.
+ * If the network can tell us data is waiting, we receive straight into a flat
+ * string which is then handed on without being copied again. Otherwise we
+ * receive into 'buf' (chunkSize bytes) and copy it into a string in one go.
+ * '*num' is set to the result of netRecv. */
+static JsVar *socketRecv(JsNetwork *net, SocketType socketType, int sckt, char *buf, int *num) {
+  JsVar *data = 0;
+  if (net->recvReady && !(socketType&ST_TLS) && net->recvReady(net, sckt)) {
+    data = jsvNewFlatStringOfLength((unsigned int)net->chunkSize);
+    if (data) {
+      char *ptr = jsvGetFlatStringPointer(data);
+      *num = netRecv(net, socketType, sckt, ptr, (size_t)net->chunkSize);
+      if (*num > JSV_FLAT_STRING_BREAK_EVEN) {
+        jsvShrinkFlatString(data, (size_t)*num);
+      } else {
+        // not worth keeping a flat string for this (and we may append to it) - copy
+        JsVar *flat = data;
+        data = (*num > 0) ? jsvNewStringOfLength((unsigned int)*num, ptr) : 0;
+        jsvUnLock(flat);
+      }
+      return data;
+    }
+  }
+  *num = netRecv(net, socketType, sckt, buf, (size_t)net->chunkSize);
+  if (*num > 0)
+    data = jsvNewStringOfLength((unsigned int)*num, buf);
+  return data;
+}
+
+/// Add newly received data onto any data we already had
+static JsVar *socketAppendReceived(JsVar *receiveData, JsVar *data) {
+  if (!receiveData || jsvIsEmptyString(receiveData)) {
+    jsvUnLock(receiveData);
+    return data;
+  }
+  jsvAppendStringVarComplete(receiveData, data);
+  jsvUnLock(data);
+  return receiveData;
+}
+
+/// When the timer we set to close idle keep-alive connections will fire (or 0)
+static JsSysTime socketKeepAliveWakeTime = 0;
+
+static void socketKeepAliveWake() {
+  // Nothing to do - being woken up means socketIdle gets to close connections that have timed out
+  socketKeepAliveWakeTime = 0;
+}
+
+/// Make sure we're woken at 'deadline' (otherwise we might sleep until a socket is ready)
+static void socketKeepAliveWakeAt(JsSysTime deadline) {
+  JsSysTime now = jshGetSystemTime();
+  if (socketKeepAliveWakeTime > now && socketKeepAliveWakeTime <= deadline) return; // we already will be
+  socketKeepAliveWakeTime = deadline;
+  jsvUnLock(jsiSetTimeout(socketKeepAliveWake, jshGetMillisecondsFromTime(deadline-now)+1));
+}
+
+/// Set when this idle keep-alive connection will be closed
+static void socketSetKeepAliveTimeout(JsVar *connection, JsVarFloat milliseconds) {
+  JsSysTime deadline = jshGetSystemTime() + jshGetTimeFromMilliseconds(milliseconds);
+  jsvObjectSetChildAndUnLock(connection, HTTP_NAME_KEEP_ALIVE_TIMEOUT, jsvNewFromLongInteger(deadline));
+  socketKeepAliveWakeAt(deadline);
+}
+
+/// Has this idle keep-alive connection timed out?
+static bool socketKeepAliveTimedOut(JsVar *connection) {
+  JsVar *timeout = jsvObjectGetChild(connection, HTTP_NAME_KEEP_ALIVE_TIMEOUT, 0);
+  if (!timeout) return false;
+  JsSysTime deadline = (JsSysTime)jsvGetLongIntegerAndUnLock(timeout);
+  if (jshGetSystemTime() >= deadline) return true;
+  socketKeepAliveWakeAt(deadline);
+  return false;
+}
+
+/// Create a new request (with its response in HTTP_NAME_RESPONSE_VAR) for a connection to an HTTP server
+static JsVar *socketServerNewRequest(JsVar *server, int sckt) {
+  JsVar *req = jspNewObject(0, "httpSRq");
+  JsVar *res = jspNewObject(0, "httpSRs");
+  if (res && req) { // out of memory?
+    socketSetType(req, ST_HTTP);
+    jsvObjectSetChild(req, HTTP_NAME_RESPONSE_VAR, res);
+    jsvObjectSetChild(req, HTTP_NAME_SERVER_VAR, server);
+    jsvObjectSetChildAndUnLock(req, HTTP_NAME_SOCKET, jsvNewFromInteger(sckt+1));
+    jsvObjectSetChildAndUnLock(res, HTTP_NAME_SOCKET, jsvNewFromInteger(sckt+1));
+  } else {
+    jsvUnLock(req);
+    req = 0;
+  }
+  jsvUnLock(res);
+  return req;
+}
+
+/// Fire the 'end' and 'close' events when a server's connection (or request/response) is finished with
+static void socketServerFireClose(JsVar *connection, JsVar *socket, bool hadError) {
+  // fire end listeners
+  jsiQueueObjectCallbacks(socket, HTTP_NAME_ON_END, NULL, 0);
+
+  // fire the close listeners
+  JsVar *params[1] = { jsvNewFromBool(hadError) };
+  if (connection!=socket)
+    jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_CLOSE, params, 1);
+  jsiQueueObjectCallbacks(socket, HTTP_NAME_ON_CLOSE, params, 1);
+  jsvUnLock(params[0]);
+}
+
+/** A response has been sent on a keep-alive connection. Put a new request/response
+ * for the same socket where 'it' points (instead of 'connection') and handle any
+ * pipelined request that we have already received. Returns 0, or a (negative)
+ * socket error if the connection should be closed */
+static int socketServerNextRequest(JsvObjectIterator *it, JsVar *connection, JsVar *socket, SocketType socketType, int sckt) {
+  JsVar *server = jsvObjectGetChild(connection, HTTP_NAME_SERVER_VAR, 0);
+  JsVar *req = socketServerNewRequest(server, sckt);
+  jsvUnLock(server);
+  if (!req) return SOCKET_ERR_MEM;
+  socketSetType(req, socketType);
+  JsVar *res = jsvObjectGetChild(req, HTTP_NAME_RESPONSE_VAR, 0);
+  JsVar *receiveData = jsvObjectGetChild(connection, HTTP_NAME_RECEIVE_DATA, 0);
+  // The old request and response are finished with
+  jsvObjectRemoveChild(connection, HTTP_NAME_RECEIVE_DATA);
+  jsvObjectRemoveChild(connection, HTTP_NAME_SOCKET);
+  jsvObjectRemoveChild(socket, HTTP_NAME_SOCKET);
+  socketServerFireClose(connection, socket, false);
+  jsvObjectIteratorSetValue(it, req);
+  socketSetKeepAliveTimeout(req, httpGetOption(req, true, "keepAliveTimeout", HTTP_KEEP_ALIVE_TIMEOUT));
+  int error = 0;
+  if (receiveData && !jsvIsEmptyString(receiveData)) // a pipelined request
+    error = socketReceived(req, res, socketType, &receiveData, true);
+  jsvObjectSetChild(req, HTTP_NAME_RECEIVE_DATA, receiveData);
+  jsvUnLock3(receiveData, res, req);
+  return error;
+}
+
+#ifdef USE_WEBSOCKET
+/** The request 'connection' (where 'it' points) asked to be a WebSocket. Reply with the
+ * handshake, put a WebSocket for the same socket in its place and pass it to the server's
+ * 'websocket' listeners. Returns 0, or a (negative) socket error if the connection should be closed */
+static int socketServerUpgrade(JsvObjectIterator *it, JsVar *connection, SocketType socketType, int sckt) {
+  JsVar *ws = jspNewObject(0, "httpWS");
+  JsVar *sendData = jsvNewEmptyArray();
+  JsVar *headers = jsvObjectGetChild(connection, HTTP_NAME_HEADERS, 0);
+  JsVar *key = jsvObjectGetChildI(headers, "Sec-WebSocket-Key");
+  JsVar *accept = key ? webSocketAcceptKey(key) : 0;
+  jsvUnLock2(headers, key);
+  JsVar *handshake = accept ? jsvVarPrintf("HTTP/1.1 101 Switching Protocols\r\n"
+                                           "Upgrade: websocket\r\n"
+                                           "Connection: Upgrade\r\n"
+                                           "Sec-WebSocket-Accept: %v\r\n\r\n", accept) : 0;
+  jsvUnLock(accept);
+  if (!ws || !sendData || !handshake) { // out of memory
+    jsvUnLock3(ws, sendData, handshake);
+    return SOCKET_ERR_MEM;
+  }
+  socketSetType(ws, ST_NORMAL | (socketType & ST_TLS));
+  jsvObjectSetChildAndUnLock(ws, HTTP_NAME_WEBSOCKET, jsvNewFromBool(true));
+  jsvObjectSetChildAndUnLock(ws, HTTP_NAME_SOCKET, jsvNewFromInteger(sckt+1));
+  jsvObjectSetChildAndUnLock(ws, HTTP_NAME_SERVER_VAR, jsvObjectGetChild(connection, HTTP_NAME_SERVER_VAR, 0));
+  socketQueueSendData(sendData, handshake);
+  jsvObjectSetChild(ws, HTTP_NAME_SEND_DATA, sendData);
+  jsvUnLock2(sendData, handshake);
+  // anything after the headers is WebSocket frames
+  JsVar *receiveData = jsvObjectGetChild(connection, HTTP_NAME_RECEIVE_DATA, 0);
+  jsvObjectRemoveChild(connection, HTTP_NAME_RECEIVE_DATA);
+  // the request and response no longer own the socket
+  JsVar *res = jsvObjectGetChild(connection, HTTP_NAME_RESPONSE_VAR, 0);
+  jsvObjectRemoveChild(connection, HTTP_NAME_SOCKET);
+  jsvObjectRemoveChild(res, HTTP_NAME_SOCKET);
+  jsvUnLock(res);
+  jsvObjectIteratorSetValue(it, ws);
+
+  JsVar *server = jsvObjectGetChild(ws, HTTP_NAME_SERVER_VAR, 0);
+  JsVar *args[2] = { ws, connection };
+  jsiQueueObjectCallbacks(server, HTTP_NAME_ON_WEBSOCKET, args, 2);
+  jsvUnLock(server);
+  if (receiveData && !jsvIsEmptyString(receiveData))
+    jsvObjectSetChildAndUnLock(ws, WS_NAME_PENDING, jsvNewFromBool(true));
+  jsvObjectSetChild(ws, HTTP_NAME_RECEIVE_DATA, receiveData);
+  jsvUnLock2(receiveData, ws);
+  return 0;
+}
+#endif
+
 bool socketServerConnectionsIdle(JsNetwork *net) {
   char *buf = alloca((size_t)net->chunkSize); // allocate on stack
 
@@ -510,28 +1203,51 @@ bool socketServerConnectionsIdle(JsNetwork *net) {
     int error = 0;
 
     if (!closeConnectionNow) {
-      int num = netRecv(net, socketType, sckt, buf, (size_t)net->chunkSize);
+      int num = 0;
+      JsVar *data = socketRecv(net, socketType, sckt, buf, &num);
       if (num<0) {
         // we probably disconnected so just get rid of this
         closeConnectionNow = true;
         error = num;
       } else {
-        if (num>0) {
+        if (data) {
+          JsVar *receiveData = socketAppendReceived(jsvObjectGetChild(connection,HTTP_NAME_RECEIVE_DATA,0), data);
+          error = socketReceived(connection, socket, socketType, &receiveData, true);
+          if (error == SOCKET_ERR_HEADERS_TOO_BIG) // tell the client why we're closing the connection
+            netSend(net, socketType, sckt, HTTP_HEADERS_TOO_BIG_RESPONSE, sizeof(HTTP_HEADERS_TOO_BIG_RESPONSE)-1);
+          jsvObjectSetChild(connection,HTTP_NAME_RECEIVE_DATA,receiveData);
+          jsvUnLock(receiveData);
+        }
+#ifdef USE_WEBSOCKET
+        else if (!isHttp && jsvGetBoolAndUnLock(jsvObjectGetChild(connection, WS_NAME_PENDING, 0))) {
+          // frames that came with the handshake - the 'websocket' listeners have been called now
+          jsvObjectRemoveChild(connection, WS_NAME_PENDING);
           JsVar *receiveData = jsvObjectGetChild(connection,HTTP_NAME_RECEIVE_DATA,0);
-          if (!receiveData) receiveData = jsvNewFromEmptyString();
-          if (receiveData) {
-            jsvAppendStringBuf(receiveData, buf, (size_t)num);
-            socketReceived(connection, socket, socketType, &receiveData, true);
-            jsvObjectSetChild(connection,HTTP_NAME_RECEIVE_DATA,receiveData);
-            jsvUnLock(receiveData);
-          }
+          webSocketReceived(connection, &receiveData);
+          jsvObjectSetChild(connection,HTTP_NAME_RECEIVE_DATA,receiveData);
+          jsvUnLock(receiveData);
+        }
+#endif
+      }
+#ifdef USE_WEBSOCKET
+      if (isHttp && !error && jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_UPGRADE, 0))) {
+        error = socketServerUpgrade(&it, connection, socketType, sckt);
+        if (error) {
+          closeConnectionNow = true;
+        } else { // carry on with the WebSocket
+          jsvUnLock2(connection, socket);
+          connection = jsvObjectIteratorGetValue(&it);
+          socket = jsvLockAgain(connection);
+          socketType = socketGetType(connection);
+          isHttp = false;
         }
       }
+#endif
 
       // send data if possible
       JsVar *sendData = jsvObjectGetChild(socket,HTTP_NAME_SEND_DATA,0);
-      if (sendData && !jsvIsEmptyString(sendData)) {
-        int sent = socketSendData(net, socket, sckt, &sendData);
+      if (socketHasSendData(sendData)) {
+        int sent = socketSendData(net, socket, sckt, sendData);
         // FIXME? checking for errors is a bit iffy. With the esp8266 network that returns
         // varied error codes we'd want to skip SOCKET_ERR_CLOSED and let the recv side deal
         // with normal closing so we don't miss the tail of what's received, but other drivers
@@ -541,25 +1257,48 @@ bool socketServerConnectionsIdle(JsNetwork *net) {
           closeConnectionNow = true;
           error = sent;
         }
-        jsvObjectSetChild(socket, HTTP_NAME_SEND_DATA, sendData); // socketSendData updated sendData
       }
       // only close if we want to close, have no data to send, and aren't receiving data
-      if ((!sendData || jsvIsEmptyString(sendData)) && num<=0) {
+      if (!socketHasSendData(sendData) && num<=0) {
         bool reallyCloseNow = jsvGetBoolAndUnLock(jsvObjectGetChild(socket,HTTP_NAME_CLOSE,0));
+        // waiting for a request (or WebSocket frames), so nothing is lost if the other end has gone
+        bool idle = false;
         if (isHttp) {
           bool hadHeaders = jsvGetBoolAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_HAD_HEADERS,0));
+          idle = !hadHeaders;
           JsVarInt contentToReceive = jsvGetIntegerAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_RECEIVE_COUNT, 0));
           if (contentToReceive > 0 || !hadHeaders) {
-            reallyCloseNow = false;
+            // still waiting for the request - unless this is an idle keep-alive connection that timed out
+            reallyCloseNow = !hadHeaders && socketKeepAliveTimedOut(connection);
           } else if (!jsvGetBoolAndUnLock(jsvObjectGetChild(connection,HTTP_NAME_ENDED,0))) {
             jsvObjectSetChildAndUnLock(connection, HTTP_NAME_ENDED, jsvNewFromBool(true));
             jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_END, NULL, 0);
             DBG("ONEND %d (%d)\n", contentToReceive, reallyCloseNow);
           }
+          if (reallyCloseNow && num>=0 && jsvGetBoolAndUnLock(jsvObjectGetChild(socket, HTTP_NAME_KEEP_ALIVE, 0))) {
+            // response sent on a keep-alive connection - wait for the next request rather than closing
+            reallyCloseNow = false;
+            error = socketServerNextRequest(&it, connection, socket, socketType, sckt);
+            // carry on with the new request
+            jsvUnLock2(connection, socket);
+            connection = jsvObjectIteratorGetValue(&it);
+            socket = jsvObjectGetChild(connection, HTTP_NAME_RESPONSE_VAR, 0);
+            if (error == SOCKET_ERR_HEADERS_TOO_BIG)
+              netSend(net, socketType, sckt, HTTP_HEADERS_TOO_BIG_RESPONSE, sizeof(HTTP_HEADERS_TOO_BIG_RESPONSE)-1);
+            if (error) reallyCloseNow = true;
+          }
         }
-        closeConnectionNow = reallyCloseNow;
+#ifdef USE_WEBSOCKET
+        else if (num<0)
+          idle = jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_WEBSOCKET, 0));
+#endif
+        /* If the other end has gone while we're idle there's nothing more to wait for. Otherwise
+         * it may only have shut down its side, and still be waiting for our response */
+        closeConnectionNow = reallyCloseNow || (num<0 && idle);
       } else if (num > 0)
         closeConnectionNow = false; // guarantee that anything received is processed
+      if (error == SOCKET_ERR_HEADERS_TOO_BIG)
+        closeConnectionNow = true;
       jsvUnLock(sendData);
     }
     if (closeConnectionNow) {
@@ -576,16 +1315,7 @@ bool socketServerConnectionsIdle(JsNetwork *net) {
 
       // fire error events
       bool hadError = fireErrorEvent(error, connection, socket);
-
-      // fire end listeners
-      jsiQueueObjectCallbacks(socket, HTTP_NAME_ON_END, NULL, 0);
-
-      // fire the close listeners
-      JsVar *params[1] = { jsvNewFromBool(hadError) };
-      if (connection!=socket)
-        jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_CLOSE, params, 1);
-      jsiQueueObjectCallbacks(socket, HTTP_NAME_ON_CLOSE, params, 1);
-      jsvUnLock(params[0]);
+      socketServerFireClose(connection, socket, hadError);
 
       _socketConnectionKill(net, connection);
       JsVar *connectionName = jsvObjectIteratorGetKey(&it);
@@ -603,6 +1333,102 @@ bool socketServerConnectionsIdle(JsNetwork *net) {
 }
 
 
+/// Did this client request ask for a keep-alive connection?
+static bool clientRequestKeepAlive(JsVar *httpClientReqVar) {
+  JsVar *options = jsvObjectGetChild(httpClientReqVar, HTTP_NAME_OPTIONS_VAR, 0);
+  bool keepAlive = jsvIsObject(options) && jsvGetBoolAndUnLock(jsvObjectGetChild(options, "keepAlive", 0));
+  jsvUnLock(options);
+  return keepAlive;
+}
+
+/// Get the port a client request is for
+static unsigned short clientRequestGetPort(JsVar *options, SocketType socketType) {
+  unsigned short port = (unsigned short)jsvGetIntegerAndUnLock(jsvObjectGetChild(options, "port", 0));
+#ifdef USE_TLS
+  if (socketType & ST_TLS) {
+    if (port==0) port = 443;
+  }
+#endif
+  if ((socketType&ST_TYPE_MASK) == ST_HTTP) {
+    if (port==0) port = 80;
+  }
+  return port;
+}
+
+/// Get the key ("host:port") that a client request's connection is stored under in HTTP_ARRAY_HTTP_CLIENT_POOL
+static JsVar *clientRequestPoolKey(JsVar *options, SocketType socketType) {
+  JsVar *host = jsvObjectGetChild(options, "host", 0);
+  JsVar *key = jsvVarPrintf("%v:%d", host, clientRequestGetPort(options, socketType));
+  jsvUnLock(host);
+  return key;
+}
+
+/// Put the socket of a finished keep-alive request in the pool, so the next request to the same host can use it
+static void socketClientPoolAdd(JsVar *httpClientReqVar, SocketType socketType, int sckt) {
+  JsVar *pool = socketGetArray(HTTP_ARRAY_HTTP_CLIENT_POOL, true);
+  JsVar *entry = (pool && jsvGetChildren(pool) < HTTP_CLIENT_POOL_SIZE) ? jsvNewObject() : 0;
+  if (entry) {
+    JsVar *options = jsvObjectGetChild(httpClientReqVar, HTTP_NAME_OPTIONS_VAR, 0);
+    socketSetType(entry, socketType);
+    jsvObjectSetChildAndUnLock(entry, HTTP_NAME_SOCKET, jsvNewFromInteger(sckt+1));
+    jsvObjectSetChildAndUnLock(entry, HTTP_NAME_POOL_KEY, clientRequestPoolKey(options, socketType));
+    jsvUnLock(options);
+    socketSetKeepAliveTimeout(entry, httpGetOption(httpClientReqVar, false, "keepAliveTimeout", HTTP_KEEP_ALIVE_TIMEOUT));
+    jsvArrayPush(pool, entry);
+    jsvUnLock(entry);
+    // so the socket doesn't get closed along with the request
+    jsvObjectRemoveChild(httpClientReqVar, HTTP_NAME_SOCKET);
+  }
+  jsvUnLock(pool);
+}
+
+/// Take an idle connection to 'key' out of the pool, returning its socket (or -1 if there isn't one)
+static int socketClientPoolTake(JsVar *key, SocketType socketType) {
+  JsVar *pool = socketGetArray(HTTP_ARRAY_HTTP_CLIENT_POOL, false);
+  if (!pool) return -1;
+  int sckt = -1;
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, pool);
+  while (sckt<0 && jsvObjectIteratorHasValue(&it)) {
+    JsVar *entry = jsvObjectIteratorGetValue(&it);
+    JsVar *entryKey = jsvObjectGetChild(entry, HTTP_NAME_POOL_KEY, 0);
+    if (socketGetType(entry)==socketType && jsvCompareString(entryKey, key, 0, 0, false)==0) {
+      sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(entry, HTTP_NAME_SOCKET, 0))-1;
+      jsvObjectIteratorRemoveAndGotoNext(&it, pool);
+    } else
+      jsvObjectIteratorNext(&it);
+    jsvUnLock2(entryKey, entry);
+  }
+  jsvObjectIteratorFree(&it);
+  jsvUnLock(pool);
+  return sckt;
+}
+
+/// Close pooled connections that have timed out, or that the server closed (or sent something on)
+static bool socketClientPoolIdle(JsNetwork *net) {
+  JsVar *pool = socketGetArray(HTTP_ARRAY_HTTP_CLIENT_POOL, false);
+  if (!pool) return false;
+  bool hadSockets = false;
+  JsvObjectIterator it;
+  jsvObjectIteratorNew(&it, pool);
+  while (jsvObjectIteratorHasValue(&it)) {
+    hadSockets = true;
+    JsVar *entry = jsvObjectIteratorGetValue(&it);
+    int sckt = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(entry, HTTP_NAME_SOCKET, 0))-1;
+    char ch;
+    if (socketKeepAliveTimedOut(entry) || netRecv(net, socketGetType(entry), sckt, &ch, 1)!=0) {
+      DBG("pool close %d\n", sckt);
+      _socketConnectionKill(net, entry);
+      jsvObjectIteratorRemoveAndGotoNext(&it, pool);
+    } else
+      jsvObjectIteratorNext(&it);
+    jsvUnLock(entry);
+  }
+  jsvObjectIteratorFree(&it);
+  jsvUnLock(pool);
+  return hadSockets;
+}
+
 bool socketClientConnectionsIdle(JsNetwork *net) {
   char *buf = alloca((size_t)net->chunkSize); // allocate on stack
 
@@ -624,6 +1450,7 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
     JsVar *receiveData = 0;
 
     bool hadHeaders = false;
+    bool keepAlive = false; // the response is complete and we can reuse the connection
     int error = 0; // error code received from netXxxx functions
     bool closeConnectionNow = jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_CLOSENOW, false));
     bool alreadyConnected = jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_CONNECTED, false));
@@ -643,11 +1470,11 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
       if (!closeConnectionNow) {
         JsVar *sendData = jsvObjectGetChild(connection,HTTP_NAME_SEND_DATA,0);
         // send data if possible
-        if (sendData && !jsvIsEmptyString(sendData)) {
+        if (socketHasSendData(sendData)) {
           // don't try to send if we're already in error state
           int num = 0;
           if (error == 0) {
-              num = socketSendData(net, connection, sckt, &sendData);
+              num = socketSendData(net, connection, sckt, sendData);
           }
           if (num > 0 && !alreadyConnected && !isHttp) { // whoa, we sent something, must be connected!
             jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_CONNECT, &connection, 1);
@@ -658,7 +1485,6 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
             closeConnectionNow = true;
             error = num;
           }
-          jsvObjectSetChild(connection, HTTP_NAME_SEND_DATA, sendData); // socketSendData updated sendData
         } else {
           // no data to send, do we want to close? do so.
           if (jsvGetBoolAndUnLock(jsvObjectGetChild(connection, HTTP_NAME_CLOSE, false)))
@@ -672,10 +1498,15 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
               jsiQueueObjectCallbacks(socket, HTTP_NAME_ON_END, NULL, 0);
               DBG("onEnd %d (%d) %d\n", contentToReceive, closeConnectionNow, hadHeaders);
             }
+            keepAlive = closeConnectionNow &&
+                        jsvGetBoolAndUnLock(jsvObjectGetChild(socket, HTTP_NAME_KEEP_ALIVE, 0)) &&
+                        clientRequestKeepAlive(connection) &&
+                        (!receiveData || jsvIsEmptyString(receiveData));
           }
         }
-        // Now read data if possible (and we have space for it)
-        int num = netRecv(net, socketType, sckt, buf, (size_t)net->chunkSize);
+        // Now read data if possible (and we have space for it) - unless the connection is going back in the pool
+        int num = 0;
+        JsVar *data = keepAlive ? 0 : socketRecv(net, socketType, sckt, buf, &num);
         if (!alreadyConnected && num == SOCKET_ERR_NO_CONN) {
           ; // ignore... it's just telling us we're not connected yet
         } else if (num < 0) {
@@ -698,20 +1529,22 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
             jsvObjectSetChildAndUnLock(connection, HTTP_NAME_CONNECTED, jsvNewFromBool(true));
             alreadyConnected = true;
             // if we do not have any data to send, issue a drain event
-            if (!sendData || (int)jsvGetStringLength(sendData) == 0)
+            if (!socketHasSendData(sendData))
               jsiQueueObjectCallbacks(connection, HTTP_NAME_ON_DRAIN, &connection, 1);
           }
           // got data add it to our receive buffer
-          if (num > 0) {
-            if (!receiveData)
-              receiveData = jsvNewFromEmptyString();
-            if (receiveData) { // could be out of memory
-              jsvAppendStringBuf(receiveData, buf, (size_t)num);
-              socketReceived(connection, socket, socketType, &receiveData, false);
-              jsvObjectSetChild(connection, HTTP_NAME_RECEIVE_DATA, receiveData);
+          if (data) { // could be out of memory
+            receiveData = socketAppendReceived(receiveData, data);
+            data = 0;
+            int err = socketReceived(connection, socket, socketType, &receiveData, false);
+            if (err < 0) {
+              closeConnectionNow = true;
+              error = err;
             }
+            jsvObjectSetChild(connection, HTTP_NAME_RECEIVE_DATA, receiveData);
           }
         }
+        jsvUnLock(data);
         jsvUnLock(sendData);
       }
     }
@@ -723,10 +1556,12 @@ bool socketClientConnectionsIdle(JsNetwork *net) {
       if (!receiveData || jsvIsEmptyString(receiveData)) {
         // If we had data to send but the socket closed, this is an error
         JsVar *sendData = jsvObjectGetChild(connection,HTTP_NAME_SEND_DATA,0);
-        if (sendData && jsvGetStringLength(sendData) > 0 && error == SOCKET_ERR_CLOSED)
+        if (socketHasSendData(sendData) && error == SOCKET_ERR_CLOSED)
           error = SOCKET_ERR_UNSENT_DATA;
         jsvUnLock(sendData);
 
+        if (keepAlive) // keep the socket open for the next request rather than closing it
+          socketClientPoolAdd(connection, socketType, sckt);
         _socketConnectionKill(net, connection);
         JsVar *connectionName = jsvObjectIteratorGetKey(&it);
         jsvObjectIteratorNext(&it);
@@ -788,27 +1623,15 @@ bool socketIdle(JsNetwork *net) {
       }
       if (theClient >= 0) { // We have a new connection
         if ((socketType&ST_TYPE_MASK) == ST_HTTP) {
-          JsVar *req = jspNewObject(0, "httpSRq");
-          JsVar *res = jspNewObject(0, "httpSRs");
-          if (res && req) { // out of memory?
-            socketSetType(req, ST_HTTP);
+          JsVar *req = socketServerNewRequest(server, theClient);
+          if (req) { // out of memory?
             JsVar *arr = socketGetArray(HTTP_ARRAY_HTTP_SERVER_CONNECTIONS, true);
             if (arr) {
               jsvArrayPush(arr, req);
               jsvUnLock(arr);
             }
-            jsvObjectSetChild(req, HTTP_NAME_RESPONSE_VAR, res);
-            jsvObjectSetChild(req, HTTP_NAME_SERVER_VAR, server);
-            jsvObjectSetChildAndUnLock(req, HTTP_NAME_SOCKET, jsvNewFromInteger(theClient+1));
-            jsvObjectSetChildAndUnLock(res, HTTP_NAME_SOCKET, jsvNewFromInteger(theClient+1));
-            // Auto-add connection close header (in HTTP/1.0 this seemed implicit, now it must be explicit)
-            // This can always be overwritten with setHeader or writeHead
-            JsVar *name = jsvNewFromString("Connection");
-            JsVar *value = jsvNewFromString("close");
-            serverResponseSetHeader(res, name, value);
-            jsvUnLock2(name, value);
           }
-          jsvUnLock2(req, res);
+          jsvUnLock(req);
         } else {
           // Normal sockets
           JsVar *sock = jspNewObject(0, "Socket");
@@ -835,17 +1658,20 @@ bool socketIdle(JsNetwork *net) {
 
   if (socketServerConnectionsIdle(net)) hadSockets = true;
   if (socketClientConnectionsIdle(net)) hadSockets = true;
+  if (socketClientPoolIdle(net)) hadSockets = true;
   netCheckError(net);
   return hadSockets;
 }
 
 // -----------------------------
 
-JsVar *serverNew(SocketType socketType, JsVar *callback) {
+JsVar *serverNew(SocketType socketType, JsVar *options, JsVar *callback) {
   JsVar *server = jspNewObject(0, ((socketType&ST_TYPE_MASK)==ST_HTTP) ? "httpSrv" : "Server");
   if (!server) return 0; // out of memory
   socketSetType(server, socketType);
   jsvObjectSetChild(server, HTTP_NAME_ON_CONNECT, callback); // no unlock needed
+  if (options)
+    jsvObjectSetChild(server, HTTP_NAME_OPTIONS_VAR, options); // no unlock needed
   return server;
 }
 
@@ -934,6 +1760,69 @@ JsVar *clientRequestNew(SocketType socketType, JsVar *options, JsVar *callback)
   return req;
 }
 
+/** Create the send queue for a request. If we're doing HTTP and haven't connected yet
+ * this puts the headers in it. contentLength is the length of the body if we know it,
+ * or -1 if data is being written before end(), in which case we send it 'chunked' */
+static JsVar *clientRequestSendHead(JsVar *httpClientReqVar, int contentLength) {
+  JsVar *sendData = jsvNewEmptyArray();
+  if (!sendData) return 0; // out of memory
+  JsVar *options = 0;
+  // Only append a header if we're doing HTTP AND we haven't already connected
+  if ((socketGetType(httpClientReqVar)&ST_TYPE_MASK) == ST_HTTP)
+    if (jsvGetIntegerAndUnLock(jsvObjectGetChild(httpClientReqVar, HTTP_NAME_SOCKET, 0))==0)
+      options = jsvObjectGetChild(httpClientReqVar, HTTP_NAME_OPTIONS_VAR, 0);
+  if (options) {
+    // We're an HTTP client - make a header
+    JsVar *method = jsvObjectGetChild(options, "method", 0);
+    JsVar *path = jsvObjectGetChild(options, "path", 0);
+    JsVar *head = jsvVarPrintf("%v %v HTTP/1.1\r\nUser-Agent: Espruino "JS_VERSION"\r\nConnection: %s\r\n", method, path,
+                               clientRequestKeepAlive(httpClientReqVar) ? "keep-alive" : "close");
+    jsvUnLock2(method, path);
+    JsVar *headers = jsvObjectGetChild(options, HTTP_NAME_HEADERS, 0);
+    bool hasHostHeader = false;
+    bool hasLength = false;
+    if (jsvIsObject(headers)) {
+      JsVar *hostHeader = jsvObjectGetChildI(headers, "Host");
+      hasHostHeader = hostHeader!=0;
+      jsvUnLock(hostHeader);
+      JsVar *lengthHeader = jsvObjectGetChildI(headers, "Content-Length");
+      hasLength = lengthHeader!=0;
+      jsvUnLock(lengthHeader);
+      httpAppendHeaders(head, headers);
+      // if Transfer-Encoding:chunked was set, subsequent writes need to 'chunk' the data that is sent
+      if (compareTransferEncodingAndUnlock(jsvObjectGetChildI(headers, "Transfer-Encoding"), "chunked")) {
+        jsvObjectSetChildAndUnLock(httpClientReqVar, HTTP_NAME_CHUNKED, jsvNewFromBool(true));
+        hasLength = true;
+      }
+    }
+    jsvUnLock(headers);
+    if (!hasLength) {
+      if (contentLength>0) {
+        jsvAppendPrintf(head, "Content-Length: %d\r\n", contentLength);
+      } else if (contentLength<0) {
+        // we're streaming data of unknown length - send it as chunks
+        jsvAppendString(head, "Transfer-Encoding: chunked\r\n");
+        jsvObjectSetChildAndUnLock(httpClientReqVar, HTTP_NAME_CHUNKED, jsvNewFromBool(true));
+      }
+    }
+    if (!hasHostHeader) {
+      JsVar *host = jsvObjectGetChild(options, "host", 0);
+      int port = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(options, "port", 0));
+      if (port>0 && port!=80)
+        jsvAppendPrintf(head, "Host: %v:%d\r\n", host, port);
+      else
+        jsvAppendPrintf(head, "Host: %v\r\n", host);
+      jsvUnLock(host);
+    }
+    // finally add ending newline
+    jsvAppendString(head, "\r\n");
+    jsvArrayPushAndUnLock(sendData, head);
+  } // else we're not HTTP (or were already connected), so don't send any header
+  jsvObjectSetChild(httpClientReqVar, HTTP_NAME_SEND_DATA, sendData);
+  jsvUnLock(options);
+  return sendData;
+}
+
 void clientRequestWrite(JsNetwork *net, JsVar *httpClientReqVar, JsVar *data, JsVar *host, unsigned short portNumber) {
   if (!_socketConnectionOpen(httpClientReqVar)) {
     jsExceptionHere(JSET_ERROR, "This socket is closed.");
@@ -944,68 +1833,35 @@ void clientRequestWrite(JsNetwork *net, JsVar *httpClientReqVar, JsVar *data, Js
   // Append data to sendData
   JsVar *sendData = jsvObjectGetChild(httpClientReqVar, HTTP_NAME_SEND_DATA, 0);
   if (!sendData) {
-    JsVar *options = 0;
-    // Only append a header if we're doing HTTP AND we haven't already connected
-    if ((socketType&ST_TYPE_MASK) == ST_HTTP)
-      if (jsvGetIntegerAndUnLock(jsvObjectGetChild(httpClientReqVar, HTTP_NAME_SOCKET, 0))==0)
-        options = jsvObjectGetChild(httpClientReqVar, HTTP_NAME_OPTIONS_VAR, 0);
-    if (options) {
-      // We're an HTTP client - make a header
-      JsVar *method = jsvObjectGetChild(options, "method", 0);
-      JsVar *path = jsvObjectGetChild(options, "path", 0);
-      sendData = jsvVarPrintf("%v %v HTTP/1.1\r\nUser-Agent: Espruino "JS_VERSION"\r\nConnection: close\r\n", method, path);
-      jsvUnLock2(method, path);
-      JsVar *headers = jsvObjectGetChild(options, HTTP_NAME_HEADERS, 0);
-      bool hasHostHeader = false;
-      if (jsvIsObject(headers)) {
-        JsVar *hostHeader = jsvObjectGetChildI(headers, "Host");
-        hasHostHeader = hostHeader!=0;
-        jsvUnLock(hostHeader);
-        httpAppendHeaders(sendData, headers);
-        // if Transfer-Encoding:chunked was set, subsequent writes need to 'chunk' the data that is sent
-        if (compareTransferEncodingAndUnlock(jsvObjectGetChild(headers, "Transfer-Encoding", 0), "chunked")) {
-          jsvObjectSetChildAndUnLock(httpClientReqVar, HTTP_NAME_CHUNKED, jsvNewFromBool(true));
-        }
-      }
-      jsvUnLock(headers);
-      if (!hasHostHeader) {
-        JsVar *host = jsvObjectGetChild(options, "host", 0);
-        int port = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(options, "port", 0));
-        if (port>0 && port!=80)
-          jsvAppendPrintf(sendData, "Host: %v:%d\r\n", host, port);
-        else
-          jsvAppendPrintf(sendData, "Host: %v\r\n", host);
-        jsvUnLock(host);
-      }
-      // finally add ending newline
-      jsvAppendString(sendData, "\r\n");
-    } else { // !options
-      // We're not HTTP (or were already connected), so don't send any header
-      sendData = jsvNewFromString("");
-    }
-    jsvObjectSetChild(httpClientReqVar, HTTP_NAME_SEND_DATA, sendData);
-    jsvUnLock(options);
+    // There was no sent data, so we haven't written headers yet. If we're
+    // writing before end() we don't know how long the request will be
+    sendData = clientRequestSendHead(httpClientReqVar, jsvIsUndefined(data) ? 0 : -1);
+    if (!sendData) return; // out of memory
   }
   // We have data and aren't out of memory...
-  if (data && sendData) {
-    // append the data to what we want to send
+  if (data) {
+    // add the data to what we want to send
     JsVar *s = jsvAsString(data);
     if (s) {
       if (jsvGetBoolAndUnLock(jsvObjectGetChild(httpClientReqVar, HTTP_NAME_CHUNKED, 0))) {
         // If we asked to send 'chunked' data, we need to wrap it up,
         // prefixed with the length
-        jsvAppendPrintf(sendData, "%x\r\n%v\r\n", jsvGetStringLength(s), s);
-      } else {
-        if ((socketType&ST_TYPE_MASK) == ST_UDP) {
-          char hostName[128];
-          jsvGetString(host, hostName, sizeof(hostName));
-          JsNetUDPPacketHeader header;
-          networkGetHostByName(net, hostName, (uint32_t*)&header.host);
-          header.port = portNumber;
-          header.length = (uint16_t)jsvGetStringLength(s);
-          jsvAppendStringBuf(sendData, (const char*)&header, sizeof(header));
+        socketQueueSendDataChunked(sendData, s);
+      } else if ((socketType&ST_TYPE_MASK) == ST_UDP) {
+        // Each UDP packet is queued separately, prefixed with a header
+        char hostName[128];
+        jsvGetString(host, hostName, sizeof(hostName));
+        JsNetUDPPacketHeader header;
+        networkGetHostByName(net, hostName, (uint32_t*)&header.host);
+        header.port = portNumber;
+        header.length = (uint16_t)jsvGetStringLength(s);
+        JsVar *packet = jsvNewStringOfLength(sizeof(header), (const char*)&header);
+        if (packet) {
+          jsvAppendStringVarComplete(packet, s);
+          jsvArrayPushAndUnLock(sendData, packet);
         }
-        jsvAppendStringVarComplete(sendData,s);
+      } else {
+        socketQueueSendData(sendData, s);
       }
       jsvUnLock(s);
     }
@@ -1027,7 +1883,20 @@ void clientRequestConnect(JsNetwork *net, JsVar *httpClientReqVar) {
   SocketType socketType = socketGetType(httpClientReqVar);
 
   JsVar *options = jsvObjectGetChild(httpClientReqVar, HTTP_NAME_OPTIONS_VAR, 0);
-  unsigned short port = (unsigned short)jsvGetIntegerAndUnLock(jsvObjectGetChild(options, "port", 0));
+  unsigned short port = clientRequestGetPort(options, socketType);
+
+  if ((socketType&ST_TYPE_MASK) == ST_HTTP && clientRequestKeepAlive(httpClientReqVar)) {
+    // reuse an idle connection to the same host if we have one
+    JsVar *key = clientRequestPoolKey(options, socketType);
+    int sckt = socketClientPoolTake(key, socketType);
+    jsvUnLock(key);
+    if (sckt>=0) {
+      DBG("clientRequestConnect reusing %d\n", sckt);
+      jsvObjectSetChildAndUnLock(httpClientReqVar, HTTP_NAME_SOCKET, jsvNewFromInteger(sckt+1));
+      jsvUnLock(options);
+      return;
+    }
+  }
 
   uint32_t host_addr = 0;
   JsVar *hostNameVar = jsvObjectGetChild(options, "host", 0);
@@ -1052,15 +1921,6 @@ void clientRequestConnect(JsNetwork *net, JsVar *httpClientReqVar) {
     return;
   }
 
-#ifdef USE_TLS
-  if (socketType & ST_TLS) {
-    if (port==0) port = 443;
-  }
-#endif
-  if ((socketType&ST_TYPE_MASK) == ST_HTTP) {
-    if (port==0) port = 80;
-  }
-
   int sckt =  netCreateSocket(net, socketType, host_addr, port, options);
   if (sckt<0) {
     jsExceptionHere(JSET_INTERNALERROR, "Unable to create socket\n");
@@ -1075,9 +1935,22 @@ void clientRequestConnect(JsNetwork *net, JsVar *httpClientReqVar) {
   netCheckError(net);
 }
 
-// 'end' this connection
-void clientRequestEnd(JsNetwork *net, JsVar *httpClientReqVar) {
+// 'end' this connection, optionally sending some final data first
+void clientRequestEnd(JsNetwork *net, JsVar *httpClientReqVar, JsVar *data) {
   SocketType socketType = socketGetType(httpClientReqVar);
+  if (!jsvIsUndefined(data)) {
+    if ((socketType&ST_TYPE_MASK) == ST_HTTP && _socketConnectionOpen(httpClientReqVar)) {
+      JsVar *sendData = jsvObjectGetChild(httpClientReqVar, HTTP_NAME_SEND_DATA, 0);
+      if (!sendData) {
+        // Nothing has been written yet, so we know how long the request is
+        JsVar *s = jsvAsString(data);
+        sendData = clientRequestSendHead(httpClientReqVar, s ? (int)jsvGetStringLength(s) : 0);
+        jsvUnLock(s);
+      }
+      jsvUnLock(sendData);
+    }
+    clientRequestWrite(net, httpClientReqVar, data, NULL, 0);
+  }
   if ((socketType&ST_TYPE_MASK) == ST_HTTP) {
     JsVar *finalData = 0;
     if (jsvGetBoolAndUnLock(jsvObjectGetChild(httpClientReqVar, HTTP_NAME_CHUNKED, 0))) {
@@ -1091,7 +1964,7 @@ void clientRequestEnd(JsNetwork *net, JsVar *httpClientReqVar) {
   } else {
     // if we never sent any data, make sure we close 'now'
     JsVar *sendData = jsvObjectGetChild(httpClientReqVar, HTTP_NAME_SEND_DATA, 0);
-    if (!sendData || jsvIsEmptyString(sendData))
+    if (!socketHasSendData(sendData))
       jsvObjectSetChildAndUnLock(httpClientReqVar, HTTP_NAME_CLOSENOW, jsvNewFromBool(true));
     jsvUnLock(sendData);
   }
@@ -1125,28 +1998,67 @@ void serverResponseWriteHead(JsVar *httpServerResponseVar, int statusCode, JsVar
     return;
   }
 
-  JsVar *headers = jsvNewObject();
-  JsVar *implicitHeaders = jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_HEADERS, 0);
-  if (jsvIsObject(implicitHeaders)) jsvObjectAppendAll(headers, implicitHeaders);
-  jsvUnLock(implicitHeaders);
-  if (jsvIsObject(explicitHeaders)) jsvObjectAppendAll(headers, explicitHeaders);
+  /* Headers are actually sent with the first write/end - so if end(data) is
+   * called straight away we know how long the response is */
+  jsvObjectSetChildAndUnLock(httpServerResponseVar, HTTP_NAME_STATUS_CODE, jsvNewFromInteger(statusCode));
+  if (jsvIsObject(explicitHeaders)) {
+    JsVar *headers = jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_HEADERS, JSV_OBJECT);
+    if (headers) jsvObjectAppendAll(headers, explicitHeaders);
+    jsvUnLock(headers);
+  }
+}
 
+/** Put the headers from writeHead/setHeader into the send queue. contentLength is
+ * the length of the whole response if we know it, or -1 */
+static void serverResponseSendHead(JsVar *httpServerResponseVar, int contentLength) {
+  int statusCode = (int)jsvGetIntegerAndUnLock(jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_STATUS_CODE, 0));
+  if (!statusCode) statusCode = 200;
+  JsVar *headers = jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_HEADERS, JSV_OBJECT);
 
-  sendData = jsvVarPrintf("HTTP/1.1 %d OK\r\nServer: Espruino "JS_VERSION"\r\n", statusCode);
+  JsVar *head = jsvVarPrintf("HTTP/1.1 %d OK\r\nServer: Espruino "JS_VERSION"\r\n", statusCode);
   if (headers) {
-    httpAppendHeaders(sendData, headers);
     // if Transfer-Encoding:chunked was set, subsequent writes need to 'chunk' the data that is sent
-    if (compareTransferEncodingAndUnlock(jsvObjectGetChildI(headers, "Transfer-Encoding"), "chunked")) {
+    bool chunked = compareTransferEncodingAndUnlock(jsvObjectGetChildI(headers, "Transfer-Encoding"), "chunked");
+    if (chunked)
+      jsvObjectSetChildAndUnLock(httpServerResponseVar, HTTP_NAME_CHUNKED, jsvNewFromBool(true));
+    JsVar *lengthHeader = jsvObjectGetChildI(headers, "Content-Length");
+    bool hasLength = chunked || lengthHeader;
+    jsvUnLock(lengthHeader);
+    if (!hasLength && contentLength>=0) {
+      jsvObjectSetChildAndUnLock(headers, "Content-Length", jsvNewFromInteger(contentLength));
+      hasLength = true;
+    }
+    /* Data is being written before end() so we don't know the length. Send
+     * it as chunks (if the client understands them and the response has a body),
+     * so it goes out straight away and the connection can still be kept open */
+    if (!hasLength && statusCode>=200 && statusCode!=204 && statusCode!=304 &&
+        !jsvGetBoolAndUnLock(jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_HTTP10, 0))) {
+      jsvObjectSetChildAndUnLock(headers, "Transfer-Encoding", jsvNewFromString("chunked"));
       jsvObjectSetChildAndUnLock(httpServerResponseVar, HTTP_NAME_CHUNKED, jsvNewFromBool(true));
+      hasLength = true;
     }
+    /* We can only keep the connection open if the client asked us to, and
+     * it can tell where this response ends */
+    bool keepAlive = hasLength && jsvGetBoolAndUnLock(jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_KEEP_ALIVE, 0));
+    JsVar *connectionHeader = jsvObjectGetChildI(headers, "Connection");
+    if (connectionHeader) { // set explicitly
+      if (httpGetConnectionFlags(connectionHeader) & HTTP_CONNECTION_CLOSE) keepAlive = false;
+      jsvUnLock(connectionHeader);
+    } else
+      jsvObjectSetChildAndUnLock(headers, "Connection", jsvNewFromString(keepAlive ? "keep-alive" : "close"));
+    if (!keepAlive)
+      jsvObjectRemoveChild(httpServerResponseVar, HTTP_NAME_KEEP_ALIVE);
+    httpAppendHeaders(head, headers);
   }
   jsvUnLock(headers);
   // finally add ending newline
-  jsvAppendString(sendData, "\r\n");
+  jsvAppendString(head, "\r\n");
+  JsVar *sendData = jsvNewEmptyArray();
+  if (sendData) jsvArrayPush(sendData, head);
+  jsvUnLock(head);
   jsvObjectSetChildAndUnLock(httpServerResponseVar, HTTP_NAME_SEND_DATA, sendData);
 }
 
-
 void serverResponseWrite(JsVar *httpServerResponseVar, JsVar *data) {
   if (!_socketConnectionOpen(httpServerResponseVar)) {
     jsExceptionHere(JSET_ERROR, "This socket is closed.");
@@ -1156,8 +2068,8 @@ void serverResponseWrite(JsVar *httpServerResponseVar, JsVar *data) {
   JsVar *sendData = jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_SEND_DATA, 0);
   if (!sendData) {
     // There was no sent data, which means we haven't written headers yet.
-    // Do that now with default values
-    serverResponseWriteHead(httpServerResponseVar, 200, 0);
+    // Do that now - we don't know how long the response will be
+    serverResponseSendHead(httpServerResponseVar, -1);
     // sendData should now have been set
     sendData = jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_SEND_DATA, 0);
   }
@@ -1168,9 +2080,9 @@ void serverResponseWrite(JsVar *httpServerResponseVar, JsVar *data) {
       if (jsvGetBoolAndUnLock(jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_CHUNKED, 0))) {
         // If we asked to send 'chunked' data, we need to wrap it up,
         // prefixed with the length
-        jsvAppendPrintf(sendData, "%x\r\n%v\r\n", jsvGetStringLength(s), s);
+        socketQueueSendDataChunked(sendData, s);
       } else {
-        jsvAppendStringVarComplete(sendData,s);
+        socketQueueSendData(sendData, s);
       }
     }
     jsvUnLock(s);
@@ -1179,7 +2091,21 @@ void serverResponseWrite(JsVar *httpServerResponseVar, JsVar *data) {
   jsvUnLock(sendData);
 }
 
-void serverResponseEnd(JsVar *httpServerResponseVar) {
+void serverResponseEnd(JsVar *httpServerResponseVar, JsVar *data) {
+  if (!_socketConnectionOpen(httpServerResponseVar)) {
+    jsExceptionHere(JSET_ERROR, "This socket is closed.");
+    return;
+  }
+  JsVar *sendData = jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_SEND_DATA, 0);
+  if (!sendData) {
+    // Nothing has been written yet, so we know how long the response is
+    JsVar *s = jsvIsUndefined(data) ? 0 : jsvAsString(data);
+    serverResponseSendHead(httpServerResponseVar, s ? (int)jsvGetStringLength(s) : 0);
+    jsvUnLock(s);
+  }
+  jsvUnLock(sendData);
+  if (!jsvIsUndefined(data)) serverResponseWrite(httpServerResponseVar, data);
+
   JsVar *finalData = 0;
   if (jsvGetBoolAndUnLock(jsvObjectGetChild(httpServerResponseVar, HTTP_NAME_CHUNKED, 0))) {
     // If we were asked to send 'chunked' data, we need to finish up
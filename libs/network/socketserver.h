@@ -25,7 +25,7 @@ void socketKill(JsNetwork *net);
 bool socketIdle(JsNetwork *net);
 
 // -----------------------------
-JsVar *serverNew(SocketType socketType, JsVar *callback);
+JsVar *serverNew(SocketType socketType, JsVar *options, JsVar *callback);
 void serverAddMembership(JsNetwork *net, JsVar *socket, JsVar *group, JsVar *ip);
 void serverListen(JsNetwork *net, JsVar *httpServerVar, unsigned short port, SocketType socketType);
 void serverClose(JsNetwork *net, JsVar *server);
@@ -33,11 +33,30 @@ void serverClose(JsNetwork *net, JsVar *server);
 JsVar *clientRequestNew(SocketType socketType, JsVar *options, JsVar *callback);
 void clientRequestWrite(JsNetwork *net, JsVar *httpClientReqVar, JsVar *data, JsVar *host, unsigned short port);
 void clientRequestConnect(JsNetwork *net, JsVar *httpClientReqVar);
-void clientRequestEnd(JsNetwork *net, JsVar *httpClientReqVar);
+void clientRequestEnd(JsNetwork *net, JsVar *httpClientReqVar, JsVar *data);
 
 void serverResponseSetHeader(JsVar *parent, JsVar *name, JsVar *value); // for HTTP
 void serverResponseWriteHead(JsVar *httpServerResponseVar, int statusCode, JsVar *headers); // for HTTP
 void serverResponseWrite(JsVar *httpServerResponseVar, JsVar *data);
-void serverResponseEnd(JsVar *httpServerResponseVar);
+void serverResponseEnd(JsVar *httpServerResponseVar, JsVar *data);
+
+#ifdef USE_WEBSOCKET
+typedef enum {
+  WS_OPCODE_CONTINUATION = 0,
+  WS_OPCODE_TEXT = 1,
+  WS_OPCODE_BINARY = 2,
+  WS_OPCODE_CLOSE = 8,
+  WS_OPCODE_PING = 9,
+  WS_OPCODE_PONG = 10,
+} WebSocketOpcode;
+
+// status codes for close frames
+#define WS_CLOSE_NORMAL 1000
+#define WS_CLOSE_PROTOCOL_ERROR 1002
+#define WS_CLOSE_TOO_BIG 1009
+
+void webSocketSend(JsVar *ws, JsVar *data, WebSocketOpcode opcode);
+void webSocketClose(JsVar *ws, int code);
+#endif
 
 #endif // SOCKETSERVER_H
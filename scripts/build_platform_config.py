@@ -255,9 +255,9 @@ codeOut("""
 #define DEFAULT_SLEEP_PIN_INDICATOR (Pin)-1 // no indicator
 
 // When to send the message that the IO buffer is getting full
-#define IOBUFFER_XOFF ((TXBUFFERMASK)*6/8)
+#define IOBUFFER_XOFF ((IOBUFFERMASK)*6/8)
 // When to send the message that we can start receiving again
-#define IOBUFFER_XON ((TXBUFFERMASK)*3/8)
+#define IOBUFFER_XON ((IOBUFFERMASK)*3/8)
 
 """);
 
@@ -322,8 +322,8 @@ if "default_console_baudrate" in board.info:
 
 codeOut("");
 if LINUX:
-  bufferSizeIO = 256
-  bufferSizeTX = 256
+  bufferSizeIO = 1024
+  bufferSizeTX = 1024
   bufferSizeTimer = 16
 elif EMSCRIPTEN:
   bufferSizeIO = 256
@@ -343,9 +343,16 @@ else:
 
 if 'util_timer_tasks' in board.info:
   bufferSizeTimer = board.info['util_timer_tasks']
-
-codeOut("#define IOBUFFERMASK "+str(bufferSizeIO-1)+" // (max 255) amount of items in event buffer - events take 5 bytes each")
-codeOut("#define TXBUFFERMASK "+str(bufferSizeTX-1)+" // (max 255) amount of items in the transmit buffer - 2 bytes each")
+if 'io_buffer_size' in board.info:
+  bufferSizeIO = board.info['io_buffer_size']
+if 'tx_buffer_size' in board.info:
+  bufferSizeTX = board.info['tx_buffer_size']
+for size in [bufferSizeIO, bufferSizeTX]:
+  if size & (size-1) or size > 65536:
+    die("IO/TX buffer sizes must be a power of 2, and at most 65536")
+
+codeOut("#define IOBUFFERMASK "+str(bufferSizeIO-1)+" // (max 65535) amount of items in event buffer - events take 5 bytes each")
+codeOut("#define TXBUFFERMASK "+str(bufferSizeTX-1)+" // (max 65535) amount of items in the transmit buffer - 2 bytes each")
 codeOut("#define UTILTIMERTASK_TASKS ("+str(bufferSizeTimer)+") // Must be power of 2 - and max 256")
 
 codeOut("");
@@ -51,7 +51,7 @@ volatile TxBufferItem txBuffer[TXBUFFERMASK+1];
 /**
  * The head and tail of the list.
  */
-volatile unsigned char txHead=0, txTail=0;
+volatile TxBufferIdx txHead=0, txTail=0;
 
 typedef enum {
   SDS_NONE,
@@ -74,7 +74,27 @@ Pin jshSerialDeviceCTSPins[JSHSERIALDEVICESTATUSES];
 // ----------------------------------------------------------------------------
 //                                                              IO EVENT BUFFER
 volatile IOEvent ioBuffer[IOBUFFERMASK+1];
-volatile unsigned char ioHead=0, ioTail=0;
+volatile IOBufferIdx ioHead=0, ioTail=0;
+
+#ifndef SAVE_ON_FLASH
+/// Serial devices each get a slot in ioDeviceStats, everything else (watches, etc) shares this one
+#define IODEVICESTATS_OTHER (1+EV_SERIAL_MAX-EV_SERIAL_START)
+#define IODEVICESTATS (IODEVICESTATS_OTHER+1)
+/** How much of ioBuffer each device is using. 'pushed' is only written when
+ * adding events and 'popped' only when removing them, so pushed-popped is the
+ * number of events in the buffer without needing a lock between the two */
+typedef struct {
+  IOBufferIdx pushed, popped; ///< count of events added to/removed from ioBuffer
+  IOBufferIdx limit; ///< most events this device may have in ioBuffer (0 = no limit)
+  unsigned int overflows; ///< events dropped because ioBuffer or the limit was full
+} JshIODeviceStats;
+volatile JshIODeviceStats ioDeviceStats[IODEVICESTATS];
+
+static unsigned int jshGetDeviceStatsIndex(IOEventFlags device) {
+  device = IOEVENTFLAGS_GETTYPE(device);
+  return DEVICE_IS_SERIAL(device) ? (unsigned int)(device-EV_SERIAL_START) : IODEVICESTATS_OTHER;
+}
+#endif
 
 // ----------------------------------------------------------------------------
 
@@ -101,6 +121,13 @@ void jshResetDevices() {
   jshSerialDeviceStates[TO_SERIAL_DEVICE_STATE(EV_USBSERIAL)] = SDS_FLOW_CONTROL_XON_XOFF;
 #ifdef BLUETOOTH
   jshSerialDeviceStates[TO_SERIAL_DEVICE_STATE(EV_BLUETOOTH)] = SDS_FLOW_CONTROL_XON_XOFF;
+#endif
+#ifndef SAVE_ON_FLASH
+  // remove any limits on IO buffer use
+  for (i=0;i<IODEVICESTATS;i++) {
+    ioDeviceStats[i].limit = 0;
+    ioDeviceStats[i].overflows = 0;
+  }
 #endif
   // reset callbacks for events
   for (i=EV_EXTI0;i<=EV_EXTI_MAX;i++)
@@ -210,7 +237,7 @@ void jshTransmit(
   // The txHead global points to the current item in the txBuffer.  Since we are adding a new
   // character, we increment the head pointer.   If it has caught up with the tail, then that means
   // we have filled the array backing the list.  What we do next is to wait for space to free up.
-  unsigned char txHeadNext = (unsigned char)((txHead+1)&TXBUFFERMASK);
+  TxBufferIdx txHeadNext = (TxBufferIdx)((txHead+1)&TXBUFFERMASK);
   if (txHeadNext==txTail) {
     jsiSetBusy(BUSY_TRANSMIT, true);
     bool wasConsoleLimbo = device==EV_LIMBO && jsiGetConsoleDevice()==EV_LIMBO;
@@ -283,31 +310,66 @@ int jshGetCharToTransmit(
     }
   }
 
-  unsigned char tempTail = txTail;
+  TxBufferIdx tempTail = txTail;
   while (txHead != tempTail) {
     if (IOEVENTFLAGS_GETTYPE(txBuffer[tempTail].flags) == device) {
       unsigned char data = txBuffer[tempTail].data;
       if (tempTail != txTail) { // so we weren't right at the back of the queue
         // we need to work back from tempTail (until we hit tail), shifting everything forwards
-        unsigned char this = tempTail;
-        unsigned char last = (unsigned char)((this+TXBUFFERMASK)&TXBUFFERMASK);
+        TxBufferIdx this = tempTail;
+        TxBufferIdx last = (TxBufferIdx)((this+TXBUFFERMASK)&TXBUFFERMASK);
         while (this!=txTail) { // if this==txTail, then last is before it, so stop here
           txBuffer[this] = txBuffer[last];
           this = last;
-          last = (unsigned char)((this+TXBUFFERMASK)&TXBUFFERMASK);
+          last = (TxBufferIdx)((this+TXBUFFERMASK)&TXBUFFERMASK);
         }
       }
-      txTail = (unsigned char)((txTail+1)&TXBUFFERMASK); // advance the tail
+      txTail = (TxBufferIdx)((txTail+1)&TXBUFFERMASK); // advance the tail
       return data; // return data
     }
-    tempTail = (unsigned char)((tempTail+1)&TXBUFFERMASK);
+    tempTail = (TxBufferIdx)((tempTail+1)&TXBUFFERMASK);
   }
   return -1; // no data :(
 }
 
+/**
+ * Look at the run of characters waiting to be transmitted on a device
+ * without removing them, so as many as can be sent at once are sent with
+ * one call. Remove the ones that were sent with jshGetCharToTransmit.
+ * \return The number of characters written to data (0 if there are none).
+ */
+unsigned int jshPeekCharsToTransmit(
+    IOEventFlags device,  // The device being looked at for a transmission.
+    unsigned char *data,  // Where to put the characters
+    unsigned int maxChars // The most characters to get
+  ) {
+  if (!maxChars) return 0;
+  if (DEVICE_HAS_DEVICE_STATE(device)) {
+    // flow control characters go first, and on their own
+    volatile JshSerialDeviceState *deviceState = &jshSerialDeviceStates[TO_SERIAL_DEVICE_STATE(device)];
+    if ((*deviceState)&SDS_XOFF_PENDING) {
+      data[0] = 19/*XOFF*/;
+      return 1;
+    }
+    if ((*deviceState)&SDS_XON_PENDING) {
+      data[0] = 17/*XON*/;
+      return 1;
+    }
+  }
+  unsigned int count = 0;
+  TxBufferIdx tempTail = txTail;
+  // only the data at the back of the queue - anything behind another device's data waits for it
+  while (count<maxChars && txHead != tempTail &&
+         IOEVENTFLAGS_GETTYPE(txBuffer[tempTail].flags) == device) {
+    data[count++] = txBuffer[tempTail].data;
+    tempTail = (TxBufferIdx)((tempTail+1)&TXBUFFERMASK);
+  }
+  return count;
+}
+
 void jshTransmitFlush() {
   jsiSetBusy(BUSY_TRANSMIT, true);
-  while (jshHasTransmitData()) ; // wait for send to finish
+  while (jshHasTransmitData()) jshBusyIdle(); // wait for send to finish
   jsiSetBusy(BUSY_TRANSMIT, false);
 }
 
@@ -334,12 +396,12 @@ void jshTransmitMove(IOEventFlags from, IOEventFlags to) {
   } else {
     // Otherwise just rename the contents of the buffer
     jshInterruptOff();
-    unsigned char tempTail = txTail;
+    TxBufferIdx tempTail = txTail;
     while (tempTail != txHead) {
       if (IOEVENTFLAGS_GETTYPE(txBuffer[tempTail].flags) == from) {
         txBuffer[tempTail].flags = (txBuffer[tempTail].flags&~EV_TYPE_MASK) | to;
       }
-      tempTail = (unsigned char)((tempTail+1)&TXBUFFERMASK);
+      tempTail = (TxBufferIdx)((tempTail+1)&TXBUFFERMASK);
     }
     jshInterruptOn();
   }
@@ -369,20 +431,30 @@ void CALLED_FROM_INTERRUPT jshPushEvent(IOEvent *evt) {
    * USB and USART data to be coming in at the same time, and it can trip
    * things up if one IRQ interrupts another. */
   jshInterruptOff();
-  unsigned char nextHead = (unsigned char)((ioHead+1) & IOBUFFERMASK);
+  IOBufferIdx nextHead = (IOBufferIdx)((ioHead+1) & IOBUFFERMASK);
+#ifndef SAVE_ON_FLASH
+  volatile JshIODeviceStats *stats = &ioDeviceStats[jshGetDeviceStatsIndex(evt->flags)];
+  if (ioTail == nextHead ||
+      (stats->limit && (IOBufferIdx)(stats->pushed-stats->popped) >= stats->limit)) {
+    stats->overflows++;
+#else
   if (ioTail == nextHead) {
+#endif
     jshInterruptOn();
     jshIOEventOverflowed();
     return; // queue full - dump this event!
   }
   ioBuffer[ioHead] = *evt;
   ioHead = nextHead;
+#ifndef SAVE_ON_FLASH
+  stats->pushed++;
+#endif
   jshInterruptOn();
 }
 
 /// Attempt to push characters onto an existing event
 static bool jshPushIOCharEventAppend(IOEventFlags channel, char charData) {
-  unsigned char lastHead = (unsigned char)((ioHead+IOBUFFERMASK) & IOBUFFERMASK); // one behind head
+  IOBufferIdx lastHead = (IOBufferIdx)((ioHead+IOBUFFERMASK) & IOBUFFERMASK); // one behind head
   if (ioHead!=ioTail && lastHead!=ioTail) {
     // we can do this because we only read in main loop, and we're in an interrupt here
     if (IOEVENTFLAGS_GETTYPE(ioBuffer[lastHead].flags) == channel) {
@@ -492,7 +564,10 @@ void CALLED_FROM_INTERRUPT jshPushIOEvent(
 bool jshPopIOEvent(IOEvent *result) {
   if (ioHead==ioTail) return false;
   *result = ioBuffer[ioTail];
-  ioTail = (unsigned char)((ioTail+1) & IOBUFFERMASK);
+#ifndef SAVE_ON_FLASH
+  ioDeviceStats[jshGetDeviceStatsIndex(result->flags)].popped++;
+#endif
+  ioTail = (IOBufferIdx)((ioTail+1) & IOBUFFERMASK);
   return true;
 }
 
@@ -502,7 +577,7 @@ bool jshPopIOEventOfType(IOEventFlags eventType, IOEvent *result) {
   if (IOEVENTFLAGS_GETTYPE(ioBuffer[ioTail].flags) == eventType)
     return jshPopIOEvent(result);
   // Now check non-top
-  unsigned char i = ioTail;
+  IOBufferIdx i = ioTail;
   while (ioHead!=i) {
     if (IOEVENTFLAGS_GETTYPE(ioBuffer[i].flags) == eventType) {
       /* We need IRQ off for this, because if we get data it's possible
@@ -511,18 +586,21 @@ bool jshPopIOEventOfType(IOEventFlags eventType, IOEvent *result) {
       jshInterruptOff();
       *result = ioBuffer[i];
       // work back and shift all items in out queue
-      unsigned char n = (unsigned char)((i+IOBUFFERMASK) & IOBUFFERMASK);
+      IOBufferIdx n = (IOBufferIdx)((i+IOBUFFERMASK) & IOBUFFERMASK);
       while (n!=ioTail) {
         ioBuffer[i] = ioBuffer[n];
         i = n;
-        n = (unsigned char)((n+IOBUFFERMASK) & IOBUFFERMASK);
+        n = (IOBufferIdx)((n+IOBUFFERMASK) & IOBUFFERMASK);
       }
+#ifndef SAVE_ON_FLASH
+      ioDeviceStats[jshGetDeviceStatsIndex(result->flags)].popped++;
+#endif
       // finally update the tail pointer, and return
-      ioTail = (unsigned char)((ioTail+1) & IOBUFFERMASK);
+      ioTail = (IOBufferIdx)((ioTail+1) & IOBUFFERMASK);
       jshInterruptOn();
       return true;
     }
-    i = (unsigned char)((i+1) & IOBUFFERMASK);
+    i = (IOBufferIdx)((i+1) & IOBUFFERMASK);
   }
   return false;
 }
@@ -553,6 +631,37 @@ bool jshHasEventSpaceForChars(int n) {
   return spaceLeft > spacesNeeded;
 }
 
+#ifndef SAVE_ON_FLASH
+void jshSetDeviceEventLimit(IOEventFlags device, int maxEvents) {
+  if (maxEvents<0) maxEvents=0;
+  if (maxEvents>IOBUFFERMASK) maxEvents=IOBUFFERMASK;
+  ioDeviceStats[jshGetDeviceStatsIndex(device)].limit = (IOBufferIdx)maxEvents;
+}
+
+bool jshGetDeviceEventStats(IOEventFlags device, int *used, int *limit, unsigned int *overflows) {
+  unsigned int idx = jshGetDeviceStatsIndex(device);
+  // non-serial devices share one slot, so only report that for EV_NONE
+  if (idx==IODEVICESTATS_OTHER && device!=EV_NONE) return false;
+  volatile JshIODeviceStats *stats = &ioDeviceStats[idx];
+  *used = (IOBufferIdx)(stats->pushed-stats->popped);
+  *limit = stats->limit;
+  *overflows = stats->overflows;
+  return true;
+}
+#endif
+
+int jshGetEventSpaceForDevice(IOEventFlags device) {
+  int space = IOBUFFERMASK/2 - jshGetEventsUsed();
+#ifndef SAVE_ON_FLASH
+  volatile JshIODeviceStats *stats = &ioDeviceStats[jshGetDeviceStatsIndex(device)];
+  if (stats->limit) {
+    int deviceSpace = (int)stats->limit - (IOBufferIdx)(stats->pushed-stats->popped);
+    if (deviceSpace < space) space = deviceSpace;
+  }
+#endif
+  return (space>0) ? space : 0;
+}
+
 // ----------------------------------------------------------------------------
 //                                                                      DEVICES
 
@@ -172,6 +172,19 @@ typedef struct IOEvent {
 
 #include "jspin.h"
 
+/// Index into ioBuffer (jsdevices.c) - only as wide as IOBUFFERMASK needs
+#if IOBUFFERMASK>255
+typedef unsigned short IOBufferIdx;
+#else
+typedef unsigned char IOBufferIdx;
+#endif
+/// Index into txBuffer (jsdevices.c) - only as wide as TXBUFFERMASK needs
+#if TXBUFFERMASK>255
+typedef unsigned short TxBufferIdx;
+#else
+typedef unsigned char TxBufferIdx;
+#endif
+
 /// Push an IO event into the ioBuffer (designed to be called from IRQ)
 void jshPushEvent(IOEvent *evt);
 // Push an 'IO' even
@@ -195,6 +208,16 @@ int jshGetEventsUsed();
 /// Do we have enough space for N characters?
 bool jshHasEventSpaceForChars(int n);
 
+#ifndef SAVE_ON_FLASH
+/** Set the most events a device may have in the IO buffer at once, so it can't
+ * starve other devices. Anything past this is dropped (and counted). 0 = no limit */
+void jshSetDeviceEventLimit(IOEventFlags device, int maxEvents);
+/// Get a device's share of the IO buffer - events used, limit and how many were dropped. Returns false if not tracked
+bool jshGetDeviceEventStats(IOEventFlags device, int *used, int *limit, unsigned int *overflows);
+#endif
+/// How many more events can this device add before the IO buffer is half full, or it reaches its limit?
+int jshGetEventSpaceForDevice(IOEventFlags device);
+
 const char *jshGetDeviceString(IOEventFlags device);
 IOEventFlags jshFromDeviceString(const char *device);
 
@@ -219,6 +242,8 @@ bool jshHasTransmitData();
 IOEventFlags jshGetDeviceToTransmit();
 /// Try and get a character for transmission - could just return -1 if nothing
 int jshGetCharToTransmit(IOEventFlags device);
+/// Look at (but don't remove) up to maxChars characters waiting to be transmitted on a device, returning how many were got
+unsigned int jshPeekCharsToTransmit(IOEventFlags device, unsigned char *data, unsigned int maxChars);
 
 
 /// Set whether the host should transmit or not
@@ -19,6 +19,10 @@
 #define SAVED_CODE_BOOTCODE_RESET ".bootrst" // bootcode that runs even after reset
 #define SAVED_CODE_BOOTCODE ".bootcde" // bootcode that doesn't run after reset
 #define SAVED_CODE_VARIMAGE ".varimg" // Image of all JsVars written to flash
+#ifdef JSF_DELTA_BLOCK_SIZE
+#define SAVED_CODE_VARHASH ".varhash" // Hashes of each block of SAVED_CODE_VARIMAGE
+#define SAVED_CODE_VARDIFF ".vardiff" // Blocks that have changed since SAVED_CODE_VARIMAGE
+#endif
 
 #ifdef DEBUG
 #define DBG(...) jsiConsolePrintf("[Flash] "__VA_ARGS__)
@@ -45,7 +49,230 @@
 // ------------------------------------------------------------------------------------------------
 // ------------------------------------------------------------------------------------------------
 
+typedef enum {
+  GNFH_GET_ALL,      ///< get all headers
+  GNFH_GET_EMPTY,    ///< stop on an empty header even if there are pages after
+} jsfGetNextFileHeaderType;
+
+typedef struct {
+  uint32_t address;          // current address in memory
+  uint32_t endAddress;       // address at which to end
+  int byteCount;
+  unsigned char buffer[128]; // buffer for read/written data
+  uint32_t bufferCnt;        // where are we in the buffer?
+} jsfcbData;
+int jsfLoadFromFlash_readcb(uint32_t *cbdata);
+
 static uint32_t jsfCreateFile(JsfFileName name, uint32_t size, JsfFileFlags flags, uint32_t startAddr, JsfFileHeader *returnedHeader);
+static bool jsfGetFileHeader(uint32_t addr, JsfFileHeader *header);
+static bool jsfGetNextFileHeader(uint32_t *addr, JsfFileHeader *header, jsfGetNextFileHeaderType type);
+static bool jsfCompactFinish();
+
+#ifdef JSF_FILE_INDEX_SIZE
+/* RAM index of name -> header address, so we don't have to scan all of
+ * flash for every jsfFindFile. It's an open addressed hash table using
+ * linear probing. Erased files leave their name with addr=0 so probing
+ * continues past them. The index is built lazily on the first lookup. If
+ * every file fit in it then it's 'complete' and a miss means the file
+ * doesn't exist - otherwise a miss still needs a scan of flash. */
+typedef struct {
+  JsfFileName name; ///< name.n==0 if empty
+  uint32_t addr;    ///< address of the header, or 0 if the file was erased
+} JsfFileIndexEntry;
+
+static JsfFileIndexEntry jsfFileIndex[JSF_FILE_INDEX_SIZE];
+static bool jsfFileIndexBuilt = false;    ///< have we scanned flash to fill the index?
+static bool jsfFileIndexComplete = false; ///< does the index contain every file?
+static uint32_t jsfFileIndexHits = 0;     ///< lookups answered without a scan of flash
+static uint32_t jsfFileIndexScans = 0;    ///< full scans of flash for a file
+
+/// Return the first slot to check for the given name
+static unsigned int jsfFileIndexHash(JsfFileName name) {
+  uint64_t h = name.n * 0x9E3779B97F4A7C15ULL;
+  return (unsigned int)(h >> 40) & (JSF_FILE_INDEX_SIZE-1);
+}
+
+/// Find the index entry for the given name, or 0
+static JsfFileIndexEntry *jsfFileIndexFind(JsfFileName name) {
+  unsigned int idx = jsfFileIndexHash(name);
+  for (unsigned int i=0;i<JSF_FILE_INDEX_SIZE;i++) {
+    JsfFileIndexEntry *e = &jsfFileIndex[(idx+i) & (JSF_FILE_INDEX_SIZE-1)];
+    if (e->name.n == name.n) return e;
+    if (!e->name.n) return 0;
+  }
+  return 0;
+}
+
+/// Set the header address of a file in the index (addr=0 if it was erased)
+static void jsfFileIndexSet(JsfFileName name, uint32_t addr) {
+  if (!jsfFileIndexBuilt) return;
+  JsfFileIndexEntry *e = jsfFileIndexFind(name);
+  if (!e && addr) {
+    // find an empty slot, or one for a file that has been erased
+    unsigned int idx = jsfFileIndexHash(name);
+    for (unsigned int i=0;i<JSF_FILE_INDEX_SIZE && !e;i++) {
+      JsfFileIndexEntry *f = &jsfFileIndex[(idx+i) & (JSF_FILE_INDEX_SIZE-1)];
+      if (!f->name.n || !f->addr) e = f;
+    }
+    if (!e) { // full - we'll have to scan flash for anything we can't find
+      jsfFileIndexComplete = false;
+      return;
+    }
+    e->name = name; // reusing an erased file's slot is fine - it never becomes empty so probing continues past it
+  }
+  if (e) e->addr = addr;
+}
+
+/// Scan flash and fill the index with all live files
+static void jsfFileIndexBuild() {
+  memset(jsfFileIndex, 0, sizeof(jsfFileIndex));
+  jsfFileIndexBuilt = true;
+  jsfFileIndexComplete = true;
+  jsfFileIndexScans++;
+  uint32_t addr = JSF_START_ADDRESS;
+  JsfFileHeader header;
+  memset(&header,0,sizeof(JsfFileHeader));
+  if (jsfGetFileHeader(addr, &header)) do {
+    if (header.replacement == JSF_WORD_UNSET && !jsfFileIndexFind(header.name)) // jsfFindFile always found the first
+      jsfFileIndexSet(header.name, addr);
+  } while (jsfGetNextFileHeader(&addr, &header, GNFH_GET_ALL));
+}
+
+/* RAM cache of file content hashes for jsfGetFileHash, so asking for the
+ * hash of a file again doesn't have to read it all back from flash. It's
+ * keyed on name and the header's size word (size+flags). Unlike the index it
+ * survives compaction, so any write to a file must forget its hash. If two
+ * names share a slot the older one is just forgotten. */
+typedef struct {
+  JsfFileName name; ///< name.n==0 if empty
+  JsfWord size;     ///< the file's JsfFileHeader.size when hashed
+  uint32_t hash;    ///< jsfHashData of the file's contents
+} JsfFileHashEntry;
+
+static JsfFileHashEntry jsfFileHashes[JSF_FILE_INDEX_SIZE];
+
+static void jsfFileHashSet(JsfFileName name, JsfWord size, uint32_t hash) {
+  JsfFileHashEntry *e = &jsfFileHashes[jsfFileIndexHash(name)];
+  e->name = name;
+  e->size = size;
+  e->hash = hash;
+}
+
+static void jsfFileHashForget(JsfFileName name) {
+  JsfFileHashEntry *e = &jsfFileHashes[jsfFileIndexHash(name)];
+  if (e->name.n == name.n) e->name.n = 0;
+}
+
+/// Get the cached hash for a file with the given header. Returns false if it isn't known
+static bool jsfFileHashGet(JsfFileHeader *header, uint32_t *hash) {
+  JsfFileHashEntry *e = &jsfFileHashes[jsfFileIndexHash(header->name)];
+  if (e->name.n != header->name.n || e->size != header->size) return false;
+  *hash = e->hash;
+  return true;
+}
+#endif
+
+/// FNV-1a hash of some data. Start with hash=JSF_HASH_INIT
+#define JSF_HASH_INIT 2166136261u
+static uint32_t jsfHashData(uint32_t hash, const unsigned char *data, uint32_t len) {
+  while (len--) hash = (hash ^ *(data++)) * 16777619u;
+  return hash;
+}
+
+#define JSF_COMPACT_JOURNAL_NAME ".cmpct"
+
+/// Where we are in a compaction
+typedef struct {
+  uint32_t seq;            ///< incremented for each page written
+  uint32_t dst;            ///< where the next byte of compacted data goes (0 if not compacting)
+  uint32_t src;            ///< address of the header of the file being copied (0 when all copied)
+  uint32_t srcPos;         ///< how many bytes of that file (including the header) have been copied
+  uint32_t srcEnd;         ///< the end of the data we started compacting
+  uint32_t journal;        ///< address of the first journal entry, or 0 if not journaling
+  JsfFileHeader srcHeader; ///< header of the file being copied
+} JsfCompactState;
+
+/// Journal entry, written after a JsfFileHeader and followed by the page's data
+typedef struct {
+  uint32_t page;           ///< the page this data is for
+  uint32_t pageSize;       ///< the size of the page
+  JsfCompactState state;   ///< the state after the page was written
+} JsfCompactJournal;
+
+static JsfCompactState jsfCompactState;
+
+#ifdef USE_HEATSHRINK
+/// Statistics for files compressed with jsfWriteFile(..., JSFF_COMPRESSED, ...)
+static struct {
+  uint32_t files;             ///< number of files written compressed
+  uint32_t uncompressedBytes; ///< total size of those files before compression
+  uint32_t compressedBytes;   ///< total size of those files after compression
+  JsSysTime compressTime;     ///< time spent compressing
+  uint32_t reads;             ///< number of compressed files read
+  JsSysTime decompressTime;   ///< time spent decompressing
+} jsfCompressStats;
+#endif
+
+#ifdef JSF_WEAR_BUCKETS
+/* Wear statistics. Erases are counted for each 1/JSF_WEAR_BUCKETS of Storage,
+ * and these are kept in JSF_WEAR_FILE_NAME. That is rewritten only when
+ * compaction starts (so the old copy is removed by the compaction) or Storage
+ * is erased, so it doesn't cause much wear itself - but erases since then are
+ * lost if power is lost. It isn't shown in the file list. */
+#define JSF_WEAR_FILE_NAME ".wear"
+typedef struct {
+  uint32_t buckets;      ///< JSF_WEAR_BUCKETS (so we know the file matches)
+  uint32_t compactions;  ///< Number of times Storage has been compacted
+  uint32_t writtenBytes; ///< Bytes written to files
+  uint32_t movedBytes;   ///< Bytes written while compacting (including the journal)
+  uint32_t erases[JSF_WEAR_BUCKETS]; ///< Page erases in each area of Storage
+} JsfWearStats;
+static JsfWearStats jsfWear;
+static bool jsfWearLoaded;  ///< Have we added the counts from JSF_WEAR_FILE_NAME to jsfWear?
+static bool jsfWearSaving;  ///< Are we writing JSF_WEAR_FILE_NAME before compacting?
+static void jsfWearLoad();
+static void jsfWearSave();
+#endif
+
+void jsfErasePage(uint32_t addr) {
+  jshFlashErasePage(addr);
+#ifdef JSF_WEAR_BUCKETS
+  if (addr>=JSF_START_ADDRESS && addr<JSF_END_ADDRESS)
+    jsfWear.erases[(uint64_t)(addr-JSF_START_ADDRESS)*JSF_WEAR_BUCKETS/FLASH_SAVED_CODE_LENGTH]++;
+#endif
+}
+
+void jsfNoteWrite(uint32_t bytes) {
+#ifdef JSF_WEAR_BUCKETS
+  if (jsfCompactState.dst) jsfWear.movedBytes += bytes;
+  else jsfWear.writtenBytes += bytes;
+#else
+  NOT_USED(bytes);
+#endif
+}
+
+static uint32_t jsfFileMoves = 0; ///< changed whenever files may have moved, see jsfGetFileMoves
+
+/// Forget where files are, but not what's in them (for when we move files about)
+static void jsfFileIndexReset() {
+  jsfFileMoves++;
+#ifdef JSF_LAZY_LOAD_VARS
+  // the saved image may be about to move - load what's left of it
+  jsfLazyLoadAll();
+#endif
+#ifdef JSF_FILE_INDEX_SIZE
+  jsfFileIndexBuilt = false;
+  jsfFileIndexComplete = false;
+#endif
+}
+
+/// Forget everything we know about where files are (call this if flash is modified directly)
+void jsfResetFileIndex() {
+  jsfFileIndexReset();
+#ifdef JSF_FILE_INDEX_SIZE
+  memset(jsfFileHashes, 0, sizeof(jsfFileHashes));
+#endif
+}
 
 /// Aligns a block, pushing it along in memory until it reaches the required alignment
 static uint32_t jsfAlignAddress(uint32_t addr) {
@@ -130,12 +357,13 @@ static bool jsfIsEqual(uint32_t addr, const unsigned char *data, uint32_t len) {
 
 /// Erase the entire contents of the memory store
 static bool jsfEraseFrom(uint32_t startAddr) {
+  jsfFileIndexReset();
   uint32_t addr, len;
   if (!jshFlashGetPage(startAddr, &addr, &len))
     return false;
   while (addr<JSF_END_ADDRESS) {
     if (!jsfIsErased(addr,len))
-      jshFlashErasePage(addr);
+      jsfErasePage(addr);
     if (!jshFlashGetPage(addr+len, &addr, &len))
       return true;
   }
@@ -145,7 +373,12 @@ static bool jsfEraseFrom(uint32_t startAddr) {
 /// Erase the entire contents of the memory store
 bool jsfEraseAll() {
   DBG("EraseAll\n");
-  return jsfEraseFrom(JSF_START_ADDRESS);
+  jsfCompactState.dst = 0; // stop any compaction
+  bool ok = jsfEraseFrom(JSF_START_ADDRESS);
+#ifdef JSF_WEAR_BUCKETS
+  if (ok && jsfWearLoaded) jsfWearSave(); // don't lose the erase counts
+#endif
+  return ok;
 }
 
 /// When a file is found in memory, erase it (by setting replacement to 0). addr=ptr to data, NOT header
@@ -153,9 +386,14 @@ static void jsfEraseFileInternal(uint32_t addr, JsfFileHeader *header) {
   DBG("EraseFile 0x%08x\n", addr);
 
   addr -= (uint32_t)sizeof(JsfFileHeader);
+#ifdef JSF_FILE_INDEX_SIZE
+  jsfFileIndexSet(header->name, 0);
+  jsfFileHashForget(header->name);
+#endif
   addr += (uint32_t)((char*)&header->replacement - (char*)header);
   header->replacement = 0;
   jshFlashWrite(&header->replacement,addr,(uint32_t)sizeof(JsfWord));
+  jsfNoteWrite((uint32_t)sizeof(JsfWord));
 }
 
 bool jsfEraseFile(JsfFileName name) {
@@ -192,11 +430,6 @@ static uint32_t jsfGetSpaceLeftInPage(uint32_t addr) {
   return nextPageStart - addr;
 }
 
-typedef enum {
-  GNFH_GET_ALL,      ///< get all headers
-  GNFH_GET_EMPTY,    ///< stop on an empty header even if there are pages after
-} jsfGetNextFileHeaderType;
-
 /** Given the address and a header, work out where the next one should be and load it.
  Both addr and header are updated. Returns true if the header is valid, false if not.
  If skipPages==true, if a header isn't valid but there's another page, jump to that.
@@ -242,6 +475,7 @@ static uint32_t jsfGetAddressOfNextStartPage(uint32_t addr) {
 
 // Get the amount of space free in this page (or all pages). addr=0 uses start page
 uint32_t jsfGetFreeSpace(uint32_t addr, bool allPages) {
+  if (!jsfCompactFinish()) return 0;
   if (!addr) addr=JSF_START_ADDRESS;
   uint32_t pageEndAddr = JSF_END_ADDRESS;
   if (!allPages) {
@@ -277,93 +511,321 @@ static uint32_t jsfGetAllocatedSpace(uint32_t addr, bool allPages, uint32_t *unc
   return allocated;
 }
 
-/* Try and compact saved data so it'll fit in Flash again.
- * TO RUN THIS, 'ALLOCATED' MUST BE CORRECT, AND THERE MUST BE ENOUGH STACK FREE
- */
-static bool jsfCompactInternal(uint32_t startAddress, uint32_t allocated) {
-  DBG("Compacting from 0x%08x\n", startAddress);
-  if (allocated>0) {
-    // allocated = amount of RAM needed to compact all pages
-    // All our allocated data will fit in RAM - awesome!
-    // Allocate RAM
-    char *swapBuffer = alloca(allocated);
-    char *swapBufferPtr = swapBuffer;
-    // Copy all data to swap
-    DBG("Compacting - copy data to swap\n");
-    JsfFileHeader header;
-    memset(&header,0,sizeof(JsfFileHeader));
-    uint32_t addr = startAddress;
-    if (jsfGetFileHeader(addr, &header)) do {
-      if (header.replacement == JSF_WORD_UNSET) { // if not replaced
-        memcpy(swapBufferPtr, &header, sizeof(JsfFileHeader));
-        swapBufferPtr += sizeof(JsfFileHeader);
-        uint32_t alignedSize = jsfAlignAddress(jsfGetFileSize(&header));
-        jshFlashRead(swapBufferPtr, addr+(uint32_t)sizeof(JsfFileHeader), alignedSize);
-        memset(&swapBufferPtr[jsfGetFileSize(&header)], 0xFF, alignedSize-jsfGetFileSize(&header));
-        swapBufferPtr += alignedSize;
+/* Compaction works a page at a time, sliding live files down towards the
+ * start of Storage. For each destination page we build its new contents in
+ * a one-page buffer on the stack from the files that follow it, then erase
+ * the page and write the buffer. We only ever copy data backwards, so by the
+ * time a page is full all the data that was in it has already been read.
+ *
+ * To survive power loss, each page's new contents (and where we'd got to)
+ * are first written to a journal in the free space after the files. Entries
+ * are packed one after the other so they end at the end of Storage, and a
+ * page is only erased when the first entry that uses it is written - so
+ * unless the journal has to wrap around each page is erased once. On boot
+ * jsfResumeCompaction finds the latest journal entry, writes that page again
+ * and carries on from there. If there isn't room for at least
+ * JSF_COMPACT_JOURNAL_MIN entries we still compact, but not safely if power
+ * is lost. */
+
+/** The fewest journal entries we can use. When we wrap around, erasing
+ * the pages for the first entry also erases the start of the second, so
+ * the latest entry (the last one) must be the third or later */
+#define JSF_COMPACT_JOURNAL_MIN 3
+
+/// Get the size of a journal entry - a header, JsfCompactJournal and a page of data. Returns 0 if we can't journal
+static uint32_t jsfGetCompactJournalEntrySize() {
+  uint32_t pageAddr, pageLen;
+  if (!jshFlashGetPage(JSF_END_ADDRESS-1, &pageAddr, &pageLen))
+    return 0;
+  return jsfAlignAddress((uint32_t)(sizeof(JsfFileHeader)+sizeof(JsfCompactJournal)) + pageLen);
+}
+
+/// Erase all the pages between the two addresses
+static void jsfErasePages(uint32_t startAddr, uint32_t endAddr) {
+  uint32_t addr, len;
+  if (!jshFlashGetPage(startAddr, &addr, &len)) return;
+  while (addr<endAddr) {
+    if (!jsfIsErased(addr,len))
+      jsfErasePage(addr);
+    if (!jshFlashGetPage(addr+len, &addr, &len)) return;
+  }
+}
+
+/// Is a file with this header still needed?
+static bool jsfIsFileLive(JsfFileHeader *header) {
+  return header->replacement == JSF_WORD_UNSET;
+}
+
+/** Compact one page. Returns false if compaction is complete (or failed) */
+static bool jsfCompactStep() {
+  JsfCompactState *cs = &jsfCompactState;
+  if (!cs->dst) return false;
+  uint32_t pageAddr, pageLen;
+  if (!jshFlashGetPage(cs->dst, &pageAddr, &pageLen)) {
+    cs->dst = 0; // shouldn't happen
+    return false;
+  }
+  if (pageLen+256 > jsuGetFreeStack()) {
+    // we'll try again next time we're called, hopefully with more stack
+    DBG("Compact - not enough stack\n");
+    return false;
+  }
+  unsigned char *buf = (unsigned char *)alloca(pageLen);
+  uint32_t bufPos = cs->dst - pageAddr;
+  // data before dst is already in the right place - it may only be part of a page when we start
+  if (bufPos) jshFlashRead(buf, pageAddr, bufPos);
+  memset(&buf[bufPos], 0xFF, pageLen-bufPos);
+  // now fill the rest of the page with files
+  while (cs->src && bufPos<pageLen) {
+    uint32_t fileLen = (uint32_t)sizeof(JsfFileHeader) + jsfAlignAddress(jsfGetFileSize(&cs->srcHeader));
+    if (jsfIsFileLive(&cs->srcHeader) && cs->srcPos<fileLen) {
+      if (!cs->srcPos && bufPos &&
+          (jsfGetFileFlags(&cs->srcHeader) & JSFF_LOG) &&
+          cs->src >= pageAddr+pageLen) {
+        // Log files must start on a page boundary - leave the rest of this page empty
+        bufPos = pageLen;
+        break;
       }
-    } while (jsfGetNextFileHeader(&addr, &header, GNFH_GET_ALL));
-    // Erase everything
-    DBG("Compacting - erasing pages\n");
-    jsfEraseFrom(startAddress);
-    // Copy data back
-    DBG("Compacting - copy data from swap\n");
-    char *swapBufferEnd = swapBufferPtr;
-    swapBufferPtr = swapBuffer;
-    while (swapBufferPtr < swapBufferEnd) {
-      memcpy(&header, swapBufferPtr, sizeof(JsfFileHeader));
-      swapBufferPtr += sizeof(JsfFileHeader);
-      JsfFileHeader newHeader;
-      uint32_t newFile = jsfCreateFile(header.name, jsfGetFileSize(&header), jsfGetFileFlags(&header), JSF_START_ADDRESS, &newHeader);
-      uint32_t alignedSize = jsfAlignAddress(jsfGetFileSize(&header));
-      if (newFile) jshFlashWrite(swapBufferPtr, newFile, alignedSize);
-      swapBufferPtr += alignedSize;
+      uint32_t l = fileLen - cs->srcPos;
+      if (l > pageLen-bufPos) l = pageLen-bufPos;
+      jshFlashRead(&buf[bufPos], cs->src+cs->srcPos, l);
+      bufPos += l;
+      cs->srcPos += l;
+    } else { // finished this file, or it was erased - move on
+      if (!jsfGetNextFileHeader(&cs->src, &cs->srcHeader, GNFH_GET_ALL) ||
+          cs->src >= cs->srcEnd)
+        cs->src = 0;
+      cs->srcPos = 0;
     }
-  } else {
-    DBG("Compacting - no data, just erasing page\n");
-    jsfEraseFrom(startAddress);
   }
-  DBG("Compaction Complete\n");
+  cs->dst = pageAddr + bufPos;
+  cs->seq++;
+  // write to the journal in case we lose power
+  uint32_t entrySize = jsfGetCompactJournalEntrySize();
+  if (cs->journal && entrySize >= sizeof(JsfFileHeader)+sizeof(JsfCompactJournal)+pageLen) {
+    uint32_t entries = (JSF_END_ADDRESS - cs->journal) / entrySize;
+    uint32_t slot = cs->journal + ((cs->seq-1) % entries)*entrySize;
+    /* The page this entry starts in was erased when the previous entry
+     * started using it, and has the end of that entry in it. Only the
+     * first entry starts in a page that's just free space (or old entries) */
+    uint32_t eraseFrom = slot;
+    uint32_t firstPage, firstPageLen;
+    if (slot!=cs->journal && jshFlashGetPage(slot, &firstPage, &firstPageLen) && firstPage<slot)
+      eraseFrom = firstPage+firstPageLen;
+    jsfErasePages(eraseFrom, slot+entrySize);
+    JsfCompactJournal j;
+    j.page = pageAddr;
+    j.pageSize = pageLen;
+    j.state = *cs;
+    JsfFileHeader header;
+    header.size = (JsfWord)(sizeof(JsfCompactJournal) + pageLen);
+    header.replacement = JSF_WORD_UNSET;
+    header.name = jsfNameFromString(JSF_COMPACT_JOURNAL_NAME);
+    // write the header last, so the entry is only valid once everything is written
+    jshFlashWrite(buf, slot+(uint32_t)(sizeof(JsfFileHeader)+sizeof(JsfCompactJournal)), pageLen);
+    jshFlashWrite(&j, slot+(uint32_t)sizeof(JsfFileHeader), (uint32_t)sizeof(JsfCompactJournal));
+    jshFlashWrite(&header, slot, (uint32_t)sizeof(JsfFileHeader));
+    jsfNoteWrite((uint32_t)(sizeof(JsfFileHeader)+sizeof(JsfCompactJournal))+pageLen);
+  }
+  DBG("Compact - write page 0x%08x (%d bytes)\n", pageAddr, bufPos);
+  jsfErasePage(pageAddr);
+  jshFlashWrite(buf, pageAddr, pageLen);
+  jsfNoteWrite(bufPos);
+  if (!cs->src) {
+    // All done. Erase everything after our data (including the journal)
+    DBG("Compaction Complete\n");
+    jsfEraseFrom(jsfGetAddressOfNextPage(pageAddr) ? jsfGetAddressOfNextPage(pageAddr) : JSF_END_ADDRESS);
+    cs->dst = 0;
+    return false;
+  }
   return true;
 }
 
+/** Start compacting Storage - call jsfCompactStep until it returns false to do it.
+ * Returns false if there's nothing to do */
+static bool jsfCompactStart() {
+#ifdef JSF_LAZY_LOAD_VARS
+  jsfLazyLoadAll(); // the saved image may move
+#endif
+  JsfCompactState *cs = &jsfCompactState;
+  memset(cs, 0, sizeof(JsfCompactState));
+  // Find the first file that isn't needed - everything before it is fine where it is
+  uint32_t addr = JSF_START_ADDRESS;
+  uint32_t dst = JSF_START_ADDRESS;
+  JsfFileHeader header;
+  memset(&header,0,sizeof(JsfFileHeader));
+  if (!jsfGetFileHeader(addr, &header)) return false;
+  while (jsfIsFileLive(&header) && addr==dst) {
+    dst = jsfAlignAddress(addr + (uint32_t)sizeof(JsfFileHeader) + jsfGetFileSize(&header));
+    if (!jsfGetNextFileHeader(&addr, &header, GNFH_GET_ALL)) return false; // no files after
+  }
+  // Could be that there's just a gap before the next page (no erased files)
+  if (jsfIsFileLive(&header)) {
+    bool anyErased = false;
+    uint32_t a = addr;
+    JsfFileHeader h = header;
+    do {
+      if (!jsfIsFileLive(&h)) anyErased = true;
+    } while (!anyErased && jsfGetNextFileHeader(&a, &h, GNFH_GET_ALL));
+    if (!anyErased) return false;
+  }
+#ifdef JSF_WEAR_BUCKETS
+  if (!jsfWearSaving && jsfWearLoaded) {
+    // Save wear statistics first (this compaction removes the old copy), then look again
+    jsfWearSaving = true;
+    jsfWearSave();
+    bool compacting = jsfCompactStart();
+    jsfWearSaving = false;
+    return compacting;
+  }
+  jsfWear.compactions++;
+#endif
+  cs->srcEnd = JSF_END_ADDRESS - jsfGetFreeSpace(0, true);
+  jsfFileIndexReset();
+  cs->dst = dst;
+  cs->src = addr;
+  cs->srcHeader = header;
+  // the journal goes in whole pages after the files, ending at the end of Storage
+  uint32_t entrySize = jsfGetCompactJournalEntrySize();
+  uint32_t freePage, freePageLen;
+  if (entrySize && jshFlashGetPage(cs->srcEnd, &freePage, &freePageLen)) {
+    if (freePage<cs->srcEnd) freePage += freePageLen;
+    uint32_t entries = (freePage<JSF_END_ADDRESS) ? (JSF_END_ADDRESS-freePage)/entrySize : 0;
+    if (entries >= JSF_COMPACT_JOURNAL_MIN)
+      cs->journal = JSF_END_ADDRESS - entries*entrySize;
+  }
+  DBG("Compacting from 0x%08x (journal 0x%08x)\n", dst, cs->journal);
+  return true;
+}
+
+/// If a compaction was interrupted (eg. by power loss) then finish it
+static void jsfCompactResume() {
+  JsfCompactState *cs = &jsfCompactState;
+  if (cs->dst) { // compacting in the background - just finish
+    while (jsfCompactStep());
+    return;
+  }
+  uint32_t entrySize = jsfGetCompactJournalEntrySize();
+  if (!entrySize) return;
+  JsfFileName name = jsfNameFromString(JSF_COMPACT_JOURNAL_NAME);
+  JsfCompactJournal j, latest;
+  latest.state.seq = 0;
+  uint32_t latestAddr = 0;
+  /* We don't know where the journal started, but it ends at the end of
+   * Storage - so look at everywhere an entry could be */
+  uint32_t n;
+  for (n=1; n*entrySize <= JSF_END_ADDRESS-JSF_START_ADDRESS; n++) {
+    uint32_t slot = JSF_END_ADDRESS - n*entrySize;
+    JsfFileHeader header;
+    jshFlashRead(&header, slot, (uint32_t)sizeof(JsfFileHeader));
+    if (header.name.n != name.n || header.replacement != JSF_WORD_UNSET) continue;
+    jshFlashRead(&j, slot+(uint32_t)sizeof(JsfFileHeader), (uint32_t)sizeof(JsfCompactJournal));
+    if (j.pageSize+sizeof(JsfCompactJournal)!=jsfGetFileSize(&header) ||
+        j.state.journal>slot || (slot-j.state.journal)%entrySize) continue;
+    if (!latestAddr || j.state.seq > latest.state.seq) {
+      latest = j;
+      latestAddr = slot;
+    }
+  }
+  if (!latestAddr || latest.pageSize+256 > jsuGetFreeStack()) return;
+  jsiConsolePrint("Resuming Storage compaction...\n");
+  // write the page again (we may have lost power while writing it)
+  unsigned char *buf = (unsigned char *)alloca(latest.pageSize);
+  jshFlashRead(buf, latestAddr+(uint32_t)(sizeof(JsfFileHeader)+sizeof(JsfCompactJournal)), latest.pageSize);
+  jsfErasePage(latest.page);
+  jshFlashWrite(buf, latest.page, latest.pageSize);
+  // and carry on from where we were
+  *cs = latest.state;
+  jsfFileIndexReset();
+  if (!cs->src) { // that was the last page
+    uint32_t next = jsfGetAddressOfNextPage(latest.page);
+    jsfEraseFrom(next ? next : JSF_END_ADDRESS);
+    cs->dst = 0;
+    return;
+  }
+  while (jsfCompactStep());
+}
 
 // Try and compact saved data so it'll fit in Flash again
 bool jsfCompact() {
   DBG("Compacting\n");
-  uint32_t addr = JSF_START_ADDRESS;
-
-  /* Try and compact the whole area first, but if that
-   * fails, keep skipping forward pages until we have
-   * enough RAM free that it's ok. */
-  while (addr) {
-    uint32_t uncompacted = 0;
-    uint32_t allocated = jsfGetAllocatedSpace(addr, true, &uncompacted);
-    if (!uncompacted) {
-      DBG("Already fully compacted\n");
-      return true;
-    }
-    if (allocated+1024 < jsuGetFreeStack()) {
-      DBG("Compacting - all data fits in RAM for 0x%08x (%d bytes)\n", addr, allocated);
-      return jsfCompactInternal(addr, allocated);
-    } else {
-      DBG("Compacting - Not enough memory for 0x%08x (%d bytes)\n", addr, allocated);
-    }
-    // move to the next available page and try from there
-    addr = jsfGetAddressOfNextStartPage(addr);
+  if (jsfCompactState.dst) {
+    jsfCompactResume();
+    return true;
+  }
+  if (!jsfCompactStart()) {
+    DBG("Already fully compacted\n");
+    return true;
   }
-  DBG("Compacting - not enough memory to compact anything\n");
-  /* TODO: we should try and compact pages at the start as well.
-   * Currently we just skip pages from the front until we have
-   * enough RAM. By doing both we could work either side of a
-   * massive saved code area. */
+  while (jsfCompactStep());
+  return !jsfCompactState.dst;
+}
+
+/// Start compacting Storage in the background - jsfCompactIdle does the work. Returns false if there's nothing to do
+bool jsfCompactBackground() {
+  if (jsfCompactState.dst) return true;
+  return jsfCompactStart();
+}
 
+/// Compact one page of Storage if we're compacting in the background. Returns true if we're still compacting
+bool jsfCompactIdle() {
+  return jsfCompactStep();
+}
+
+/** If compacting in the background, finish - the file list isn't valid during compaction.
+ * Returns false (and throws) if we couldn't, in which case the files mustn't be looked at */
+static bool jsfCompactFinish() {
+  if (!jsfCompactState.dst) return true;
+  jsfCompactResume();
+  if (!jsfCompactState.dst) return true;
+  // jsfCompactStep needs a page worth of stack - we'll finish when jsfCompactIdle is called
+  jsExceptionHere(JSET_ERROR, "Not enough free stack to finish compacting Storage");
   return false;
 }
 
+/* jsfSaveToFlash streams data into free space and writes the file's size
+ * last, once it knows it. If it never got that far (power loss, or the data
+ * didn't fit) then the file at addr has a name but no size. Turn everything
+ * from there to the end of Storage into one erased file so the next
+ * compaction cleans it up. */
+static bool jsfTrashUnfinishedFile(uint32_t addr) {
+  JsfFileHeader header;
+  jshFlashRead(&header, addr, (uint32_t)sizeof(JsfFileHeader));
+  if (header.size != JSF_WORD_UNSET || header.replacement != JSF_WORD_UNSET ||
+      header.name.n == (uint64_t)-1)
+    return false;
+  DBG("Trashing unfinished file at 0x%08x\n", addr);
+  JsfWord w[2];
+  w[0] = JSF_END_ADDRESS - (addr + (uint32_t)sizeof(JsfFileHeader) + JSF_ALIGNMENT);
+  w[1] = 0; // replacement - erased
+  jshFlashWrite(w, addr, (uint32_t)sizeof(w));
+  jsfFileIndexReset();
+  return true;
+}
+
+/// If a compaction or save was interrupted (eg. by power loss) then clean up after it
+void jsfResumeCompaction() {
+  jsfCompactResume();
+#ifdef JSF_WEAR_BUCKETS
+  jsfWearLoad();
+#endif
+  /* Look for the end of the files in each used page. We can't just follow
+   * the headers with GNFH_GET_ALL as after an unfinished file the next page
+   * may contain data that looks like a header */
+  uint32_t addr = JSF_START_ADDRESS;
+  JsfFileHeader header;
+  while (addr && jsfGetFileHeader(addr, &header)) {
+    while (jsfGetNextFileHeader(&addr, &header, GNFH_GET_EMPTY));
+    if (addr && jsfTrashUnfinishedFile(addr)) return;
+    addr = jsfGetAddressOfNextPage(addr);
+  }
+  if (addr) jsfTrashUnfinishedFile(addr);
+}
+
 /// Create a new 'file' in the memory store. Return the address of data start, or 0 on error
 static uint32_t jsfCreateFile(JsfFileName name, uint32_t size, JsfFileFlags flags, uint32_t startAddr, JsfFileHeader *returnedHeader) {
   DBG("CreateFile (%d bytes)\n", size);
+  if (!jsfCompactFinish()) return 0;
   uint32_t requiredSize = jsfAlignAddress(size)+(uint32_t)sizeof(JsfFileHeader);
   assert(startAddr);
   bool compacted = false;
@@ -417,7 +879,8 @@ static uint32_t jsfCreateFile(JsfFileName name, uint32_t size, JsfFileFlags flag
   if (nextPage && // there is a next page
       ((nextPage - addr) < requiredSize) && // it would straddle pages
       (spaceAvailable > (size + nextPage - addr)) && // there is space
-      (requiredSize < 512) && // it's not too big. We should always try and put big files as near the start as possible. See note in jsfCompact
+      ((requiredSize < 512) || // it's not too big. We should always try and put big files as near the start as possible. See note in jsfCompact
+       (flags & JSFF_LOG)) && // or it needs to start on a page boundary
       !jsfGetFileHeader(nextPage, &header)) { // the next page is free
     DBG("CreateFile positioning file on page boundary (0x%08x -> 0x%08x)\n", addr, nextPage);
     addr = nextPage;
@@ -429,15 +892,90 @@ static uint32_t jsfCreateFile(JsfFileName name, uint32_t size, JsfFileFlags flag
   header.replacement = JSF_WORD_UNSET;
   DBG("CreateFile write header\n");
   jshFlashWrite(&header,addr,(uint32_t)sizeof(JsfFileHeader));
+  jsfNoteWrite((uint32_t)sizeof(JsfFileHeader));
   DBG("CreateFile written header\n");
+#ifdef JSF_FILE_INDEX_SIZE
+  jsfFileIndexSet(name, addr);
+  jsfFileHashForget(name);
+#endif
   if (returnedHeader) *returnedHeader = header;
   return addr+(uint32_t)sizeof(JsfFileHeader);
 }
 
 /// Find a 'file' in the memory store. Return the address of data start (and header if returnedHeader!=0). Returns 0 if not found
+#ifdef JSF_WEAR_BUCKETS
+/// Add the wear statistics saved in Storage to the ones we've counted since boot
+static void jsfWearLoad() {
+  if (jsfWearLoaded) return;
+  jsfWearLoaded = true;
+  JsfFileHeader header;
+  uint32_t addr = jsfFindFile(jsfNameFromString(JSF_WEAR_FILE_NAME), &header);
+  if (!addr || jsfGetFileSize(&header)!=sizeof(JsfWearStats)) return;
+  JsfWearStats saved;
+  jshFlashRead(&saved, addr, (uint32_t)sizeof(JsfWearStats));
+  if (saved.buckets != JSF_WEAR_BUCKETS) return; // different build - start again
+  jsfWear.compactions += saved.compactions;
+  jsfWear.writtenBytes += saved.writtenBytes;
+  jsfWear.movedBytes += saved.movedBytes;
+  for (int i=0;i<JSF_WEAR_BUCKETS;i++)
+    jsfWear.erases[i] += saved.erases[i];
+}
+
+/// Write the wear statistics to Storage if there's space without compacting. This doesn't allocate any JsVars
+static void jsfWearSave() {
+  if (jsfGetFreeSpace(0, true) < jsfAlignAddress((uint32_t)sizeof(JsfWearStats)) + (uint32_t)sizeof(JsfFileHeader))
+    return;
+  jsfWear.buckets = JSF_WEAR_BUCKETS;
+  JsfFileHeader header;
+  uint32_t addr = jsfCreateFile(jsfNameFromString(JSF_WEAR_FILE_NAME), (uint32_t)sizeof(JsfWearStats), JSFF_NONE, JSF_START_ADDRESS, &header);
+  if (addr) {
+    jsfNoteWrite((uint32_t)sizeof(JsfWearStats));
+    jshFlashWriteAligned(&jsfWear, addr, (uint32_t)sizeof(JsfWearStats));
+  }
+}
+#endif
+
+uint32_t jsfGetFileMoves() {
+  return jsfFileMoves;
+}
+
+bool jsfIsFileAt(JsfFileName name, uint32_t addr, JsfFileHeader *returnedHeader) {
+  if (jsfCompactState.dst || addr < JSF_START_ADDRESS+(uint32_t)sizeof(JsfFileHeader))
+    return false;
+  JsfFileHeader header;
+  if (!jsfGetFileHeader(addr-(uint32_t)sizeof(JsfFileHeader), &header) ||
+      header.replacement != JSF_WORD_UNSET ||
+      header.name.n != name.n)
+    return false;
+  if (returnedHeader)
+    *returnedHeader = header;
+  return true;
+}
+
 uint32_t jsfFindFile(JsfFileName name, JsfFileHeader *returnedHeader) {
+  if (!jsfCompactFinish()) return 0;
   uint32_t addr = JSF_START_ADDRESS;
   JsfFileHeader header;
+#ifdef JSF_FILE_INDEX_SIZE
+  if (!jsfFileIndexBuilt) jsfFileIndexBuild();
+  JsfFileIndexEntry *e = jsfFileIndexFind(name);
+  if (e && e->addr) {
+    // check the header is still what we expect, just in case flash was modified behind our back
+    if (jsfGetFileHeader(e->addr, &header) &&
+        header.replacement == JSF_WORD_UNSET &&
+        header.name.n == name.n) {
+      jsfFileIndexHits++;
+      if (returnedHeader)
+        *returnedHeader = header;
+      return e->addr+(uint32_t)sizeof(JsfFileHeader);
+    }
+    jsfResetFileIndex();
+  } else if (jsfFileIndexComplete) {
+    jsfFileIndexHits++;
+    return 0;
+  }
+  jsfFileIndexScans++;
+#endif
   memset(&header,0,sizeof(JsfFileHeader));
   if (jsfGetFileHeader(addr, &header)) do {
     // check for something with the same name that hasn't been replaced
@@ -456,6 +994,7 @@ uint32_t jsfFindFile(JsfFileName name, JsfFileHeader *returnedHeader) {
 
 /// Output debug info for files stored in flash storage
 void jsfDebugFiles() {
+  if (!jsfCompactFinish()) return;
   uint32_t addr = JSF_START_ADDRESS;
   uint32_t pageAddr = 0, pageLen = 0, pageEndAddr = 0;
 
@@ -491,10 +1030,73 @@ void jsfDebugFiles() {
   } while (jsfGetNextFileHeader(&addr, &header, GNFH_GET_ALL));
 }
 
+#ifdef USE_HEATSHRINK
+typedef struct {
+  unsigned char *ptr;
+  uint32_t len; ///< bytes left in the buffer
+} jsfDecompressOutput;
+
+/// heatshrink output callback that writes to a buffer, dropping anything past its end
+static void jsfDecompress_writecb(unsigned char ch, uint32_t *cbdata) {
+  jsfDecompressOutput *out = (jsfDecompressOutput*)cbdata;
+  if (!out->len) return;
+  out->len--;
+  *(out->ptr++) = ch;
+}
+
+/// Decompress a file written with JSFF_COMPRESSED into RAM
+static JsVar *jsfReadCompressedFile(uint32_t addr, JsfFileHeader *header) {
+  JsSysTime startTime = jshGetSystemTime();
+  uint32_t length;
+  jshFlashRead(&length, addr, 4); // uncompressed length
+  if (length >= FLASH_SAVED_CODE_LENGTH*16) return 0; // corrupt?
+  jsfcbData cbData;
+  memset(&cbData, 0, sizeof(cbData));
+  cbData.address = addr+4;
+  cbData.endAddress = addr+jsfGetFileSize(header);
+  // The stored length may be wrong if the file is corrupt, so never write past the buffer
+  uint32_t decodedLength;
+  JsVar *v = jsvNewFlatStringOfLength(length);
+  if (v) {
+    jsfDecompressOutput out;
+    out.ptr = (unsigned char*)jsvGetFlatStringPointer(v);
+    out.len = length;
+    decodedLength = heatshrink_decode_cb(jsfLoadFromFlash_readcb, (uint32_t*)&cbData, jsfDecompress_writecb, (uint32_t*)&out);
+  } else {
+    v = jsvNewStringOfLength(length, NULL);
+    if (!v) return 0;
+    JsvStringIterator it; // the iterator ignores writes past the end of the string
+    jsvStringIteratorNew(&it, v, 0);
+    decodedLength = heatshrink_decode_cb(jsfLoadFromFlash_readcb, (uint32_t*)&cbData, heatshrink_var_output_cb, (uint32_t*)&it);
+    jsvStringIteratorFree(&it);
+  }
+  if (decodedLength != length) {
+    jsvUnLock(v);
+    return 0; // corrupt
+  }
+  jsfCompressStats.reads++;
+  jsfCompressStats.decompressTime += jshGetSystemTime() - startTime;
+  return v;
+}
+#endif
+
 JsVar *jsfReadFile(JsfFileName name, int offset, int length) {
   JsfFileHeader header;
   uint32_t addr = jsfFindFile(name, &header);
   if (!addr) return 0;
+#ifdef USE_HEATSHRINK
+  // The saved RAM image is compressed too, but in its own format
+  if ((jsfGetFileFlags(&header) & JSFF_COMPRESSED) &&
+      name.n != jsfNameFromString(SAVED_CODE_VARIMAGE).n) {
+    JsVar *v = jsfReadCompressedFile(addr, &header);
+    if (v && (offset>0 || length>0)) {
+      JsVar *sub = jsvNewFromStringVar(v, (size_t)(offset>0 ? offset : 0), (length>0) ? (size_t)length : JSVAPPENDSTRINGVAR_MAXLENGTH);
+      jsvUnLock(v);
+      v = sub;
+    }
+    return v;
+  }
+#endif
   // clip requested read lengths
   if (offset<0) offset=0;
   uint32_t fileLen = jsfGetFileSize(&header);
@@ -527,19 +1129,25 @@ JsVar *jsfReadFile(JsfFileName name, int offset, int length) {
   }
 #endif
 #ifdef LINUX
-  // linux fakes flash with a file, so we can't just return a pointer to it!
-  uint32_t alignedSize = jsfAlignAddress(length);
-  char *d = (char*)malloc(alignedSize);
-  jshFlashRead(d, addr, alignedSize);
-  JsVar *v = jsvNewStringOfLength(length, d);
-  free(d);
-  return v;
-#else
-  return jsvNewNativeString((char*)mappedAddr, length);
+  // linux fakes flash with a file - if that couldn't be memory-mapped we can't just return a pointer to it!
+  if (!mappedAddr) {
+    uint32_t alignedSize = jsfAlignAddress(length);
+    char *d = (char*)malloc(alignedSize);
+    jshFlashRead(d, addr, alignedSize);
+    JsVar *v = jsvNewStringOfLength(length, d);
+    free(d);
+    return v;
+  }
 #endif
+  return jsvNewNativeString((char*)mappedAddr, (size_t)length);
 }
 
-bool jsfWriteFile(JsfFileName name, JsVar *data, JsfFileFlags flags, JsVarInt offset, JsVarInt _size) {
+bool jsfIsStoragePointer(const void *ptr) {
+  size_t start = jshFlashGetMemMapAddress((size_t)JSF_START_ADDRESS);
+  return start && (size_t)ptr>=start && (size_t)ptr<start+(JSF_END_ADDRESS-JSF_START_ADDRESS);
+}
+
+static bool jsfWriteFileInternal(JsfFileName name, JsVar *data, JsfFileFlags flags, JsVarInt offset, JsVarInt _size) {
   if (offset<0 || _size<0) return false;
   uint32_t size = (uint32_t)_size;
   // Data length
@@ -581,20 +1189,171 @@ bool jsfWriteFile(JsfFileName name, JsVar *data, JsfFileFlags flags, JsVarInt of
   }
   DBG("jsfWriteFile write contents\n");
   jshFlashWriteAligned(dPtr, addr, (uint32_t)dLen);
+  jsfNoteWrite((uint32_t)dLen);
   DBG("jsfWriteFile written contents\n");
+#ifdef JSF_FILE_INDEX_SIZE
+  jsfFileHashForget(name);
+#endif
   return true;
 }
 
+bool jsfGetFileHash(JsfFileName name, uint32_t *hash) {
+  JsfFileHeader header;
+  uint32_t addr = jsfFindFile(name, &header);
+  if (!addr) return false;
+#ifdef JSF_FILE_INDEX_SIZE
+  if (jsfFileHashGet(&header, hash)) return true;
+#endif
+  unsigned char buf[128];
+  uint32_t h = JSF_HASH_INIT;
+  uint32_t len = jsfGetFileSize(&header);
+  while (len) {
+    uint32_t l = len;
+    if (l>sizeof(buf)) l=sizeof(buf);
+    jshFlashRead(buf, addr, l);
+    h = jsfHashData(h, buf, l);
+    addr += l;
+    len -= l;
+  }
+#ifdef JSF_FILE_INDEX_SIZE
+  // StorageLog writes records directly, so don't remember hashes of logs
+  if (!(jsfGetFileFlags(&header) & JSFF_LOG))
+    jsfFileHashSet(name, header.size, h);
+#endif
+  *hash = h;
+  return true;
+}
+
+bool jsfWriteFile(JsfFileName name, JsVar *data, JsfFileFlags flags, JsVarInt offset, JsVarInt _size) {
+  if (!(flags & JSFF_COMPRESSED))
+    return jsfWriteFileInternal(name, data, flags, offset, _size);
+  if (offset || _size) {
+    jsExceptionHere(JSET_ERROR, "Compressed files must be written all at once");
+    return false;
+  }
+#ifdef USE_HEATSHRINK
+  JsSysTime startTime = jshGetSystemTime();
+  JSV_GET_AS_CHAR_ARRAY(dPtr, dLen, data);
+  if (!dPtr) return false;
+  // Store the uncompressed length, then the compressed data
+  uint32_t compressedLen = 4 + heatshrink_encode((unsigned char*)dPtr, dLen, NULL, NULL);
+  JsVar *cData = 0;
+  if (compressedLen < dLen) {
+    cData = jsvNewStringOfLength(compressedLen, NULL);
+    if (cData) {
+      JsvStringIterator it;
+      jsvStringIteratorNew(&it, cData, 0);
+      uint32_t len = (uint32_t)dLen;
+      for (int i=0;i<4;i++)
+        jsvStringIteratorSetCharAndNext(&it, (char)(len>>(i*8)));
+      heatshrink_encode((unsigned char*)dPtr, dLen, heatshrink_var_output_cb, (uint32_t*)&it);
+      jsvStringIteratorFree(&it);
+    }
+  }
+  jsfCompressStats.compressTime += jshGetSystemTime() - startTime;
+  if (cData) {
+    jsfCompressStats.files++;
+    jsfCompressStats.uncompressedBytes += (uint32_t)dLen;
+    jsfCompressStats.compressedBytes += compressedLen;
+    bool ok = jsfWriteFileInternal(name, cData, flags, 0, 0);
+    jsvUnLock(cData);
+    return ok;
+  }
+#endif
+  // didn't compress (or not worth it) - write as-is
+  return jsfWriteFileInternal(name, data, (JsfFileFlags)(flags & ~(unsigned)JSFF_COMPRESSED), 0, 0);
+}
+
+/// Return an object containing statistics about flash storage
+JsVar *jsfGetStorageStats() {
+  JsVar *o = jsvNewObject();
+  if (!o) return 0;
+  if (!jsfCompactFinish()) {
+    jsvUnLock(o);
+    return 0;
+  }
+  uint32_t uncompacted = 0;
+  uint32_t allocated = jsfGetAllocatedSpace(JSF_START_ADDRESS, true, &uncompacted);
+#ifdef JSF_WEAR_BUCKETS
+  uint32_t fragmented = FLASH_SAVED_CODE_LENGTH - jsfGetFreeSpace(0,true) - allocated - uncompacted;
+  JsfFileHeader header;
+  if (jsfFindFile(jsfNameFromString(JSF_WEAR_FILE_NAME), &header))
+    allocated -= jsfAlignAddress(jsfGetFileSize(&header)) + (uint32_t)sizeof(JsfFileHeader);
+#endif
+  jsvObjectSetChildAndUnLock(o, "totalBytes", jsvNewFromLongInteger(FLASH_SAVED_CODE_LENGTH));
+  jsvObjectSetChildAndUnLock(o, "freeBytes", jsvNewFromLongInteger(jsfGetFreeSpace(0,true)));
+  jsvObjectSetChildAndUnLock(o, "fileBytes", jsvNewFromLongInteger(allocated));
+  jsvObjectSetChildAndUnLock(o, "trashBytes", jsvNewFromLongInteger(uncompacted));
+#ifdef JSF_FILE_INDEX_SIZE
+  jsvObjectSetChildAndUnLock(o, "indexSize", jsvNewFromLongInteger(JSF_FILE_INDEX_SIZE));
+  jsvObjectSetChildAndUnLock(o, "indexComplete", jsvNewFromBool(jsfFileIndexComplete));
+  jsvObjectSetChildAndUnLock(o, "indexHits", jsvNewFromLongInteger(jsfFileIndexHits));
+  jsvObjectSetChildAndUnLock(o, "indexScans", jsvNewFromLongInteger(jsfFileIndexScans));
+#endif
+#ifdef JSF_LAZY_LOAD_VARS
+  uint32_t blocks, loaded;
+  jsfLazyLoadGetStats(&blocks, &loaded);
+  jsvObjectSetChildAndUnLock(o, "imageBlocks", jsvNewFromLongInteger(blocks));
+  jsvObjectSetChildAndUnLock(o, "imageBlocksLoaded", jsvNewFromLongInteger(loaded));
+#endif
+#ifdef JSF_WEAR_BUCKETS
+  jsvObjectSetChildAndUnLock(o, "compactions", jsvNewFromLongInteger(jsfWear.compactions));
+  jsvObjectSetChildAndUnLock(o, "writtenBytes", jsvNewFromLongInteger(jsfWear.writtenBytes));
+  jsvObjectSetChildAndUnLock(o, "movedBytes", jsvNewFromLongInteger(jsfWear.movedBytes));
+  jsvObjectSetChildAndUnLock(o, "writeAmplification", jsvNewFromFloat(jsfWear.writtenBytes ?
+      (JsVarFloat)(jsfWear.writtenBytes+jsfWear.movedBytes) / jsfWear.writtenBytes : 1));
+  jsvObjectSetChildAndUnLock(o, "fragmentedBytes", jsvNewFromLongInteger(fragmented));
+  uint32_t erases = 0, maxErases = 0, minErases = 0xFFFFFFFF;
+  JsVar *pageErases = jsvNewTypedArray(ARRAYBUFFERVIEW_UINT32, JSF_WEAR_BUCKETS);
+  JsvArrayBufferIterator it;
+  if (pageErases) jsvArrayBufferIteratorNew(&it, pageErases, 0);
+  for (int i=0;i<JSF_WEAR_BUCKETS;i++) {
+    uint32_t e = jsfWear.erases[i];
+    erases += e;
+    if (e>maxErases) maxErases = e;
+    if (e<minErases) minErases = e;
+    if (pageErases) {
+      jsvArrayBufferIteratorSetIntegerValue(&it, (JsVarInt)e);
+      jsvArrayBufferIteratorNext(&it);
+    }
+  }
+  if (pageErases) jsvArrayBufferIteratorFree(&it);
+  jsvObjectSetChildAndUnLock(o, "erases", jsvNewFromLongInteger(erases));
+  jsvObjectSetChildAndUnLock(o, "maxPageErases", jsvNewFromLongInteger(maxErases));
+  jsvObjectSetChildAndUnLock(o, "minPageErases", jsvNewFromLongInteger(minErases));
+  jsvObjectSetChildAndUnLock(o, "pageErases", pageErases);
+#endif
+#ifdef USE_HEATSHRINK
+  jsvObjectSetChildAndUnLock(o, "compressedFiles", jsvNewFromLongInteger(jsfCompressStats.files));
+  jsvObjectSetChildAndUnLock(o, "compressRatio", jsvNewFromFloat(jsfCompressStats.compressedBytes ?
+      (JsVarFloat)jsfCompressStats.uncompressedBytes / jsfCompressStats.compressedBytes : 1));
+  jsvObjectSetChildAndUnLock(o, "compressTime", jsvNewFromFloat(jshGetMillisecondsFromTime(jsfCompressStats.compressTime)));
+  jsvObjectSetChildAndUnLock(o, "decompressedFiles", jsvNewFromLongInteger(jsfCompressStats.reads));
+  jsvObjectSetChildAndUnLock(o, "decompressTime", jsvNewFromFloat(jshGetMillisecondsFromTime(jsfCompressStats.decompressTime)));
+#endif
+  return o;
+}
+
 /// Return all files in flash as a JsVar array of names
 JsVar *jsfListFiles() {
   JsVar *files = jsvNewEmptyArray();
   if (!files) return 0;
+  if (!jsfCompactFinish()) {
+    jsvUnLock(files);
+    return 0;
+  }
 
   char nameBuf[sizeof(JsfFileName)+1];
+#ifdef JSF_WEAR_BUCKETS
+  JsfFileName wearName = jsfNameFromString(JSF_WEAR_FILE_NAME);
+#endif
   uint32_t addr = JSF_START_ADDRESS;
   JsfFileHeader header;
   memset(&header,0,sizeof(JsfFileHeader));
   if (jsfGetFileHeader(addr, &header)) do {
+#ifdef JSF_WEAR_BUCKETS
+    if (header.name.n == wearName.n) continue; // internal - not a user file
+#endif
     if (header.replacement == JSF_WORD_UNSET) { // if not replaced
       memcpy(nameBuf, &header.name, sizeof(JsfFileName));
       nameBuf[sizeof(JsfFileName)]=0;
@@ -624,19 +1383,16 @@ static uint32_t getBuildHash() {
 #endif
 }
 
-typedef struct {
-  uint32_t address;          // current address in memory
-  uint32_t endAddress;       // address at which to end
-  int byteCount;
-  unsigned char buffer[128]; // buffer for read/written data
-  uint32_t bufferCnt;        // where are we in the buffer?
-} jsfcbData;
 // cbdata = struct jsfcbData
 void jsfSaveToFlash_writecb(unsigned char ch, uint32_t *cbdata) {
   jsfcbData *data = (jsfcbData*)cbdata;
   data->buffer[data->bufferCnt++] = ch;
   if (data->bufferCnt>=(uint32_t)sizeof(data->buffer)) {
-    jshFlashWrite(data->buffer, data->address, data->bufferCnt);
+    // if we've run out of space, keep counting but don't write
+    if (data->address+data->bufferCnt <= data->endAddress) {
+      jshFlashWrite(data->buffer, data->address, data->bufferCnt);
+      jsfNoteWrite(data->bufferCnt);
+    }
     data->address += data->bufferCnt;
     data->bufferCnt = 0;
     if ((data->address&1023)==0) jsiConsolePrint(".");
@@ -647,7 +1403,12 @@ void jsfSaveToFlash_finish(jsfcbData *data) {
   while (data->bufferCnt & (JSF_ALIGNMENT-1))
     data->buffer[data->bufferCnt++] = 0xFF;
   // write
-  jshFlashWrite(data->buffer, data->address, data->bufferCnt);
+  if (data->address+data->bufferCnt <= data->endAddress) {
+    jshFlashWrite(data->buffer, data->address, data->bufferCnt);
+    jsfNoteWrite(data->bufferCnt);
+  }
+  data->address += data->bufferCnt;
+  data->bufferCnt = 0;
 }
 
 // cbdata = struct jsfcbData
@@ -666,55 +1427,413 @@ int jsfLoadFromFlash_readcb(uint32_t *cbdata) {
   return data->buffer[data->bufferCnt++];
 }
 
+#ifdef JSF_DELTA_BLOCK_SIZE
+/* For delta saves the RAM image is split into JSF_DELTA_BLOCK_SIZE blocks.
+ * A full save also writes a hash of each block to SAVED_CODE_VARHASH, and
+ * jsfSaveDeltaToFlash compares against these to find out what has changed
+ * (rather than tracking every write to a JsVar). Changed blocks are written
+ * uncompressed to SAVED_CODE_VARDIFF as [uint32 block index][block data].  */
+
+static uint32_t jsfReadWord(uint32_t addr) {
+  uint32_t w;
+  jshFlashRead(&w, addr, 4);
+  return w;
+}
+
+/// Size of the given block (the last one may be shorter)
+static uint32_t jsfBlockSize(unsigned int varSize, uint32_t block) {
+  uint32_t start = block*JSF_DELTA_BLOCK_SIZE;
+  return ((varSize-start) < JSF_DELTA_BLOCK_SIZE) ? (varSize-start) : JSF_DELTA_BLOCK_SIZE;
+}
+
+/** Get a pointer to the given block of RAM. With RESIZABLE_JSVARS, JsVars are
+ * allocated JSVAR_BLOCK_SIZE at a time so RAM isn't contiguous - but a block
+ * never spans two allocations */
+static unsigned char *jsfGetBlockData(uint32_t block) {
+  uint32_t offset = block*JSF_DELTA_BLOCK_SIZE;
+  return (unsigned char*)_jsvGetAddressOf((JsVarRef)(offset/sizeof(JsVar) + 1)) + offset%sizeof(JsVar);
+}
+
+/// 32 bit FNV-1a hash of a block of RAM
+static uint32_t jsfHashBlock(unsigned int varSize, uint32_t block) {
+  return jsfHashData(JSF_HASH_INIT, jsfGetBlockData(block), jsfBlockSize(varSize, block));
+}
+
+/// Write SAVED_CODE_VARHASH for the current RAM image. If we can't, delta saves won't be possible
+static void jsfSaveBlockHashes(unsigned int varSize) {
+  uint32_t blocks = (varSize + JSF_DELTA_BLOCK_SIZE - 1) / JSF_DELTA_BLOCK_SIZE;
+  uint32_t size = 4 + blocks*4;
+  jsfcbData cbData;
+  memset(&cbData, 0, sizeof(cbData));
+  cbData.address = jsfCreateFile(jsfNameFromString(SAVED_CODE_VARHASH), size, JSFF_NONE, JSF_START_ADDRESS, 0);
+  if (!cbData.address) return;
+  cbData.endAddress = jsfAlignAddress(cbData.address+size);
+  uint32_t w = JSF_DELTA_BLOCK_SIZE;
+  for (uint32_t i=0;i<=blocks;i++) {
+    if (i) w = jsfHashBlock(varSize, i-1);
+    for (int j=0;j<4;j++)
+      jsfSaveToFlash_writecb(((unsigned char*)&w)[j], (uint32_t*)&cbData);
+  }
+  jsfSaveToFlash_finish(&cbData);
+}
+#endif
+
+#ifdef JSF_LAZY_LOAD_VARS
+/* For lazy loading, the RAM image is split into blocks of JSF_LAZY_LOAD_VARS
+ * JsVars, each compressed separately and followed by a JsfLazyBlockInfo. On
+ * load we walk back from the end of the file to find where each block is,
+ * but don't decompress anything. jsvGetAddressOf then calls jsfLazyLoad the
+ * first time each block is used, and jsfLazyLoadIdle loads the rest when
+ * we're idle.
+ *
+ * The list of free JsVars runs through all blocks, so we store the first
+ * free JsVar in each block. When a block is loaded its free JsVars are linked
+ * together and the last is linked to the first free JsVar of the next block
+ * that has any. Until then nothing can get to the next block's free JsVars. */
+typedef struct {
+  uint32_t length;     ///< compressed length of the block (which comes right before this)
+  uint32_t firstEmpty; ///< first free JsVar in this block (or 0)
+  uint32_t skip;       ///< number of JsVars at the start of this block that are data for a flat string in the previous block
+} JsfLazyBlockInfo;
+
+/// Max number of blocks we can load lazily. If the image is bigger we load it all at once
+#define JSF_LAZY_LOAD_MAX_BLOCKS 1024
+
+bool jsfLazyLoadPending; ///< Are there blocks that still need loading?
+static uint32_t jsfLazyBlockCount; ///< How many blocks there are
+static uint32_t jsfLazyBlocksLoaded; ///< How many blocks have been loaded
+static uint32_t jsfLazyBlockInfoAddr[JSF_LAZY_LOAD_MAX_BLOCKS]; ///< Address in flash of each block's JsfLazyBlockInfo
+static uint8_t jsfLazyBlockLoaded[(JSF_LAZY_LOAD_MAX_BLOCKS+7)/8];
+
+/// Compress each block of the RAM image and write it along with its JsfLazyBlockInfo. Returns the amount of data written
+static uint32_t jsfSaveLazyBlocks(unsigned int varSize, jsfcbData *cbData) {
+  uint32_t varCount = varSize / (uint32_t)sizeof(JsVar);
+  uint32_t written = 0;
+  uint32_t flatStringEnd = 0; // the JsVar after the current flat string's data
+  for (uint32_t start=0; start<varCount; start+=JSF_LAZY_LOAD_VARS) {
+    uint32_t count = varCount-start;
+    if (count > JSF_LAZY_LOAD_VARS) count = JSF_LAZY_LOAD_VARS;
+    JsfLazyBlockInfo info;
+    info.firstEmpty = 0;
+    info.skip = (flatStringEnd > start) ? flatStringEnd-start : 0;
+    if (info.skip > count) info.skip = count;
+    // Find the first free JsVar, and the end of any flat strings, the same way as jsvCreateEmptyVarList
+    for (uint32_t i=start+info.skip; i<start+count; i++) {
+      JsVar *v = _jsvGetAddressOf((JsVarRef)(i+1));
+      if ((v->flags&JSV_VARTYPEMASK) == JSV_UNUSED) {
+        if (!info.firstEmpty) info.firstEmpty = i+1; // refs start at 1
+      } else if (jsvIsFlatString(v)) {
+        i += (uint32_t)jsvGetFlatStringBlocks(v);
+        flatStringEnd = i+1;
+      }
+    }
+    // a block's JsVars are contiguous, even with RESIZABLE_JSVARS
+    info.length = (uint32_t)COMPRESS((unsigned char*)_jsvGetAddressOf((JsVarRef)(start+1)), count*sizeof(JsVar), jsfSaveToFlash_writecb, (uint32_t*)cbData);
+    for (unsigned int j=0;j<sizeof(info);j++)
+      jsfSaveToFlash_writecb(((unsigned char*)&info)[j], (uint32_t*)cbData);
+    written += info.length + (uint32_t)sizeof(info);
+  }
+  return written;
+}
+
+static bool jsfLazyIsLoaded(uint32_t block) {
+  return (jsfLazyBlockLoaded[block>>3] >> (block&7)) & 1;
+}
+
+/// Decompress a block into RAM and link its free JsVars into the free list
+static void jsfLazyLoadBlock(uint32_t block) {
+  if (jsfLazyIsLoaded(block)) return;
+  jsfLazyBlockLoaded[block>>3] |= (uint8_t)(1<<(block&7));
+  if (++jsfLazyBlocksLoaded >= jsfLazyBlockCount)
+    jsfLazyLoadPending = false;
+  JsfLazyBlockInfo info;
+  jshFlashRead(&info, jsfLazyBlockInfoAddr[block], (uint32_t)sizeof(info));
+  uint32_t start = block*JSF_LAZY_LOAD_VARS;
+  uint32_t count = jsvGetMemoryTotal()-start;
+  if (count > JSF_LAZY_LOAD_VARS) count = JSF_LAZY_LOAD_VARS;
+  JsVar *vars = _jsvGetAddressOf((JsVarRef)(start+1)); // block is marked as loaded so this won't recurse
+  jsfcbData cbData;
+  memset(&cbData, 0, sizeof(cbData));
+  cbData.address = jsfLazyBlockInfoAddr[block] - info.length;
+  cbData.endAddress = jsfLazyBlockInfoAddr[block];
+  DECOMPRESS(jsfLoadFromFlash_readcb, (uint32_t*)&cbData, (unsigned char*)vars);
+  // Link up free JsVars
+  JsVar *lastEmpty = 0;
+  uint32_t flatStringEnd = 0;
+  for (uint32_t i=info.skip; i<count; i++) {
+    JsVar *v = &vars[i];
+    if ((v->flags&JSV_VARTYPEMASK) == JSV_UNUSED) {
+      if (lastEmpty) jsvSetNextSibling(lastEmpty, (JsVarRef)(start+i+1));
+      lastEmpty = v;
+    } else if (jsvIsFlatString(v)) {
+      i += (uint32_t)jsvGetFlatStringBlocks(v);
+      flatStringEnd = start+i+1;
+    }
+  }
+  if (lastEmpty) {
+    JsVarRef next = 0;
+    for (uint32_t b=block+1; b<jsfLazyBlockCount && !next; b++) {
+      jshFlashRead(&info, jsfLazyBlockInfoAddr[b], (uint32_t)sizeof(info));
+      next = (JsVarRef)info.firstEmpty;
+    }
+    jsvSetNextSibling(lastEmpty, next);
+  }
+  // A flat string's data must be in RAM as soon as the string is
+  for (uint32_t b=block+1; b*JSF_LAZY_LOAD_VARS<flatStringEnd; b++)
+    jsfLazyLoadBlock(b);
+}
+
+/// Called from jsvGetAddressOf when jsfLazyLoadPending is set, to ensure the JsVar is loaded
+void jsfLazyLoad(JsVarRef ref) {
+  uint32_t block = (uint32_t)(ref-1) / JSF_LAZY_LOAD_VARS;
+  if (block < jsfLazyBlockCount)
+    jsfLazyLoadBlock(block);
+}
+
+/// Load one block that hasn't been used yet. Returns true if there's more to load
+bool jsfLazyLoadIdle() {
+  if (!jsfLazyLoadPending) return false;
+  for (uint32_t b=0; b<jsfLazyBlockCount; b++) {
+    if (!jsfLazyIsLoaded(b)) {
+      jsfLazyLoadBlock(b);
+      break;
+    }
+  }
+  return jsfLazyLoadPending;
+}
+
+/// Load everything that hasn't been loaded yet (eg. before Storage is compacted)
+void jsfLazyLoadAll() {
+  while (jsfLazyLoadIdle());
+}
+
+/// Forget about anything that hasn't been loaded (because RAM is being reset)
+void jsfLazyLoadCancel() {
+  jsfLazyLoadPending = false;
+}
+
+/// Get the first free JsVar (for jsvCreateEmptyVarList) when blocks are still to be loaded
+JsVarRef jsfLazyLoadFirstEmpty() {
+  JsfLazyBlockInfo info;
+  for (uint32_t b=0; b<jsfLazyBlockCount; b++) {
+    jshFlashRead(&info, jsfLazyBlockInfoAddr[b], (uint32_t)sizeof(info));
+    if (info.firstEmpty) return (JsVarRef)info.firstEmpty;
+  }
+  return 0;
+}
+
+/// Set up lazy loading of the image at addr (after the build hash). Returns false if it can't be loaded lazily
+static bool jsfLazyLoadStart(uint32_t addr, uint32_t endAddr) {
+  // Walk back from the end to find each block (last block first)
+  uint32_t blocks = 0;
+  uint32_t infoAddr = endAddr;
+  while (infoAddr != addr) {
+    if (blocks >= JSF_LAZY_LOAD_MAX_BLOCKS) return false;
+    if (infoAddr < addr+sizeof(JsfLazyBlockInfo)) return false; // corrupt
+    infoAddr -= (uint32_t)sizeof(JsfLazyBlockInfo);
+    jsfLazyBlockInfoAddr[blocks++] = infoAddr;
+    JsfLazyBlockInfo info;
+    jshFlashRead(&info, infoAddr, (uint32_t)sizeof(info));
+    if (info.length > infoAddr-addr) return false; // corrupt
+    infoAddr -= info.length;
+  }
+  for (uint32_t b=0; b<blocks/2; b++) {
+    uint32_t a = jsfLazyBlockInfoAddr[b];
+    jsfLazyBlockInfoAddr[b] = jsfLazyBlockInfoAddr[blocks-1-b];
+    jsfLazyBlockInfoAddr[blocks-1-b] = a;
+  }
+#ifdef RESIZABLE_JSVARS
+  // the image may be from after we allocated more JsVars
+  if (blocks*JSF_LAZY_LOAD_VARS > jsvGetMemoryTotal())
+    jsvSetMemoryTotal(blocks*JSF_LAZY_LOAD_VARS);
+#endif
+  if (blocks != (jsvGetMemoryTotal() + JSF_LAZY_LOAD_VARS - 1) / JSF_LAZY_LOAD_VARS)
+    return false; // from a different sized image
+  jsfLazyBlockCount = blocks;
+  jsfLazyBlocksLoaded = 0;
+  memset(jsfLazyBlockLoaded, 0, sizeof(jsfLazyBlockLoaded));
+  jsfLazyLoadPending = true;
+  return true;
+}
+
+/// Return the number of blocks (and how many are loaded) for lazy loading
+void jsfLazyLoadGetStats(uint32_t *blocks, uint32_t *loaded) {
+  *blocks = jsfLazyBlockCount;
+  *loaded = jsfLazyBlocksLoaded;
+}
+#endif
+
+/* Compress the RAM image straight into the free space at the end of Storage.
+ * The header's size is only written once we know it. Returns the compressed
+ * size, or 0 if it didn't fit (in which case the space is marked as erased) */
+static uint32_t jsfSaveToFlashStream(unsigned char *varPtr, unsigned int varSize) {
+  JsfFileName name = jsfNameFromString(SAVED_CODE_VARIMAGE);
+  uint32_t addr = JSF_END_ADDRESS - jsfGetFreeSpace(0, true);
+  uint32_t dataAddr = addr + (uint32_t)sizeof(JsfFileHeader);
+  if (dataAddr + JSF_ALIGNMENT >= JSF_END_ADDRESS ||
+      !jsfIsErased(addr, (uint32_t)sizeof(JsfFileHeader)))
+    return 0;
+  // Write the name - jsfTrashUnfinishedFile cleans up if we don't get further
+  JsfFileHeader header;
+  memset(&header, 0xFF, sizeof(header));
+  header.name = name;
+  jshFlashWrite(&header.name, addr+(uint32_t)((char*)&header.name - (char*)&header), (uint32_t)sizeof(JsfFileName));
+  // Now write the data
+  jsfcbData cbData;
+  memset(&cbData, 0, sizeof(cbData));
+  cbData.address = dataAddr;
+  cbData.endAddress = JSF_END_ADDRESS - JSF_ALIGNMENT; // jsfGetFileHeader needs a gap at the end
+  // write the hash
+  uint32_t hash = getBuildHash();
+  int i;
+  for (i=0;i<4;i++)
+    jsfSaveToFlash_writecb(((unsigned char*)&hash)[i], (uint32_t*)&cbData);
+  // write compressed data
+#ifdef JSF_LAZY_LOAD_VARS
+  NOT_USED(varPtr);
+  uint32_t compressedSize = 4 + jsfSaveLazyBlocks(varSize, &cbData);
+#else
+  uint32_t compressedSize = 4 + COMPRESS(varPtr, varSize, jsfSaveToFlash_writecb, (uint32_t*)&cbData);
+#endif
+  jsfSaveToFlash_finish(&cbData);
+  if (cbData.address > cbData.endAddress) {
+    jsfTrashUnfinishedFile(addr);
+    return 0;
+  }
+  // finally write the size to make the file valid
+  header.size = compressedSize | ((uint32_t)JSFF_COMPRESSED<<24);
+  jshFlashWrite(&header.size, addr, (uint32_t)sizeof(JsfWord));
+  jsfNoteWrite((uint32_t)sizeof(JsfFileHeader));
+#ifdef JSF_FILE_INDEX_SIZE
+  jsfFileIndexSet(name, addr);
+  jsfFileHashForget(name);
+#endif
+  return compressedSize;
+}
+
 /// Save the RAM image to flash (this is the actual interpreter state)
 void jsfSaveToFlash() {
+#ifdef JSF_LAZY_LOAD_VARS
+  jsfLazyLoadAll(); // we read RAM directly, so it must all be loaded
+#endif
   unsigned int varSize = jsvGetMemoryTotal() * (unsigned int)sizeof(JsVar);
   unsigned char* varPtr = (unsigned char *)_jsvGetAddressOf(1);
 
   jsiConsolePrint("Compacting Flash...\n");
   // Ensure we get rid of any saved code we had before
   jsfEraseFile(jsfNameFromString(SAVED_CODE_VARIMAGE));
+#ifdef JSF_DELTA_BLOCK_SIZE
+  jsfEraseFile(jsfNameFromString(SAVED_CODE_VARHASH));
+  jsfEraseFile(jsfNameFromString(SAVED_CODE_VARDIFF));
+#endif
   // Try and compact, just to ensure we get the maximum amount saved
   jsfCompact();
-  jsiConsolePrint("Calculating Size...\n");
-  // Work out how much data this'll take, plus 4 bytes for build hash
-  uint32_t compressedSize = 4 + COMPRESS(varPtr, varSize, NULL, NULL);
-  // How much data do we have?
-  uint32_t savedCodeAddr = jsfCreateFile(jsfNameFromString(SAVED_CODE_VARIMAGE), compressedSize, JSFF_COMPRESSED, JSF_START_ADDRESS, 0);
-  if (!savedCodeAddr) {
-    jsiConsolePrintf("ERROR: Too big to save to flash (%d vs %d bytes)\n", compressedSize, jsfGetFreeSpace(0,true));
+  uint32_t freeSpace = jsfGetFreeSpace(0,true);
+  jsiConsolePrint("Writing..");
+  JsSysTime startTime = jshGetSystemTime();
+  uint32_t compressedSize = jsfSaveToFlashStream(varPtr, varSize);
+  if (!compressedSize) {
+    jsiConsolePrintf("\nERROR: Too big to save to flash (%d bytes free)\n", freeSpace);
     jsvSoftInit();
     jspSoftInit();
     jsiConsolePrint("Deleting command history and trying again...\n");
     while (jsiFreeMoreMemory());
     jspSoftKill();
     jsvSoftKill();
-    savedCodeAddr = jsfCreateFile(jsfNameFromString(SAVED_CODE_VARIMAGE), compressedSize, JSFF_COMPRESSED, JSF_START_ADDRESS, 0);
+    jsfCompact(); // remove what we wrote last time
+    jsiConsolePrint("Writing..");
+    startTime = jshGetSystemTime();
+    compressedSize = jsfSaveToFlashStream(varPtr, varSize);
   }
-  if (!savedCodeAddr) {
+  if (!compressedSize) {
+    jsfCompact(); // remove what we wrote
     if (jsfGetAllocatedSpace(JSF_START_ADDRESS, true, 0))
-      jsiConsolePrint("Not enough free space to save. Try require('Storage').eraseAll()\n");
+      jsiConsolePrint("\nNot enough free space to save. Try require('Storage').eraseAll()\n");
     else
-      jsiConsolePrint("Code is too big to save to Flash.\n");
+      jsiConsolePrint("\nCode is too big to save to Flash.\n");
     return;
   }
-  // Ok, we have space!
-  // Now start writing
+  jsiConsolePrintf("\nCompressed %d bytes to %d\n", varSize, compressedSize);
+#ifdef JSF_DELTA_BLOCK_SIZE
+  jsfSaveBlockHashes(varSize);
+#endif
+#ifdef LINUX
+  JsVarFloat ms = jshGetMillisecondsFromTime(jshGetSystemTime() - startTime);
+  jsiConsolePrintf("Saved in %fms (%d kB/s)\n", ms, (int)(varSize / ((ms>0)?ms:1)));
+#else
+  NOT_USED(startTime);
+#endif
+}
+
+#ifdef JSF_DELTA_BLOCK_SIZE
+/// Save only the blocks of RAM that have changed since the last jsfSaveToFlash
+void jsfSaveDeltaToFlash() {
+#ifdef JSF_LAZY_LOAD_VARS
+  jsfLazyLoadAll(); // we hash RAM directly, so it must all be loaded
+#endif
+  unsigned int varSize = jsvGetMemoryTotal() * (unsigned int)sizeof(JsVar);
+  uint32_t blocks = (varSize + JSF_DELTA_BLOCK_SIZE - 1) / JSF_DELTA_BLOCK_SIZE;
+  JsfFileHeader header, hashHeader;
+  uint32_t imageAddr = jsfFindFile(jsfNameFromString(SAVED_CODE_VARIMAGE), &header);
+  uint32_t hashAddr = jsfFindFile(jsfNameFromString(SAVED_CODE_VARHASH), &hashHeader);
+  if (!imageAddr || !hashAddr || jsfReadWord(hashAddr)!=JSF_DELTA_BLOCK_SIZE) {
+    jsfSaveToFlash();
+    return;
+  }
+  if (jsfGetFileSize(&hashHeader) != 4+blocks*4) {
+    // the amount of RAM has changed since the full save
+    jsiConsolePrint("Memory size changed - saving everything\n");
+    jsfSaveToFlash();
+    return;
+  }
+  JsSysTime startTime = jshGetSystemTime();
+  // Work out how big the delta will be
+  uint32_t changed = 0, diffSize = 8;
+  for (uint32_t i=0;i<blocks;i++) {
+    if (jsfHashBlock(varSize, i) != jsfReadWord(hashAddr+4+i*4)) {
+      changed++;
+      diffSize += 4 + jsfBlockSize(varSize, i);
+    }
+  }
+  /* If the delta has grown to half the size of the full image, consolidate
+   * by doing a full save. */
+  if (diffSize*2 > jsfGetFileSize(&header)) {
+    jsiConsolePrintf("%d of %d blocks changed - saving everything\n", changed, blocks);
+    jsfSaveToFlash();
+    return;
+  }
+  jsfEraseFile(jsfNameFromString(SAVED_CODE_VARDIFF));
   jsfcbData cbData;
   memset(&cbData, 0, sizeof(cbData));
-  cbData.address = savedCodeAddr;
-  cbData.endAddress = jsfAlignAddress(savedCodeAddr+compressedSize);
-  jsiConsolePrint("Writing..");
-  // write the hash
-  uint32_t hash = getBuildHash();
-  int i;
-  for (i=0;i<4;i++)
-    jsfSaveToFlash_writecb(((unsigned char*)&hash)[i], (uint32_t*)&cbData);
-  // write compressed data
-  COMPRESS(varPtr, varSize, jsfSaveToFlash_writecb, (uint32_t*)&cbData);
+  cbData.address = jsfCreateFile(jsfNameFromString(SAVED_CODE_VARDIFF), diffSize, JSFF_NONE, JSF_START_ADDRESS, 0);
+  if (!cbData.address) {
+    jsiConsolePrint("Not enough space for delta - saving everything\n");
+    jsfSaveToFlash();
+    return;
+  }
+  cbData.endAddress = jsfAlignAddress(cbData.address+diffSize);
+  uint32_t w[2] = { getBuildHash(), JSF_DELTA_BLOCK_SIZE };
+  for (unsigned int j=0;j<sizeof(w);j++)
+    jsfSaveToFlash_writecb(((unsigned char*)w)[j], (uint32_t*)&cbData);
+  for (uint32_t i=0;i<blocks;i++) {
+    if (jsfHashBlock(varSize, i) != jsfReadWord(hashAddr+4+i*4)) {
+      for (unsigned int j=0;j<4;j++)
+        jsfSaveToFlash_writecb(((unsigned char*)&i)[j], (uint32_t*)&cbData);
+      unsigned char *data = jsfGetBlockData(i);
+      uint32_t len = jsfBlockSize(varSize, i);
+      for (uint32_t j=0;j<len;j++)
+        jsfSaveToFlash_writecb(data[j], (uint32_t*)&cbData);
+    }
+  }
   jsfSaveToFlash_finish(&cbData);
-  jsiConsolePrintf("\nCompressed %d bytes to %d\n", varSize, compressedSize);
+  jsiConsolePrintf("Saved %d of %d blocks (%d bytes)\n", changed, blocks, diffSize);
+#ifdef LINUX
+  jsiConsolePrintf("Saved in %fms\n", jshGetMillisecondsFromTime(jshGetSystemTime() - startTime));
+#else
+  NOT_USED(startTime);
+#endif
 }
+#endif
 
 
 /// Load the RAM image from flash (this is the actual interpreter state)
@@ -726,7 +1845,6 @@ void jsfLoadStateFromFlash() {
   }
 
   //  unsigned int dataSize = jsvGetMemoryTotal() * sizeof(JsVar);
-  unsigned char* varPtr = (unsigned char *)_jsvGetAddressOf(1);
 
   jsfcbData cbData;
   memset(&cbData, 0, sizeof(cbData));
@@ -742,7 +1860,47 @@ void jsfLoadStateFromFlash() {
     return;
   }
   jsiConsolePrintf("Loading %d bytes from flash...\n", jsfGetFileSize(&header));
+#ifdef LINUX
+  JsSysTime startTime = jshGetSystemTime();
+#endif
+#ifdef JSF_LAZY_LOAD_VARS
+  if (!jsfLazyLoadStart(cbData.address, cbData.endAddress)) {
+    jsiConsolePrintf("Saved code is corrupt\n");
+    return;
+  }
+#else
+  unsigned char* varPtr = (unsigned char *)_jsvGetAddressOf(1);
   DECOMPRESS(jsfLoadFromFlash_readcb, (uint32_t*)&cbData, varPtr);
+#endif
+#ifdef JSF_DELTA_BLOCK_SIZE
+  // Apply any blocks that changed since the image was saved
+  uint32_t diffAddr = jsfFindFile(jsfNameFromString(SAVED_CODE_VARDIFF), &header);
+  if (diffAddr && jsfReadWord(diffAddr)==hash && jsfReadWord(diffAddr+4)==JSF_DELTA_BLOCK_SIZE) {
+#ifdef JSF_LAZY_LOAD_VARS
+    // The delta changes which JsVars are free, so we can't load lazily
+    jsfLazyLoadAll();
+#endif
+    unsigned int varSize = jsvGetMemoryTotal() * (unsigned int)sizeof(JsVar);
+    uint32_t blocks = (varSize + JSF_DELTA_BLOCK_SIZE - 1) / JSF_DELTA_BLOCK_SIZE;
+    uint32_t addr = diffAddr+8, endAddr = diffAddr+jsfGetFileSize(&header);
+    while (addr+4 <= endAddr) {
+      uint32_t block = jsfReadWord(addr);
+      if (block >= blocks) break; // corrupt
+      uint32_t len = jsfBlockSize(varSize, block);
+      jshFlashRead(jsfGetBlockData(block), addr+4, len);
+      addr += 4+len;
+    }
+  }
+#endif
+#ifdef LINUX
+  JsVarFloat ms = jshGetMillisecondsFromTime(jshGetSystemTime() - startTime);
+#ifdef JSF_LAZY_LOAD_VARS
+  if (jsfLazyLoadPending)
+    jsiConsolePrintf("Ready to load %d blocks on demand in %fms\n", jsfLazyBlockCount, ms);
+  else
+#endif
+  jsiConsolePrintf("Loaded in %fms (%d kB/s)\n", ms, (int)(jsvGetMemoryTotal()*sizeof(JsVar) / ((ms>0)?ms:1)));
+#endif
 }
 
 void jsfSaveBootCodeToFlash(JsVar *code, bool runAfterReset) {
@@ -786,6 +1944,10 @@ bool jsfFlashContainsCode() {
 void jsfRemoveCodeFromFlash() {
   jsiConsolePrint("Erasing saved code.");
   jsfEraseFile(jsfNameFromString(SAVED_CODE_VARIMAGE));
+#ifdef JSF_DELTA_BLOCK_SIZE
+  jsfEraseFile(jsfNameFromString(SAVED_CODE_VARHASH));
+  jsfEraseFile(jsfNameFromString(SAVED_CODE_VARDIFF));
+#endif
   jsfEraseFile(jsfNameFromString(SAVED_CODE_BOOTCODE));
   jsfEraseFile(jsfNameFromString(SAVED_CODE_BOOTCODE_RESET));
   jsiConsolePrint("\nDone!\n");
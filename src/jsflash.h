@@ -32,8 +32,55 @@ typedef struct {
   JsfFileName name; ///< 0-padded filename
 } JsfFileHeader;
 
+#if !defined(JSF_FILE_INDEX_SIZE) && !defined(SAVE_ON_FLASH)
+/// Number of entries in the RAM index of files in Storage (must be a power of 2). Define as 0 to disable
+#ifdef LINUX
+#define JSF_FILE_INDEX_SIZE 256
+#else
+#define JSF_FILE_INDEX_SIZE 32
+#endif
+#endif
+#if defined(JSF_FILE_INDEX_SIZE) && JSF_FILE_INDEX_SIZE==0
+#undef JSF_FILE_INDEX_SIZE
+#endif
+
+#if !defined(JSF_WEAR_BUCKETS) && !defined(SAVE_ON_FLASH)
+/// Storage is split into this many areas for counting erases (ideally one per page). Define as 0 to disable wear statistics
+#ifdef LINUX
+#define JSF_WEAR_BUCKETS 256
+#else
+#define JSF_WEAR_BUCKETS 32
+#endif
+#endif
+#if defined(JSF_WEAR_BUCKETS) && JSF_WEAR_BUCKETS==0
+#undef JSF_WEAR_BUCKETS
+#endif
+
+#if !defined(JSF_DELTA_BLOCK_SIZE) && !defined(SAVE_ON_FLASH)
+/// Size in bytes of the blocks of RAM that save(true) compares and writes. Define as 0 to disable delta saves
+#define JSF_DELTA_BLOCK_SIZE 256
+#endif
+#if defined(JSF_DELTA_BLOCK_SIZE) && JSF_DELTA_BLOCK_SIZE==0
+#undef JSF_DELTA_BLOCK_SIZE
+#endif
+
+#if !defined(JSF_LAZY_LOAD_VARS) && defined(LINUX) && defined(USE_HEATSHRINK)
+/// Number of JsVars in each separately compressed block of the saved image, so they can be loaded on demand. Define as 0 to disable
+#define JSF_LAZY_LOAD_VARS 64
+#endif
+#if defined(JSF_LAZY_LOAD_VARS) && JSF_LAZY_LOAD_VARS==0
+#undef JSF_LAZY_LOAD_VARS
+#endif
+#if defined(JSF_LAZY_LOAD_VARS) && defined(RESIZABLE_JSVARS) && (JSVAR_BLOCK_SIZE % JSF_LAZY_LOAD_VARS)
+#error "JSF_LAZY_LOAD_VARS blocks must not span JSVAR_BLOCK_SIZE blocks"
+#endif
+#if defined(JSF_DELTA_BLOCK_SIZE) && defined(RESIZABLE_JSVARS) && (JSVAR_BLOCK_SIZE % JSF_DELTA_BLOCK_SIZE)
+#error "JSF_DELTA_BLOCK_SIZE blocks must not span JSVAR_BLOCK_SIZE blocks"
+#endif
+
 typedef enum {
   JSFF_NONE,
+  JSFF_LOG = 64,          // This file is a ring log (see StorageLog) and its header must be at the start of a page
   JSFF_COMPRESSED = 128   // This file contains compressed data
 } JsfFileFlags; // these are stored in the top 8 bits of JsfFileHeader.size
 
@@ -50,8 +97,16 @@ uint32_t jsfGetFileSize(JsfFileHeader *header);
 JsfFileFlags jsfGetFileFlags(JsfFileHeader *header);
 /// Find a 'file' in the memory store. Return the address of data start (and header if returnedHeader!=0). Returns 0 if not found
 uint32_t jsfFindFile(JsfFileName name, JsfFileHeader *returnedHeader);
+/// Return a number that changes whenever files may have moved - while it's the same, addresses from jsfFindFile can be reused
+uint32_t jsfGetFileMoves();
+/// Check the file 'name' is still (not erased or replaced) at the data address 'addr' from jsfFindFile, and get its header
+bool jsfIsFileAt(JsfFileName name, uint32_t addr, JsfFileHeader *returnedHeader);
 /// Return the contents of a file as a memory mapped var
 JsVar *jsfReadFile(JsfFileName name, int offset, int length);
+/// Is 'ptr' inside memory-mapped Storage? (where the strings from jsfReadFile point - it can only be changed with jshFlashWrite)
+bool jsfIsStoragePointer(const void *ptr);
+/// Get a 32 bit hash of a file's contents (as stored). Returns false if the file doesn't exist
+bool jsfGetFileHash(JsfFileName name, uint32_t *hash);
 /// Write a file. For simple stuff just leave offset and size as 0
 bool jsfWriteFile(JsfFileName name, JsVar *data, JsfFileFlags flags, JsVarInt offset, JsVarInt _size);
 /// Erase the given file, return true on success
@@ -60,8 +115,22 @@ bool jsfEraseFile(JsfFileName name);
 bool jsfEraseAll();
 /// Try and compact saved data so it'll fit in Flash again
 bool jsfCompact();
+/// Start compacting Storage in the background - jsfCompactIdle does the work. Returns false if there's nothing to do
+bool jsfCompactBackground();
+/// Compact one page of Storage if we're compacting in the background. Returns true if we're still compacting
+bool jsfCompactIdle();
+/// If a compaction or save was interrupted (eg. by power loss) then clean up after it
+void jsfResumeCompaction();
 /// Return all files in flash as a JsVar array of names
 JsVar *jsfListFiles();
+/// Return an object containing statistics about flash storage
+JsVar *jsfGetStorageStats();
+/// Forget everything we know about where files are (call this if flash is modified directly)
+void jsfResetFileIndex();
+/// Erase a page of Storage (counting it for wear statistics)
+void jsfErasePage(uint32_t addr);
+/// Note that data has been written to Storage directly (for wear statistics)
+void jsfNoteWrite(uint32_t bytes);
 /// Output debug info for files stored in flash storage
 void jsfDebugFiles();
 // Get the amount of space free in this page (or all pages). addr=0 uses start page
@@ -70,8 +139,28 @@ uint32_t jsfGetFreeSpace(uint32_t addr, bool allPages);
 // ------------------------------------------------------------------------ For loading/saving code to flash
 /// Save contents of JsVars into Flash.
 void jsfSaveToFlash();
+#ifdef JSF_DELTA_BLOCK_SIZE
+/// Save only the blocks of RAM that have changed since the last jsfSaveToFlash (or do a full save if needed)
+void jsfSaveDeltaToFlash();
+#endif
 /// Load the RAM image from flash (this is the actual interpreter state)
 void jsfLoadStateFromFlash();
+#ifdef JSF_LAZY_LOAD_VARS
+/// Are there blocks of the saved image that still need loading? If so jsvGetAddressOf calls jsfLazyLoad
+extern bool jsfLazyLoadPending;
+/// Ensure the block containing this JsVar has been loaded
+void jsfLazyLoad(JsVarRef ref);
+/// Load one block that hasn't been used yet. Returns true if there's more to load
+bool jsfLazyLoadIdle();
+/// Load everything that hasn't been loaded yet
+void jsfLazyLoadAll();
+/// Forget about anything that hasn't been loaded (because RAM is being reset)
+void jsfLazyLoadCancel();
+/// Get the first free JsVar (for jsvCreateEmptyVarList) when blocks are still to be loaded
+JsVarRef jsfLazyLoadFirstEmpty();
+/// Return the number of blocks (and how many are loaded) for lazy loading
+void jsfLazyLoadGetStats(uint32_t *blocks, uint32_t *loaded);
+#endif
 
 /// Save bootup code to flash - see jsfLoadBootCodeFromFlash
 void jsfSaveBootCodeToFlash(JsVar *code, bool runAfterReset);
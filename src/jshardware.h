@@ -56,6 +56,17 @@ void jshBusyIdle();
  */
 bool jshSleep(JsSysTime timeUntilWake);
 
+#ifdef LINUX
+/// Make jshSleep wake up when the given file descriptor is readable (or stop if watch=false)
+void jshSleepWatchFd(int fd, bool watch);
+/// Wake jshSleep up from another thread (eg. the input thread after pushing IO events)
+void jshSleepWake();
+/// Is anything (eg. an open socket) watched by jshSleep? If so there may be more work to do later
+bool jshSleepHasWatches();
+/// Allow jshSleep to wait for input with no timer or watch pending (the REPL). Scripts should exit when idle instead
+void jshSleepAllowIndefinite(bool allow);
+#endif
+
 /** Clean up ready to stop Espruino. Unused on embedded targets, but used on Linux,
  * where GPIO that have been exported may need unexporting, and so on. */
 void jshKill();
@@ -777,6 +777,8 @@ void jsiSemiInit(bool autoLoad) {
   pinBusyIndicator = DEFAULT_BUSY_PIN_INDICATOR;
 #endif
 
+  // If we lost power while compacting Storage, finish off
+  jsfResumeCompaction();
   /* If flash contains any code, then we should
      Try and load from it... */
   bool loadFlash = autoLoad && jsfFlashContainsCode();
@@ -2149,12 +2151,17 @@ void jsiIdle() {
       jsiSoftKill();
       jspSoftKill();
       jsvSoftKill();
-      jsfSaveToFlash();
+#ifdef JSF_DELTA_BLOCK_SIZE
+      if (s&JSIS_TODO_FLASH_SAVE_DELTA)
+        jsfSaveDeltaToFlash();
+      else
+#endif
+        jsfSaveToFlash();
       jshReset();
       jsvSoftInit();
       jspSoftInit();
       jsiSoftInit(false /* not been reset */);
-      jsiStatus &= (JsiStatus)~JSIS_TODO_FLASH_SAVE;
+      jsiStatus &= (JsiStatus)~(JSIS_TODO_FLASH_SAVE|JSIS_TODO_FLASH_SAVE_DELTA);
     }
     if ((s&JSIS_TODO_FLASH_LOAD) == JSIS_TODO_FLASH_LOAD) {
       JsVar *filenameVar = jsvObjectGetChild(execInfo.hiddenRoot,JSI_LOAD_CODE_NAME,0);
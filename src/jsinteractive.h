@@ -148,7 +148,8 @@ typedef enum {
   JSIS_TODO_FLASH_SAVE    = 1<<5, ///< save to flash
   JSIS_TODO_FLASH_LOAD    = 1<<6, ///< load from flash
   JSIS_TODO_RESET         = 1<<7, ///< reset the board, don't load anything
-  JSIS_TODO_MASK = JSIS_TODO_FLASH_SAVE|JSIS_TODO_FLASH_LOAD|JSIS_TODO_RESET,
+  JSIS_TODO_FLASH_SAVE_DELTA = 1<<12, ///< when saving to flash, only save what changed since the last full save
+  JSIS_TODO_MASK = JSIS_TODO_FLASH_SAVE|JSIS_TODO_FLASH_SAVE_DELTA|JSIS_TODO_FLASH_LOAD|JSIS_TODO_RESET,
   JSIS_CONSOLE_FORCED     = 1<<8, ///< see jsiSetConsoleDevice
   JSIS_WATCHDOG_AUTO      = 1<<9, ///< Automatically kick the watchdog timer on idle
   JSIS_PASSWORD_PROTECTED = 1<<10, ///< Password protected
@@ -21,6 +21,7 @@
 #include "jswrap_object.h" // for jswrap_object_toString
 #include "jswrap_arraybuffer.h" // for jsvNewTypedArray
 #include "jswrap_dataview.h" // for jsvNewDataViewWithData
+#include "jsflash.h" // for jsfLazyLoad
 
 #ifdef DEBUG
   /** When freeing, clear the references (nextChild/etc) in the JsVar.
@@ -132,6 +133,9 @@ bool jsvIsIterable(const JsVar *v) {
  * This is effectively a Lock without locking! */
 static ALWAYS_INLINE JsVar *jsvGetAddressOf(JsVarRef ref) {
   assert(ref);
+#ifdef JSF_LAZY_LOAD_VARS
+  if (jsfLazyLoadPending) jsfLazyLoad(ref);
+#endif
 #ifdef RESIZABLE_JSVARS
   assert(ref <= jsVarsSize);
   JsVarRef t = ref-1;
@@ -195,6 +199,14 @@ void jsvSetMaxVarsUsed(unsigned int size) {
 
 // maps the empty variables in...
 void jsvCreateEmptyVarList() {
+#ifdef JSF_LAZY_LOAD_VARS
+  /* If we're loading saved JsVars on demand, the free list was saved with
+   * them and gets linked up as each block is loaded */
+  if (jsfLazyLoadPending) {
+    jsVarFirstEmpty = jsfLazyLoadFirstEmpty();
+    return;
+  }
+#endif
   assert(!isMemoryBusy);
   isMemoryBusy = MEMBUSY_SYSTEM;
   jsVarFirstEmpty = 0;
@@ -280,6 +292,9 @@ void jsvInit(unsigned int size) {
 }
 
 void jsvKill() {
+#ifdef JSF_LAZY_LOAD_VARS
+  jsfLazyLoadCancel();
+#endif
 #ifdef RESIZABLE_JSVARS
   unsigned int i;
   for (i=0;i<jsVarsSize>>JSVAR_BLOCK_SHIFT;i++)
@@ -341,10 +356,12 @@ void jsvSetMemoryTotal(unsigned int jsNewVarCount) {
   unsigned int i;
   for (i=oldBlockCount;i<newBlockCount;i++)
     jsVarBlocks[i] = malloc(sizeof(JsVar) * JSVAR_BLOCK_SIZE);
-  /** and now reset all the newly allocated vars. We know jsVarFirstEmpty
-   * is 0 (because jsiFreeMoreMemory returned 0) so we can just assign it.  */
-  assert(!jsVarFirstEmpty);
+  /** and now reset all the newly allocated vars. jsVarFirstEmpty is usually
+   * 0 (because jsiFreeMoreMemory returned 0) but if not (eg. we're about to
+   * load a saved image) any free vars go after the new ones. */
+  JsVarRef oldFirstEmpty = jsVarFirstEmpty;
   jsVarFirstEmpty = jsvInitJsVars(oldSize+1, jsVarsSize-oldSize);
+  jsvSetNextSibling(jsvGetAddressOf(jsVarsSize), oldFirstEmpty);
   // jsiConsolePrintf("Resized memory from %d blocks to %d\n", oldBlockCount, newBlockCount);
   touchedFreeList = true;
   isMemoryBusy = MEM_NOT_BUSY;
@@ -547,6 +564,37 @@ static NO_INLINE void jsvFreePtrInternal(JsVar *var) {
   jshInterruptOn();
 }
 
+/// Free 'count' contiguous blocks starting at 'first' (eg. the data blocks of a flat string)
+static void jsvFreeBlocks(JsVarRef first, size_t count) {
+  JsVarRef i = (JsVarRef)(first+count-1);
+  // Because this is a whole bunch of blocks, try
+  // and insert it in the right place in the free list
+  // So, iterate along free list to figure out where we
+  // need to insert the free items
+  jshInterruptOff(); // to allow this to be used from an IRQ
+  JsVarRef insertBefore = jsVarFirstEmpty;
+  JsVarRef insertAfter = 0;
+  while (insertBefore && insertBefore<i) {
+    insertAfter = insertBefore;
+    insertBefore = jsvGetNextSibling(jsvGetAddressOf(insertBefore));
+  }
+  // free in reverse, so the free list ends up in kind of the right order
+  while (count--) {
+    JsVar *p = jsvGetAddressOf(i--);
+    p->flags = JSV_UNUSED; // set locks to 0 so the assert in jsvFreePtrInternal doesn't get fed up
+    // add this to our free list
+    jsvSetNextSibling(p, insertBefore);
+    insertBefore = jsvGetRef(p);
+  }
+  // patch up jsVarFirstEmpty/rejoin the list
+  if (insertAfter)
+    jsvSetNextSibling(jsvGetAddressOf(insertAfter), insertBefore);
+  else
+    jsVarFirstEmpty = insertBefore;
+  touchedFreeList = true;
+  jshInterruptOn();
+}
+
 ALWAYS_INLINE void jsvFreePtr(JsVar *var) {
   /* To be here, we're not supposed to be part of anything else. If
    * we were, we'd have been freed by jsvGarbageCollect */
@@ -588,34 +636,7 @@ ALWAYS_INLINE void jsvFreePtr(JsVar *var) {
     // We might be a flat string
     if (jsvIsFlatString(var)) {
       // in which case we need to free all the blocks.
-      size_t count = jsvGetFlatStringBlocks(var);
-      JsVarRef i = (JsVarRef)(jsvGetRef(var)+count);
-      // Because this is a whole bunch of blocks, try
-      // and insert it in the right place in the free list
-      // So, iterate along free list to figure out where we
-      // need to insert the free items
-      jshInterruptOff(); // to allow this to be used from an IRQ
-      JsVarRef insertBefore = jsVarFirstEmpty;
-      JsVarRef insertAfter = 0;
-      while (insertBefore && insertBefore<i) {
-        insertAfter = insertBefore;
-        insertBefore = jsvGetNextSibling(jsvGetAddressOf(insertBefore));
-      }
-      // free in reverse, so the free list ends up in kind of the right order
-      while (count--) {
-        JsVar *p = jsvGetAddressOf(i--);
-        p->flags = JSV_UNUSED; // set locks to 0 so the assert in jsvFreePtrInternal doesn't get fed up
-        // add this to our free list
-        jsvSetNextSibling(p, insertBefore);
-        insertBefore = jsvGetRef(p);
-      }
-      // patch up jsVarFirstEmpty/rejoin the list
-      if (insertAfter)
-        jsvSetNextSibling(jsvGetAddressOf(insertAfter), insertBefore);
-      else
-        jsVarFirstEmpty = insertBefore;
-      touchedFreeList = true;
-      jshInterruptOn();
+      jsvFreeBlocks((JsVarRef)(jsvGetRef(var)+1), jsvGetFlatStringBlocks(var));
     } else if (jsvIsBasicString(var)) {
 #ifdef CLEAR_MEMORY_ON_FREE
       jsvSetFirstChild(var, 0); // firstchild could have had string data in
@@ -1507,6 +1528,16 @@ size_t jsvGetFlatStringBlocks(const JsVar *v) {
   return ((size_t)v->varData.integer+sizeof(JsVar)-1) / sizeof(JsVar);
 }
 
+void jsvShrinkFlatString(JsVar *v, size_t length) {
+  assert(jsvIsFlatString(v));
+  if (!jsvIsFlatString(v) || length >= (size_t)v->varData.integer) return;
+  size_t oldBlocks = jsvGetFlatStringBlocks(v);
+  v->varData.integer = (JsVarInt)length;
+  size_t newBlocks = jsvGetFlatStringBlocks(v);
+  if (newBlocks < oldBlocks)
+    jsvFreeBlocks((JsVarRef)(jsvGetRef(v)+1+newBlocks), oldBlocks-newBlocks);
+}
+
 char *jsvGetFlatStringPointer(JsVar *v) {
   assert(jsvIsFlatString(v));
   if (!jsvIsFlatString(v)) return 0;
@@ -1531,8 +1562,13 @@ char *jsvGetDataPointer(JsVar *v, size_t *len) {
     char *r = jsvGetDataPointer(d, len);
     jsvUnLock(d);
     if (r) {
-      r += v->varData.arraybuffer.byteOffset;
-      *len = v->varData.arraybuffer.length;
+      size_t byteLength = jsvGetArrayBufferLength(v) * JSV_ARRAYBUFFER_GET_SIZE(v->varData.arraybuffer.type);
+      size_t byteOffset = v->varData.arraybuffer.byteOffset;
+      // make sure we don't return a length that goes past the end of the backing string
+      if (byteOffset > *len) byteOffset = *len;
+      if (byteOffset+byteLength > *len) byteLength = *len-byteOffset;
+      r += byteOffset;
+      *len = byteLength;
     }
     return r;
   }
@@ -1540,7 +1576,8 @@ char *jsvGetDataPointer(JsVar *v, size_t *len) {
     *len = v->varData.nativeStr.len;
     return (char*)v->varData.nativeStr.ptr;
   }
-  if (jsvIsFlatString(v)) {
+  if (jsvIsFlatString(v) && !jsvGetLastChild(v)) {
+    // Flat string, as long as nothing has been appended onto the end of it
     *len = jsvGetStringLength(v);
     return jsvGetFlatStringPointer(v);
   }
@@ -494,9 +494,13 @@ JsVar *jsvAsFlatString(JsVar *var); ///< Create a flat string from the given var
 bool jsvIsEmptyString(JsVar *v); ///< Returns true if the string is empty - faster than jsvGetStringLength(v)==0
 size_t jsvGetStringLength(const JsVar *v); ///< Get the length of this string, IF it is a string
 size_t jsvGetFlatStringBlocks(const JsVar *v); ///< return the number of blocks used by the given flat string - EXCLUDING the first data block
+void jsvShrinkFlatString(JsVar *v, size_t length); ///< Reduce the length of a flat string, freeing any blocks that are no longer needed
 char *jsvGetFlatStringPointer(JsVar *v); ///< Get a pointer to the data in this flat string
 JsVar *jsvGetFlatStringFromPointer(char *v); ///< Given a pointer to the first element of a flat string, return the flat string itself (DANGEROUS!)
-char *jsvGetDataPointer(JsVar *v, size_t *len); ///< If the variable points to a *flat* area of memory, return a pointer (and set length). Otherwise return 0.
+/** If the variable points to a *flat* area of memory, return a pointer (and set length in bytes). Otherwise return 0.
+ * For ArrayBuffers/views the pointer is to the view's first element. For native strings (eg. `E.memoryArea`
+ * or a memory-mapped file from Storage) this points straight at the original memory, so no copy is made. */
+char *jsvGetDataPointer(JsVar *v, size_t *len);
 size_t jsvGetLinesInString(JsVar *v); ///<  IN A STRING get the number of lines in the string (min=1)
 size_t jsvGetCharsOnLine(JsVar *v, size_t line); ///<  IN A STRING Get the number of characters on a line - lines start at 1
 void jsvGetLineAndCol(JsVar *v, size_t charIdx, size_t *line, size_t *col); ///< IN A STRING, get the 1-based line and column of the given character. Both values must be non-null
@@ -14,8 +14,10 @@
  * ----------------------------------------------------------------------------
  */
 #include "jswrap_arraybuffer.h"
+#include "jswrap_array.h"
 #include "jsparse.h"
 #include "jsinteractive.h"
+#include "jsflash.h"
 
 /*JSON{
   "type" : "class",
@@ -491,6 +493,21 @@ void jswrap_arraybufferview_set(JsVar *parent, JsVar *arr, int offset) {
     jsExceptionHere(JSET_ERROR, "Expecting first argument to be an array, not %t", arr);
     return;
   }
+  // If both arrays are the same type and in flat memory, just copy the data
+  if (jsvIsArrayBuffer(arr) && jsvIsArrayBuffer(parent) && offset>=0 &&
+      arr->varData.arraybuffer.type == parent->varData.arraybuffer.type) {
+    size_t srcLen, dstLen, elementSize = JSV_ARRAYBUFFER_GET_SIZE(parent->varData.arraybuffer.type);
+    char *src = jsvGetDataPointer(arr, &srcLen);
+    char *dst = src ? jsvGetDataPointer(parent, &dstLen) : 0;
+    if (dst) {
+      size_t byteOffset = (size_t)offset*elementSize;
+      if (byteOffset < dstLen) {
+        if (srcLen > dstLen-byteOffset) srcLen = dstLen-byteOffset;
+        memmove(&dst[byteOffset], src, srcLen);
+      }
+      return;
+    }
+  }
   JsvIterator itsrc;
   jsvIteratorNew(&itsrc, arr, JSIF_EVERY_ARRAY_ELEMENT);
   JsvArrayBufferIterator itdst;
@@ -583,6 +600,244 @@ JsVar *jswrap_arraybufferview_map(JsVar *parent, JsVar *funcVar, JsVar *thisVar)
 }
 
 
+#ifndef SAVE_ON_FLASH
+/* Introsort (quicksort falling back to heapsort if recursion gets too deep, and
+ * insertion sort for small partitions) working directly on an array of TYPE */
+#define TYPEDARRAY_INTROSORT(TYPE)                                            \
+static void jswrap_arraybufferview_heapsift_##TYPE(TYPE *a, size_t root, size_t n) { \
+  while (root*2+1 < n) {                                                      \
+    size_t child = root*2+1;                                                  \
+    if (child+1<n && a[child]<a[child+1]) child++;                            \
+    if (!(a[root]<a[child])) return;                                          \
+    TYPE t = a[root]; a[root] = a[child]; a[child] = t;                       \
+    root = child;                                                             \
+  }                                                                           \
+}                                                                             \
+static void jswrap_arraybufferview_introsort_##TYPE(TYPE *a, size_t n, int depth) { \
+  TYPE t;                                                                     \
+  while (n>16) {                                                              \
+    if (depth-- <= 0) {                                                       \
+      size_t i;                                                               \
+      for (i=n/2;i>0;i--) jswrap_arraybufferview_heapsift_##TYPE(a, i-1, n);  \
+      for (i=n-1;i>0;i--) {                                                   \
+        t = a[0]; a[0] = a[i]; a[i] = t;                                      \
+        jswrap_arraybufferview_heapsift_##TYPE(a, 0, i);                      \
+      }                                                                       \
+      return;                                                                 \
+    }                                                                         \
+    /* median of 3 - then put pivot first for a Hoare partition */            \
+    size_t m = n/2;                                                           \
+    if (a[m]<a[0]) { t = a[m]; a[m] = a[0]; a[0] = t; }                       \
+    if (a[n-1]<a[m]) { t = a[n-1]; a[n-1] = a[m]; a[m] = t; }                 \
+    if (a[m]<a[0]) { t = a[m]; a[m] = a[0]; a[0] = t; }                       \
+    t = a[m]; a[m] = a[0]; a[0] = t;                                          \
+    TYPE p = a[0];                                                            \
+    ptrdiff_t i = -1, j = (ptrdiff_t)n;                                       \
+    while (true) {                                                            \
+      do i++; while (a[i]<p);                                                 \
+      do j--; while (p<a[j]);                                                 \
+      if (i>=j) break;                                                        \
+      t = a[i]; a[i] = a[j]; a[j] = t;                                        \
+    }                                                                         \
+    /* recurse on the smaller side, loop on the larger */                     \
+    size_t nlo = (size_t)j+1;                                                 \
+    if (nlo < n-nlo) {                                                        \
+      jswrap_arraybufferview_introsort_##TYPE(a, nlo, depth);                 \
+      a += nlo;                                                               \
+      n -= nlo;                                                               \
+    } else {                                                                  \
+      jswrap_arraybufferview_introsort_##TYPE(&a[nlo], n-nlo, depth);         \
+      n = nlo;                                                                \
+    }                                                                         \
+  }                                                                           \
+  size_t i,j;                                                                 \
+  for (i=1;i<n;i++) {                                                         \
+    t = a[i];                                                                 \
+    for (j=i;j>0 && t<a[j-1];j--) a[j] = a[j-1];                              \
+    a[j] = t;                                                                 \
+  }                                                                           \
+}
+
+TYPEDARRAY_INTROSORT(uint16_t)
+TYPEDARRAY_INTROSORT(int16_t)
+TYPEDARRAY_INTROSORT(uint32_t)
+TYPEDARRAY_INTROSORT(int32_t)
+TYPEDARRAY_INTROSORT(float)
+TYPEDARRAY_INTROSORT(double)
+
+/// Counting sort for 8 bit data. If isSigned, the top bit is flipped so negative numbers come first
+static void jswrap_arraybufferview_sort8(uint8_t *a, size_t n, bool isSigned) {
+  uint32_t count[256];
+  uint8_t flip = isSigned ? 0x80 : 0;
+  size_t i;
+  unsigned int v;
+  memset(count, 0, sizeof(count));
+  for (i=0;i<n;i++) count[a[i]^flip]++;
+  for (v=0;v<256;v++) {
+    uint32_t c = count[v];
+    while (c--) *(a++) = (uint8_t)(v^flip);
+  }
+}
+
+/** LSB radix sort for 16 bit data, using 'tmp' (n items) as scratch space.
+ * If isSigned, the top bit is flipped so negative numbers come first */
+static void jswrap_arraybufferview_sort16(uint16_t *a, uint16_t *tmp, size_t n, bool isSigned) {
+  uint32_t count[256];
+  uint16_t *src = a, *dst = tmp;
+  int shift;
+  for (shift=0;shift<16;shift+=8) {
+    uint8_t flip = (isSigned && shift) ? 0x80 : 0;
+    size_t i;
+    uint32_t total = 0;
+    memset(count, 0, sizeof(count));
+    for (i=0;i<n;i++) count[((src[i]>>shift)&255)^flip]++;
+    for (i=0;i<256;i++) {
+      uint32_t c = count[i];
+      count[i] = total;
+      total += c;
+    }
+    for (i=0;i<n;i++) dst[count[((src[i]>>shift)&255)^flip]++] = src[i];
+    uint16_t *t = src; src = dst; dst = t;
+  }
+  // after 2 passes the data is back in 'a'
+}
+
+/// Move all NaNs to the end of the array, and return the number of items that aren't NaN
+#define TYPEDARRAY_SKIP_NAN(TYPE)                                             \
+static size_t jswrap_arraybufferview_skipNaN_##TYPE(TYPE *a, size_t n) {      \
+  size_t i, j = 0;                                                            \
+  for (i=0;i<n;i++) {                                                         \
+    if (!isnan(a[i])) {                                                       \
+      TYPE t = a[i]; a[i] = a[j]; a[j++] = t;                                 \
+    }                                                                         \
+  }                                                                           \
+  return j;                                                                   \
+}
+TYPEDARRAY_SKIP_NAN(float)
+TYPEDARRAY_SKIP_NAN(double)
+
+/// Sort n items of the given type, starting at the (aligned) pointer 'data'. Returns false if type isn't supported
+static bool jswrap_arraybufferview_sortData(char *data, size_t n, JsVarDataArrayBufferViewType type) {
+  int depth = 0;
+  size_t i;
+  for (i=n;i;i>>=1) depth+=2;
+  switch (type & ~ARRAYBUFFERVIEW_CLAMPED) {
+    case ARRAYBUFFERVIEW_UINT8:
+    case ARRAYBUFFERVIEW_INT8:
+      jswrap_arraybufferview_sort8((uint8_t*)data, n, JSV_ARRAYBUFFER_IS_SIGNED(type));
+      return true;
+    case ARRAYBUFFERVIEW_UINT16:
+    case ARRAYBUFFERVIEW_INT16: {
+      uint16_t *tmp = 0;
+      bool tmpAllocated = false;
+      if (n*sizeof(uint16_t)+256 < jsuGetFreeStack()) {
+        tmp = (uint16_t*)alloca(n*sizeof(uint16_t));
+      } else {
+        tmp = (uint16_t*)jsvMalloc(n*sizeof(uint16_t));
+        tmpAllocated = tmp!=0;
+      }
+      if (tmp) {
+        jswrap_arraybufferview_sort16((uint16_t*)data, tmp, n, JSV_ARRAYBUFFER_IS_SIGNED(type));
+        if (tmpAllocated) jsvFree(tmp);
+      } else if (JSV_ARRAYBUFFER_IS_SIGNED(type)) {
+        jswrap_arraybufferview_introsort_int16_t((int16_t*)data, n, depth);
+      } else {
+        jswrap_arraybufferview_introsort_uint16_t((uint16_t*)data, n, depth);
+      }
+      return true;
+    }
+    case ARRAYBUFFERVIEW_UINT32:
+      jswrap_arraybufferview_introsort_uint32_t((uint32_t*)data, n, depth);
+      return true;
+    case ARRAYBUFFERVIEW_INT32:
+      jswrap_arraybufferview_introsort_int32_t((int32_t*)data, n, depth);
+      return true;
+    case ARRAYBUFFERVIEW_FLOAT32:
+      n = jswrap_arraybufferview_skipNaN_float((float*)data, n);
+      jswrap_arraybufferview_introsort_float((float*)data, n, depth);
+      return true;
+    case ARRAYBUFFERVIEW_FLOAT64:
+      n = jswrap_arraybufferview_skipNaN_double((double*)data, n);
+      jswrap_arraybufferview_introsort_double((double*)data, n, depth);
+      return true;
+    default:
+      return false;
+  }
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "ArrayBufferView",
+  "name" : "sort",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_arraybufferview_sort",
+  "params" : [
+    ["var","JsVar","A function to use to compare array elements (or undefined)"]
+  ],
+  "return" : ["JsVar","This array object"],
+  "return_object" : "ArrayBufferView"
+}
+Do an in-place sort of the array.
+
+If no compare function is supplied, values are sorted numerically (NaN last)
+directly on the array's data - using a radix sort for 8 and 16 bit arrays
+and introsort for others. If a compare function is supplied, a quicksort is
+performed that calls it for each comparison.
+
+Data in Storage (eg. from `require("Storage").readArrayBuffer`) can't be
+sorted in place, so an exception is thrown - sort a copy instead.
+ */
+JsVar *jswrap_arraybufferview_sort(JsVar *array, JsVar *compareFn) {
+  if (!jsvIsArrayBuffer(array) || !jsvIsUndefined(compareFn))
+    return jswrap_array_sort(array, compareFn);
+  JsVarDataArrayBufferViewType type = array->varData.arraybuffer.type;
+  size_t size = JSV_ARRAYBUFFER_GET_SIZE(type);
+  if ((type & ARRAYBUFFERVIEW_BIG_ENDIAN) || (size&(size-1)))
+    return jswrap_array_sort(array, compareFn);
+  size_t n = jsvGetArrayBufferLength(array);
+  size_t len;
+  JsVar *backing = jsvGetArrayBufferBackingString(array);
+  char *data = jsvGetDataPointer(array, &len);
+  // Storage (eg. from Storage.readArrayBuffer) can't be written to like RAM
+  if (jsvIsFlashString(backing) || (data && jsvIsNativeString(backing) && jsfIsStoragePointer(data))) {
+    jsExceptionHere(JSET_ERROR, "Can't sort data in Storage - copy it first");
+    jsvUnLock(backing);
+    return 0;
+  }
+  // only sort directly if the data is in a flat string in RAM
+  if (!jsvIsFlatString(backing)) data = 0;
+  if (data && (((size_t)data & (size-1)) || len<n*size)) data = 0; // unaligned or truncated
+  if (data) {
+    jswrap_arraybufferview_sortData(data, n, type);
+  } else if (n) {
+    // Not flat - copy into a temporary flat buffer, sort, and copy back
+    char *tmp = (char*)jsvMalloc(n*size);
+    if (!tmp) {
+      jsvUnLock(backing);
+      return jswrap_array_sort(array, compareFn);
+    }
+    JsvStringIterator it;
+    size_t i;
+    jsvStringIteratorNew(&it, backing, (size_t)array->varData.arraybuffer.byteOffset);
+    for (i=0;i<n*size;i++) {
+      tmp[i] = jsvStringIteratorGetChar(&it);
+      jsvStringIteratorNext(&it);
+    }
+    jsvStringIteratorFree(&it);
+    jswrap_arraybufferview_sortData(tmp, n, type);
+    jsvStringIteratorNew(&it, backing, (size_t)array->varData.arraybuffer.byteOffset);
+    for (i=0;i<n*size;i++) {
+      jsvStringIteratorSetChar(&it, tmp[i]);
+      jsvStringIteratorNext(&it);
+    }
+    jsvStringIteratorFree(&it);
+    jsvFree(tmp);
+  }
+  jsvUnLock(backing);
+  return jsvLockAgain(array);
+}
+#endif
+
 // -----------------------------------------------------------------------------------------------------
 //                                                                      Steal Array's methods for this
 // -----------------------------------------------------------------------------------------------------
@@ -626,20 +881,6 @@ Return `true` if the array includes the value, `false` otherwise
 }
 Join all elements of this array together into one string, using 'separator' between them. eg. ```[1,2,3].join(' ')=='1 2 3'```
  */
-/*JSON{
-  "type" : "method",
-  "class" : "ArrayBufferView",
-  "name" : "sort",
-  "ifndef" : "SAVE_ON_FLASH",
-  "generate" : "jswrap_array_sort",
-  "params" : [
-    ["var","JsVar","A function to use to compare array elements (or undefined)"]
-  ],
-  "return" : ["JsVar","This array object"],
-  "return_object" : "ArrayBufferView"
-}
-Do an in-place quicksort of the array
- */
 /*JSON{
   "type" : "method",
   "class" : "ArrayBufferView",
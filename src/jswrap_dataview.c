@@ -323,3 +323,471 @@ void jswrap_dataview_set(JsVar *dataview, JsVarDataArrayBufferViewType type, int
   "ifndef" : "SAVE_ON_FLASH"
 }
 */
+
+// =============================================================================  STRUCT CODEC
+
+#define JSI_DATAVIEW_CODEC_FORMAT JS_HIDDEN_CHAR_STR"fmt"
+#define JSI_DATAVIEW_CODEC_NAMES JS_HIDDEN_CHAR_STR"nam"
+#define DATAVIEW_CODEC_MAX_SIZE 4096 ///< the biggest a record (or a repeat count) may be
+
+/*JSON{
+  "type" : "class",
+  "class" : "DataViewCodec",
+  "ifndef" : "SAVE_ON_FLASH"
+}
+A compiled binary record layout, created with `DataView.compile`. This
+can unpack and pack whole records (or arrays of records) in one call.
+ */
+
+/** Get the next item from a struct format string, advancing 'fmt'. Sets
+ * the type character and the repeat count. Returns false at the end of the string */
+static bool jswrap_dataview_codecNext(const char **fmt, char *type, int *count) {
+  while (**fmt==' ') (*fmt)++;
+  if (!**fmt) return false;
+  *count = 0;
+  bool hasCount = false;
+  while (isNumeric(**fmt)) {
+    *count = (*count)*10 + (*((*fmt)++) - '0');
+    if (*count > DATAVIEW_CODEC_MAX_SIZE) *count = DATAVIEW_CODEC_MAX_SIZE+1; // too big, but don't overflow
+    hasCount = true;
+  }
+  if (!hasCount) *count = 1;
+  *type = **fmt;
+  if (*type) (*fmt)++;
+  return true;
+}
+
+/// Get the size in bytes of a struct format type character, or 0 if it's invalid
+static int jswrap_dataview_codecTypeSize(char type) {
+  switch (type) {
+    case 'x': case 'b': case 'B': case '?': case 's': return 1;
+    case 'h': case 'H': return 2;
+    case 'i': case 'I': case 'l': case 'L': case 'f': return 4;
+    case 'd': return 8;
+    default: return 0;
+  }
+}
+
+/** Get the size in bytes of a record and the number of values in it from the format
+ * string (after any endianness character). Returns -1 (and throws) if it's invalid or too big */
+static int jswrap_dataview_codecGetSize(const char *fmt, int *values) {
+  char type;
+  int count;
+  int size = 0;
+  if (values) *values = 0;
+  while (jswrap_dataview_codecNext(&fmt, &type, &count)) {
+    int typeSize = jswrap_dataview_codecTypeSize(type);
+    if (!typeSize) {
+      jsExceptionHere(JSET_ERROR, "Unknown format character %c", type ? type : ' ');
+      return -1;
+    }
+    // count and size are both <= DATAVIEW_CODEC_MAX_SIZE+1, so this can't overflow
+    size += typeSize*count;
+    if (size > DATAVIEW_CODEC_MAX_SIZE) {
+      jsExceptionHere(JSET_ERROR, "Record too big (max %d bytes)", DATAVIEW_CODEC_MAX_SIZE);
+      return -1;
+    }
+    if (values) {
+      if (type=='s') (*values)++;
+      else if (type!='x') *values += count;
+    }
+  }
+  return size;
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "class" : "DataView",
+  "name" : "compile",
+  "generate" : "jswrap_dataview_compile",
+  "params" : [
+    ["format","JsVar","A format string - see below"],
+    ["names","JsVar","(optional) An array of field names. If supplied, records are unpacked to/packed from objects rather than arrays"]
+  ],
+  "return" : ["JsVar","A `DataViewCodec` object"],
+  "return_object" : "DataViewCodec",
+  "ifndef" : "SAVE_ON_FLASH"
+}
+Compile a binary record layout, in the style of Python's `struct` module, into a
+codec that can unpack or pack whole records in one native call. For example:
+
+```
+var c = DataView.compile("<HHfB", ["id","flags","temp","battery"]);
+c.unpack(buffer, 0) // => {id:..., flags:..., temp:..., battery:...}
+c.unpack(buffer, 0, 10) // => array of 10 records
+c.pack({id:1, flags:0, temp:21.5, battery:90}) // => ArrayBuffer
+```
+
+The first character may be `<` for little endian, or `>`/`!` for big endian (the default
+is little endian). Then each item is an optional repeat count followed by:
+
+* `x` - padding byte (no value)
+* `b`/`B` - signed/unsigned 8 bit integer
+* `?` - boolean (8 bit)
+* `h`/`H` - signed/unsigned 16 bit integer
+* `i`/`I` (or `l`/`L`) - signed/unsigned 32 bit integer
+* `f` - 32 bit float
+* `d` - 64 bit float
+* `s` - a String, where the repeat count is the length (eg. `4s`)
+ */
+JsVar *jswrap_dataview_compile(JsVar *format, JsVar *names) {
+  if (!jsvIsString(format)) {
+    jsExceptionHere(JSET_TYPEERROR, "Expecting format String, got %t", format);
+    return 0;
+  }
+  if (!jsvIsUndefined(names) && !jsvIsArray(names)) {
+    jsExceptionHere(JSET_TYPEERROR, "Expecting names to be an Array, got %t", names);
+    return 0;
+  }
+  char fmtBuf[64];
+  if (jsvGetString(format, fmtBuf, sizeof(fmtBuf))>=sizeof(fmtBuf)-1) {
+    jsExceptionHere(JSET_ERROR, "Format string too long");
+    return 0;
+  }
+  const char *fmt = fmtBuf;
+  if (*fmt=='<' || *fmt=='>' || *fmt=='!' || *fmt=='=' || *fmt=='@') fmt++;
+  int values;
+  int size = jswrap_dataview_codecGetSize(fmt, &values);
+  if (size<0) return 0;
+  if (jsvIsArray(names) && jsvGetArrayLength(names)!=values) {
+    jsExceptionHere(JSET_ERROR, "Format has %d values, but %d names given", values, (int)jsvGetArrayLength(names));
+    return 0;
+  }
+  JsVar *codec = jspNewObject(0, "DataViewCodec");
+  if (!codec) return 0;
+  jsvObjectSetChild(codec, JSI_DATAVIEW_CODEC_FORMAT, format);
+  if (jsvIsArray(names)) jsvObjectSetChild(codec, JSI_DATAVIEW_CODEC_NAMES, names);
+  jsvObjectSetChildAndUnLock(codec, "size", jsvNewFromInteger(size));
+  return codec;
+}
+
+/// Information about where a set of records is stored
+typedef struct {
+  char fmt[64];     ///< the format string
+  bool littleEndian;
+  size_t size;      ///< the size of each record
+  JsVar *names;     ///< field names (or 0)
+  JsVar *data;      ///< the string containing the data
+  char *ptr;        ///< pointer to the data if flat (offset applied)
+  size_t offset;    ///< offset in data
+  size_t length;    ///< length available from offset
+} DataViewCodecInfo;
+
+/** Fill in info for the codec and the buffer, returning false on error. buffer can be an ArrayBuffer,
+ * typed array, DataView or String */
+static bool jswrap_dataview_codecGetInfo(JsVar *codec, DataViewCodecInfo *info, JsVar *buffer, int byteOffset) {
+  info->names = 0;
+  info->data = 0;
+  JsVar *format = jsvObjectGetChild(codec, JSI_DATAVIEW_CODEC_FORMAT, 0);
+  if (!format) {
+    jsExceptionHere(JSET_ERROR, "DataViewCodec not initialised");
+    return false;
+  }
+  jsvGetString(format, info->fmt, sizeof(info->fmt));
+  jsvUnLock(format);
+  info->littleEndian = !(info->fmt[0]=='>' || info->fmt[0]=='!');
+  // work the size out again rather than trusting the (writable) 'size' property
+  const char *fmt = info->fmt;
+  if (*fmt=='<' || *fmt=='>' || *fmt=='!' || *fmt=='=' || *fmt=='@') fmt++;
+  int size = jswrap_dataview_codecGetSize(fmt, 0);
+  if (size<0) return false;
+  info->size = (size_t)size;
+  if (!buffer) return true;
+  if (byteOffset<0) byteOffset = 0;
+  size_t offset = (size_t)byteOffset;
+  size_t length = 0;
+  if (jsvIsObject(buffer) && jsvIsInstanceOf(buffer, "DataView")) {
+    size_t viewOffset = (size_t)jsvGetIntegerAndUnLock(jsvObjectGetChild(buffer, "byteOffset", 0));
+    offset += viewOffset;
+    length = viewOffset + (size_t)jsvGetIntegerAndUnLock(jsvObjectGetChild(buffer, "byteLength", 0));
+    buffer = jsvObjectGetChild(buffer, "buffer", 0);
+  } else
+    buffer = jsvLockAgain(buffer);
+  if (jsvIsArrayBuffer(buffer)) {
+    offset += buffer->varData.arraybuffer.byteOffset;
+    if (!length) length = jsvGetArrayBufferLength(buffer) * JSV_ARRAYBUFFER_GET_SIZE(buffer->varData.arraybuffer.type);
+    length += buffer->varData.arraybuffer.byteOffset;
+    info->data = jsvGetArrayBufferBackingString(buffer);
+  } else if (jsvIsString(buffer)) {
+    length = jsvGetStringLength(buffer);
+    info->data = jsvLockAgain(buffer);
+  }
+  jsvUnLock(buffer);
+  if (!info->data) {
+    jsExceptionHere(JSET_TYPEERROR, "Expecting ArrayBuffer, DataView or String");
+    return false;
+  }
+  size_t dataLen = 0;
+  info->ptr = jsvGetDataPointer(info->data, &dataLen);
+  if (info->ptr && dataLen<length) length = dataLen;
+  if (offset > length) offset = length;
+  info->offset = offset;
+  info->length = length - offset;
+  if (info->ptr) info->ptr += offset;
+  info->names = jsvObjectGetChild(codec, JSI_DATAVIEW_CODEC_NAMES, 0);
+  return true;
+}
+
+static void jswrap_dataview_codecFreeInfo(DataViewCodecInfo *info) {
+  jsvUnLock2(info->names, info->data);
+}
+
+/// Copy 'len' bytes, reversing them if the endianness of the record differs from ours
+static void jswrap_dataview_codecCopy(char *dst, const char *src, int len, bool reverse) {
+  int i;
+  for (i=0;i<len;i++)
+    dst[i] = src[reverse ? (len-1-i) : i];
+}
+
+/// Unpack one record from 'rec' into an Array or Object
+static JsVar *jswrap_dataview_codecUnpackRecord(DataViewCodecInfo *info, const char *rec) {
+  JsVar *result = info->names ? jsvNewObject() : jsvNewEmptyArray();
+  if (!result) return 0;
+  JsvObjectIterator namesIt;
+  if (info->names) jsvObjectIteratorNew(&namesIt, info->names);
+  const char *fmt = info->fmt;
+  if (*fmt=='<' || *fmt=='>' || *fmt=='!' || *fmt=='=' || *fmt=='@') fmt++;
+  bool reverse = !info->littleEndian;
+  char type;
+  int count;
+  while (jswrap_dataview_codecNext(&fmt, &type, &count)) {
+    int typeSize = jswrap_dataview_codecTypeSize(type);
+    if (type=='x') {
+      rec += count;
+      continue;
+    }
+    if (type=='s') {
+      typeSize = count;
+      count = 1;
+    }
+    while (count--) {
+      union { uint8_t u8; int8_t i8; uint16_t u16; int16_t i16; uint32_t u32; int32_t i32; float f; double d; char c[8]; } v;
+      JsVar *value = 0;
+      if (type=='s') {
+        value = jsvNewStringOfLength((unsigned int)typeSize, rec);
+      } else {
+        jswrap_dataview_codecCopy(v.c, rec, typeSize, reverse);
+        switch (type) {
+          case 'b': value = jsvNewFromInteger(v.i8); break;
+          case 'B': value = jsvNewFromInteger(v.u8); break;
+          case '?': value = jsvNewFromBool(v.u8!=0); break;
+          case 'h': value = jsvNewFromInteger(v.i16); break;
+          case 'H': value = jsvNewFromInteger(v.u16); break;
+          case 'i': case 'l': value = jsvNewFromInteger(v.i32); break;
+          case 'I': case 'L': value = jsvNewFromLongInteger(v.u32); break;
+          case 'f': value = jsvNewFromFloat(v.f); break;
+          case 'd': value = jsvNewFromFloat(v.d); break;
+        }
+      }
+      rec += typeSize;
+      if (info->names) {
+        JsVar *name = jsvObjectIteratorGetValue(&namesIt);
+        JsVar *nameStr = jsvAsString(name);
+        jsvObjectSetChildVar(result, nameStr, value);
+        jsvUnLock3(name, nameStr, value);
+        jsvObjectIteratorNext(&namesIt);
+      } else {
+        jsvArrayPushAndUnLock(result, value);
+      }
+    }
+  }
+  if (info->names) jsvObjectIteratorFree(&namesIt);
+  return result;
+}
+
+/// Pack one record from an Array or Object into 'rec'
+static void jswrap_dataview_codecPackRecord(DataViewCodecInfo *info, JsVar *values, char *rec) {
+  bool useNames = info->names && !jsvIsArray(values) && jsvIsObject(values);
+  JsvObjectIterator namesIt;
+  JsvIterator valuesIt;
+  if (useNames) jsvObjectIteratorNew(&namesIt, info->names);
+  else jsvIteratorNew(&valuesIt, values, JSIF_EVERY_ARRAY_ELEMENT);
+  const char *fmt = info->fmt;
+  if (*fmt=='<' || *fmt=='>' || *fmt=='!' || *fmt=='=' || *fmt=='@') fmt++;
+  bool reverse = !info->littleEndian;
+  char type;
+  int count;
+  while (jswrap_dataview_codecNext(&fmt, &type, &count)) {
+    int typeSize = jswrap_dataview_codecTypeSize(type);
+    if (type=='x') {
+      memset(rec, 0, (size_t)count);
+      rec += count;
+      continue;
+    }
+    if (type=='s') {
+      typeSize = count;
+      count = 1;
+    }
+    while (count--) {
+      JsVar *value = 0;
+      if (useNames) {
+        JsVar *name = jsvObjectIteratorGetValue(&namesIt);
+        JsVar *nameStr = jsvAsString(name);
+        value = jsvSkipNameAndUnLock(jsvFindChildFromVar(values, nameStr, false));
+        jsvUnLock2(name, nameStr);
+        jsvObjectIteratorNext(&namesIt);
+      } else if (jsvIteratorHasElement(&valuesIt)) {
+        value = jsvIteratorGetValue(&valuesIt);
+        jsvIteratorNext(&valuesIt);
+      }
+      union { uint8_t u8; uint16_t u16; uint32_t u32; float f; double d; char c[8]; } v;
+      switch (type) {
+        case 's': {
+          memset(rec, 0, (size_t)typeSize);
+          JsVar *str = jsvAsString(value);
+          jsvGetStringChars(str, 0, rec, (size_t)typeSize);
+          jsvUnLock(str);
+        } break;
+        case 'b': case 'B': case '?': v.u8 = (uint8_t)jsvGetInteger(value); break;
+        case 'h': case 'H': v.u16 = (uint16_t)jsvGetInteger(value); break;
+        case 'i': case 'l': v.u32 = (uint32_t)jsvGetInteger(value); break;
+        case 'I': case 'L': v.u32 = (uint32_t)jsvGetLongInteger(value); break;
+        case 'f': v.f = (float)jsvGetFloat(value); break;
+        case 'd': v.d = jsvGetFloat(value); break;
+      }
+      jsvUnLock(value);
+      if (type!='s') jswrap_dataview_codecCopy(rec, v.c, typeSize, reverse);
+      rec += typeSize;
+    }
+  }
+  if (useNames) jsvObjectIteratorFree(&namesIt);
+  else jsvIteratorFree(&valuesIt);
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "DataViewCodec",
+  "name" : "unpack",
+  "generate" : "jswrap_dataview_codec_unpack",
+  "params" : [
+    ["buffer","JsVar","The `ArrayBuffer`, typed array, `DataView` or String to read from"],
+    ["byteOffset","int","(optional) The offset in bytes to start reading from"],
+    ["count","int","(optional) If specified, read this many consecutive records and return them in an Array"]
+  ],
+  "return" : ["JsVar","The record (an Array, or an Object if names were given to `DataView.compile`), or an Array of records"],
+  "ifndef" : "SAVE_ON_FLASH"
+}
+Unpack a record (or `count` records) from the given buffer. Returns undefined if there
+isn't enough data in the buffer for a whole record.
+ */
+JsVar *jswrap_dataview_codec_unpack(JsVar *codec, JsVar *buffer, int byteOffset, int count) {
+  DataViewCodecInfo info;
+  if (!jswrap_dataview_codecGetInfo(codec, &info, buffer, byteOffset)) return 0;
+  bool multiple = count>0;
+  if (!multiple) count = 1;
+  if ((size_t)count > info.length / (info.size ? info.size : 1))
+    count = (int)(info.length / (info.size ? info.size : 1));
+  JsVar *result = multiple ? jsvNewEmptyArray() : 0;
+  char *rec = info.ptr;
+  JsvStringIterator it;
+  if (!rec) {
+    // Data isn't flat - copy each record into a buffer on the stack
+    if (info.size+256 > jsuGetFreeStack()) {
+      jsExceptionHere(JSET_ERROR, "Not enough free stack for record");
+      jsvUnLock(result);
+      jswrap_dataview_codecFreeInfo(&info);
+      return 0;
+    }
+    rec = (char*)alloca(info.size);
+    jsvStringIteratorNew(&it, info.data, info.offset);
+  }
+  int i;
+  for (i=0;i<count;i++) {
+    if (!info.ptr) {
+      size_t j;
+      for (j=0;j<info.size;j++) {
+        rec[j] = jsvStringIteratorGetChar(&it);
+        jsvStringIteratorNext(&it);
+      }
+    }
+    JsVar *record = jswrap_dataview_codecUnpackRecord(&info, rec);
+    if (info.ptr) rec += info.size;
+    if (multiple) jsvArrayPushAndUnLock(result, record);
+    else result = record;
+  }
+  if (!info.ptr) jsvStringIteratorFree(&it);
+  jswrap_dataview_codecFreeInfo(&info);
+  return result;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "DataViewCodec",
+  "name" : "pack",
+  "generate" : "jswrap_dataview_codec_pack",
+  "params" : [
+    ["values","JsVar","A record (an Array, or an Object if names were given to `DataView.compile`), or an Array of records"],
+    ["buffer","JsVar","(optional) The `ArrayBuffer`, typed array or `DataView` to write into. If undefined, a new ArrayBuffer is created"],
+    ["byteOffset","int","(optional) The offset in bytes to start writing at"]
+  ],
+  "return" : ["JsVar","The buffer written to"],
+  "ifndef" : "SAVE_ON_FLASH"
+}
+Pack a record (or an Array of records) into a buffer. Records that won't fit
+in the buffer are ignored.
+ */
+JsVar *jswrap_dataview_codec_pack(JsVar *codec, JsVar *values, JsVar *buffer, int byteOffset) {
+  DataViewCodecInfo info;
+  if (!jswrap_dataview_codecGetInfo(codec, &info, 0, 0)) return 0;
+  // is this an array of records?
+  bool multiple = false;
+  if (jsvIsArray(values)) {
+    JsVar *first = jsvGetArrayItem(values, 0);
+    multiple = jsvIsArray(first) || (info.names && jsvIsObject(first));
+    jsvUnLock(first);
+  }
+  JsVar *result;
+  if (jsvIsUndefined(buffer)) {
+    int count = multiple ? (int)jsvGetArrayLength(values) : 1;
+    if (byteOffset<0) byteOffset = 0;
+    result = jswrap_arraybuffer_constructor((JsVarInt)info.size*count + byteOffset);
+    if (!result) return 0;
+  } else {
+    result = jsvLockAgain(buffer);
+  }
+  if (!jswrap_dataview_codecGetInfo(codec, &info, result, byteOffset)) {
+    jsvUnLock(result);
+    return 0;
+  }
+  char *rec = info.ptr;
+  JsvStringIterator it;
+  if (!rec) {
+    if (info.size+256 > jsuGetFreeStack()) {
+      jsExceptionHere(JSET_ERROR, "Not enough free stack for record");
+      jswrap_dataview_codecFreeInfo(&info);
+      jsvUnLock(result);
+      return 0;
+    }
+    rec = (char*)alloca(info.size);
+    jsvStringIteratorNew(&it, info.data, info.offset);
+  }
+  JsvIterator recIt;
+  if (multiple) jsvIteratorNew(&recIt, values, JSIF_EVERY_ARRAY_ELEMENT);
+  size_t remaining = info.length;
+  while (remaining >= info.size) {
+    JsVar *record;
+    if (multiple) {
+      if (!jsvIteratorHasElement(&recIt)) break;
+      record = jsvIteratorGetValue(&recIt);
+      jsvIteratorNext(&recIt);
+    } else
+      record = jsvLockAgain(values);
+    jswrap_dataview_codecPackRecord(&info, record, rec);
+    jsvUnLock(record);
+    if (info.ptr) {
+      rec += info.size;
+    } else {
+      size_t j;
+      for (j=0;j<info.size;j++) {
+        jsvStringIteratorSetChar(&it, rec[j]);
+        jsvStringIteratorNext(&it);
+      }
+    }
+    remaining -= info.size;
+    if (!multiple) break;
+  }
+  if (multiple) jsvIteratorFree(&recIt);
+  if (!info.ptr) jsvStringIteratorFree(&it);
+  jswrap_dataview_codecFreeInfo(&info);
+  return result;
+}
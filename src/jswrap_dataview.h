@@ -16,3 +16,6 @@
 JsVar *jswrap_dataview_constructor(JsVar *buffer, int byteOffset, int byteLength);
 JsVar *jswrap_dataview_get(JsVar *dataview, JsVarDataArrayBufferViewType type, int byteOffset, bool littleEndian);
 void jswrap_dataview_set(JsVar *dataview, JsVarDataArrayBufferViewType type, int byteOffset, JsVar *value, bool littleEndian);
+JsVar *jswrap_dataview_compile(JsVar *format, JsVar *names);
+JsVar *jswrap_dataview_codec_unpack(JsVar *codec, JsVar *buffer, int byteOffset, int count);
+JsVar *jswrap_dataview_codec_pack(JsVar *codec, JsVar *values, JsVar *buffer, int byteOffset);
@@ -347,31 +347,48 @@ JsVarFloat jswrap_espruino_convolve(JsVar *arr1, JsVar *arr2, int offset) {
 
 #ifdef SAVE_ON_FLASH_MATH
 #define FFTDATATYPE double
+#define FFTDATATYPE_ARRAYBUFFER ARRAYBUFFERVIEW_FLOAT64
 #else
 #define FFTDATATYPE float
+#define FFTDATATYPE_ARRAYBUFFER ARRAYBUFFERVIEW_FLOAT32
 #endif
 
+/* Fill in a quarter-wave cosine table of tabN/4+1 entries, tab[k] = cos(2*PI*k/tabN).
+ * This is enough to get the sin and cos of any angle 2*PI*k/tabN for k<tabN/2.
+ * tabN must be a power of 2 and >=4 */
+static void FFT_twiddleTable(FFTDATATYPE *tab, size_t tabN) {
+  size_t k, q = tabN>>2;
+  for (k=0;k<=q;k++)
+    tab[k] = (FFTDATATYPE)jswrap_math_sin(2*PI*(double)(q-k)/(double)tabN);
+}
+
+/// Get cos and sin of 2*PI*k/tabN from a table created with FFT_twiddleTable (k<tabN/2)
+static void FFT_twiddle(const FFTDATATYPE *tab, size_t tabN, size_t k, FFTDATATYPE *c, FFTDATATYPE *s) {
+  size_t q = tabN>>2;
+  if (k<=q) {
+    *c = tab[k];
+    *s = tab[q-k];
+  } else {
+    *c = -tab[(tabN>>1)-k];
+    *s = tab[k-q];
+  }
+}
+
 // http://paulbourke.net/miscellaneous/dft/
 /*
    This computes an in-place complex-to-complex FFT
-   x and y are the real and imaginary arrays of 2^m points.
-   dir =  1 gives forward transform
-   dir = -1 gives reverse transform
+   x and y are the real and imaginary arrays of n points (n a power of 2).
+   Twiddle factors come from 'tab' (see FFT_twiddleTable), where tabN is a multiple of n.
+   No scaling is applied.
  */
-short FFT(short int dir,long m,FFTDATATYPE *x,FFTDATATYPE *y)
-{
-  long n,i,i1,j,k,i2,l,l1,l2;
-  FFTDATATYPE c1,c2,tx,ty,t1,t2,u1,u2,z;
-
-  /* Calculate the number of points */
-  n = 1;
-  for (i=0;i<m;i++)
-    n *= 2;
+static void FFT(bool inverse, size_t n, FFTDATATYPE *x, FFTDATATYPE *y, const FFTDATATYPE *tab, size_t tabN) {
+  size_t i,i1,j,k,i2,l1,l2;
+  FFTDATATYPE tx,ty,t1,t2,u1,u2;
 
   /* Do the bit reversal */
   i2 = n >> 1;
   j = 0;
-  for (i=0;i<n-1;i++) {
+  for (i=0;i+1<n;i++) {
     if (i < j) {
       tx = x[i];
       ty = y[i];
@@ -389,15 +406,11 @@ short FFT(short int dir,long m,FFTDATATYPE *x,FFTDATATYPE *y)
   }
 
   /* Compute the FFT */
-  c1 = -1.0;
-  c2 = 0.0;
-  l2 = 1;
-  for (l=0;l<m;l++) {
-    l1 = l2;
-    l2 <<= 1;
-    u1 = 1.0;
-    u2 = 0.0;
+  for (l2=2;l2<=n;l2<<=1) {
+    l1 = l2>>1;
     for (j=0;j<l1;j++) {
+      FFT_twiddle(tab, tabN, j*(tabN/l2), &u1, &u2);
+      if (!inverse) u2 = -u2;
       for (i=j;i<n;i+=l2) {
         i1 = i + l1;
         t1 = u1 * x[i1] - u2 * y[i1];
@@ -407,25 +420,36 @@ short FFT(short int dir,long m,FFTDATATYPE *x,FFTDATATYPE *y)
         x[i] += t1;
         y[i] += t2;
       }
-      z =  u1 * c1 - u2 * c2;
-      u2 = u1 * c2 + u2 * c1;
-      u1 = z;
     }
-    c2 = (FFTDATATYPE)jswrap_math_sqrt((1.0 - c1) / 2.0);
-    if (dir == 1)
-      c2 = -c2;
-    c1 = (FFTDATATYPE)jswrap_math_sqrt((1.0 + c1) / 2.0);
   }
+}
 
-  /* Scaling for forward transform */
-  if (dir == 1) {
-    for (i=0;i<n;i++) {
-      x[i] /= (FFTDATATYPE)n;
-      y[i] /= (FFTDATATYPE)n;
-    }
+/* Given the n/2 point complex FFT z of an n point real sequence x (packed
+   as z[k] = x[2k] + i*x[2k+1]), work out the modulus of each of the first
+   n/2 points of the FFT of x, scaled by 'scale', and write them into zr.
+   The modulus of point n/2 is returned. Points above n/2 are the mirror image. */
+static FFTDATATYPE FFT_realModulus(size_t n, FFTDATATYPE *zr, FFTDATATYPE *zi, const FFTDATATYPE *tab, FFTDATATYPE scale) {
+  size_t k, h = n>>1;
+  FFTDATATYPE c, s, er, ei, odr, odi, xr, xi, yr, yi;
+  FFTDATATYPE last = (FFTDATATYPE)fabs((zr[0]-zi[0])*scale);
+  zr[0] = (FFTDATATYPE)fabs((zr[0]+zi[0])*scale);
+  for (k=1;k<=h/2;k++) {
+    size_t m = h-k;
+    FFT_twiddle(tab, n, k, &c, &s);
+    // X[k] = E + W^k * O, where W = e^(-2*PI*i/n)
+    er = (zr[k]+zr[m])/2;
+    ei = (zi[k]-zi[m])/2;
+    odr = (zi[k]+zi[m])/2;
+    odi = (zr[m]-zr[k])/2;
+    xr = er + c*odr + s*odi;
+    xi = ei + c*odi - s*odr;
+    // X[m] = conj(E - W^k * O)
+    yr = er - c*odr - s*odi;
+    yi = ei - c*odi + s*odr;
+    zr[k] = (FFTDATATYPE)jswrap_math_sqrt(xr*xr + xi*xi)*scale;
+    zr[m] = (FFTDATATYPE)jswrap_math_sqrt(yr*yr + yi*yi)*scale;
   }
-
-  return(TRUE);
+  return last;
 }
 
 /*JSON{
@@ -444,43 +468,81 @@ Performs a Fast Fourier Transform (FFT) in 32 bit floats on the supplied data an
 original arrays. Note that if only one array is supplied, the data written back is the modulus of the complex
 result `sqrt(r*r+i*i)`.
 
-In order to perform the FFT, there has to be enough room on the stack to allocate two arrays of 32 bit
-floating point numbers - this will limit the maximum size of FFT possible to around 1024 items on
-most platforms.
+If only one array is supplied, the input is known to be real so a half-size FFT is performed, which
+is around twice as fast and uses half the memory.
+
+If `Float32Array`s (or `Int16Array`s) are supplied, data is read from and written to them directly. If
+both arrays are `Float32Array`s with a length that is a power of 2, the FFT is performed in-place
+without making any copy of the data.
+
+Working memory for the FFT is allocated on the stack if there is room, or from Espruino's variable
+storage if not. The maximum size of the FFT is therefore limited by available memory.
 
 **Note:** on the Original Espruino board, FFTs are performed in 64bit arithmetic as there isn't
 space to include the 32 bit maths routines (2x more RAM is required).
  */
-void _jswrap_espruino_FFT_getData(FFTDATATYPE *dst, JsVar *src, size_t length) {
-  JsvIterator it;
+/// Return a pointer to the data in a typed array of the given type if it is directly accessible
+static void *_jswrap_espruino_FFT_getPtr(JsVar *arr, JsVarDataArrayBufferViewType type) {
+  if (!jsvIsArrayBuffer(arr) || arr->varData.arraybuffer.type!=type) return 0;
+  size_t len;
+  char *ptr = jsvGetDataPointer(arr, &len);
+  if ((size_t)ptr & (JSV_ARRAYBUFFER_GET_SIZE(type)-1)) return 0; // unaligned
+  return ptr;
+}
+/// Store item i. If dstOdd is set, even items go into dst and odd items into dstOdd
+static void _jswrap_espruino_FFT_store(FFTDATATYPE *dst, FFTDATATYPE *dstOdd, size_t i, FFTDATATYPE v) {
+  if (dstOdd) ((i&1) ? dstOdd : dst)[i>>1] = v;
+  else dst[i] = v;
+}
+/// Read 'length' items into dst (see _jswrap_espruino_FFT_store), zero-padding if needed
+void _jswrap_espruino_FFT_getData(FFTDATATYPE *dst, FFTDATATYPE *dstOdd, JsVar *src, size_t length) {
   size_t i=0;
-  if (jsvIsIterable(src)) {
+  FFTDATATYPE *fp = (FFTDATATYPE*)_jswrap_espruino_FFT_getPtr(src, FFTDATATYPE_ARRAYBUFFER);
+  int16_t *ip = (int16_t*)_jswrap_espruino_FFT_getPtr(src, ARRAYBUFFERVIEW_INT16);
+  if (fp || ip) {
+    size_t l = (size_t)jsvGetLength(src);
+    if (l>length) l = length;
+    for (;i<l;i++)
+      _jswrap_espruino_FFT_store(dst, dstOdd, i, fp ? fp[i] : (FFTDATATYPE)ip[i]);
+  } else if (jsvIsIterable(src)) {
+    JsvIterator it;
     jsvIteratorNew(&it, src, JSIF_EVERY_ARRAY_ELEMENT);
     while (i<length && jsvIteratorHasElement(&it)) {
-      dst[i++] = (FFTDATATYPE)jsvIteratorGetFloatValue(&it);
+      _jswrap_espruino_FFT_store(dst, dstOdd, i++, (FFTDATATYPE)jsvIteratorGetFloatValue(&it));
       jsvIteratorNext(&it);
     }
     jsvIteratorFree(&it);
   }
-  while (i<length)
-    dst[i++]=0;
-}
-void _jswrap_espruino_FFT_setData(JsVar *dst, FFTDATATYPE *src, FFTDATATYPE *srcModulus, size_t length) {
+  for (;i<length;i++)
+    _jswrap_espruino_FFT_store(dst, dstOdd, i, 0);
+}
+/** Write data back. If srcModulus is set, write the modulus of src and srcModulus. If
+ * mirror is set, src only contains the first length/2 items, with item length/2 in 'mirrorMid' */
+void _jswrap_espruino_FFT_setData(JsVar *dst, FFTDATATYPE *src, FFTDATATYPE *srcModulus, bool mirror, FFTDATATYPE mirrorMid, size_t length) {
+  size_t i, l = (size_t)jsvGetLength(dst);
+  if (l>length) l = length;
+  FFTDATATYPE *fp = (FFTDATATYPE*)_jswrap_espruino_FFT_getPtr(dst, FFTDATATYPE_ARRAYBUFFER);
+  int16_t *ip = (int16_t*)_jswrap_espruino_FFT_getPtr(dst, ARRAYBUFFERVIEW_INT16);
+  if (fp==src) return; // data was processed in-place
   JsvIterator it;
-  jsvIteratorNew(&it, dst, JSIF_EVERY_ARRAY_ELEMENT);
-  size_t i=0;
-  while (i<length && jsvIteratorHasElement(&it)) {
-    JsVarFloat f;
-    if (srcModulus)
-      f = jswrap_math_sqrt(src[i]*src[i] + srcModulus[i]*srcModulus[i]);
+  if (!fp && !ip) jsvIteratorNew(&it, dst, JSIF_EVERY_ARRAY_ELEMENT);
+  for (i=0;i<l;i++) {
+    FFTDATATYPE f;
+    if (mirror)
+      f = (i==length/2) ? mirrorMid : src[(i<length/2) ? i : length-i];
+    else if (srcModulus)
+      f = (FFTDATATYPE)jswrap_math_sqrt(src[i]*src[i] + srcModulus[i]*srcModulus[i]);
     else
       f = src[i];
-
-    jsvUnLock(jsvIteratorSetValue(&it, jsvNewFromFloat(f)));
-    i++;
-    jsvIteratorNext(&it);
+    if (fp) fp[i] = f;
+    else if (ip) ip[i] = (int16_t)(isfinite(f) ? (long long)f : 0);
+    else {
+      if (!jsvIteratorHasElement(&it)) break;
+      jsvUnLock(jsvIteratorSetValue(&it, jsvNewFromFloat(f)));
+      jsvIteratorNext(&it);
+    }
   }
-  jsvIteratorFree(&it);
+  if (!fp && !ip) jsvIteratorFree(&it);
 }
 void jswrap_espruino_FFT(JsVar *arrReal, JsVar *arrImag, bool inverse) {
   if (!(jsvIsIterable(arrReal)) ||
@@ -492,33 +554,70 @@ void jswrap_espruino_FFT(JsVar *arrReal, JsVar *arrImag, bool inverse) {
   // get length and work out power of 2
   size_t l = (size_t)jsvGetLength(arrReal);
   size_t pow2 = 1;
-  int order = 0;
-  while (pow2 < l) {
+  while (pow2 < l)
     pow2 <<= 1;
-    order++;
-  }
-
-  if (jsuGetFreeStack() < 256+sizeof(FFTDATATYPE)*pow2*2) {
-    jsExceptionHere(JSET_ERROR, "Insufficient stack for computing FFT");
-    return;
-  }
+  if (pow2<2) return; // FFT of one item is itself
+  size_t tabN = (pow2<4) ? 4 : pow2;
 
-  FFTDATATYPE *vReal = (FFTDATATYPE*)alloca(sizeof(FFTDATATYPE)*pow2*2);
-  FFTDATATYPE *vImag = &vReal[pow2];
-
-  // load data
-  _jswrap_espruino_FFT_getData(vReal, arrReal, pow2);
-  _jswrap_espruino_FFT_getData(vImag, arrImag, pow2);
-
-  // do FFT
-  FFT(inverse ? -1 : 1, order, vReal, vImag);
-
-  // Put the results back
-  // If we had imaginary data then DON'T modulus the result
   bool hasImagResult = jsvIsIterable(arrImag);
-  _jswrap_espruino_FFT_setData(arrReal, vReal, hasImagResult?0:vImag, pow2);
-  if (hasImagResult)
-    _jswrap_espruino_FFT_setData(arrImag, vImag, 0, pow2);
+  // Real-only input of >=4 points can be done as a half-size complex FFT
+  bool isReal = !hasImagResult && pow2>=4;
+  FFTDATATYPE *vReal = 0, *vImag = 0;
+  if (hasImagResult && (size_t)jsvGetLength(arrReal)==pow2 && (size_t)jsvGetLength(arrImag)==pow2) {
+    vReal = (FFTDATATYPE*)_jswrap_espruino_FFT_getPtr(arrReal, FFTDATATYPE_ARRAYBUFFER);
+    vImag = (FFTDATATYPE*)_jswrap_espruino_FFT_getPtr(arrImag, FFTDATATYPE_ARRAYBUFFER);
+  }
+  bool inPlace = vReal && vImag;
+
+  size_t dataItems = inPlace ? 0 : (isReal ? pow2 : pow2*2);
+  size_t bufSize = sizeof(FFTDATATYPE)*(dataItems + (tabN>>2) + 1);
+  FFTDATATYPE *buf;
+  bool bufAllocated = false;
+  if (jsuGetFreeStack() >= 256+bufSize) {
+    buf = (FFTDATATYPE*)alloca(bufSize);
+  } else {
+    buf = (FFTDATATYPE*)jsvMalloc(bufSize);
+    if (!buf) {
+      jsExceptionHere(JSET_ERROR, "Insufficient memory for computing FFT");
+      return;
+    }
+    bufAllocated = true;
+  }
+  FFTDATATYPE *tab = &buf[dataItems];
+  FFT_twiddleTable(tab, tabN);
+
+  if (isReal) {
+    size_t h = pow2>>1;
+    vReal = buf;
+    vImag = &buf[h];
+    // pack even items into the real part and odd items into the imaginary
+    _jswrap_espruino_FFT_getData(vReal, vImag, arrReal, pow2);
+    FFT(false, h, vReal, vImag, tab, tabN);
+    FFTDATATYPE mid = FFT_realModulus(pow2, vReal, vImag, tab, inverse ? 1 : (FFTDATATYPE)1/(FFTDATATYPE)pow2);
+    _jswrap_espruino_FFT_setData(arrReal, vReal, 0, true, mid, pow2);
+  } else {
+    if (!inPlace) {
+      vReal = buf;
+      vImag = &buf[pow2];
+      _jswrap_espruino_FFT_getData(vReal, 0, arrReal, pow2);
+      _jswrap_espruino_FFT_getData(vImag, 0, arrImag, pow2);
+    }
+    FFT(inverse, pow2, vReal, vImag, tab, tabN);
+    /* Scaling for forward transform */
+    if (!inverse) {
+      FFTDATATYPE scale = (FFTDATATYPE)1/(FFTDATATYPE)pow2;
+      for (size_t i=0;i<pow2;i++) {
+        vReal[i] *= scale;
+        vImag[i] *= scale;
+      }
+    }
+    // Put the results back
+    // If we had imaginary data then DON'T modulus the result
+    _jswrap_espruino_FFT_setData(arrReal, vReal, hasImagResult?0:vImag, false, 0, pow2);
+    if (hasImagResult)
+      _jswrap_espruino_FFT_setData(arrImag, vImag, 0, false, 0, pow2);
+  }
+  if (bufAllocated) jsvFree(buf);
 }
 
 /*JSON{
@@ -715,6 +814,116 @@ JsVar *jswrap_espruino_getErrorFlags() {
   return jswrap_espruino_getErrorFlagArray(flags);
 }
 
+#ifndef SAVE_ON_FLASH
+/// Get a serial device from a Serial object or a device name, or EV_NONE (and an exception)
+static IOEventFlags jswrap_espruino_getSerialDevice(JsVar *device) {
+  IOEventFlags dev = EV_NONE;
+  if (jsvIsObject(device)) {
+    dev = jsiGetDeviceFromClass(device);
+  } else if (jsvIsString(device)) {
+    char name[16];
+    jsvGetString(device, name, sizeof(name));
+    dev = jshFromDeviceString(name);
+  }
+  if (!DEVICE_IS_SERIAL(dev)) {
+    jsExceptionHere(JSET_ERROR, "Expecting a Serial device, got %q", device);
+    return EV_NONE;
+  }
+  return dev;
+}
+#endif
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "setIOLimit",
+  "generate" : "jswrap_espruino_setIOLimit",
+  "params" : [
+    ["device","JsVar","A Serial device (eg. `Serial1`) or its name (eg. `\"Serial1\"`)"],
+    ["maxEvents","int","The most events the device may have in the IO buffer at once, or 0 for no limit"]
+  ]
+}
+Limit how much of the IO buffer (which holds received characters and `setWatch`
+events until they are handled) one device may use. This stops a device that
+receives a lot of data from filling the buffer and causing data from the
+console or `setWatch` events to be lost.
+
+Each event holds up to 4 characters. Characters that arrive while a device is
+at its limit are lost, and counted in `E.getIOStats().devices[name].overflows`.
+On Linux the data is left unread (so the OS buffers it) instead.
+
+Limits are removed by `reset()`.
+ */
+void jswrap_espruino_setIOLimit(JsVar *device, int maxEvents) {
+  IOEventFlags dev = jswrap_espruino_getSerialDevice(device);
+  if (dev == EV_NONE) return;
+  jshSetDeviceEventLimit(dev, maxEvents);
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "E",
+  "name" : "getIOStats",
+  "generate" : "jswrap_espruino_getIOStats",
+  "return" : ["JsVar","An object containing information on the IO buffer"]
+}
+Get information on the IO buffer (received characters and `setWatch` events
+waiting to be handled) and the transmit buffer:
+
+```
+{
+  ioSize : 1024, // events the IO buffer can hold
+  ioUsed : 0,    // events in it now
+  txSize : 1024, // characters the transmit buffer can hold
+  devices : {    // Serial devices that have used or lost events, or have a limit
+    Serial1 : { used : 0, limit : 64, overflows : 12 },
+    ...
+  },
+  other : { used : 0, limit : 0, overflows : 0 } // everything else - eg. setWatch
+}
+```
+
+`overflows` counts events lost because the IO buffer was full, or the device
+was at the limit set with `E.setIOLimit`. These also set the `FIFO_FULL` error
+flag (see `E.getErrorFlags`).
+ */
+#ifndef SAVE_ON_FLASH
+/// Get {used,limit,overflows} for a device (or EV_NONE for everything else). 0 if unused (and skipUnused)
+static JsVar *jswrap_espruino_getDeviceIOStats(IOEventFlags dev, bool skipUnused) {
+  int used, limit;
+  unsigned int overflows;
+  if (!jshGetDeviceEventStats(dev, &used, &limit, &overflows)) return 0;
+  if (skipUnused && !used && !limit && !overflows) return 0;
+  JsVar *o = jsvNewObject();
+  if (!o) return 0;
+  jsvObjectSetChildAndUnLock(o, "used", jsvNewFromInteger(used));
+  jsvObjectSetChildAndUnLock(o, "limit", jsvNewFromInteger(limit));
+  jsvObjectSetChildAndUnLock(o, "overflows", jsvNewFromInteger((JsVarInt)overflows));
+  return o;
+}
+#endif
+
+JsVar *jswrap_espruino_getIOStats() {
+  JsVar *obj = jsvNewObject();
+  if (!obj) return 0;
+  jsvObjectSetChildAndUnLock(obj, "ioSize", jsvNewFromInteger(IOBUFFERMASK+1));
+  jsvObjectSetChildAndUnLock(obj, "ioUsed", jsvNewFromInteger(jshGetEventsUsed()));
+  jsvObjectSetChildAndUnLock(obj, "txSize", jsvNewFromInteger(TXBUFFERMASK+1));
+  JsVar *devices = jsvNewObject();
+  if (devices) {
+    IOEventFlags dev;
+    for (dev=EV_SERIAL_START;dev<=EV_SERIAL_MAX;dev++) {
+      JsVar *o = jswrap_espruino_getDeviceIOStats(dev, true);
+      if (o) jsvObjectSetChildAndUnLock(devices, jshGetDeviceString(dev), o);
+    }
+  }
+  jsvObjectSetChildAndUnLock(obj, "devices", devices);
+  jsvObjectSetChildAndUnLock(obj, "other", jswrap_espruino_getDeviceIOStats(EV_NONE, false));
+  return obj;
+}
+
 
 /*JSON{
   "type" : "staticmethod",
@@ -31,6 +31,8 @@ void jswrap_espruino_kickWatchdog();
 /// Return an array of errors based on the current flags
 JsVar *jswrap_espruino_getErrorFlagArray(JsErrorFlags flags);
 JsVar *jswrap_espruino_getErrorFlags();
+void jswrap_espruino_setIOLimit(JsVar *device, int maxEvents);
+JsVar *jswrap_espruino_getIOStats();
 JsVar *jswrap_espruino_toArrayBuffer(JsVar *str);
 JsVar *jswrap_espruino_toUint8Array(JsVar *args);
 JsVar *jswrap_espruino_toString(JsVar *args);
@@ -0,0 +1,368 @@
+/*
+ * This file is part of Espruino, a JavaScript interpreter for Microcontrollers
+ *
+ * Copyright (C) 2013 Gordon Williams <gw@pur3.co.uk>
+ *
+ * This Source Code Form is subject to the terms of the Mozilla Public
+ * License, v. 2.0. If a copy of the MPL was not distributed with this
+ * file, You can obtain one at http://mozilla.org/MPL/2.0/.
+ *
+ * ----------------------------------------------------------------------------
+ * This file is designed to be parsed during the build process
+ *
+ * JavaScript methods for FIR/IIR digital filters
+ * ----------------------------------------------------------------------------
+ */
+#include "jswrap_filter.h"
+#include "jswrap_arraybuffer.h"
+#include "jsvar.h"
+#include "jsvariterator.h"
+#include "jsparse.h"
+#include "jsinteractive.h"
+
+#ifndef SAVE_ON_FLASH
+
+#define JSI_FILTER_DATA_NAME JS_HIDDEN_CHAR_STR"dat"
+
+typedef enum {
+  FILTER_FIR,
+  FILTER_IIR
+} PACKED_FLAGS FilterType;
+
+/** Stored at the start of the filter's flat data string. It's followed by
+ * the coefficients and then the filter state, all as floats:
+ *
+ * FIR: count taps, then 2*count items of delay line (written twice so the sum is over a contiguous area)
+ * IIR: 5 coefficients (b0,b1,b2,a1,a2) for each of count sections, then 2 items of state per section
+ */
+typedef struct {
+  FilterType type;
+  uint16_t count;       ///< Number of FIR taps or IIR biquad sections
+  uint16_t decimate;    ///< Only output every Nth sample
+  uint16_t interpolate; ///< Output N samples for every input sample
+  uint16_t phase;       ///< Decimation phase (carried between calls)
+  uint16_t pos;         ///< Position in FIR delay line
+} FilterInfo;
+
+#define FILTER_HEADER_FLOATS ((sizeof(FilterInfo)+sizeof(float)-1)/sizeof(float))
+
+/// A buffer of samples that we read or write sequentially
+typedef struct {
+  char *ptr; ///< Data pointer if the data is flat, aligned and long enough, or 0 if we must use an iterator
+  JsVarDataArrayBufferViewType type;
+  size_t length;
+  JsvIterator it;
+} FilterBuffer;
+
+/*JSON{
+  "type" : "class",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "Filter"
+}
+This class implements digital filters (FIR and cascaded biquad IIR) with optional decimation
+and interpolation. Whole buffers of samples are processed in one native call, and the filter's
+state is kept between calls so that consecutive buffers are filtered as one continuous signal.
+
+For instance to low-pass filter data coming from a double-buffered `Waveform`:
+
+```
+var w = new Waveform(128,{doubleBuffer:true, bits:16});
+var f = new Filter({iir:[0.0675,0.135,0.0675,-1.143,0.413]}); // 2nd order Butterworth, fc = fs/10
+var out = new Uint16Array(128);
+w.on("buffer", function(buf) {
+  f.process(buf, out);
+  // ... use out
+});
+w.startInput(A0,4000,{repeat:true});
+```
+ */
+
+/// Bytes needed for the filter's info, coefficients and state
+static size_t jswrap_filter_getDataSize(FilterType type, size_t count) {
+  size_t nCoeffs = (type==FILTER_FIR) ? count : count*5;
+  return sizeof(float)*(FILTER_HEADER_FLOATS + nCoeffs + count*2);
+}
+
+/** Get the filter's info from its flat string. Flat string data needn't be aligned, so the
+ * string is allocated with sizeof(float)-1 bytes of slack and the info starts at the first
+ * float-aligned address. Returns 0 if the string is too small. */
+static FilterInfo *jswrap_filter_getAlignedInfo(JsVar *data, size_t *len) {
+  char *ptr = jsvIsFlatString(data) ? jsvGetDataPointer(data, len) : 0;
+  if (!ptr) return 0;
+  size_t offset = (size_t)(-(intptr_t)ptr) & (sizeof(float)-1);
+  if (*len < offset+sizeof(FilterInfo)) return 0;
+  *len -= offset;
+  return (FilterInfo*)(ptr+offset);
+}
+
+/// Get the filter's info and data, or 0 on failure
+static FilterInfo *jswrap_filter_getInfo(JsVar *filter) {
+  JsVar *data = jsvObjectGetChild(filter, JSI_FILTER_DATA_NAME, 0);
+  size_t len = 0;
+  FilterInfo *info = jswrap_filter_getAlignedInfo(data, &len);
+  jsvUnLock(data);
+  if (!info || len<jswrap_filter_getDataSize(info->type, info->count)) {
+    jsExceptionHere(JSET_ERROR, "Filter not initialised");
+    return 0;
+  }
+  return info;
+}
+
+static float *jswrap_filter_getCoeffs(FilterInfo *info) {
+  return &((float*)info)[FILTER_HEADER_FLOATS];
+}
+
+static float *jswrap_filter_getState(FilterInfo *info) {
+  return &jswrap_filter_getCoeffs(info)[(info->type==FILTER_FIR) ? info->count : info->count*5];
+}
+
+/*JSON{
+  "type" : "constructor",
+  "class" : "Filter",
+  "name" : "Filter",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_filter_constructor",
+  "params" : [
+    ["options","JsVar","An object containing `{fir:[...]}` or `{iir:[...]}` (see below)"]
+  ],
+  "return" : ["JsVar","A Filter object"]
+}
+Create a digital filter. `options` is an object containing:
+
+```
+{
+  fir : [ ... ], // Array of FIR filter taps (h[0] first)
+  // or
+  iir : [ ... ], // Cascaded biquad IIR filter: 5 coefficients per stage: b0,b1,b2,a1,a2 (a0 is assumed to be 1)
+  decimate : 1, // optional - only output every Nth sample
+  interpolate : 1, // optional - insert N-1 zeros between each input sample before filtering
+                   //            (the input is multiplied by N to keep the gain the same)
+}
+```
+
+`interpolate` and `decimate` can be combined for resampling by a rational factor - the
+filter should then be designed as a low-pass at the lower of the two Nyquist frequencies.
+ */
+JsVar *jswrap_filter_constructor(JsVar *options) {
+  if (!jsvIsObject(options)) {
+    jsExceptionHere(JSET_ERROR, "Expecting options to be an Object, not %t", options);
+    return 0;
+  }
+  JsVar *fir = jsvObjectGetChild(options, "fir", 0);
+  JsVar *iir = jsvObjectGetChild(options, "iir", 0);
+  JsVar *coeffs = fir ? fir : iir;
+  FilterType type = fir ? FILTER_FIR : FILTER_IIR;
+  JsVarInt decimate = jsvGetIntegerAndUnLock(jsvObjectGetChild(options, "decimate", 0));
+  JsVarInt interpolate = jsvGetIntegerAndUnLock(jsvObjectGetChild(options, "interpolate", 0));
+  if (!decimate) decimate = 1;
+  if (!interpolate) interpolate = 1;
+  JsVarInt nCoeffs = jsvIsIterable(coeffs) ? jsvGetLength(coeffs) : 0;
+  JsVarInt count = (type==FILTER_FIR) ? nCoeffs : nCoeffs/5;
+  if ((fir && iir) || !jsvIsIterable(coeffs) || count<1 || count>0xFFFF ||
+      (type==FILTER_IIR && nCoeffs%5)) {
+    jsExceptionHere(JSET_ERROR, "Expecting either 'fir' array of taps, or 'iir' array with 5 coefficients per stage");
+    jsvUnLock2(fir, iir);
+    return 0;
+  }
+  if (decimate<1 || decimate>0xFFFF || interpolate<1 || interpolate>0xFFFF) {
+    jsExceptionHere(JSET_ERROR, "Invalid decimate or interpolate value");
+    jsvUnLock2(fir, iir);
+    return 0;
+  }
+
+  size_t len = jswrap_filter_getDataSize(type, (size_t)count) + sizeof(float)-1; // slack for alignment
+  JsVar *data = jsvNewFlatStringOfLength((unsigned int)len);
+  JsVar *filter = data ? jspNewObject(0, "Filter") : 0;
+  if (!filter) {
+    jsvUnLock3(data, fir, iir);
+    return 0; // out of memory
+  }
+  FilterInfo *info = jswrap_filter_getAlignedInfo(data, &len);
+  assert(info);
+  info->type = type;
+  info->count = (uint16_t)count;
+  info->decimate = (uint16_t)decimate;
+  info->interpolate = (uint16_t)interpolate;
+  float *c = jswrap_filter_getCoeffs(info);
+  JsvIterator it;
+  jsvIteratorNew(&it, coeffs, JSIF_EVERY_ARRAY_ELEMENT);
+  while (jsvIteratorHasElement(&it)) {
+    *(c++) = (float)jsvIteratorGetFloatValue(&it);
+    jsvIteratorNext(&it);
+  }
+  jsvIteratorFree(&it);
+  jsvUnLock2(fir, iir);
+  jsvObjectSetChildAndUnLock(filter, JSI_FILTER_DATA_NAME, data);
+  return filter;
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Filter",
+  "name" : "reset",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_filter_reset"
+}
+Reset the filter's state (as if it had only ever been given zeros)
+ */
+void jswrap_filter_reset(JsVar *filter) {
+  FilterInfo *info = jswrap_filter_getInfo(filter);
+  if (!info) return;
+  info->phase = 0;
+  info->pos = 0;
+  memset(jswrap_filter_getState(info), 0, sizeof(float)*info->count*2);
+}
+
+static bool jswrap_filter_bufferNew(FilterBuffer *b, JsVar *arr) {
+  b->ptr = 0;
+  b->type = ARRAYBUFFERVIEW_UNDEFINED;
+  if (!jsvIsIterable(arr)) return false;
+  b->length = (size_t)jsvGetLength(arr);
+  if (jsvIsArrayBuffer(arr)) {
+    size_t len;
+    JsVarDataArrayBufferViewType type = arr->varData.arraybuffer.type;
+    size_t size = JSV_ARRAYBUFFER_GET_SIZE(type);
+    char *ptr = jsvGetDataPointer(arr, &len);
+    if (ptr && len>=b->length*size && !(type&ARRAYBUFFERVIEW_BIG_ENDIAN) && size!=3 && !((size_t)ptr & (size-1))) {
+      b->ptr = ptr;
+      b->type = type;
+      return true;
+    }
+  }
+  jsvIteratorNew(&b->it, arr, JSIF_EVERY_ARRAY_ELEMENT);
+  return true;
+}
+
+static void jswrap_filter_bufferFree(FilterBuffer *b) {
+  if (!b->ptr) jsvIteratorFree(&b->it);
+}
+
+/// Read the next sample from a buffer
+static float jswrap_filter_bufferGet(FilterBuffer *b, size_t i) {
+  switch (b->type & ~ARRAYBUFFERVIEW_CLAMPED) {
+    case ARRAYBUFFERVIEW_FLOAT32: return ((float*)b->ptr)[i];
+    case ARRAYBUFFERVIEW_INT16: return ((int16_t*)b->ptr)[i];
+    case ARRAYBUFFERVIEW_UINT16: return ((uint16_t*)b->ptr)[i];
+    case ARRAYBUFFERVIEW_UINT8: case ARRAYBUFFERVIEW_ARRAYBUFFER: return ((uint8_t*)b->ptr)[i];
+    case ARRAYBUFFERVIEW_INT8: return ((int8_t*)b->ptr)[i];
+    case ARRAYBUFFERVIEW_INT32: return (float)((int32_t*)b->ptr)[i];
+    case ARRAYBUFFERVIEW_UINT32: return (float)((uint32_t*)b->ptr)[i];
+    case ARRAYBUFFERVIEW_FLOAT64: return (float)((double*)b->ptr)[i];
+    default: {
+      float f = (float)jsvIteratorGetFloatValue(&b->it);
+      jsvIteratorNext(&b->it);
+      return f;
+    }
+  }
+}
+
+/// Round and clip a sample to the range given
+static double jswrap_filter_clip(float v, double min, double max) {
+  if (!(v > min)) return min; // also catches NaN
+  if (v >= max) return max;
+  return (v<0) ? ceil(v-0.5) : floor(v+0.5);
+}
+
+/// Write the next sample to a buffer, saturating if the buffer is an integer type
+static void jswrap_filter_bufferSet(FilterBuffer *b, size_t i, float v) {
+  switch (b->type & ~ARRAYBUFFERVIEW_CLAMPED) {
+    case ARRAYBUFFERVIEW_FLOAT32: ((float*)b->ptr)[i] = v; break;
+    case ARRAYBUFFERVIEW_INT16: ((int16_t*)b->ptr)[i] = (int16_t)jswrap_filter_clip(v, -32768, 32767); break;
+    case ARRAYBUFFERVIEW_UINT16: ((uint16_t*)b->ptr)[i] = (uint16_t)jswrap_filter_clip(v, 0, 65535); break;
+    case ARRAYBUFFERVIEW_UINT8: case ARRAYBUFFERVIEW_ARRAYBUFFER: ((uint8_t*)b->ptr)[i] = (uint8_t)jswrap_filter_clip(v, 0, 255); break;
+    case ARRAYBUFFERVIEW_INT8: ((int8_t*)b->ptr)[i] = (int8_t)jswrap_filter_clip(v, -128, 127); break;
+    case ARRAYBUFFERVIEW_INT32: ((int32_t*)b->ptr)[i] = (int32_t)jswrap_filter_clip(v, -2147483648.0, 2147483647); break;
+    case ARRAYBUFFERVIEW_UINT32: ((uint32_t*)b->ptr)[i] = (uint32_t)jswrap_filter_clip(v, 0, 4294967295.0); break;
+    case ARRAYBUFFERVIEW_FLOAT64: ((double*)b->ptr)[i] = v; break;
+    default:
+      jsvUnLock(jsvIteratorSetValue(&b->it, jsvNewFromFloat(v)));
+      jsvIteratorNext(&b->it);
+      break;
+  }
+}
+
+/*JSON{
+  "type" : "method",
+  "class" : "Filter",
+  "name" : "process",
+  "ifndef" : "SAVE_ON_FLASH",
+  "generate" : "jswrap_filter_process",
+  "params" : [
+    ["input","JsVar","An array or typed array of samples to filter"],
+    ["output","JsVar","(optional) A typed array to write the filtered samples into. If undefined, `input` is overwritten"]
+  ],
+  "return" : ["int","The number of samples written to output"]
+}
+Filter all the samples in `input` and write them to `output`. The filter's state is kept, so
+calling this on consecutive buffers filters them as if they were one continuous signal.
+
+If `decimate` or `interpolate` were specified, the number of samples written will differ from
+the input length - writing stops when `output` is full. If writing to an integer typed array,
+values are rounded and saturated to the range of the array's type.
+
+`output` can't be left undefined if the filter is interpolating, as more samples are
+output than are input.
+ */
+int jswrap_filter_process(JsVar *filter, JsVar *input, JsVar *output) {
+  FilterInfo *info = jswrap_filter_getInfo(filter);
+  if (!info) return 0;
+  if (jsvIsUndefined(output)) {
+    if (info->interpolate>1) {
+      jsExceptionHere(JSET_ERROR, "Output buffer required when interpolating");
+      return 0;
+    }
+    output = input;
+  }
+  if (!jsvIsIterable(input) || !jsvIsArrayBuffer(output)) {
+    jsExceptionHere(JSET_ERROR, "Expecting an iterable input and a typed array output, not %t and %t", input, output);
+    return 0;
+  }
+  FilterBuffer in, out;
+  jswrap_filter_bufferNew(&in, input);
+  jswrap_filter_bufferNew(&out, output);
+  float *c = jswrap_filter_getCoeffs(info);
+  float *s = jswrap_filter_getState(info);
+  unsigned int n = info->count;
+  float gain = (float)info->interpolate;
+  size_t i, o = 0;
+  for (i=0; i<in.length && o<out.length; i++) {
+    float x = jswrap_filter_bufferGet(&in, i)*gain;
+    unsigned int u;
+    for (u=0; u<info->interpolate && o<out.length; u++) {
+      if (u) x = 0;
+      bool emit = info->phase==0;
+      if (++info->phase >= info->decimate) info->phase = 0;
+      float y = 0;
+      unsigned int k;
+      if (info->type==FILTER_FIR) {
+        // delay line is stored twice, so s[pos..pos+n) is always the last n samples, newest last
+        unsigned int p = info->pos;
+        s[p] = x;
+        s[p+n] = x;
+        if (++p >= n) p = 0;
+        info->pos = (uint16_t)p;
+        // we only need the output if we're not throwing it away
+        if (!emit) continue;
+        float *d = &s[p+n-1];
+        for (k=0;k<n;k++)
+          y += c[k] * *(d--);
+      } else {
+        // transposed direct form II biquads
+        y = x;
+        for (k=0;k<n;k++) {
+          float *bc = &c[k*5], *bs = &s[k*2];
+          x = y;
+          y = bc[0]*x + bs[0];
+          bs[0] = bc[1]*x - bc[3]*y + bs[1];
+          bs[1] = bc[2]*x - bc[4]*y;
+        }
+        if (!emit) continue;
+      }
+      jswrap_filter_bufferSet(&out, o++, y);
+    }
+  }
+  jswrap_filter_bufferFree(&in);
+  jswrap_filter_bufferFree(&out);
+  return (int)o;
+}
+#endif
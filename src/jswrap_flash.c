@@ -105,6 +105,7 @@ void jswrap_flash_erasePage(JsVar *addr) {
     jsExceptionHere(JSET_ERROR, "Address should be an integer, got %t", addr);
     return;
   }
+  jsfResetFileIndex();
   jshFlashErasePage((uint32_t)jsvGetInteger(addr));
 }
 
@@ -134,6 +135,7 @@ void jswrap_flash_write(JsVar *data, int addr) {
 
   JSV_GET_AS_CHAR_ARRAY(flashData, flashDataLen, data);
 
+  jsfResetFileIndex();
   if (flashData && flashDataLen)
     jshFlashWriteAligned(flashData, (unsigned int)addr, (unsigned int)flashDataLen);
 }
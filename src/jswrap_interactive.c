@@ -175,7 +175,10 @@ void jswrap_interface_load(JsVar *storageName) {
 /*JSON{
   "type" : "function",
   "name" : "save",
-  "generate_full" : "jsiStatus|=JSIS_TODO_FLASH_SAVE;"
+  "generate" : "jswrap_interface_save",
+  "params" : [
+    ["delta","bool","(optional) If true, only save the parts of RAM that have changed since the last full save"]
+  ]
 }
 Save the state of the interpreter into flash (including the results of calling
 `setWatch`, `setInterval`, `pinMode`, and any listeners). The state will then be loaded automatically
@@ -199,7 +202,20 @@ This will then be automatically executed by Espruino every time it starts.
 
 In order to stop the program saved with this command being loaded automatically,
 check out [the Troubleshooting guide](https://www.espruino.com/Troubleshooting#espruino-stopped-working-after-i-typed-save-)
+
+If you save often (for instance to checkpoint state), `save(true)` only writes
+the blocks of RAM that have changed since the last full `save()`, which is much
+faster and causes less flash wear. Once the changes grow to half the size of
+a full save, a full save is done instead.
  */
+void jswrap_interface_save(bool delta) {
+  jsiStatus |= JSIS_TODO_FLASH_SAVE;
+#ifdef JSF_DELTA_BLOCK_SIZE
+  if (delta) jsiStatus |= JSIS_TODO_FLASH_SAVE_DELTA;
+#else
+  NOT_USED(delta);
+#endif
+}
 /*JSON{
   "type" : "function",
   "name" : "reset",
@@ -21,6 +21,7 @@ void jswrap_interface_setSleepIndicator(JsVar *pinVar);
 void jswrap_interface_setDeepSleep(bool sleep);
 void jswrap_interface_trace(JsVar *root);
 void jswrap_interface_load(JsVar *storageName);
+void jswrap_interface_save(bool delta);
 void jswrap_interface_reset(bool clearFlash);
 void jswrap_interface_print(JsVar *v);
 void jswrap_interface_edit(JsVar *funcName);
@@ -155,6 +155,32 @@ JsVar *jswrap_storage_readArrayBuffer(JsVar *name) {
   return r;
 }
 
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "Storage",
+  "name" : "hash",
+  "generate" : "jswrap_storage_hash",
+  "params" : [
+    ["name","JsVar","The filename - max 8 characters (case sensitive)"]
+  ],
+  "return" : ["JsVar","A 32 bit hash of the file's contents, or `undefined` if the file doesn't exist"]
+}
+Return a 32 bit FNV-1a hash of the contents of a file. Tools that keep
+Storage in sync can use this to find out which files need writing.
+
+Hashes are remembered in RAM until the file is written to or Espruino
+restarts, so asking for the same file's hash again doesn't need to read
+the file. Files written
+with `{compress:true}` are hashed as they are stored, so the hash is
+of the compressed data.
+*/
+JsVar *jswrap_storage_hash(JsVar *name) {
+  uint32_t hash;
+  if (!jsfGetFileHash(jsfNameFromVar(name), &hash)) return 0;
+  return jsvNewFromLongInteger(hash);
+}
+
 /*JSON{
   "type" : "staticmethod",
   "ifndef" : "SAVE_ON_FLASH",
@@ -164,7 +190,7 @@ JsVar *jswrap_storage_readArrayBuffer(JsVar *name) {
   "params" : [
     ["name","JsVar","The filename - max 8 characters (case sensitive)"],
     ["data","JsVar","The data to write"],
-    ["offset","int","The offset within the file to write"],
+    ["offset","JsVar","The offset within the file to write, or an options object (see below)"],
     ["size","int","The size of the file (if a file is to be created that is bigger than the data)"]
   ],
   "return" : ["bool","True on success, false on failure"]
@@ -196,8 +222,32 @@ print(f.read("a"));
 
 This can be useful if you've got more data to write than you
 have RAM available.
+
+Instead of an offset you can also supply an object of options:
+
+* `compress` - if `true`, the file is compressed with heatshrink before
+being written. `read`, `readJSON` and `require` decompress it automatically,
+but it must be read into RAM (so it can't be executed direct from flash)
+and it can't be written in parts. If the data doesn't compress, it is
+written uncompressed.
+
+```
+require("Storage").write("MyFile", data, {compress:true});
+```
 */
-bool jswrap_storage_write(JsVar *name, JsVar *data, JsVarInt offset, JsVarInt _size) {
+bool jswrap_storage_write(JsVar *name, JsVar *data, JsVar *offsetVar, JsVarInt _size) {
+  JsfFileFlags flags = JSFF_NONE;
+  JsVarInt offset = 0;
+  if (jsvIsObject(offsetVar)) {
+    bool compress = false;
+    jsvConfigObject configs[] = {
+        {"compress", JSV_BOOLEAN, &compress},
+    };
+    if (!jsvReadConfigObject(offsetVar, configs, sizeof(configs) / sizeof(jsvConfigObject)))
+      return false;
+    if (compress) flags |= JSFF_COMPRESSED;
+  } else
+    offset = jsvGetInteger(offsetVar);
   JsVar *d;
   if (jsvIsObject(data)) {
     d = jswrap_json_stringify(data,0,0);
@@ -205,7 +255,7 @@ bool jswrap_storage_write(JsVar *name, JsVar *data, JsVarInt offset, JsVarInt _s
     _size = 0;
   } else
     d = jsvLockAgainSafe(data);
-  bool success = jsfWriteFile(jsfNameFromVar(name), d, JSFF_NONE, offset, _size);
+  bool success = jsfWriteFile(jsfNameFromVar(name), d, flags, offset, _size);
   jsvUnLock(d);
   return success;
 }
@@ -232,7 +282,10 @@ JsVar *jswrap_storage_list() {
   "ifndef" : "SAVE_ON_FLASH",
   "class" : "Storage",
   "name" : "compact",
-  "generate" : "jswrap_storage_compact"
+  "generate" : "jswrap_storage_compact",
+  "params" : [
+    ["background","bool","(optional) If true, compact a page at a time while Espruino is idle rather than all at once"]
+  ]
 }
 The Flash Storage system is journaling. To make the most of the limited
 write cycles of Flash memory, Espruino marks deleted/replaced files as
@@ -240,8 +293,14 @@ garbage and moves on to a fresh part of flash memory. Espruino only
 fully erases those files when it is running low on flash, or when
 `compact` is called.
 
-`compact` may fail if there isn't enough RAM free on the stack to
-use as swap space, however in this case it will not lose data.
+Compaction moves files a page at a time, so only needs one page of
+RAM free on the stack to use as swap space. If there is free space at
+the end of Storage, each page is journaled there first so that
+compaction can resume on the next boot if power is lost.
+
+If `background` is true, `compact` returns immediately and a page is
+compacted each time Espruino is idle. Any other use of `Storage`
+before this is complete will finish compacting first.
 
 **Note:** `compact` rearranges the contents of memory. If code is
 referencing that memory (eg. functions that have their code stored in flash)
@@ -250,8 +309,23 @@ call `eraseFiles` before uploading data that you intend to reference to
 ensure that uploaded files are right at the start of flash and cannot be
 compacted further.
  */
-void jswrap_storage_compact() {
-  jsfCompact();
+void jswrap_storage_compact(bool background) {
+  if (background) jsfCompactBackground();
+  else jsfCompact();
+}
+
+/*JSON{
+  "type" : "idle",
+  "generate" : "jswrap_storage_idle",
+  "ifndef" : "SAVE_ON_FLASH"
+}*/
+bool jswrap_storage_idle() {
+  bool busy = jsfCompactIdle();
+#ifdef JSF_LAZY_LOAD_VARS
+  // load any of the saved image that hasn't been used yet
+  if (jsfLazyLoadIdle()) busy = true;
+#endif
+  return busy;
 }
 
 /*JSON{
@@ -286,6 +360,40 @@ int jswrap_storage_getFree() {
   return (int)jsfGetFreeSpace(0,true);
 }
 
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "Storage",
+  "name" : "getStats",
+  "generate" : "jswrap_storage_getStats",
+  "return" : ["JsVar","An object containing statistics about Storage"]
+}
+Return an object containing information about how Storage is being used:
+
+* `totalBytes` - the size of the Storage area
+* `freeBytes` - the amount of free space (see `getFree`)
+* `fileBytes` - bytes used by files that are still in use
+* `trashBytes` - bytes used by files that have been erased or replaced (reclaimed by `compact`)
+* `indexSize` - how many files can be held in the RAM index of file locations
+* `indexComplete` - whether every file is in the RAM index
+* `indexHits` - file lookups answered from the RAM index without scanning Storage
+* `indexScans` - file lookups that had to scan through Storage
+* `compactions` - how many times Storage has been compacted
+* `writtenBytes` - bytes written to Storage for files
+* `movedBytes` - bytes rewritten while compacting
+* `writeAmplification` - total bytes written to flash for each byte of file data
+* `fragmentedBytes` - space that is neither free nor used by a file (gaps left at the ends of pages)
+* `erases` - the total number of page erases
+* `maxPageErases`/`minPageErases` - the most and least erases of any area of Storage
+* `pageErases` - a `Uint32Array` of erase counts for each area of Storage
+
+Wear statistics are kept in the `.wear` file, which is only updated when
+Storage is compacted or erased - so erases since then are lost if power is lost.
+ */
+JsVar *jswrap_storage_getStats() {
+  return jsfGetStorageStats();
+}
+
 /*JSON{
   "type" : "staticmethod",
   "ifndef" : "SAVE_ON_FLASH",
@@ -669,3 +777,434 @@ void jswrap_storagefile_erase(JsVar *f) {
   jsvObjectSetChildAndUnLock(f,"addr",jsvNewFromInteger(0));
   jsvObjectSetChildAndUnLock(f,"mode",jsvNewFromInteger(0));
 }
+
+// ------------------------------------------------------------------------------------------------
+
+/// Information stored at the start of a log file
+typedef struct {
+  uint16_t recordSize; ///< size of the data in each record
+  uint16_t flags;      ///< STORAGELOG_FLAGS
+  uint32_t pageSize;   ///< size of each page
+  uint32_t pages;      ///< number of pages in the ring
+  uint32_t reserved;
+} StorageLogInfo;
+
+typedef enum {
+  SLF_TIME = 1, ///< each record has a timestamp
+} StorageLogFlags;
+
+/// Empty (erased) record number
+#define STORAGELOG_EMPTY 0xFFFFFFFF
+/// Hidden child of a StorageLog holding the file's data address (so we don't have to look it up for each record)
+#define STORAGELOG_ADDR_NAME JS_HIDDEN_CHAR_STR"adr"
+/// Hidden child of a StorageLog holding jsfGetFileMoves() when the address was cached
+#define STORAGELOG_MOVES_NAME JS_HIDDEN_CHAR_STR"mov"
+
+/// Size of each record in flash - a uint32 record number, optional double timestamp, then data
+static uint32_t storagelog_getSlotSize(StorageLogInfo *info) {
+  uint32_t s = 4u + ((info->flags & SLF_TIME) ? 8u : 0u) + info->recordSize;
+  return (s + (JSF_ALIGNMENT-1)) & (uint32_t)~(JSF_ALIGNMENT-1);
+}
+
+/// Remember where the log file's data is, until files next move
+static void storagelog_setCachedAddr(JsVar *log, uint32_t addr) {
+  jsvObjectSetChildAndUnLock(log,STORAGELOG_ADDR_NAME,jsvNewFromLongInteger(addr));
+  jsvObjectSetChildAndUnLock(log,STORAGELOG_MOVES_NAME,jsvNewFromLongInteger(jsfGetFileMoves()));
+}
+
+/** Find the log file and get its info. Returns the address of the first page of the ring, or 0 */
+static uint32_t storagelog_getAddr(JsVar *log, StorageLogInfo *info) {
+  JsfFileName fname = jsfNameFromVarAndUnLock(jsvObjectGetChild(log,"name",0));
+  JsfFileHeader header;
+  uint32_t addr = (uint32_t)jsvGetLongIntegerAndUnLock(jsvObjectGetChild(log,STORAGELOG_ADDR_NAME,0));
+  uint32_t moves = (uint32_t)jsvGetLongIntegerAndUnLock(jsvObjectGetChild(log,STORAGELOG_MOVES_NAME,0));
+  if (!addr || moves!=jsfGetFileMoves() || !jsfIsFileAt(fname, addr, &header)) {
+    addr = jsfFindFile(fname, &header);
+    storagelog_setCachedAddr(log, addr);
+  }
+  if (!addr || !(jsfGetFileFlags(&header) & JSFF_LOG)) {
+    jsExceptionHere(JSET_ERROR, "Log file not found");
+    return 0;
+  }
+  jshFlashRead(info, addr, sizeof(StorageLogInfo));
+  // the header is at the start of a page, so the ring starts at the next page
+  return addr - (uint32_t)sizeof(JsfFileHeader) + info->pageSize;
+}
+
+/// Get the record number stored at the given slot
+static uint32_t storagelog_getRecordNumber(uint32_t slotAddr) {
+  uint32_t n;
+  jshFlashRead(&n, slotAddr, 4);
+  return n;
+}
+
+/// Work out the next record number by scanning the start of each page, then the latest page
+static uint32_t storagelog_recover(uint32_t ringAddr, StorageLogInfo *info) {
+  uint32_t slotSize = storagelog_getSlotSize(info);
+  uint32_t perPage = info->pageSize / slotSize;
+  uint32_t latestPage = 0, latest = STORAGELOG_EMPTY;
+  for (uint32_t p=0;p<info->pages;p++) {
+    uint32_t n = storagelog_getRecordNumber(ringAddr + p*info->pageSize);
+    if (n!=STORAGELOG_EMPTY && (latest==STORAGELOG_EMPTY || n>latest)) {
+      latest = n;
+      latestPage = p;
+    }
+  }
+  if (latest==STORAGELOG_EMPTY) return 0;
+  for (uint32_t i=1;i<perPage;i++) {
+    uint32_t n = storagelog_getRecordNumber(ringAddr + latestPage*info->pageSize + i*slotSize);
+    if (n!=latest+1) break;
+    latest = n;
+  }
+  return latest+1;
+}
+
+/*JSON{
+  "type" : "staticmethod",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "Storage",
+  "name" : "openLog",
+  "generate" : "jswrap_storage_openLog",
+  "params" : [
+    ["name","JsVar","The filename - max 8 characters (case sensitive)"],
+    ["options","JsVar","An object `{size:bytes_per_record, count:number_of_records, time:bool}`"]
+  ],
+  "return" : ["JsVar","A `StorageLog` object"],
+  "return_object" : "StorageLog"
+}
+Open (or create) a ring log in Storage. This is a file that stores
+fixed-size records, and when it is full the oldest records are
+overwritten. It is designed for fast, sustained logging.
+
+* `size` - the maximum size in bytes of each record's data (default 16)
+* `count` - the minimum number of records the log should hold (default 100)
+* `time` - if true, the time each record was written is also stored (and `StorageLog.find` can be used)
+
+If a log already exists with the same name and options it is opened and
+records are appended after the existing ones, otherwise any existing
+file is erased and a new log is created.
+
+Please see `StorageLog` for more information.
+*/
+JsVar *jswrap_storage_openLog(JsVar *name, JsVar *options) {
+  StorageLogInfo info;
+  memset(&info, 0, sizeof(info));
+  int size = 16, count = 100;
+  bool time = false;
+  jsvConfigObject configs[] = {
+      {"size", JSV_INTEGER, &size},
+      {"count", JSV_INTEGER, &count},
+      {"time", JSV_BOOLEAN, &time}
+  };
+  if (!jsvReadConfigObject(options, configs, sizeof(configs) / sizeof(jsvConfigObject)))
+    return 0;
+  uint32_t pageAddr;
+  if (!jshFlashGetPage(FLASH_SAVED_CODE_START, &pageAddr, &info.pageSize))
+    return 0;
+  info.recordSize = (uint16_t)size;
+  info.flags = time ? SLF_TIME : 0;
+  uint32_t slotSize = storagelog_getSlotSize(&info);
+  if (size<=0 || size>65535 || count<=0 || slotSize>info.pageSize) {
+    jsExceptionHere(JSET_ERROR, "Invalid record size or count");
+    return 0;
+  }
+  uint32_t perPage = info.pageSize / slotSize;
+  // one more page than we need, as a page must be erased before it can be reused
+  info.pages = 1 + ((uint32_t)count + perPage - 1) / perPage;
+  if (info.pages<2) info.pages = 2;
+  // The first page holds the header and StorageLogInfo
+  uint32_t fileSize = info.pageSize - (uint32_t)sizeof(JsfFileHeader) + info.pages*info.pageSize;
+
+  JsVar *n = jsvNewFromStringVar(name,0,8);
+  JsfFileName fname = jsfNameFromVar(n);
+  JsfFileHeader header;
+  uint32_t addr = jsfFindFile(fname, &header);
+  StorageLogInfo existing;
+  if (addr) jshFlashRead(&existing, addr, sizeof(StorageLogInfo));
+  if (!addr || !(jsfGetFileFlags(&header) & JSFF_LOG) ||
+      memcmp(&existing, &info, sizeof(StorageLogInfo)) ||
+      jsfGetFileSize(&header)!=fileSize) {
+    // create a new log
+    JsVar *data = jsvNewStringOfLength(sizeof(StorageLogInfo), (char*)&info);
+    for (int attempt=0;attempt<2;attempt++) {
+      jsfEraseFile(fname);
+      addr = 0;
+      if (!jsfWriteFile(fname, data, JSFF_LOG, 0, (JsVarInt)fileSize)) break;
+      addr = jsfFindFile(fname, &header);
+      // the header must be at the start of a page - if it isn't, compact and try again
+      uint32_t headerAddr = addr - (uint32_t)sizeof(JsfFileHeader), pageLen;
+      if (addr && jshFlashGetPage(headerAddr, &pageAddr, &pageLen) && pageAddr==headerAddr)
+        break;
+      jsfEraseFile(fname);
+      addr = 0;
+      if (!attempt) jsfCompact();
+    }
+    jsvUnLock(data);
+    if (!addr) {
+      if (!jspHasError())
+        jsExceptionHere(JSET_ERROR, "Not enough free space for log");
+      jsvUnLock(n);
+      return 0;
+    }
+  }
+  JsVar *log = jspNewObject(0, "StorageLog");
+  if (!log) {
+    jsvUnLock(n);
+    return 0;
+  }
+  jsvObjectSetChildAndUnLock(log,"name",n);
+  storagelog_setCachedAddr(log, addr);
+  uint32_t ringAddr = addr - (uint32_t)sizeof(JsfFileHeader) + info.pageSize;
+  jsvObjectSetChildAndUnLock(log,"next",jsvNewFromLongInteger(storagelog_recover(ringAddr, &info)));
+  return log;
+}
+
+/*JSON{
+  "type" : "class",
+  "class" : "StorageLog",
+  "ifndef" : "SAVE_ON_FLASH"
+}
+These objects are created from `require("Storage").openLog`
+and allow fixed-size records to be appended to a ring log.
+
+Each record is given a number (starting at 0) when it is appended. When the
+log is full, the oldest page of records is erased to make room for more.
+Appending is constant time (the position of the next record is kept in RAM,
+and is recovered from flash when the log is opened) so logs can be written
+to at a high rate.
+
+```
+var log = require("Storage").openLog("temps", {size:4, count:1000, time:true});
+log.append(new Float32Array([E.getTemperature()]).buffer);
+// later
+var info = log.getInfo(); // {first, next, ...}
+var n = log.find(getTime()-3600); // first record in the last hour
+new Float32Array(E.toArrayBuffer(log.read(n)))[0]
+```
+*/
+
+/*JSON{
+  "type" : "method",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "StorageLog",
+  "name" : "append",
+  "generate" : "jswrap_storagelog_append",
+  "params" : [
+    ["data","JsVar","The data to write (a String or ArrayBuffer) - this will be zero-padded (or truncated) to the record size"],
+    ["time","JsVar","(optional) The time of this record in seconds (if the log stores times). Defaults to `getTime()`"]
+  ],
+  "return" : ["JsVar","The record number of this record"]
+}
+Append a record to the log
+*/
+JsVar *jswrap_storagelog_append(JsVar *log, JsVar *data, JsVar *time) {
+  StorageLogInfo info;
+  uint32_t ringAddr = storagelog_getAddr(log, &info);
+  if (!ringAddr) return 0;
+  uint32_t slotSize = storagelog_getSlotSize(&info);
+  uint32_t perPage = info.pageSize / slotSize;
+  uint32_t next = (uint32_t)jsvGetLongIntegerAndUnLock(jsvObjectGetChild(log,"next",0));
+  if (next==STORAGELOG_EMPTY) {
+    jsExceptionHere(JSET_ERROR, "Log is full");
+    return 0;
+  }
+  JSV_GET_AS_CHAR_ARRAY(dPtr, dLen, data);
+  if (!dPtr) return 0;
+  if (dLen>info.recordSize) dLen = info.recordSize;
+  // record number and time
+  unsigned char head[12];
+  uint32_t headLen = 4;
+  memcpy(head, &next, 4);
+  if (info.flags & SLF_TIME) {
+    JsVarFloat t = jsvIsUndefined(time) ?
+        ((JsVarFloat)jshGetSystemTime() / (JsVarFloat)jshGetTimeFromMilliseconds(1000)) :
+        jsvGetFloat(time);
+    memcpy(&head[4], &t, 8);
+    headLen += 8;
+  }
+  uint32_t slot = next % (perPage*info.pages);
+  uint32_t slotAddr = ringAddr + (slot/perPage)*info.pageSize + (slot%perPage)*slotSize;
+  // starting a new page? erase it first (this loses the oldest records)
+  if ((slot%perPage)==0 && storagelog_getRecordNumber(slotAddr)!=STORAGELOG_EMPTY)
+    jsfErasePage(slotAddr);
+  /* Records can be up to a page, which is too much for the stack, so write
+   * the slot a chunk at a time. Start at the end so that the record number
+   * (which marks the record as written) goes in last. */
+  unsigned char buf[64];
+  uint32_t offset = slotSize;
+  while (offset) {
+    uint32_t i, l = offset % (uint32_t)sizeof(buf);
+    if (!l) l = (uint32_t)sizeof(buf);
+    offset -= l;
+    for (i=0;i<l;i++) {
+      uint32_t p = offset+i;
+      if (p<headLen) buf[i] = head[p];
+      else if (p-headLen<dLen) buf[i] = (unsigned char)dPtr[p-headLen];
+      else buf[i] = 0; // pad the data to the record size
+    }
+    jshFlashWrite(buf, slotAddr+offset, l);
+  }
+  jsfNoteWrite(slotSize);
+  jsvObjectSetChildAndUnLock(log,"next",jsvNewFromLongInteger(next+1));
+  return jsvNewFromLongInteger(next);
+}
+
+/// Get the address of a record, or 0 if it isn't in the log
+static uint32_t storagelog_getRecordAddr(JsVar *log, StorageLogInfo *info, uint32_t n) {
+  uint32_t ringAddr = storagelog_getAddr(log, info);
+  if (!ringAddr) return 0;
+  uint32_t slotSize = storagelog_getSlotSize(info);
+  uint32_t perPage = info->pageSize / slotSize;
+  uint32_t slot = n % (perPage*info->pages);
+  uint32_t addr = ringAddr + (slot/perPage)*info->pageSize + (slot%perPage)*slotSize;
+  if (storagelog_getRecordNumber(addr)!=n) return 0;
+  return addr;
+}
+
+/// Get the number of the first (oldest) record in the log
+static uint32_t storagelog_getFirst(StorageLogInfo *info, uint32_t next) {
+  if (!next) return 0;
+  uint32_t perPage = info->pageSize / storagelog_getSlotSize(info);
+  uint32_t last = next-1;
+  uint32_t lastPageStart = last - (last%perPage);
+  uint32_t others = (info->pages-1)*perPage;
+  return (lastPageStart>others) ? lastPageStart-others : 0;
+}
+
+/*JSON{
+  "type" : "method",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "StorageLog",
+  "name" : "read",
+  "generate" : "jswrap_storagelog_read",
+  "params" : [
+    ["n","int","The record number"]
+  ],
+  "return" : ["JsVar","The record's data as a String, or undefined if the record isn't in the log"]
+}
+Read a record from the log
+*/
+JsVar *jswrap_storagelog_read(JsVar *log, JsVarInt n) {
+  StorageLogInfo info;
+  if (n<0) return 0;
+  uint32_t addr = storagelog_getRecordAddr(log, &info, (uint32_t)n);
+  if (!addr) return 0;
+  addr += 4u + ((info.flags & SLF_TIME) ? 8u : 0u);
+  JsVar *v = jsvNewStringOfLength(info.recordSize, NULL);
+  if (!v) return 0;
+  JsvStringIterator it;
+  jsvStringIteratorNew(&it, v, 0);
+  while (jsvStringIteratorHasChar(&it)) {
+    unsigned char *data;
+    unsigned int l = 0;
+    jsvStringIteratorGetPtrAndNext(&it, &data, &l);
+    jshFlashRead(data, addr, l);
+    addr += l;
+  }
+  jsvStringIteratorFree(&it);
+  return v;
+}
+
+/// Get the time of a record (or NaN)
+static JsVarFloat storagelog_getTime(JsVar *log, StorageLogInfo *info, uint32_t n) {
+  uint32_t addr = storagelog_getRecordAddr(log, info, n);
+  if (!addr || !(info->flags & SLF_TIME)) return NAN;
+  JsVarFloat t;
+  jshFlashRead(&t, addr+4, 8);
+  return t;
+}
+
+/*JSON{
+  "type" : "method",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "StorageLog",
+  "name" : "getTime",
+  "generate" : "jswrap_storagelog_getTime",
+  "params" : [
+    ["n","int","The record number"]
+  ],
+  "return" : ["float","The time the record was written, or NaN if the record isn't in the log (or the log doesn't store times)"]
+}
+Get the time of a record in the log
+*/
+JsVarFloat jswrap_storagelog_getTime(JsVar *log, JsVarInt n) {
+  StorageLogInfo info;
+  if (n<0) return NAN;
+  return storagelog_getTime(log, &info, (uint32_t)n);
+}
+
+/*JSON{
+  "type" : "method",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "StorageLog",
+  "name" : "find",
+  "generate" : "jswrap_storagelog_find",
+  "params" : [
+    ["time","float","The time to search for"]
+  ],
+  "return" : ["int","The number of the first record written at or after `time`, or -1 if there are none"]
+}
+Search for a record by time (for logs opened with `time:true`). Records
+are assumed to have been written in time order, so this is a binary search.
+*/
+JsVarInt jswrap_storagelog_find(JsVar *log, JsVarFloat time) {
+  StorageLogInfo info;
+  if (!storagelog_getAddr(log, &info)) return -1;
+  uint32_t next = (uint32_t)jsvGetLongIntegerAndUnLock(jsvObjectGetChild(log,"next",0));
+  uint32_t lo = storagelog_getFirst(&info, next), hi = next;
+  while (lo<hi) {
+    uint32_t mid = lo + (hi-lo)/2;
+    if (storagelog_getTime(log, &info, mid) < time) lo = mid+1;
+    else hi = mid;
+  }
+  return (lo<next) ? (JsVarInt)lo : -1;
+}
+
+/*JSON{
+  "type" : "method",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "StorageLog",
+  "name" : "getInfo",
+  "generate" : "jswrap_storagelog_getInfo",
+  "return" : ["JsVar","An object `{first, next, count, capacity, size, time}`"]
+}
+Get information about the log:
+
+* `first` - the number of the oldest record in the log
+* `next` - the number the next record will get
+* `count` - the number of records in the log
+* `capacity` - the most records the log can hold (just before the oldest page is erased)
+* `size` - the size of each record's data in bytes
+* `time` - whether records have timestamps
+*/
+JsVar *jswrap_storagelog_getInfo(JsVar *log) {
+  StorageLogInfo info;
+  if (!storagelog_getAddr(log, &info)) return 0;
+  uint32_t next = (uint32_t)jsvGetLongIntegerAndUnLock(jsvObjectGetChild(log,"next",0));
+  uint32_t first = storagelog_getFirst(&info, next);
+  uint32_t perPage = info.pageSize / storagelog_getSlotSize(&info);
+  JsVar *o = jsvNewObject();
+  if (!o) return 0;
+  jsvObjectSetChildAndUnLock(o, "first", jsvNewFromLongInteger(first));
+  jsvObjectSetChildAndUnLock(o, "next", jsvNewFromLongInteger(next));
+  jsvObjectSetChildAndUnLock(o, "count", jsvNewFromLongInteger(next-first));
+  jsvObjectSetChildAndUnLock(o, "capacity", jsvNewFromLongInteger(info.pages*perPage));
+  jsvObjectSetChildAndUnLock(o, "size", jsvNewFromInteger(info.recordSize));
+  jsvObjectSetChildAndUnLock(o, "time", jsvNewFromBool(info.flags & SLF_TIME));
+  return o;
+}
+
+/*JSON{
+  "type" : "method",
+  "ifndef" : "SAVE_ON_FLASH",
+  "class" : "StorageLog",
+  "name" : "erase",
+  "generate" : "jswrap_storagelog_erase"
+}
+Erase this log (the `StorageLog` can't be used afterwards)
+*/
+void jswrap_storagelog_erase(JsVar *log) {
+  jsfEraseFile(jsfNameFromVarAndUnLock(jsvObjectGetChild(log,"name",0)));
+  storagelog_setCachedAddr(log, 0);
+  jsvObjectSetChildAndUnLock(log,"next",jsvNewFromInteger(0));
+}
@@ -19,15 +19,26 @@ void jswrap_storage_eraseAll();
 JsVar *jswrap_storage_read(JsVar *name, int offset, int length);
 JsVar *jswrap_storage_readJSON(JsVar *name);
 JsVar *jswrap_storage_readArrayBuffer(JsVar *name);
-bool jswrap_storage_write(JsVar *name, JsVar *data, JsVarInt offset, JsVarInt size);
+JsVar *jswrap_storage_hash(JsVar *name);
+bool jswrap_storage_write(JsVar *name, JsVar *data, JsVar *offset, JsVarInt size);
 void jswrap_storage_erase(JsVar *name);
-void jswrap_storage_compact();
+void jswrap_storage_compact(bool background);
+bool jswrap_storage_idle();
 JsVar *jswrap_storage_list();
 void jswrap_storage_debug();
 int jswrap_storage_getFree();
+JsVar *jswrap_storage_getStats();
 
 JsVar *jswrap_storage_open(JsVar *name, JsVar *mode);
 JsVar *jswrap_storagefile_read(JsVar *f, int len);
 JsVar *jswrap_storagefile_readLine(JsVar *f);
 void jswrap_storagefile_write(JsVar *parent, JsVar *_data);
 void jswrap_storagefile_erase(JsVar *f);
+
+JsVar *jswrap_storage_openLog(JsVar *name, JsVar *options);
+JsVar *jswrap_storagelog_append(JsVar *log, JsVar *data, JsVar *time);
+JsVar *jswrap_storagelog_read(JsVar *log, JsVarInt n);
+JsVarFloat jswrap_storagelog_getTime(JsVar *log, JsVarInt n);
+JsVarInt jswrap_storagelog_find(JsVar *log, JsVarFloat time);
+JsVar *jswrap_storagelog_getInfo(JsVar *log);
+void jswrap_storagelog_erase(JsVar *log);
@@ -13,6 +13,7 @@
  */
  #include <stdlib.h>
  #include <string.h>
+ #include <errno.h>
  #include <stdio.h>
  #include <unistd.h>
  #include <sys/time.h>
@@ -20,9 +21,17 @@
  #include <conio.h>
 #else//!__MINGW32__
  #include <sys/select.h>
+ #include <sys/mman.h>
  #include <termios.h>
  #include <fcntl.h>
 #endif//__MINGW32__
+#ifdef __linux__
+ #include <poll.h>
+ #include <sys/epoll.h>
+ #include <sys/eventfd.h>
+ #include <sys/timerfd.h>
+ #define USE_EPOLL // jshSleep and the input thread block on fds rather than sleeping for fixed times
+#endif
  #include <signal.h>
  #include <inttypes.h>
 
@@ -38,6 +47,10 @@
 #define FAKE_FLASH_BLOCKSIZE FLASH_PAGE_SIZE
 #define FAKE_FLASH_BLOCKS    (FLASH_TOTAL/FLASH_PAGE_SIZE)
 
+#ifndef __MINGW32__
+#define FAKE_FLASH_MMAP // memory-map the fake flash file rather than using file IO for each access
+#endif
+
 #ifdef DEBUG
 #define FAKE_FLASH_DBG(...) jsiConsolePrintf(__VA_ARGS__)
 #else
@@ -119,22 +132,22 @@ JsVarInt sysfs_read_int(const char *path) {
 #error EXTI_COUNT needs to be 16 or above for WiringPi
 #endif
 
-void irqEXTI0() { jshPushIOWatchEvent(EV_EXTI0); }
-void irqEXTI1() { jshPushIOWatchEvent(EV_EXTI0+1); }
-void irqEXTI2() { jshPushIOWatchEvent(EV_EXTI0+2); }
-void irqEXTI3() { jshPushIOWatchEvent(EV_EXTI0+3); }
-void irqEXTI4() { jshPushIOWatchEvent(EV_EXTI0+4); }
-void irqEXTI5() { jshPushIOWatchEvent(EV_EXTI0+5); }
-void irqEXTI6() { jshPushIOWatchEvent(EV_EXTI0+6); }
-void irqEXTI7() { jshPushIOWatchEvent(EV_EXTI0+7); }
-void irqEXTI8() { jshPushIOWatchEvent(EV_EXTI0+8); }
-void irqEXTI9() { jshPushIOWatchEvent(EV_EXTI0+9); }
-void irqEXTI10() { jshPushIOWatchEvent(EV_EXTI0+10); }
-void irqEXTI11() { jshPushIOWatchEvent(EV_EXTI0+11); }
-void irqEXTI12() { jshPushIOWatchEvent(EV_EXTI0+12); }
-void irqEXTI13() { jshPushIOWatchEvent(EV_EXTI0+13); }
-void irqEXTI14() { jshPushIOWatchEvent(EV_EXTI0+14); }
-void irqEXTI15() { jshPushIOWatchEvent(EV_EXTI0+15); }
+void irqEXTI0() { jshPushIOWatchEvent(EV_EXTI0); jshSleepWake(); }
+void irqEXTI1() { jshPushIOWatchEvent(EV_EXTI0+1); jshSleepWake(); }
+void irqEXTI2() { jshPushIOWatchEvent(EV_EXTI0+2); jshSleepWake(); }
+void irqEXTI3() { jshPushIOWatchEvent(EV_EXTI0+3); jshSleepWake(); }
+void irqEXTI4() { jshPushIOWatchEvent(EV_EXTI0+4); jshSleepWake(); }
+void irqEXTI5() { jshPushIOWatchEvent(EV_EXTI0+5); jshSleepWake(); }
+void irqEXTI6() { jshPushIOWatchEvent(EV_EXTI0+6); jshSleepWake(); }
+void irqEXTI7() { jshPushIOWatchEvent(EV_EXTI0+7); jshSleepWake(); }
+void irqEXTI8() { jshPushIOWatchEvent(EV_EXTI0+8); jshSleepWake(); }
+void irqEXTI9() { jshPushIOWatchEvent(EV_EXTI0+9); jshSleepWake(); }
+void irqEXTI10() { jshPushIOWatchEvent(EV_EXTI0+10); jshSleepWake(); }
+void irqEXTI11() { jshPushIOWatchEvent(EV_EXTI0+11); jshSleepWake(); }
+void irqEXTI12() { jshPushIOWatchEvent(EV_EXTI0+12); jshSleepWake(); }
+void irqEXTI13() { jshPushIOWatchEvent(EV_EXTI0+13); jshSleepWake(); }
+void irqEXTI14() { jshPushIOWatchEvent(EV_EXTI0+14); jshSleepWake(); }
+void irqEXTI15() { jshPushIOWatchEvent(EV_EXTI0+15); jshSleepWake(); }
 void irqEXTIDoNothing() { }
 
 void (*irqEXTIs[16])(void) = {
@@ -243,12 +256,15 @@ int kbhit()
     return select(STDIN_FILENO+1, &fds, NULL, NULL, &tv);
 }
 
+static bool stdinAtEOF = false; ///< stdin has been closed, so don't wait for data on it
+
 int getch()
 {
     int r;
     unsigned char c;
-    if ((r = (int)read(STDIN_FILENO, &c, sizeof(c))) < 0) {
-        return r;
+    if ((r = (int)read(STDIN_FILENO, &c, sizeof(c))) <= 0) {
+        if (r==0) stdinAtEOF = true;
+        return -1;
     } else {
         return c;
     }
@@ -258,47 +274,243 @@ int getch()
 pthread_t inputThread;
 bool isInitialised;
 
+#ifdef USE_EPOLL
+static int sleepEpoll = -1;  ///< epoll set that jshSleep waits on
+static int sleepWakeFd = -1; ///< eventfd in sleepEpoll, so other threads can wake jshSleep
+static int sleepTimerFd = -1; ///< timerfd in sleepEpoll, so jshSleep wakes precisely at the next timer
+static int sleepWatches = 0; ///< how many fds (apart from sleepWakeFd/sleepTimerFd) are in sleepEpoll
+static bool sleepIndefinite = false; ///< may we sleep with no timer or watch pending? See jshSleepAllowIndefinite
+
+void jshSleepWatchFd(int fd, bool watch) {
+  if (sleepEpoll<0) return;
+  struct epoll_event ev;
+  memset(&ev, 0, sizeof(ev));
+  ev.events = EPOLLIN;
+  ev.data.fd = fd;
+  if (epoll_ctl(sleepEpoll, watch ? EPOLL_CTL_ADD : EPOLL_CTL_DEL, fd, &ev)==0 && fd!=sleepWakeFd && fd!=sleepTimerFd)
+    sleepWatches += watch ? 1 : -1;
+}
+
+bool jshSleepHasWatches() {
+  return sleepWatches>0;
+}
+
+void jshSleepAllowIndefinite(bool allow) {
+  sleepIndefinite = allow;
+}
+
+void jshSleepWake() {
+  if (sleepWakeFd<0) return;
+  uint64_t one = 1;
+  /* This only fails (EAGAIN) if the counter would overflow, in which case
+   * sleepWakeFd is already readable and jshSleep will wake anyway */
+  if (write(sleepWakeFd, &one, sizeof(one))<0) return;
+}
+#else
+void jshSleepWatchFd(int fd, bool watch) {
+}
+
+void jshSleepWake() {
+}
+
+bool jshSleepHasWatches() {
+  return false;
+}
+
+void jshSleepAllowIndefinite(bool allow) {
+}
+#endif
+
+#if defined(USE_EPOLL) && defined(SYSFS_GPIO_DIR)
+#define GPIO_FD_CLOSED -1 ///< gpioValueFd: we're not watching this pin
+#define GPIO_FD_POLL   -2 ///< gpioValueFd: no edge interrupts for this pin, so we must poll it
+static int gpioValueFd[JSH_PIN_COUNT]; ///< open 'value' files of watched pins (only used by the input thread)
+
+/// Open/close the 'value' files of watched pins so we can wait for edges on them
+static void jshInputThreadUpdateGPIO() {
+  Pin pin;
+  for (pin=0;pin<JSH_PIN_COUNT;pin++) {
+    if (gpioShouldWatch[pin] && gpioValueFd[pin]==GPIO_FD_CLOSED) {
+      char path[64] = SYSFS_GPIO_DIR"/gpio";
+      itostr(pin, &path[strlen(path)], 10);
+      strcat(&path[strlen(path)], "/edge");
+      int f = open(path, O_WRONLY);
+      bool hasEdge = f>=0 && write(f, "both", 4)==4;
+      if (f>=0) close(f);
+      strcpy(&path[strlen(path)-4], "value");
+      f = hasEdge ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+      gpioValueFd[pin] = (f>=0) ? f : GPIO_FD_POLL;
+    } else if (!gpioShouldWatch[pin] && gpioValueFd[pin]!=GPIO_FD_CLOSED) {
+      if (gpioValueFd[pin]>=0) close(gpioValueFd[pin]);
+      gpioValueFd[pin] = GPIO_FD_CLOSED;
+    }
+  }
+}
+#endif
+
+static volatile IOEventFlags txBlockedDevice = EV_NONE; ///< device whose output is full, so its data waits in txBuffer
+
+#ifdef USE_EPOLL
+static int inputWakeFd = -1; ///< eventfd that wakes the input thread when it has work to do
+
+/// Wake the input thread up (eg. because it has new fds to wait on)
+static void jshInputThreadWake() {
+  if (inputWakeFd<0) return;
+  uint64_t one = 1;
+  // As in jshSleepWake, a failed write means a wake is already pending
+  if (write(inputWakeFd, &one, sizeof(one))<0) return;
+}
+
+/** Block until the input thread has something to do: data on the console or
+ * an open device, an edge on a watched pin, or a wake from another thread. */
+static void jshInputThreadWait() {
+  struct pollfd fds[EV_DEVICE_MAX+JSH_PIN_COUNT+3];
+  int nfds = 0, i;
+  int timeout = -1;
+  if (execInfo.execute & EXEC_CTRL_C_MASK)
+    timeout = 50; // Ctrl-C is escalated on each iteration
+  if (inputWakeFd>=0) {
+    fds[nfds].fd = inputWakeFd;
+    fds[nfds++].events = POLLIN;
+  }
+  // only wait for data on devices with space in the IO buffer, otherwise wait for the main thread to make space
+  if (!stdinAtEOF) {
+    if (jshGetEventSpaceForDevice(EV_USBSERIAL)) {
+      fds[nfds].fd = STDIN_FILENO;
+      fds[nfds++].events = POLLIN;
+    } else
+      timeout = 1;
+  }
+  for (i=0;i<=EV_DEVICE_MAX;i++) {
+    if (ioDevices[i]) {
+      short events = 0;
+      if (jshGetEventSpaceForDevice(i))
+        events |= POLLIN;
+      else
+        timeout = 1;
+      if (i==txBlockedDevice)
+        events |= POLLOUT; // so we can send what's left in txBuffer
+      if (events) {
+        fds[nfds].fd = ioDevices[i];
+        fds[nfds++].events = events;
+      }
+    }
+  }
+#ifdef SYSFS_GPIO_DIR
+  jshInputThreadUpdateGPIO();
+  Pin pin;
+  for (pin=0;pin<JSH_PIN_COUNT;pin++) {
+    if (gpioValueFd[pin]>=0) {
+      fds[nfds].fd = gpioValueFd[pin];
+      fds[nfds++].events = POLLPRI | POLLERR;
+    } else if (gpioValueFd[pin]==GPIO_FD_POLL)
+      timeout = 1;
+  }
+#endif
+  if (poll(fds, (nfds_t)nfds, timeout) <= 0) return;
+  for (i=0;i<nfds;i++) {
+    if (!fds[i].revents) continue;
+    if (fds[i].fd==inputWakeFd) {
+      // just reset the counter - if it's already 0 (EAGAIN) there's nothing to do
+      uint64_t count;
+      if (read(inputWakeFd, &count, sizeof(count))<0) continue;
+    }
+#ifdef SYSFS_GPIO_DIR
+    else if (fds[i].events & POLLPRI) {
+      /* a GPIO edge stays signalled until the value file is re-read. We
+       * don't use what we read (jshInputThread reads the pin itself), but
+       * if it fails we'd spin on the edge forever, so poll the pin instead */
+      char buf[4];
+      lseek(fds[i].fd, 0, SEEK_SET);
+      if (read(fds[i].fd, buf, sizeof(buf))<0) {
+        for (pin=0;pin<JSH_PIN_COUNT;pin++)
+          if (gpioValueFd[pin]==fds[i].fd) {
+            close(gpioValueFd[pin]);
+            gpioValueFd[pin] = GPIO_FD_POLL;
+          }
+      }
+    }
+#endif
+  }
+}
+#else
+static void jshInputThreadWake() {
+}
+#endif
+
+static pthread_mutex_t txMutex = PTHREAD_MUTEX_INITIALIZER; ///< only one thread may take data from txBuffer at a time
+static JsSysTime txLastSent; ///< when jshTransmitQueued last ran, so jshUSARTKick can let bursts build up
+
+/** Write any data queued for our devices, a run of characters at a time.
+ * Devices are non-blocking, so anything that can't be written straight away
+ * is left in txBuffer and we try again later - when jshInputThreadWait sees
+ * the device is writable, or from jshIdle/jshBusyIdle.
+ * Called from the main thread (jshUSARTKick/jshIdle) and the input thread */
+static void jshTransmitQueued() {
+  pthread_mutex_lock(&txMutex);
+  txBlockedDevice = EV_NONE;
+  IOEventFlags device = jshGetDeviceToTransmit();
+  while (device != EV_NONE) {
+    unsigned char buf[TXBUFFERMASK+1];
+    unsigned int len = jshPeekCharsToTransmit(device, buf, sizeof(buf));
+    if (!len) break;
+    ssize_t n = len;
+    if (ioDevices[device]) { // with no device the data is just dropped
+      do {
+        n = write(ioDevices[device], buf, len);
+      } while (n<0 && errno==EINTR);
+      if (n<0) // full (EAGAIN), or an error - drop the data rather than trying forever
+        n = (errno==EAGAIN) ? 0 : len;
+    }
+    unsigned int i;
+    for (i=0;i<(unsigned int)n;i++)
+      jshGetCharToTransmit(device);
+    if (n<(ssize_t)len) { // device is full
+      txBlockedDevice = device;
+      break;
+    }
+    device = jshGetDeviceToTransmit();
+  }
+  txLastSent = jshGetSystemTime();
+  pthread_mutex_unlock(&txMutex);
+}
+
 void jshInputThread() {
   while (isInitialised) {
     bool shortSleep = false;
+    int eventsUsed = jshGetEventsUsed();
     /* Handle the delayed Ctrl-C -> interrupt behaviour (see description by EXEC_CTRL_C's definition)  */
     if (execInfo.execute & EXEC_CTRL_C_WAIT)
       execInfo.execute = (execInfo.execute & ~EXEC_CTRL_C_WAIT) | EXEC_INTERRUPTED;
     if (execInfo.execute & EXEC_CTRL_C)
       execInfo.execute = (execInfo.execute & ~EXEC_CTRL_C) | EXEC_CTRL_C_WAIT;
     // Read from the console if we have space
-    while (kbhit() && (jshGetEventsUsed()<IOBUFFERMASK/2)) {
+    while (kbhit() && jshGetEventSpaceForDevice(EV_USBSERIAL)) {
       int ch = getch();
       if (ch<0) break;
       jshPushIOCharEvent(EV_USBSERIAL, (char)ch);
     }
-    // Read from any open devices - if we have space
-    if (jshGetEventsUsed() < IOBUFFERMASK/2) {
-      int i;
-      for (i=0;i<=EV_DEVICE_MAX;i++) {
-        if (ioDevices[i]) {
-          char buf[32];
-          // read can return -1 (EAGAIN) because O_NONBLOCK is set
-          int bytes = (int)read(ioDevices[i], buf, sizeof(buf));
-          if (bytes>0) {
-            //int j; for (j=0;j<bytes;j++) printf("]] '%c'\r\n", buf[j]);
-            jshPushIOCharEvents(i, buf, (unsigned int)bytes);
-            shortSleep = true;
-          }
+    // Read from any open devices - if they have space
+    int i;
+    for (i=0;i<=EV_DEVICE_MAX;i++) {
+      int space = ioDevices[i] ? jshGetEventSpaceForDevice(i) : 0;
+      if (space) {
+        char buf[32];
+        // the first char may need an event to itself (see jshPushIOCharEventAppend)
+        size_t len = sizeof(buf);
+        if (len > 1+(size_t)(space-1)*IOEVENT_MAXCHARS) len = 1+(size_t)(space-1)*IOEVENT_MAXCHARS;
+        // read can return -1 (EAGAIN) because O_NONBLOCK is set
+        int bytes = (int)read(ioDevices[i], buf, len);
+        if (bytes>0) {
+          //int j; for (j=0;j<bytes;j++) printf("]] '%c'\r\n", buf[j]);
+          jshPushIOCharEvents(i, buf, (unsigned int)bytes);
+          shortSleep = true;
         }
       }
     }
-    // Write any data we have
-    IOEventFlags device = jshGetDeviceToTransmit();
-    while (device != EV_NONE) {
-      char ch = (char)jshGetCharToTransmit(device);
-      //printf("[[ '%c'\r\n", ch);
-      if (ioDevices[device]) {
-        write(ioDevices[device], &ch, 1);
-        shortSleep = true;
-      }
-      device = jshGetDeviceToTransmit();
-    }
+    // Write any data we have (usually already done by the main thread)
+    if (jshHasTransmitData())
+      jshTransmitQueued();
 
 
 #ifdef SYSFS_GPIO_DIR
@@ -313,9 +525,25 @@ void jshInputThread() {
         }
       }
 #endif
+    // If we pushed events, make sure the main thread isn't sleeping
+    if (jshGetEventsUsed() != eventsUsed)
+      jshSleepWake();
 
+#ifdef USE_EPOLL
+    NOT_USED(shortSleep); // poll tells us when there's more data
+    jshInputThreadWait();
+#else
     jshDelayMicroseconds(shortSleep ? 1000 : 50000);
+#endif
   }
+#if defined(USE_EPOLL) && defined(SYSFS_GPIO_DIR)
+  Pin pin;
+  for (pin=0;pin<JSH_PIN_COUNT;pin++)
+    if (gpioValueFd[pin]>=0) {
+      close(gpioValueFd[pin]);
+      gpioValueFd[pin] = GPIO_FD_CLOSED;
+    }
+#endif
 }
 
 
@@ -362,6 +590,24 @@ void jshInit() {
   }
 #endif
 
+#ifdef USE_EPOLL
+  if (sleepEpoll<0) {
+    sleepEpoll = epoll_create1(EPOLL_CLOEXEC);
+    sleepWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    sleepTimerFd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (sleepEpoll>=0 && sleepWakeFd>=0)
+      jshSleepWatchFd(sleepWakeFd, true);
+    if (sleepEpoll>=0 && sleepTimerFd>=0)
+      jshSleepWatchFd(sleepTimerFd, true);
+  }
+  if (inputWakeFd<0)
+    inputWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#ifdef SYSFS_GPIO_DIR
+  for (i=0;i<JSH_PIN_COUNT;i++)
+    gpioValueFd[i] = GPIO_FD_CLOSED;
+#endif
+#endif
+
   isInitialised = true;
   int err = pthread_create(&inputThread, NULL, &jshInputThread, NULL);
   if (err != 0)
@@ -377,6 +623,7 @@ void jshKill() {
 
   // Request that the input thread finishes
   isInitialised = false;
+  jshInputThreadWake();
   // wait for thread to finish
   pthread_join(inputThread, NULL);
 
@@ -396,7 +643,21 @@ void jshKill() {
 }
 
 void jshIdle() {
-  // all done in the thread now...
+  // IO is done in the input thread, apart from sending anything jshUSARTKick left
+  if (jshHasTransmitData())
+    jshTransmitQueued();
+}
+
+void jshBusyIdle() {
+  // jshTransmit is waiting for space in the transmit buffer
+  IOEventFlags device = txBlockedDevice;
+  if (device!=EV_NONE && ioDevices[device]) {
+    // don't spin while the device is full - give it a moment to drain
+    struct pollfd pfd = { ioDevices[device], POLLOUT, 0 };
+    poll(&pfd, 1, 10);
+  }
+  if (jshHasTransmitData())
+    jshTransmitQueued();
 }
 
 // ----------------------------------------------------------------------------
@@ -612,6 +873,7 @@ IOEventFlags jshPinWatch(Pin pin, bool shouldWatch) {
 #ifdef SYSFS_GPIO_DIR
         gpioShouldWatch[pin] = true;
         gpioLastState[pin] = jshPinGetValue(pin);
+        jshInputThreadWake(); // so it starts waiting for edges on this pin
 #endif
 #ifdef USE_WIRINGPI
         wiringPiISR(pin, INT_EDGE_BOTH, irqEXTIs[exti-EV_EXTI0]);
@@ -623,6 +885,7 @@ IOEventFlags jshPinWatch(Pin pin, bool shouldWatch) {
       gpioEventFlags[pin] = 0;
 #ifdef SYSFS_GPIO_DIR
       gpioShouldWatch[pin] = false;
+      jshInputThreadWake();
 #endif
 #ifdef USE_WIRINGPI
       wiringPiISR(pin, INT_EDGE_BOTH, irqEXTIDoNothing);
@@ -734,13 +997,20 @@ void jshUSARTSetup(IOEventFlags device, JshUSARTInfo *inf) {
   } else {
     jsError("No path defined for device");
   }
+  jshInputThreadWake(); // so it waits for data on the new fd
 }
 
 /** Kick a device into action (if required). For instance we may need
  * to set up interrupts */
 void jshUSARTKick(IOEventFlags device) {
   assert(DEVICE_IS_USART(device) || DEVICE_IS_SPI(device));
-  // all done by the idle loop
+  /* Write from this thread rather than handing over to the input thread,
+   * which would leave the main thread spinning (it won't sleep with data
+   * waiting to be sent) until the scheduler got round to running it.
+   * If we only just sent something, let the data build up so it goes out
+   * with one write() - jshIdle, or jshBusyIdle if the buffer fills, sends it */
+  if (jshGetSystemTime() > txLastSent+jshGetTimeFromMilliseconds(1))
+    jshTransmitQueued();
 }
 
 void jshSPISetup(IOEventFlags device, JshSPIInfo *inf) {
@@ -757,6 +1027,7 @@ void jshSPISetup(IOEventFlags device, JshSPIInfo *inf) {
    } else {
      jsError("No path defined for device");
    }
+   jshInputThreadWake(); // so it waits for data on the new fd
 }
 
 /** Send data through the given SPI device (if data>=0), and return the result
@@ -798,16 +1069,43 @@ void jshI2CRead(IOEventFlags device, unsigned char address, int nBytes, unsigned
 
 /// Enter simple sleep mode (can be woken up by interrupts). Returns true on success
 bool jshSleep(JsSysTime timeUntilWake) {
+  JsVarFloat usecfloat = jshGetMillisecondsFromTime(timeUntilWake)*1000;
+  unsigned int usecs = (usecfloat < 0xFFFFFFFF) ? (unsigned int)usecfloat : 0xFFFFFFFF;
+#ifdef USE_EPOLL
+  if (sleepEpoll>=0 && sleepWakeFd>=0 && sleepTimerFd>=0) {
+    /* The input thread wakes us with sleepWakeFd when it pushes events (it
+     * waits for GPIO edges itself), anything else (eg. network sockets) adds
+     * its fd with jshSleepWatchFd, and sleepTimerFd fires at the next timer -
+     * so we can sleep right up until there is something to do */
+    if (usecs == 0) return true;
+    if (usecs == 0xFFFFFFFF && !sleepIndefinite && !sleepWatches)
+      return true; // nothing could wake us - a script's main loop is about to exit
+    struct itimerspec when;
+    memset(&when, 0, sizeof(when));
+    if (usecs != 0xFFFFFFFF) {
+      when.it_value.tv_sec = usecs / 1000000;
+      when.it_value.tv_nsec = (long)(usecs % 1000000) * 1000;
+    } // else leave it disarmed
+    timerfd_settime(sleepTimerFd, 0, &when, NULL);
+    struct epoll_event events[8];
+    int n = epoll_wait(sleepEpoll, events, 8, -1);
+    for (int i=0;i<n;i++) {
+      if (events[i].data.fd == sleepWakeFd || events[i].data.fd == sleepTimerFd) {
+        // reset the counter - EAGAIN just means it was already 0
+        uint64_t count;
+        if (read(events[i].data.fd, &count, sizeof(count))<0) continue;
+      }
+    }
+    return true;
+  }
+#endif
   bool hasWatches = false;
 #ifdef SYSFS_GPIO_DIR
   Pin pin;
   for (pin=0;pin<JSH_PIN_COUNT;pin++)
     if (gpioShouldWatch[pin]) hasWatches = true;
 #endif
- 
-  JsVarFloat usecfloat = jshGetMillisecondsFromTime(timeUntilWake)*1000;
-  unsigned int usecs = (usecfloat < 0xFFFFFFFF) ? (unsigned int)usecfloat : 0xFFFFFFFF;
-  if (hasWatches && usecs>1000) 
+  if (hasWatches && usecs>1000)
     usecs=1000; // don't sleep much if we have watches - we need to keep polling them
   if (usecs > 50000)
     usecs = 50000; // don't want to sleep too much (user input/HTTP/etc)
@@ -863,6 +1161,47 @@ JsVar *jshFlashGetFree() {
   return jsFreeFlash;
 }
 
+#ifdef FAKE_FLASH_MMAP
+static unsigned char *fakeFlash = 0; ///< The fake flash file, memory mapped read-only (or 0)
+static int fakeFlashFd = -1; ///< The fake flash file, kept open so jshFlashWrite/jshFlashErasePage can write to it
+
+/// Memory-map the fake flash file, creating it if it doesn't exist and dontCreate=false. Returns true on success
+static bool jshFlashMap(bool dontCreate) {
+  if (fakeFlash) return true;
+  int fd = open(FAKE_FLASH_FILENAME, O_RDWR);
+  if (fd<0 && dontCreate) return false;
+  if (fd<0) fd = open(FAKE_FLASH_FILENAME, O_RDWR|O_CREAT, 0644);
+  if (fd<0) return false;
+  size_t len = FAKE_FLASH_BLOCKSIZE*FAKE_FLASH_BLOCKS;
+  off_t filelen = lseek(fd, 0, SEEK_END);
+  if (filelen>=0 && (size_t)filelen<len) {
+    // pad out with 0xFF, as this is what erased flash contains
+    size_t pad = len-(size_t)filelen;
+    char *buf = malloc(pad);
+    memset(buf, 0xFF, pad);
+    ssize_t w = write(fd, buf, pad);
+    free(buf);
+    if (w!=(ssize_t)pad) {
+      close(fd);
+      return false;
+    }
+  }
+  /* Ask for the mapping at FLASH_START so flash addresses are real pointers
+   * as they would be on an MCU - but it's fine if we get something else.
+   * Like real flash it's read-only, so anything that tries to write to a
+   * Storage file directly faults rather than silently changing it. Writes
+   * go through fakeFlashFd and appear in the mapping (it's MAP_SHARED) */
+  void *m = mmap((void*)(size_t)FLASH_START, len, PROT_READ, MAP_SHARED, fd, 0);
+  if (m==MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+  fakeFlash = (unsigned char*)m;
+  fakeFlashFd = fd;
+  return true;
+}
+#endif
+
 static FILE *jshFlashOpenFile(bool dontCreate) {
   FILE *f = fopen(FAKE_FLASH_FILENAME, "r+b");
   if (!f && dontCreate) return 0;
@@ -884,6 +1223,20 @@ static FILE *jshFlashOpenFile(bool dontCreate) {
 }
 void jshFlashErasePage(uint32_t addr) {
   FAKE_FLASH_DBG("FlashErasePage 0x%08x\n", addr);
+#ifdef FAKE_FLASH_MMAP
+  if (jshFlashMap(true)) {
+    uint32_t startAddr, pageSize;
+    if (jshFlashGetPage(addr, &startAddr, &pageSize)) {
+      char *buf = malloc(pageSize);
+      memset(buf, 0xFF, pageSize);
+      ssize_t w = pwrite(fakeFlashFd, buf, pageSize, startAddr-FLASH_START);
+      assert(w==(ssize_t)pageSize);
+      NOT_USED(w);
+      free(buf);
+    }
+    return;
+  }
+#endif
   FILE *f = jshFlashOpenFile(true);
   if (!f) return; // if no file and we're erasing, we don't have to do anything
   uint32_t startAddr, pageSize;
@@ -906,6 +1259,12 @@ void jshFlashRead(void *buf, uint32_t addr, uint32_t len) {
     return;
   }
   addr -= FLASH_START;
+#ifdef FAKE_FLASH_MMAP
+  if (jshFlashMap(true)) {
+    memcpy(buf, &fakeFlash[addr], len);
+    return;
+  }
+#endif
 
   FILE *f = jshFlashOpenFile(true);
   if (!f) { // no file, so it's all 0xFF
@@ -935,6 +1294,19 @@ void jshFlashWrite(void *buf, uint32_t addr, uint32_t len) {
     return;
   }
   addr -= FLASH_START;
+#ifdef FAKE_FLASH_MMAP
+  if (jshFlashMap(false)) {
+    // like real flash, writes can only clear bits
+    unsigned char *wbuf = malloc(len);
+    for (i=0;i<len;i++)
+      wbuf[i] = fakeFlash[addr+i] & ((unsigned char*)buf)[i];
+    ssize_t w = pwrite(fakeFlashFd, wbuf, len, addr);
+    assert(w==(ssize_t)len);
+    NOT_USED(w);
+    free(wbuf);
+    return;
+  }
+#endif
 
   FILE *f = jshFlashOpenFile(false);
   if (!f) return;
@@ -956,8 +1328,12 @@ void jshFlashWrite(void *buf, uint32_t addr, uint32_t len) {
   fclose(f);
 }
 
-// No - we can't memory-map the flash memory under Linux (well, we could but for testing it's handy not to)
 size_t jshFlashGetMemMapAddress(size_t ptr) {
+#ifdef FAKE_FLASH_MMAP
+  // If our fake flash file is memory-mapped, return a pointer into it
+  if (ptr>=FLASH_START && ptr<FLASH_START+FLASH_TOTAL && jshFlashMap(true))
+    return (size_t)&fakeFlash[ptr-FLASH_START];
+#endif
   return 0;
 }
 
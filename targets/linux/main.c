@@ -70,7 +70,7 @@ bool run_test(const char *filename) {
 
   isRunning = true;
   bool isBusy = true;
-  while (isRunning && (jsiHasTimers() || isBusy))
+  while (isRunning && (jsiHasTimers() || isBusy || jshSleepHasWatches()))
     isBusy = jsiLoop();
 
   JsVar *result = jsvObjectGetChild(execInfo.root, "result", 0/*no create*/);
@@ -271,7 +271,7 @@ int main(int argc, char **argv) {
         int errCode = handleErrors();
         isRunning = !errCode;
         bool isBusy = true;
-        while (isRunning && (jsiHasTimers() || isBusy))
+        while (isRunning && (jsiHasTimers() || isBusy || jshSleepHasWatches()))
           isBusy = jsiLoop();
         jsiKill();
         jsvKill();
@@ -332,7 +332,7 @@ int main(int argc, char **argv) {
     free(buffer);
     isRunning = !errCode;
     bool isBusy = true;
-    while (isRunning && (jsiHasTimers() || isBusy))
+    while (isRunning && (jsiHasTimers() || isBusy || jshSleepHasWatches()))
       isBusy = jsiLoop();
     jsiKill();
     jsvKill();
@@ -373,6 +373,7 @@ int main(int argc, char **argv) {
   addNativeFunction("quit", nativeQuit);
   addNativeFunction("interrupt", nativeInterrupt);
 
+  jshSleepAllowIndefinite(true); // wait for console input
   while (isRunning) {
     jsiLoop();
   }
@@ -0,0 +1,64 @@
+// Compare E.FFT against a simple DFT
+
+function dft(re, im, inverse) {
+  var n = re.length, r = [], i = [];
+  for (var k=0;k<n;k++) {
+    var sr = 0, si = 0;
+    for (var t=0;t<n;t++) {
+      var a = (inverse?2:-2)*Math.PI*k*t/n;
+      var xi = im ? im[t] : 0;
+      sr += re[t]*Math.cos(a) - xi*Math.sin(a);
+      si += re[t]*Math.sin(a) + xi*Math.cos(a);
+    }
+    if (!inverse) { sr/=n; si/=n; }
+    r.push(sr); i.push(si);
+  }
+  return {re:r,im:i};
+}
+function near(a,b) {
+  for (var k=0;k<a.length;k++)
+    if (Math.abs(a[k]-b[k])>0.001) return false;
+  return true;
+}
+
+var data = [];
+for (var k=0;k<16;k++) data.push(Math.sin(k)+k/8);
+var d = dft(data);
+var mod = d.re.map(function(r,k) { return Math.sqrt(r*r+d.im[k]*d.im[k]); });
+
+// real-only input (half-size FFT)
+var a = data.slice();
+E.FFT(a);
+var r1 = near(a, mod);
+var a = new Float32Array(data);
+E.FFT(a);
+var r2 = near(a, mod);
+// complex input
+var a = data.slice(), b = new Array(16).fill(0);
+E.FFT(a,b);
+var r3 = near(a, d.re) && near(b, d.im);
+// in-place Float32Array
+var a = new Float32Array(data), b = new Float32Array(16);
+E.FFT(a,b);
+var r4 = near(a, d.re) && near(b, d.im);
+// inverse
+E.FFT(a,b,true);
+var r5 = near(a, data) && near(b, new Array(16).fill(0));
+// Int16Array
+var a = new Int16Array(16);
+a[1] = 1000;
+E.FFT(a);
+var r6 = true;
+for (var k=0;k<16;k++) if (a[k]!=62) r6 = false; // 1000/16
+// non power of 2 length
+var a = [1,2,3], b = [0,0,0];
+E.FFT(a,b);
+var d = dft([1,2,3,0]);
+var r7 = near(a, d.re.slice(0,3)) && near(b, d.im.slice(0,3));
+// Large FFT - more than would fit on the stack
+var a = new Float32Array(8192), b = new Float32Array(8192);
+a[3] = 1;
+E.FFT(a,b);
+var r8 = Math.abs(a[0]-1/8192)<0.00001 && Math.abs(a[4096]+1/8192)<0.00001 && Math.abs(b[4096])<0.00001;
+
+result = r1 && r2 && r3 && r4 && r5 && r6 && r7 && r8;
@@ -0,0 +1,18 @@
+// ArrayBufferView.set copies directly between arrays of the same type
+var a = new Uint16Array([1,2,3,4]);
+var b = new Uint16Array(6);
+b.set(a,1);
+var r1 = b.join(",")=="0,1,2,3,4,0";
+var c = new Uint16Array(3);
+c.set(a); // truncated
+var r2 = c.join(",")=="1,2,3";
+var d = new Float32Array([0.5,1.5]);
+var e = new Float32Array(new ArrayBuffer(16),4,2);
+e.set(d);
+var r3 = e.join(",")=="0.5,1.5";
+// different types still convert
+var f = new Int8Array(2);
+f.set(new Float32Array([-1.5,2.5]));
+var r4 = f.join(",")=="-1,2";
+
+result = r1 && r2 && r3 && r4;
@@ -0,0 +1,54 @@
+// DataView.compile struct codec
+var ok = true;
+function check(a,b) {
+  if (JSON.stringify(a)!=JSON.stringify(b)) {
+    console.log("Got "+JSON.stringify(a)+", expected "+JSON.stringify(b));
+    ok = false;
+  }
+}
+
+var c = DataView.compile("<HhBxf", ["a","b","c","d"]);
+check(c.size, 10);
+var buf = c.pack({a:1234, b:-5, c:200, d:1.5});
+check(buf.byteLength, 10);
+check(c.unpack(buf), {a:1234, b:-5, c:200, d:1.5});
+// compare against DataView accessors
+var dv = new DataView(buf);
+check(dv.getUint16(0,true), 1234);
+check(dv.getInt16(2,true), -5);
+check(dv.getFloat32(6,true), 1.5);
+
+// big endian, arrays, repeat counts
+var be = DataView.compile(">2HI");
+var b = new Uint8Array([0,1,0,2,0xFF,0xFF,0xFF,0xFE]);
+check(be.unpack(b.buffer), [1,2,4294967294]);
+check(be.unpack(b), [1,2,4294967294]);
+// multiple records
+var r = DataView.compile("<bB");
+var arr = new Uint8Array([255,255,1,2,3,4]);
+check(r.unpack(arr, 0, 3), [[-1,255],[1,2],[3,4]]);
+check(r.unpack(arr, 2, 10), [[1,2],[3,4]]);
+// pack multiple records into an existing buffer at an offset
+var out = new Uint8Array(6);
+r.pack([[1,2],[3,4]], out.buffer, 2);
+check(out, new Uint8Array([0,0,1,2,3,4]));
+// strings and booleans
+var s = DataView.compile("3s?d");
+var p = s.pack(["abc", true, 3.25]);
+check(s.unpack(p), ["abc", true, 3.25]);
+check(s.unpack(E.toString(p)), ["abc", true, 3.25]);
+// DataView input with offset
+var dv2 = new DataView(new Uint8Array([9,9,7,0]).buffer, 2);
+check(DataView.compile("<H").unpack(dv2), [7]);
+// bad formats
+try { DataView.compile("q"); ok = false; } catch (e) {}
+// records that are too big, or whose size would overflow
+try { DataView.compile("99999999999B"); ok = false; } catch (e) {}
+try { DataView.compile("20000000x"); ok = false; } catch (e) {}
+try { DataView.compile("4000d"); ok = false; } catch (e) {}
+// changing 'size' doesn't change how much is read
+var sz = DataView.compile("<H");
+sz.size = 100000000;
+check(sz.unpack(E.toString([1,0])), [1]);
+
+result = ok;
@@ -0,0 +1,31 @@
+// Filter class - FIR/IIR, state kept between calls, decimate/interpolate
+
+var f = new Filter({fir:[0.5,0.5]});
+var a = new Float32Array([1,2,3,4]);
+var r1 = f.process(a)==4 && a.join(",")=="0.5,1.5,2.5,3.5";
+var b = new Float32Array([5,6]);
+f.process(b);
+var r2 = b.join(",")=="4.5,5.5"; // carried on from previous buffer
+
+var f = new Filter({fir:[1,1,1,1], decimate:2});
+var o = new Int16Array(4);
+var r3 = f.process([1,2,3,4,5,6,7,8], o)==4 && o.join(",")=="1,6,14,22";
+
+var f = new Filter({fir:[1,1], interpolate:2});
+var o = new Float32Array(6);
+var r4 = f.process([1,2,3], o)==6 && o.join(",")=="2,2,4,4,6,6";
+
+var f = new Filter({iir:[1,0,0,-0.5,0]});
+var o = new Float32Array(5);
+f.process([1,0,0,0,0], o);
+var r5 = o.join(",")=="1,0.5,0.25,0.125,0.0625";
+f.reset();
+f.process([1,0,0,0,0], o);
+var r6 = o.join(",")=="1,0.5,0.25,0.125,0.0625";
+
+// saturation when writing to integer arrays
+var o = new Uint8Array(3);
+new Filter({fir:[1]}).process([-5,1000,3.6],o);
+var r7 = o.join(",")=="0,255,4";
+
+result = r1 && r2 && r3 && r4 && r5 && r6 && r7;
@@ -6,3 +6,19 @@ var decompr = E.toString(require("heatshrink").decompress(compr));
 
 result = decompr == source;
 
+
+// compress/decompress work directly on the data of flat typed arrays
+var a = new Uint8Array(200);
+for (var i=0;i<a.length;i++) a[i] = i*7;
+var b = new Uint8Array(require("heatshrink").decompress(require("heatshrink").compress(a)));
+result = result && b.length==a.length && b.join()==a.join();
+
+// other typed arrays are compressed as each element &255, whether their data is flat or not
+var a = new Uint16Array(200);
+for (var i=0;i<a.length;i++) a[i] = i*7;
+var s = "";
+for (var i=0;i<200;i++) s += String.fromCharCode((i*7)&255,(i*7)>>8);
+var c = new Uint16Array(E.toArrayBuffer(s)); // not flat
+var b = new Uint8Array(require("heatshrink").decompress(require("heatshrink").compress(a)));
+var d = new Uint8Array(require("heatshrink").decompress(require("heatshrink").compress(c)));
+result = result && b.length==200 && d.length==200 && b.join()==d.join() && b[100]==(700&255);
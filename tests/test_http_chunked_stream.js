@@ -0,0 +1,84 @@
+// Data written before end() is sent 'chunked' automatically, by both the server and client
+
+var result = 0;
+var http = require("http");
+var net = require("net");
+
+var big = "";
+while (big.length<2000) big += "0123456789abcdef";
+
+var server = http.createServer(function (req, res) {
+  var body = '';
+  req.on('data', function(data) { body += data; });
+  req.on('end', function() {
+    if (req.url=="/pipe") {
+      // pipe from something with a 'read' method, which returns undefined when done
+      var pos = 0;
+      E.pipe({ read : function(n) {
+        if (pos>=big.length) return undefined;
+        pos += n;
+        return big.substr(pos-n, n);
+      }}, res, {chunkSize:256});
+    } else if (req.url=="/echo") {
+      res.end(req.headers["Transfer-Encoding"]+" "+req.headers["Content-Length"]+" "+body);
+    } else {
+      res.writeHead(200);
+      res.write("a");
+      setTimeout(function() {
+        res.write("bc");
+        res.end("d");
+      }, 10);
+    }
+  });
+});
+server.listen(8084);
+
+var results = {};
+function check() {
+  console.log(JSON.stringify(results));
+  if (Object.keys(results).length<5) return;
+  server.close();
+  result = results.raw11.indexOf("Transfer-Encoding: chunked\r\n")>0 &&
+           results.raw11.indexOf("Connection: keep-alive\r\n")>0 &&
+           results.raw11.endsWith("\r\n\r\n1\r\na\r\n2\r\nbc\r\n1\r\nd\r\n0\r\n\r\n") &&
+           results.raw10.indexOf("Transfer-Encoding")<0 &&
+           results.raw10.endsWith("\r\n\r\nabcd") &&
+           results.pipe &&
+           results.streamed=="chunked undefined xyz" &&
+           results.ended=="undefined 5 hello";
+}
+
+// HTTP/1.1 gets chunks and stays open, then HTTP/1.0 on the same connection is sent the data as-is
+var c = net.connect({port: 8084}, function() {
+  var reply = "";
+  c.on('data', function(d) {
+    reply += d;
+    if (!results.raw11 && reply.endsWith("0\r\n\r\n")) {
+      results.raw11 = reply;
+      reply = "";
+      c.write("GET /old HTTP/1.0\r\n\r\n");
+    }
+  });
+  c.on('close', function() {
+    results.raw10 = reply;
+    check();
+  });
+  c.write("GET /new HTTP/1.1\r\nHost: localhost\r\n\r\n");
+});
+
+http.get("http://localhost:8084/pipe", function(res) {
+  var body = "";
+  res.on('data', function(d) { body += d; });
+  res.on('close', function() { results.pipe = body==big; check(); });
+});
+
+function post(body, cb) {
+  var req = http.request({port:8084, path:"/echo", method:"POST"}, function(res) {
+    var reply = "";
+    res.on('data', function(d) { reply += d; });
+    res.on('close', function() { cb(reply); check(); });
+  });
+  body(req);
+}
+post(function(req) { req.write("xy"); req.end("z"); }, function(r) { results.streamed = r; });
+post(function(req) { req.end("hello"); }, function(r) { results.ended = r; });
@@ -0,0 +1,44 @@
+// HTTP headers arriving a few bytes at a time, and headers that are too big
+
+var result = 0;
+var http = require("http");
+var net = require("net");
+
+var server = http.createServer({maxHeaderSize:300}, function (req, res) {
+  var body = '';
+  req.on('data', function(data) { body += data; });
+  req.on('end', function() {
+    res.writeHead(200);
+    res.end(req.method+" "+req.url+" "+req.headers.Host+" "+req.headers['X-Empty']+"|"+body);
+  });
+});
+server.listen(8081);
+
+var request = "GET /slow.html HTTP/1.1\r\nConnection: close\r\nHost:  localhost\r\nX-Empty:\r\ncontent-length: 5\r\n\r\nhello";
+var slowReply = "", bigReply = "";
+
+function sendSlowly(c, i) {
+  if (i>=request.length) return;
+  c.write(request.substr(i,7));
+  setTimeout(sendSlowly, 1, c, i+7);
+}
+
+var slow = net.connect({port: 8081}, function() {
+  slow.on('data', function(d) { slowReply += d; });
+  slow.on('close', checkSlow);
+  sendSlowly(slow, 0);
+});
+
+function checkSlow() {
+  console.log(JSON.stringify(slowReply));
+  if (!slowReply.endsWith("\r\n\r\nGET /slow.html localhost |hello")) return server.close();
+  var big = net.connect({port: 8081}, function() {
+    big.on('data', function(d) { bigReply += d; });
+    big.on('close', function() {
+      console.log(JSON.stringify(bigReply));
+      server.close();
+      result = bigReply.startsWith("HTTP/1.1 431 ");
+    });
+    big.write("GET / HTTP/1.1\r\nX-Big: "+"x".repeat(400)+"\r\n\r\n");
+  });
+}
@@ -0,0 +1,76 @@
+// HTTP keep-alive: pipelined requests on one connection, idle timeouts, and reusing client connections
+
+var result = 0;
+var http = require("http");
+var net = require("net");
+
+var server = http.createServer({keepAliveTimeout:200}, function (req, res) {
+  var body = '';
+  req.on('data', function(data) { body += data; });
+  req.on('end', function() {
+    res.writeHead(200);
+    res.end(req.method+req.url+body);
+  });
+});
+server.listen(8082);
+
+var pipelined = "";
+function testPipelining() {
+  var c = net.connect({port: 8082}, function() {
+    c.on('data', function(d) { pipelined += d; });
+    c.on('close', testTimeout);
+    c.write("GET /a HTTP/1.1\r\nHost: x\r\n\r\n"+
+            "POST /b HTTP/1.1\r\nContent-Length: 3\r\n\r\nabc"+
+            "GET /c HTTP/1.1\r\nConnection: close\r\n\r\n");
+  });
+}
+
+var idleTime;
+function testTimeout() {
+  var c = net.connect({port: 8082}, function() {
+    var t = getTime();
+    c.on('close', function() {
+      idleTime = getTime()-t;
+      testClient();
+    });
+    c.write("GET /d HTTP/1.1\r\n\r\n");
+  });
+}
+
+// a server that counts connections and answers every request on them
+var connections = 0;
+var rawServer = net.createServer(function(c) {
+  connections++;
+  c.on('data', function(d) {
+    for (var i=0;i<d.split("\r\n\r\n").length-1;i++)
+      c.write("HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok");
+  });
+});
+rawServer.listen(8083);
+
+var replies = [];
+function get(callback) {
+  http.get({host:"localhost", port:8083, path:"/", keepAlive:true, keepAliveTimeout:100}, function(res) {
+    var body = '';
+    res.on('data', function(d) { body += d; });
+    res.on('close', function() { replies.push(body); callback(); });
+  });
+}
+function testClient() {
+  get(function() { get(function() { get(check); }); });
+}
+
+function check() {
+  console.log(JSON.stringify(pipelined), idleTime, replies, connections);
+  server.close();
+  setTimeout(function() { rawServer.close(); }, 200); // once the pooled connection has timed out
+  var responses = pipelined.split("HTTP/1.1 200 OK");
+  result = responses.length==4 &&
+    responses[1].indexOf("Connection: keep-alive")>=0 && responses[1].endsWith("\r\n\r\nGET/a") &&
+    responses[2].indexOf("Connection: keep-alive")>=0 && responses[2].endsWith("\r\n\r\nPOST/babc") &&
+    responses[3].indexOf("Connection: close")>=0 && responses[3].endsWith("\r\n\r\nGET/c") &&
+    idleTime>0.15 && idleTime<1 &&
+    replies.join(",")=="ok,ok,ok" && connections==1;
+}
+
+testPipelining();
@@ -0,0 +1,102 @@
+// WebSocket upgrade and framing handled natively by the HTTP server, tested with a client made from a net socket
+
+var result = 0;
+var http = require("http");
+var net = require("net");
+
+var server = http.createServer(function (req, res) {
+  res.writeHead(200);
+  res.end("not a websocket");
+});
+var wsUrl;
+server.on('websocket', function(ws, req) {
+  wsUrl = req.url;
+  ws.on('message', function(msg) {
+    if (msg=="bye") ws.close(4000);
+    else ws.send("echo:"+msg);
+  });
+  ws.on('pong', function(d) { results.pong = d; });
+  ws.ping("P");
+});
+server.listen(8085);
+
+var results = { messages : [] };
+
+// a masked client frame
+function frame(opcode, data, fin) {
+  var mask = [1,2,3,4];
+  var f = String.fromCharCode((fin===false?0:0x80)|opcode);
+  if (data.length<126) f += String.fromCharCode(0x80|data.length);
+  else f += String.fromCharCode(0x80|126, data.length>>8, data.length&255);
+  f += E.toString(mask);
+  for (var i=0;i<data.length;i++)
+    f += String.fromCharCode(data.charCodeAt(i) ^ mask[i&3]);
+  return f;
+}
+
+var big = "";
+while (big.length<300) big += "0123456789";
+
+var c = net.connect({port: 8085}, function() {
+  var reply = "";
+  var handshake;
+  c.on('data', function(d) {
+    reply += d;
+    if (!handshake) {
+      var i = reply.indexOf("\r\n\r\n");
+      if (i<0) return;
+      handshake = reply.substr(0,i);
+      reply = reply.substr(i+4);
+    }
+    // server frames aren't masked, and ours are all small
+    while (reply.length>=2) {
+      var len = reply.charCodeAt(1), hdr = 2;
+      if (len==126) { len = (reply.charCodeAt(2)<<8)|reply.charCodeAt(3); hdr = 4; }
+      if (reply.length<hdr+len) break;
+      var op = reply.charCodeAt(0)&15, payload = reply.substr(hdr,len);
+      reply = reply.substr(hdr+len);
+      if (op==1) results.messages.push(payload);
+      if (op==9) { results.ping = payload; c.write(frame(10, payload)); }
+      if (op==10) results.clientPong = payload;
+      if (op==8) results.closeCode = (payload.charCodeAt(0)<<8)|payload.charCodeAt(1);
+    }
+  });
+  c.on('close', function() {
+    results.handshake = handshake;
+    check();
+  });
+  // the key from RFC 6455, with the first frames in the same packet as the request
+  c.write("GET /chat HTTP/1.1\r\nHost: localhost\r\nUpgrade: websocket\r\nConnection: keep-alive, Upgrade\r\n"+
+          "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n\r\n"+
+          frame(1,"hello"));
+  setTimeout(function() {
+    c.write(frame(1,"frag",false)+frame(0,"men",false)); // a fragmented message...
+    c.write(frame(9,"pingdata")); // ...with a ping in the middle
+    c.write(frame(0,"ted"));
+    c.write(frame(1,big));
+  }, 10);
+  setTimeout(function() {
+    c.write(frame(1,"bye"));
+  }, 50);
+});
+
+// a normal request still works
+http.get("http://localhost:8085/", function(res) {
+  var body = "";
+  res.on('data', function(d) { body += d; });
+  res.on('close', function() { results.normal = body; check(); });
+});
+
+function check() {
+  console.log(JSON.stringify(results));
+  if (!results.handshake || !results.normal) return;
+  server.close();
+  result = results.handshake.startsWith("HTTP/1.1 101 ") &&
+           results.handshake.indexOf("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=")>0 &&
+           wsUrl=="/chat" &&
+           results.messages.join(",")=="echo:hello,echo:fragmented,echo:"+big &&
+           results.clientPong=="pingdata" &&
+           results.ping=="P" && results.pong=="P" &&
+           results.closeCode==4000 &&
+           results.normal=="not a websocket";
+}
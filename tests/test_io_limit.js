@@ -0,0 +1,20 @@
+// Check per-device IO buffer limits and overflow counters (E.setIOLimit/E.getIOStats)
+var got = "";
+LoopbackB.on('data', function(d) { got += d; });
+E.setIOLimit(LoopbackB, 2);
+// 20 chars would need 5 events - only 2 (5 chars, as the first event isn't appended to) fit
+LoopbackA.write("0123456789abcdefghij");
+var stats = E.getIOStats();
+var before = stats.devices.LoopbackB;
+E.getErrorFlags(); // clear FIFO_FULL
+
+setTimeout(function() {
+  var after = E.getIOStats().devices.LoopbackB;
+  E.setIOLimit("LoopbackB", 0);
+  var cleared = E.getIOStats().devices.LoopbackB;
+  result = stats.ioSize>0 && stats.txSize>0 && stats.other!==undefined &&
+           before.used==2 && before.limit==2 && before.overflows==15 &&
+           got=="01234" &&
+           after.used==0 && after.overflows==15 &&
+           cleared.limit==0;
+}, 10);
@@ -0,0 +1,8 @@
+// A socket that fails to connect straight away mustn't stop Espruino from exiting when it's idle
+
+var result = 0;
+try {
+  require("net").connect({host:"255.255.255.255", port:80});
+} catch (e) {
+  result = 1;
+}
@@ -0,0 +1,27 @@
+// Socket test sending more data than fits in one receive chunk
+
+var result = 0;
+var net = require("net");
+
+var payload = "";
+for (var i=0;i<2000;i++) payload += String.fromCharCode(48+(i%75)) + i;
+
+var server = net.createServer(function(c) { //'connection' listener
+  c.write(payload);
+  c.end();
+});
+server.listen(4445);
+
+var client = net.connect({port: 4445}, function() { //'connect' listener
+  var body='';
+  var chunks=0;
+  client.on('data', function(data) {
+    body += data;
+    chunks++;
+  });
+  client.on('end', function() {
+    console.log('client disconnected', body.length, chunks);
+    server.close();
+    result = body==payload;
+  });
+});
@@ -0,0 +1,34 @@
+// Sending a file read from Storage, which then changes before it has all been sent
+
+var result = 0;
+var net = require("net");
+var s = require("Storage");
+s.eraseAll();
+
+var big = "0123456789abcdef";
+while (big.length < 8192) big += big;
+s.write("junk", "x");
+s.write("page", big);
+var expected = s.read("page");
+
+var server = net.createServer(function(c) {
+  c.write(expected);
+  c.end();
+  // move the file over where it was, and put something else after it
+  s.erase("junk");
+  s.compact();
+  s.erase("page");
+  s.write("other", big.toUpperCase());
+  s.compact();
+});
+server.listen(4447);
+
+var client = net.connect({port: 4447}, function() {
+  var body = '';
+  client.on('data', function(data) { body += data; });
+  client.on('end', function() {
+    server.close();
+    s.eraseAll();
+    result = body==big;
+  });
+});
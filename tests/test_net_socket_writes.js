@@ -0,0 +1,35 @@
+// Socket test with many small writes mixed with big ones
+
+var result = 0;
+var net = require("net");
+
+var big = "0123456789abcdef";
+while (big.length < 100000) big += big;
+var expected = "";
+
+var server = net.createServer(function(c) { //'connection' listener
+  for (var i=0;i<50;i++) {
+    c.write(i+",");
+    expected += i+",";
+  }
+  c.write(big);
+  expected += big;
+  for (var i=0;i<50;i++) {
+    c.write(E.toString(i));
+    expected += E.toString(i);
+  }
+  c.end();
+});
+server.listen(4446);
+
+var client = net.connect({port: 4446}, function() { //'connect' listener
+  var body='';
+  client.on('data', function(data) {
+    body += data;
+  });
+  client.on('end', function() {
+    console.log('client disconnected', body.length, expected.length);
+    server.close();
+    result = body==expected;
+  });
+});
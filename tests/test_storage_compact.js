@@ -0,0 +1,73 @@
+// Page-at-a-time Storage compaction
+var s = require("Storage");
+s.eraseAll();
+var ok = true;
+var expected = {};
+function str(n, c) { var r = ""; while (r.length<n) r += String.fromCharCode(c + (r.length%7)); return r; }
+function fill(seed) {
+  // files of all sizes, including ones bigger than a page
+  for (var i=0;i<60;i++) {
+    var name = "f"+(i%25);
+    var data = str(((i*337+seed)%3000)+1, 65+(i%20));
+    s.write(name, data);
+    expected[name] = data;
+    if (i%7==3) { s.erase(name); delete expected[name]; }
+  }
+}
+function check() {
+  for (var n in expected)
+    if (s.read(n)!=expected[n]) { ok = false; print("Bad "+n); }
+  if (s.list().length != Object.keys(expected).length) { ok = false; print("Bad list "+s.list()); }
+}
+fill(0);
+var before = s.getStats();
+if (!before.trashBytes) ok = false;
+s.compact();
+check();
+var after = s.getStats();
+if (after.trashBytes || after.fileBytes!=before.fileBytes || after.freeBytes<=before.freeBytes) ok = false;
+// with plenty of free space for the journal, no page is erased more than once
+for (var i=0;i<after.pageErases.length;i++)
+  if (after.pageErases[i]-before.pageErases[i] > 1) { ok = false; print("Page "+i+" erased too often"); }
+// compacting again does nothing
+s.compact();
+check();
+// background compaction, finished off by accessing Storage
+fill(123);
+s.compact(true);
+check();
+if (s.getStats().trashBytes) ok = false;
+// background compaction, done while idle
+fill(77);
+s.compact(true);
+setTimeout(function() {
+  if (s.getStats().trashBytes) ok = false;
+  check();
+  checkLowStack();
+  s.eraseAll();
+  result = ok;
+}, 100);
+
+/* Reading while a background compaction is in progress finishes it first, but that needs
+ * a page worth of stack. Read from deeper and deeper inside nested brackets (which the parser
+ * recurses into) until it can't, and check the read then fails rather than returning what's
+ * in a half-compacted Storage */
+function checkLowStack() {
+  for (var depth=0;depth<10000;depth+=4) {
+    var data = str(100, 65+(depth%20));
+    s.write("junk", "x");
+    s.write("keep", data); // the new copy is after 'junk', so compaction moves it
+    s.erase("junk");
+    s.compact(true);
+    var r;
+    try {
+      r = eval("(".repeat(depth)+"s.read('keep')"+")".repeat(depth));
+    } catch (e) {
+      // compaction can finish once we have more stack
+      if (s.read("keep")!=data || s.getStats().trashBytes) ok = false;
+      return;
+    }
+    if (r!=data) { ok = false; print("Bad read at depth "+depth); return; }
+  }
+  ok = false; // we never ran out of stack?
+}
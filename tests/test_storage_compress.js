@@ -0,0 +1,34 @@
+// Storage files written with {compress:true}
+var s = require("Storage");
+s.eraseAll();
+
+var text = "";
+for (var i=0;i<50;i++) text += "Hello World "+(i&7)+"\n";
+s.write("txt", text, {compress:true});
+var stats = s.getStats();
+var r1 = s.read("txt")==text;
+var r2 = s.read("txt",6,5)=="World";
+var r3 = s.read("txt",text.length-2)=="1\n";
+// compressed file takes less flash than the data
+var r4 = stats.fileBytes < text.length && stats.compressedFiles==1 && stats.compressRatio>2;
+
+s.write("js", {a:[1,2,3,4,5,6,7,8,9,10,1,2,3,4,5,6,7,8,9,10],b:"Hello Hello Hello Hello"}, {compress:true});
+var j = s.readJSON("js");
+var r5 = j.a.length==20 && j.b=="Hello Hello Hello Hello";
+
+s.write("mod", "exports.hello = function() { return 'Hello'+' '+'Hello'+' '+'Hello'+' '+'Hello'; };", {compress:true});
+var r6 = require("mod").hello()=="Hello Hello Hello Hello";
+
+// data that doesn't compress is stored as-is
+var n = s.getStats().compressedFiles;
+s.write("small", "ab", {compress:true});
+var r7 = s.read("small")=="ab" && s.getStats().compressedFiles==n;
+
+// normal offset writes still work
+s.write("a","Hello",0,11);
+s.write("a"," World",5);
+var r8 = s.read("a")=="Hello World";
+
+var r9 = s.getStats().decompressedFiles >= 5;
+
+result = r1 && r2 && r3 && r4 && r5 && r6 && r7 && r8 && r9;
@@ -0,0 +1,40 @@
+// Storage.hash, and skipping writes of unchanged files
+var s = require("Storage");
+s.eraseAll();
+
+s.write("a","Hello World");
+var h = s.hash("a");
+// FNV-1a of "Hello World"
+var r1 = h==0xb3902527;
+var r2 = s.hash("nothere")===undefined;
+
+// writing the same data again is skipped
+var free = s.getFree();
+s.write("a","Hello World");
+var r3 = s.getFree()==free && s.read("a")=="Hello World" && s.hash("a")==h;
+
+// different data of the same length is written
+s.write("a","Hello Earth");
+var r4 = s.read("a")=="Hello Earth" && s.hash("a")!=h;
+
+// writes in parts change the hash
+s.write("b","Hello",0,11);
+var hb = s.hash("b");
+s.write("b"," World",5);
+var r5 = s.hash("b")==h && hb!=h;
+var free = s.getFree();
+s.write("b","Hello World");
+var r6 = s.getFree()==free;
+
+// hashes survive compaction
+s.erase("a");
+s.compact();
+var r7 = s.hash("b")==h;
+
+// data with the same hash (a FNV-1a collision) is still written
+s.write("c","000bec20");
+var hc = s.hash("c");
+s.write("c","0004a0f5");
+var r8 = s.read("c")=="0004a0f5" && s.hash("c")==hc;
+
+result = r1 && r2 && r3 && r4 && r5 && r6 && r7 && r8;
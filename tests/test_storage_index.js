@@ -0,0 +1,25 @@
+// Check the RAM index of files in Storage stays in sync with flash
+var s = require("Storage");
+s.eraseAll();
+var ok = true;
+var N = 300; // more than the index can hold on Linux
+for (var i=0;i<N;i++) s.write("f"+i, "data"+i);
+for (var i=0;i<N;i++) if (s.read("f"+i)!="data"+i) ok = false;
+if (s.read("nope")!==undefined) ok = false;
+s.erase("f3");
+if (s.read("f3")!==undefined) ok = false;
+s.write("f3","new");
+s.write("f4","changed");
+if (s.read("f3")!="new" || s.read("f4")!="changed") ok = false;
+s.compact();
+if (s.read("f3")!="new" || s.read("f4")!="changed" || s.read(("f"+(N-1)))!="data"+(N-1)) ok = false;
+// Small number of files - all lookups come from the index
+s.eraseAll();
+s.write("a","A");
+s.write("b","B");
+var st = s.getStats();
+for (var i=0;i<10;i++) if (s.read("a")!="A" || s.read("c")!==undefined) ok = false;
+var st2 = s.getStats();
+if (!st2.indexComplete || st2.indexScans!=st.indexScans || st2.indexHits<st.indexHits+20) ok = false;
+s.eraseAll();
+result = ok;
@@ -0,0 +1,37 @@
+// After load() the saved image is only loaded as it's used - saving again before it's all loaded must save everything
+var s = require("Storage");
+if (!s.read("lazyStep")) s.eraseAll();
+var state = {a:{x:1}, list:[]};
+for (var i=0;i<200;i++) state.list.push({n:i, s:"item "+i});
+// onInit is also called after each save()
+function onInit() {
+  var step = s.read("lazyStep");
+  if (step=="1") {
+    // only just loaded - touch a few vars and save again
+    var st = s.getStats();
+    wasLazy = st.imageBlocksLoaded < st.imageBlocks;
+    state.a.x = 5;
+    s.write("lazyStep", "2");
+    save();
+  } else if (step=="reloaded") {
+    var expected = JSON.parse(s.read("lazyJSON"));
+    expected.a.x = 5;
+    result = wasLazy && JSON.stringify(state)==JSON.stringify(expected);
+    s.write("lazyStep", "3");
+  }
+}
+save();
+setTimeout(function() {
+  // this timer was saved too, so it runs again after each load()
+  var step = s.read("lazyStep");
+  if (!step) {
+    s.write("lazyJSON", JSON.stringify(state));
+    s.write("lazyStep", "1");
+    state = undefined;
+    load();
+  } else if (step=="2") {
+    s.write("lazyStep", "reloaded");
+    state = undefined;
+    load();
+  } else if (step=="3") s.eraseAll();
+}, 10);
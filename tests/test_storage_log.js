@@ -0,0 +1,56 @@
+// Ring log files in Storage
+var s = require("Storage");
+s.eraseAll();
+var ok = true;
+s.write("before",E.toString(new Uint8Array(1500).fill(65))); // so the log doesn't start at the very start of Storage
+var log = s.openLog("log", {size:6, count:200, time:true});
+var info = log.getInfo();
+if (info.first!==0 || info.next!==0 || info.count!==0 || info.size!==6 || info.capacity<200) ok = false;
+var cap = info.capacity;
+for (var i=0;i<150;i++)
+  if (log.append("r"+i, 1000+i)!==i) ok = false;
+if (log.read(0)!="r0\0\0\0\0" || log.read(149)!="r149\0\0" || log.read(150)!==undefined) ok = false;
+if (log.getTime(42)!=1042) ok = false;
+if (log.find(1100.5)!=101 || log.find(0)!=0 || log.find(5000)!=-1) ok = false;
+// re-opening recovers the position
+log = s.openLog("log", {size:6, count:200, time:true});
+if (log.getInfo().next!==150) ok = false;
+// wrap around - oldest records get erased
+for (var i=150;i<1000;i++) log.append("r"+i, 1000+i);
+info = log.getInfo();
+if (info.next!==1000 || info.count<200 || info.count>cap) ok = false;
+if (log.read(info.first-1)!==undefined || log.read(info.first)!="r"+info.first+"\0\0") ok = false;
+if (log.read(999)!="r999\0\0") ok = false;
+if (log.find(1900)!=900 || log.find(0)!=info.first) ok = false;
+log = s.openLog("log", {size:6, count:200, time:true});
+if (log.getInfo().next!==1000) ok = false;
+// the log survives being moved by compaction
+s.erase("before");
+s.compact();
+if (log.read(999)!="r999\0\0" || log.append("again")!==1000 || log.read(1000)!="again\0") ok = false;
+// different options makes a new log
+log = s.openLog("log", {size:4, count:10});
+if (log.getInfo().next!==0 || log.getInfo().time) ok = false;
+log.append(new Uint8Array([1,2,3,4]).buffer);
+if (log.read(0)!="\1\2\3\4") ok = false;
+log.erase();
+if (s.list().indexOf("log")>=0) ok = false;
+// an erased log can't be read from
+try { log.read(0); ok = false; } catch (e) { if (e.message!="Log file not found") ok = false; }
+// the log is found again after a compaction in the background moves it
+s.write("before",E.toString(new Uint8Array(1500).fill(65)));
+log = s.openLog("log", {size:4, count:100});
+for (var i=0;i<10;i++) log.append("b"+i);
+s.erase("before");
+s.compact(true);
+if (log.read(9)!="b9\0\0" || log.append("c")!==10 || log.read(10)!="c\0\0\0") ok = false;
+if (s.getStats().trashBytes) ok = false;
+// records bigger than a single flash write
+log = s.openLog("big", {size:300, count:20, time:true});
+var big = "";
+for (var i=0;i<250;i++) big += String.fromCharCode(33+(i%90));
+log.append(big, 123);
+log.append(big+big, 456); // truncated
+if (log.read(0)!=big+"\0".repeat(50) || log.read(1)!=(big+big).substr(0,300) || log.getTime(1)!=456) ok = false;
+s.eraseAll();
+result = ok;
@@ -0,0 +1,21 @@
+// save() streams a compressed image of RAM to Storage - check load() brings it all back
+var s = require("Storage");
+if (!s.read("saveStep")) s.eraseAll();
+var state = {n:[1,2,3], s:"hello".repeat(40), t:new Uint16Array([1,2,65535]), f:function(x) { return x*2; }};
+for (var i=0;i<100;i++) state["k"+i] = i*i;
+function onInit() {
+  // Storage isn't part of the saved image, so we can use it to tell we've been loaded
+  var ok = s.read("saveStep")=="loaded" && !global.changed;
+  ok = ok && JSON.stringify(state)==s.read("saveJSON") && state.f(21)==42;
+  result = ok;
+}
+save();
+setTimeout(function() {
+  // this timer was saved too, so it runs again after load()
+  if (s.read("saveStep")) return s.eraseAll();
+  s.write("saveJSON", JSON.stringify(state));
+  s.write("saveStep", "loaded");
+  state = undefined;
+  changed = true;
+  load();
+}, 10);
@@ -0,0 +1,50 @@
+// save(true) only writes the blocks of RAM that changed since the last save() - check load() applies them
+var s = require("Storage");
+if (!s.read("deltaStep")) s.eraseAll();
+var state = {list:[]};
+for (var i=0;i<200;i++) state.list.push({n:i, s:"item "+i});
+// onInit is also called after each save()
+function onInit() {
+  var step = s.read("deltaStep");
+  if (step=="loaded") {
+    // image + a changed block
+    deltaUsed = s.list().indexOf(".vardiff")>=0;
+    deltaOk = JSON.stringify(state)==s.read("deltaJSON");
+  } else if (step=="reloaded") {
+    // the heap grew since the full save, so save(true) must have saved everything
+    result = deltaUsed && deltaOk && s.list().indexOf(".vardiff")<0 &&
+             JSON.stringify(state)==s.read("deltaJSON") && grown.length==3000 &&
+             process.memory().total>memTotal;
+  }
+}
+save();
+function next() {
+  // this is saved too, so it runs again after each load()
+  var step = s.read("deltaStep");
+  if (!step) {
+    state.list[5].s = "changed";
+    s.write("deltaJSON", JSON.stringify(state));
+    s.write("deltaStep", "delta");
+    save(true);
+    setTimeout(next, 10);
+  } else if (step=="delta") {
+    s.write("deltaStep", "loaded");
+    state = undefined;
+    load();
+  } else if (step=="loaded") {
+    memTotal = process.memory().total;
+    grown = [];
+    for (var i=0;i<3000;i++) grown.push({i:i});
+    state.list[7].s = "changed too";
+    s.write("deltaJSON", JSON.stringify(state));
+    s.write("deltaStep", "grown");
+    save(true);
+    setTimeout(next, 10);
+  } else if (step=="grown") {
+    s.write("deltaStep", "reloaded");
+    state = undefined;
+    grown = undefined;
+    load();
+  } else if (step=="reloaded") s.eraseAll();
+}
+setTimeout(next, 10);
@@ -0,0 +1,26 @@
+// Storage wear and write amplification statistics
+var s = require("Storage");
+s.eraseAll();
+
+var st = s.getStats();
+var c = st.compactions, e = st.erases, w = st.writtenBytes;
+var r1 = st.pageErases instanceof Uint32Array && st.pageErases.length>0 &&
+         E.sum(st.pageErases)==st.erases && st.maxPageErases>=st.minPageErases;
+
+// writing a file counts the header and data
+s.write("a","Hello World");
+st = s.getStats();
+var r2 = st.writtenBytes >= w+11 && st.writeAmplification>=1;
+
+// fill Storage with files we then delete, so it has to compact
+var data = "";
+for (var i=0;i<1000;i++) data+=String.fromCharCode(65+(i%26));
+for (var i=0;i<20;i++) { s.write("b"+i, data); s.erase("b"+i); }
+s.compact();
+st = s.getStats();
+var r3 = st.compactions>c && st.erases>e && st.movedBytes>0 &&
+         st.writeAmplification>1 && s.read("a")=="Hello World";
+// the stats are kept in Storage, but not listed as a file
+var r4 = s.read(".wear")!==undefined && s.list().indexOf(".wear")<0 && st.trashBytes==0;
+
+result = r1 && r2 && r3 && r4;
@@ -0,0 +1,47 @@
+// Typed arrays sort numerically by default (not as strings)
+function sorted(a) {
+  for (var i=1;i<a.length;i++) if (a[i-1]>a[i]) return false;
+  return true;
+}
+
+var ok = true;
+[Uint8Array,Int8Array,Uint16Array,Int16Array,Uint32Array,Int32Array,Float32Array,Float64Array].forEach(function(T) {
+  var a = new T(500);
+  for (var i=0;i<a.length;i++) a[i] = (Math.random()-0.5)*100000;
+  a.sort();
+  if (!sorted(a)) ok = false;
+});
+
+var a = new Uint8Array([10,9,100,1]).sort();
+var r1 = a.join(",")=="1,9,10,100";
+var a = new Int16Array([3,-1,2,-300]).sort();
+var r2 = a.join(",")=="-300,-1,2,3";
+var a = new Float32Array([3,NaN,1,-2,NaN,0]).sort();
+var r3 = a.join(",")=="-2,0,1,3,NaN,NaN";
+// with compare function
+var a = new Int32Array([1,3,5]).sort(function(a,b) { return b-a; });
+var r4 = a.join(",")=="5,3,1";
+// view at an offset into a buffer
+var a = new Int32Array(new ArrayBuffer(40),4,3);
+a.set([9,8,7]);
+a.sort();
+var r5 = a.join(",")=="7,8,9";
+// data that isn't stored in a flat string
+var s = "";
+for (var i=0;i<40;i++) s += String.fromCharCode(100-i,0);
+var a = new Uint16Array(E.toArrayBuffer(s)).sort();
+var r6 = sorted(a) && a[0]==61;
+// data in Storage is read-only, so can't be sorted in place
+var st = require("Storage");
+st.write("sort",new Uint8Array([5,3,9,1]).buffer);
+var r7 = false;
+try {
+  new Uint8Array(st.readArrayBuffer("sort")).sort();
+} catch (e) {
+  r7 = true;
+}
+r7 = r7 && new Uint8Array(st.readArrayBuffer("sort")).join(",")=="5,3,9,1" &&
+     new Uint8Array(new Uint8Array(st.readArrayBuffer("sort"))).sort().join(",")=="1,3,5,9";
+st.erase("sort");
+
+result = ok && r1 && r2 && r3 && r4 && r5 && r6 && r7;